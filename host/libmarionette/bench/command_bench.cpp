@@ -0,0 +1,83 @@
+/*! \file command_bench.cpp
+ *
+ * Command round trips against a connected board.
+ *
+ *     command_bench <shell port> [count] [window] [command]
+ *
+ * Sends count commands (default "version") once strictly one at a time
+ * and once with up to window commands in flight.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <future>
+#include <string>
+
+#include "marionette/command_client.h"
+
+using marionette::CommandClient;
+using marionette::Response;
+
+static double run(CommandClient & client, const std::string & cmd, size_t count, size_t window, size_t & failed)
+{
+  std::deque<std::future<Response> > queue;
+  auto t0 = std::chrono::steady_clock::now();
+
+  for( size_t i = 0; i < count; i++ )
+  {
+    if( queue.size() >= window )
+    {
+      failed += queue.front().get().ok ? 0 : 1;
+      queue.pop_front();
+    }
+    queue.push_back(client.submit(cmd));
+  }
+  while( !queue.empty() )
+  {
+    failed += queue.front().get().ok ? 0 : 1;
+    queue.pop_front();
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char * argv[])
+{
+  if( argc < 2 )
+  {
+    std::fprintf(stderr, "usage: %s <shell port> [count] [window] [command]\n", argv[0]);
+    return 1;
+  }
+
+  size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 0) : 1000;
+  size_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 0) : CommandClient::default_max_in_flight;
+  std::string cmd = argc > 4 ? argv[4] : "version";
+
+  try
+  {
+    CommandClient client;
+    client.open(argv[1], window);
+
+    size_t failed = 0;
+    double serial = run(client, cmd, count, 1, failed);
+    double pipelined = run(client, cmd, count, window, failed);
+
+    std::printf("command     %s x %zu\n", cmd.c_str(), count);
+    std::printf("serial      %8.0f commands/s %8.1f us each\n", count / serial, serial / count * 1e6);
+    std::printf("window %-4zu %8.0f commands/s %8.1f us each\n", window, count / pipelined, pipelined / count * 1e6);
+    if( failed )
+    {
+      std::printf("failed      %zu\n", failed);
+    }
+  }
+  catch( const std::exception & e )
+  {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,189 @@
+/*! \file stream_bench.cpp
+ *
+ * Stream decoder throughput.
+ *
+ *     stream_bench [-c <chunk bytes>] [-n <records>] [capture file]
+ *
+ * Without a capture file an mpipe stream is synthesized the way the
+ * firmware writes it: adc 2 and 3 interleaved, a T record every 64 sample
+ * sets and the odd serial record in between. A capture is any raw dump of
+ * the stream port, e.g. 'cat /dev/ttyACM1 > capture.txt'.
+ *
+ * The input is fed in chunks of the given size to mimic USB reads. The
+ * same data is also parsed line by line with sscanf as a reference for
+ * the Python readline() approach.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "marionette/stream_decoder.h"
+
+using marionette::StreamDecoder;
+
+static const unsigned timestamp_interval = 64;
+
+static std::string synthesize(size_t records)
+{
+  std::string out;
+  char line[64];
+  uint16_t seq[2] = { 0, 0 };
+  uint64_t ticks = 0;
+
+  out.reserve(records * 38 + records / 2);
+
+  for( size_t i = 0; i < records; i++ )
+  {
+    unsigned d = i & 1;
+
+    if( seq[d] % timestamp_interval == 0 )
+    {
+      std::snprintf(line, sizeof(line), "T%c:%04X%016llX\r\n", '2' + d, seq[d], (unsigned long long) ticks);
+      out += line;
+    }
+
+    int n = std::snprintf(line, sizeof(line), "A%c:%04X", '2' + d, seq[d]);
+    for( unsigned ch = 0; ch < StreamDecoder::channels; ch++ )
+    {
+      n += std::snprintf(line + n, sizeof(line) - n, "%04X", (unsigned) ((i * 7 + ch * 331) & 0xfff));
+    }
+    std::snprintf(line + n, sizeof(line) - n, "\r\n");
+    out += line;
+
+    if( i % 1000 == 999 )
+    {
+      out += "S1:48656C6C6F\r\n";
+    }
+
+    seq[d]++;
+    ticks += 1440;
+  }
+
+  return out;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char * argv[])
+{
+  size_t chunk = 4096;
+  size_t records = 2000000;
+  const char * capture = nullptr;
+
+  for( int i = 1; i < argc; i++ )
+  {
+    if( std::strcmp(argv[i], "-c") == 0 && i + 1 < argc )
+    {
+      chunk = std::strtoul(argv[++i], nullptr, 0);
+    }
+    else if( std::strcmp(argv[i], "-n") == 0 && i + 1 < argc )
+    {
+      records = std::strtoul(argv[++i], nullptr, 0);
+    }
+    else if( argv[i][0] != '-' )
+    {
+      capture = argv[i];
+    }
+    else
+    {
+      std::fprintf(stderr, "usage: %s [-c <chunk bytes>] [-n <records>] [capture file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::string data;
+  if( capture )
+  {
+    std::ifstream in(capture, std::ios::binary);
+    if( !in )
+    {
+      std::fprintf(stderr, "cannot open %s\n", capture);
+      return 1;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  else
+  {
+    data = synthesize(records);
+  }
+  if( chunk == 0 )
+  {
+    chunk = data.size();
+  }
+
+  // room for every record of the input
+  size_t capacity = data.size() / 37 + 1;
+  std::vector<uint16_t> seq[StreamDecoder::max_devices];
+  std::vector<uint16_t> samples[StreamDecoder::max_devices];
+  std::vector<uint16_t> ts_seq[StreamDecoder::max_devices];
+  std::vector<uint64_t> ts_ticks[StreamDecoder::max_devices];
+
+  StreamDecoder decoder;
+  for( unsigned d = 0; d < StreamDecoder::max_devices; d++ )
+  {
+    seq[d].resize(capacity);
+    samples[d].resize(capacity * StreamDecoder::channels);
+    ts_seq[d].resize(capacity / 8 + 1);
+    ts_ticks[d].resize(capacity / 8 + 1);
+    decoder.attach(d, seq[d].data(), samples[d].data(), capacity);
+    decoder.attach_timestamps(d, ts_seq[d].data(), ts_ticks[d].data(), capacity / 8 + 1);
+  }
+
+  const uint8_t * p = reinterpret_cast<const uint8_t *>(data.data());
+  auto t0 = std::chrono::steady_clock::now();
+  for( size_t off = 0; off < data.size(); off += chunk )
+  {
+    decoder.feed(p + off, std::min(chunk, data.size() - off));
+  }
+  double t_decoder = seconds_since(t0);
+
+  // reference: split lines, sscanf each record
+  t0 = std::chrono::steady_clock::now();
+  size_t ref_records = 0;
+  size_t start = 0;
+  while( start < data.size() )
+  {
+    size_t nl = data.find('\n', start);
+    if( nl == std::string::npos )
+    {
+      break;
+    }
+    std::string line = data.substr(start, nl - start);
+    unsigned dev, s, v[7];
+    if( std::sscanf(line.c_str(), "A%1u:%4x%4x%4x%4x%4x%4x%4x%4x", &dev, &s,
+                    &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) == 9 )
+    {
+      ref_records++;
+    }
+    start = nl + 1;
+  }
+  double t_reference = seconds_since(t0);
+
+  const marionette::StreamStats & st = decoder.stats();
+  double mb = data.size() / 1e6;
+
+  std::printf("input       %s, %.1f MB, chunk %zu\n", capture ? capture : "synthetic", mb, chunk);
+  std::printf("records     %llu samples, %llu timestamps, %llu other\n",
+              (unsigned long long) st.records, (unsigned long long) st.timestamps, (unsigned long long) st.other);
+  std::printf("errors      %llu gaps, %llu malformed, %llu dropped\n",
+              (unsigned long long) st.gaps, (unsigned long long) st.malformed, (unsigned long long) st.dropped);
+  std::printf("decoder     %8.1f MB/s %12.0f records/s\n", mb / t_decoder, st.records / t_decoder);
+  std::printf("sscanf      %8.1f MB/s %12.0f records/s\n", mb / t_reference, ref_records / t_reference);
+
+  if( ref_records != st.records + st.dropped )
+  {
+    std::fprintf(stderr, "record count mismatch: reference %zu\n", ref_records);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*! \file command_client.h
+ *
+ * Pipelined command client for the Marionette shell (SDU1).
+ *
+ * The shell answers every command in order with one block:
+ *
+ *     BEGIN:
+ *     <type>:<name>:<value>      zero or more
+ *     END:OK | END:ERROR
+ *
+ * so responses can be matched to requests by position alone. submit()
+ * writes the command immediately and returns a future; up to
+ * max_in_flight commands are outstanding at once. A reader thread
+ * completes the futures as the END lines arrive.
+ */
+
+#ifndef MARIONETTE_COMMAND_CLIENT_H_
+#define MARIONETTE_COMMAND_CLIENT_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "marionette/serial_port.h"
+
+namespace marionette
+{
+
+struct Field
+{
+  std::string type;   //!< "U32", "H64", "S", "#", "W", "E", ...
+  std::string name;   //!< empty for message lines
+  std::string value;
+};
+
+struct Response
+{
+  std::string command;
+  bool ok = false;
+  std::vector<Field> fields;
+
+  //! first field named name, nullptr if there is none
+  const Field * find(const std::string & name) const;
+  //! text of the first "E:" line, empty if there is none
+  std::string error() const;
+};
+
+class CommandClient
+{
+public:
+  static const size_t default_max_in_flight = 32;
+
+  CommandClient();
+  ~CommandClient();
+
+  CommandClient(const CommandClient &) = delete;
+  CommandClient & operator=(const CommandClient &) = delete;
+
+  //! open the shell port and switch off echo and prompt
+  void open(const std::string & device, size_t max_in_flight = default_max_in_flight);
+  void close();
+  bool is_open() const { return port_.is_open(); }
+
+  //! send cmd without waiting, blocks only while the window is full
+  std::future<Response> submit(const std::string & cmd);
+
+  //! send cmd and wait for its response
+  Response command(const std::string & cmd);
+
+  //! responses still outstanding
+  size_t in_flight();
+
+private:
+  struct Pending
+  {
+    std::string command;
+    std::promise<Response> promise;
+  };
+
+  void reader();
+  void line(const char * text, size_t len);
+  void fail_pending(const std::string & why);
+
+  SerialPort port_;
+  std::thread reader_;
+  bool running_;
+
+  std::mutex write_mutex_;
+  std::mutex mutex_;
+  std::condition_variable window_;
+  std::deque<Pending> pending_;
+  size_t max_in_flight_;
+
+  // owned by the reader thread
+  bool in_block_;
+  Response current_;
+};
+
+} // namespace marionette
+
+#endif
@@ -0,0 +1,75 @@
+/*! \file marionette.h
+ *
+ * C interface to libmarionette, stable for ctypes and other FFIs.
+ *
+ * Functions returning int return a negative value on failure;
+ * mn_last_error() then describes it (per thread).
+ */
+
+#ifndef MARIONETTE_H_
+#define MARIONETTE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mn_client mn_client_t;
+typedef struct mn_decoder mn_decoder_t;
+
+typedef struct mn_stream_stats {
+  uint64_t bytes;
+  uint64_t records;
+  uint64_t timestamps;
+  uint64_t dropped;
+  uint64_t gaps;
+  uint64_t malformed;
+  uint64_t other;
+} mn_stream_stats_t;
+
+const char * mn_last_error(void);
+
+/* command client (SDU1) */
+mn_client_t * mn_client_open(const char * device, uint32_t max_in_flight);
+void mn_client_close(mn_client_t * client);
+
+/* returns a ticket >= 0 for mn_client_result */
+int64_t mn_client_submit(mn_client_t * client, const char * cmd);
+
+/* wait for a ticket. The response body ("<type>:<name>:<value>" lines) is
+ * copied to buf, NUL terminated and truncated to len. Returns 1 for END:OK,
+ * 0 for END:ERROR.
+ */
+int mn_client_result(mn_client_t * client, int64_t ticket, char * buf, size_t len);
+
+/* submit and wait */
+int mn_client_command(mn_client_t * client, const char * cmd, char * buf, size_t len);
+
+/* stream decoder (SDU2) */
+mn_decoder_t * mn_decoder_new(void);
+void mn_decoder_free(mn_decoder_t * decoder);
+
+/* samples is channel major: uint16_t[7][capacity] */
+int mn_decoder_attach(mn_decoder_t * decoder, uint32_t dev, uint16_t * seq, uint16_t * samples, size_t capacity);
+/* optional, uint8_t[capacity] channel masks of the stored sample records */
+int mn_decoder_attach_present(mn_decoder_t * decoder, uint32_t dev, uint8_t * present);
+/* optional, uint16_t[capacity] gpio words of the D records */
+int mn_decoder_attach_digital(mn_decoder_t * decoder, uint32_t dev, uint16_t * digital);
+int mn_decoder_attach_timestamps(mn_decoder_t * decoder, uint32_t dev, uint16_t * seq, uint64_t * ticks, size_t capacity);
+
+/* returns sample records stored */
+size_t mn_decoder_feed(mn_decoder_t * decoder, const uint8_t * data, size_t len);
+
+size_t mn_decoder_count(mn_decoder_t * decoder, uint32_t dev);
+size_t mn_decoder_timestamp_count(mn_decoder_t * decoder, uint32_t dev);
+void mn_decoder_rewind(mn_decoder_t * decoder, uint32_t dev);
+void mn_decoder_reset(mn_decoder_t * decoder);
+void mn_decoder_stats(mn_decoder_t * decoder, mn_stream_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
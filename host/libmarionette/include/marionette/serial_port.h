@@ -0,0 +1,46 @@
+/*! \file serial_port.h
+ *
+ * Raw POSIX serial port used for the Marionette CDC ACM channels.
+ */
+
+#ifndef MARIONETTE_SERIAL_PORT_H_
+#define MARIONETTE_SERIAL_PORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace marionette
+{
+
+class SerialPort
+{
+public:
+  SerialPort();
+  explicit SerialPort(const std::string & device);
+  ~SerialPort();
+
+  SerialPort(const SerialPort &) = delete;
+  SerialPort & operator=(const SerialPort &) = delete;
+
+  void open(const std::string & device);
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+
+  //! write all bytes, throws on error
+  void write(const void * data, size_t len);
+  void write(const std::string & str) { write(str.data(), str.size()); }
+
+  //! read up to len bytes, waits at most timeout_ms, returns 0 on timeout
+  size_t read(void * data, size_t len, int timeout_ms);
+
+  //! discard anything received until the line has been quiet for quiet_ms
+  void drain(int quiet_ms);
+
+private:
+  int fd_;
+};
+
+} // namespace marionette
+
+#endif
@@ -0,0 +1,127 @@
+/*! \file stream_decoder.h
+ *
+ * Decoder for the mpipe stream port (SDU2).
+ *
+ * Records handled:
+ *
+ *     A<dev>:<seq 4 hex><7 x sample 4 hex>\r\n
+ *     M<dev>:<seq 4 hex><mask 2 hex><present samples 4 hex>\r\n
+ *     D<dev>:<seq 4 hex><mask 2 hex><present samples 4 hex><word 4 hex>\r\n
+ *     T<dev>:<seq 4 hex><ticks 16 hex>\r\n
+ *
+ * M records carry the sample sets in which adc.divisor left channels
+ * out, one sample per set mask bit in channel order. Absent channels are
+ * stored as StreamDecoder::absent; attach_present() also keeps the mask.
+ * D records are M records with the gpio port word read on the same
+ * trigger (mixed.start); attach_digital() keeps the word and the mask
+ * gets StreamDecoder::digital_present.
+ *
+ * Samples are decoded straight from the caller's input into columnar
+ * buffers the caller attached per device (numpy arrays from Python), so
+ * nothing is allocated or copied per record. Only a trailing partial
+ * line is carried between feed() calls. Other lines (S, C, ...) are
+ * counted and skipped.
+ */
+
+#ifndef MARIONETTE_STREAM_DECODER_H_
+#define MARIONETTE_STREAM_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace marionette
+{
+
+struct StreamStats
+{
+  uint64_t bytes;
+  uint64_t records;       //!< A/M/D records stored
+  uint64_t timestamps;    //!< T records stored
+  uint64_t dropped;       //!< A/M/D/T records with no room or no buffer attached
+  uint64_t gaps;          //!< sequence discontinuities in A/M/D records
+  uint64_t malformed;     //!< A/M/D/T lines that failed to decode
+  uint64_t other;         //!< lines of other record types
+};
+
+class StreamDecoder
+{
+public:
+  static const unsigned max_devices = 10;   //!< '0'..'9'
+  static const unsigned channels = 7;       //!< ADC_SAMPLE_SET_SIZE
+  static const uint16_t absent = 0xffff;    //!< sample of a channel not in an M record
+  static const uint8_t digital_present = 0x80;  //!< present mask bit of a D record
+
+  StreamDecoder();
+
+  /*! sample buffers for dev: seq[capacity] and samples[channels][capacity]
+   *  (channel major, so samples + ch * capacity is one channel)
+   */
+  void attach(unsigned dev, uint16_t * seq, uint16_t * samples, size_t capacity);
+
+  //! optional present[capacity] channel masks for the records of attach()
+  void attach_present(unsigned dev, uint8_t * present);
+
+  //! optional digital[capacity] gpio words of the D records, 0 for others
+  void attach_digital(unsigned dev, uint16_t * digital);
+
+  //! timestamp buffers for dev: seq[capacity], ticks[capacity]
+  void attach_timestamps(unsigned dev, uint16_t * seq, uint64_t * ticks, size_t capacity);
+
+  //! decode len bytes, returns A/M/D records stored by this call
+  size_t feed(const uint8_t * data, size_t len);
+
+  size_t count(unsigned dev) const;
+  size_t timestamp_count(unsigned dev) const;
+
+  //! restart filling the buffers of dev from index 0
+  void rewind(unsigned dev);
+
+  //! forget partial input, counts and statistics, keep attached buffers
+  void reset();
+
+  const StreamStats & stats() const { return stats_; }
+
+private:
+  struct Device
+  {
+    uint16_t * seq;
+    uint16_t * samples;
+    uint8_t * present;
+    uint16_t * digital;
+    size_t capacity;
+    size_t count;
+
+    uint16_t * ts_seq;
+    uint64_t * ts_ticks;
+    size_t ts_capacity;
+    size_t ts_count;
+
+    bool have_seq;
+    uint16_t next_seq;
+  };
+
+  // "A0:" + 4 + 7 * 4, "T0:" + 4 + 16, without line end
+  static const size_t sample_len = 3 + 4 + channels * 4;
+  static const size_t timestamp_len = 3 + 4 + 16;
+  // "M0:" + 4 + 2, followed by 4 per mask bit (and 4 for D)
+  static const size_t masked_len = 3 + 4 + 2;
+  static const uint32_t no_digital = 0x10000;
+  static const size_t carry_size = 128;
+
+  bool sample_record(const uint8_t * s);
+  bool masked_record(const uint8_t * s, size_t len);
+  bool store(Device & d, uint32_t seq, const uint32_t * v, uint8_t mask, uint32_t digital);
+  bool timestamp_record(const uint8_t * s);
+  void line(const uint8_t * s, size_t len);
+
+  Device dev_[max_devices];
+  StreamStats stats_;
+
+  uint8_t carry_[carry_size];
+  size_t carry_len_;
+  bool carry_overflow_;
+};
+
+} // namespace marionette
+
+#endif
@@ -0,0 +1,204 @@
+#!/usr/bin/env python
+# file: marionette_native.py
+
+"""
+ctypes binding for libmarionette (see ../README.md).
+
+    import marionette_native as mn
+
+    client = mn.Client("/dev/ttyACM0")
+    tickets = [client.submit("gpio.read_port(%s)" % p) for p in "ABCDEFGHI"]
+    results = [client.result(t) for t in tickets]    # (ok, {name: (type, value)}, lines)
+
+    stream = mn.StreamDecoder(capacity=1 << 20)
+    with open("/dev/ttyACM1", "rb", buffering=0) as tty:
+        while stream.count(2) < 100000:
+            stream.feed(tty.read(4096))
+    seq, samples = stream.samples(2)     # numpy views, samples[channel][i]
+
+The library is looked up next to this file in ../build, then through the
+MARIONETTE_LIB environment variable, then on the normal library path.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+Channels        = 7
+Absent          = 0xffff    # sample of a channel left out of an M record
+Digital_Present = 0x80      # present mask bit of a D record
+Max_Devices     = 10
+Result_Size     = 1 << 16
+
+
+class StreamStats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_uint64) for name in
+                ("bytes", "records", "timestamps", "dropped", "gaps", "malformed", "other")]
+
+    def as_dict(self):
+        return dict((name, getattr(self, name)) for name, _ in self._fields_)
+
+
+def _load():
+    here = os.path.dirname(os.path.abspath(__file__))
+    for path in (os.environ.get("MARIONETTE_LIB"),
+                 os.path.join(here, "..", "build", "libmarionette.so"),
+                 "libmarionette.so"):
+        if path and (os.path.exists(path) or "/" not in path):
+            try:
+                return ctypes.CDLL(path)
+            except OSError:
+                pass
+    raise OSError("libmarionette.so not found, run make in host/libmarionette")
+
+
+_lib = _load()
+
+_u8p  = ctypes.POINTER(ctypes.c_uint8)
+_u16p = ctypes.POINTER(ctypes.c_uint16)
+_u64p = ctypes.POINTER(ctypes.c_uint64)
+
+_lib.mn_last_error.restype = ctypes.c_char_p
+_lib.mn_client_open.restype = ctypes.c_void_p
+_lib.mn_client_open.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+_lib.mn_client_close.argtypes = [ctypes.c_void_p]
+_lib.mn_client_submit.restype = ctypes.c_int64
+_lib.mn_client_submit.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.mn_client_result.argtypes = [ctypes.c_void_p, ctypes.c_int64, ctypes.c_char_p, ctypes.c_size_t]
+_lib.mn_client_command.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+
+_lib.mn_decoder_new.restype = ctypes.c_void_p
+_lib.mn_decoder_free.argtypes = [ctypes.c_void_p]
+_lib.mn_decoder_attach.argtypes = [ctypes.c_void_p, ctypes.c_uint32, _u16p, _u16p, ctypes.c_size_t]
+_lib.mn_decoder_attach_present.argtypes = [ctypes.c_void_p, ctypes.c_uint32, _u8p]
+_lib.mn_decoder_attach_digital.argtypes = [ctypes.c_void_p, ctypes.c_uint32, _u16p]
+_lib.mn_decoder_attach_timestamps.argtypes = [ctypes.c_void_p, ctypes.c_uint32, _u16p, _u64p, ctypes.c_size_t]
+_lib.mn_decoder_feed.restype = ctypes.c_size_t
+_lib.mn_decoder_feed.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+_lib.mn_decoder_count.restype = ctypes.c_size_t
+_lib.mn_decoder_count.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+_lib.mn_decoder_timestamp_count.restype = ctypes.c_size_t
+_lib.mn_decoder_timestamp_count.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+_lib.mn_decoder_rewind.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+_lib.mn_decoder_reset.argtypes = [ctypes.c_void_p]
+_lib.mn_decoder_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(StreamStats)]
+
+
+def _error():
+    return _lib.mn_last_error().decode(errors="replace")
+
+
+def _parse(text):
+    """response body -> ({name: (type, value)}, [lines])"""
+    lines  = text.decode(errors="replace").splitlines()
+    values = {}
+    for line in lines:
+        fields = line.split(":", 2)
+        if len(fields) == 3 and fields[0] not in ("#", "W", "E"):
+            values[fields[1]] = (fields[0], fields[2])
+    return values, lines
+
+
+class Client():
+    """pipelined command client for the shell port"""
+
+    def __init__(self, port="/dev/ttyACM0", max_in_flight=32):
+        self.handle = _lib.mn_client_open(port.encode(), max_in_flight)
+        if not self.handle:
+            raise IOError(_error())
+        self.buffer = ctypes.create_string_buffer(Result_Size)
+
+    def submit(self, cmd):
+        ticket = _lib.mn_client_submit(self.handle, cmd.encode())
+        if ticket < 0:
+            raise IOError(_error())
+        return ticket
+
+    def result(self, ticket):
+        ok = _lib.mn_client_result(self.handle, ticket, self.buffer, Result_Size)
+        if ok < 0:
+            raise IOError(_error())
+        values, lines = _parse(self.buffer.value)
+        return (ok == 1, values, lines)
+
+    def command(self, cmd):
+        return self.result(self.submit(cmd))
+
+    def close(self):
+        if self.handle:
+            _lib.mn_client_close(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
+
+
+class StreamDecoder():
+    """mpipe stream decoder filling numpy arrays"""
+
+    def __init__(self, capacity=1 << 16, devices=(2, 3), timestamp_capacity=None):
+        self.handle = _lib.mn_decoder_new()
+        self.capacity = capacity
+        self.buffers = {}
+        ts_capacity = timestamp_capacity or capacity // 32 + 1
+        for dev in devices:
+            seq     = np.zeros(capacity, dtype=np.uint16)
+            samples = np.zeros((Channels, capacity), dtype=np.uint16)
+            present = np.zeros(capacity, dtype=np.uint8)
+            digital = np.zeros(capacity, dtype=np.uint16)
+            ts_seq  = np.zeros(ts_capacity, dtype=np.uint16)
+            ticks   = np.zeros(ts_capacity, dtype=np.uint64)
+            _lib.mn_decoder_attach(self.handle, dev, seq.ctypes.data_as(_u16p),
+                                   samples.ctypes.data_as(_u16p), capacity)
+            _lib.mn_decoder_attach_present(self.handle, dev, present.ctypes.data_as(_u8p))
+            _lib.mn_decoder_attach_digital(self.handle, dev, digital.ctypes.data_as(_u16p))
+            _lib.mn_decoder_attach_timestamps(self.handle, dev, ts_seq.ctypes.data_as(_u16p),
+                                              ticks.ctypes.data_as(_u64p), ts_capacity)
+            self.buffers[dev] = (seq, samples, ts_seq, ticks, present, digital)
+
+    def feed(self, data):
+        """decode bytes, returns sample records stored"""
+        return _lib.mn_decoder_feed(self.handle, data, len(data))
+
+    def count(self, dev):
+        return _lib.mn_decoder_count(self.handle, dev)
+
+    def samples(self, dev):
+        """(seq[n], samples[7][n]) views of the records decoded so far"""
+        n = self.count(dev)
+        seq, samples, _, _, _, _ = self.buffers[dev]
+        return seq[:n], samples[:, :n]
+
+    def present(self, dev):
+        """channel masks[n] of the records decoded so far, absent samples are Absent"""
+        n = self.count(dev)
+        return self.buffers[dev][4][:n]
+
+    def digital(self, dev):
+        """gpio words[n] of the records decoded so far, valid where present has Digital_Present"""
+        n = self.count(dev)
+        return self.buffers[dev][5][:n]
+
+    def timestamps(self, dev):
+        """(seq[n], ticks[n]) views of the T records decoded so far"""
+        n = _lib.mn_decoder_timestamp_count(self.handle, dev)
+        _, _, ts_seq, ticks, _, _ = self.buffers[dev]
+        return ts_seq[:n], ticks[:n]
+
+    def rewind(self, dev):
+        """start filling the buffers of dev from the beginning again"""
+        _lib.mn_decoder_rewind(self.handle, dev)
+
+    def stats(self):
+        st = StreamStats()
+        _lib.mn_decoder_stats(self.handle, ctypes.byref(st))
+        return st.as_dict()
+
+    def close(self):
+        if self.handle:
+            _lib.mn_decoder_free(self.handle)
+            self.handle = None
+
+    def __del__(self):
+        self.close()
@@ -0,0 +1,267 @@
+/*! \file command_client.cpp
+ */
+
+#include "marionette/command_client.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace marionette
+{
+
+static const int reader_poll_ms = 50;
+static const int open_quiet_ms  = 200;
+
+const Field * Response::find(const std::string & name) const
+{
+  for( const Field & f : fields )
+  {
+    if( f.name == name )
+    {
+      return &f;
+    }
+  }
+  return nullptr;
+}
+
+std::string Response::error() const
+{
+  for( const Field & f : fields )
+  {
+    if( f.type == "E" )
+    {
+      return f.value;
+    }
+  }
+  return std::string();
+}
+
+CommandClient::CommandClient()
+  : running_(false), max_in_flight_(default_max_in_flight), in_block_(false)
+{
+}
+
+CommandClient::~CommandClient()
+{
+  close();
+}
+
+void CommandClient::open(const std::string & device, size_t max_in_flight)
+{
+  close();
+
+  port_.open(device);
+  max_in_flight_ = max_in_flight ? max_in_flight : 1;
+
+  // finish any partial line, silence the shell and drop whatever it said
+  port_.write("\r\n+noecho\r\n+noprompt\r\n");
+  port_.drain(open_quiet_ms);
+
+  in_block_ = false;
+  running_ = true;
+  reader_ = std::thread(&CommandClient::reader, this);
+}
+
+void CommandClient::close()
+{
+  if( reader_.joinable() )
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+    reader_.join();
+  }
+  port_.close();
+  fail_pending("client closed");
+}
+
+std::future<Response> CommandClient::submit(const std::string & cmd)
+{
+  if( !is_open() )
+  {
+    throw std::runtime_error("client not open");
+  }
+
+  std::future<Response> result;
+
+  // queue before writing so the reader always finds the entry, and write
+  // under the same lock order so queue order matches wire order
+  std::lock_guard<std::mutex> write_lock(write_mutex_);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    window_.wait(lock, [this] { return pending_.size() < max_in_flight_ || !running_; });
+    if( !running_ )
+    {
+      throw std::runtime_error("client closed");
+    }
+    pending_.emplace_back();
+    pending_.back().command = cmd;
+    result = pending_.back().promise.get_future();
+  }
+
+  port_.write(cmd + "\r\n");
+
+  return result;
+}
+
+Response CommandClient::command(const std::string & cmd)
+{
+  return submit(cmd).get();
+}
+
+size_t CommandClient::in_flight()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.size();
+}
+
+void CommandClient::reader()
+{
+  char buffer[4096];
+  std::string partial;
+
+  for( ;; )
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if( !running_ )
+      {
+        break;
+      }
+    }
+
+    size_t n;
+    try
+    {
+      n = port_.read(buffer, sizeof(buffer), reader_poll_ms);
+    }
+    catch( const std::exception & )
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+      window_.notify_all();
+      break;
+    }
+
+    const char * p = buffer;
+    const char * end = buffer + n;
+
+    while( p < end )
+    {
+      const char * nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+      if( nl == nullptr )
+      {
+        partial.append(p, end - p);
+        break;
+      }
+
+      if( partial.empty() )
+      {
+        line(p, nl - p);
+      }
+      else
+      {
+        partial.append(p, nl - p);
+        line(partial.data(), partial.size());
+        partial.clear();
+      }
+      p = nl + 1;
+    }
+  }
+
+  fail_pending("connection lost");
+}
+
+void CommandClient::line(const char * text, size_t len)
+{
+  if( len > 0 && text[len - 1] == '\r' )
+  {
+    len--;
+  }
+  if( len == 0 )
+  {
+    return;
+  }
+
+  std::string s(text, len);
+
+  if( s == "BEGIN:" )
+  {
+    in_block_ = true;
+    current_ = Response();
+    return;
+  }
+
+  // anything outside a block is unsolicited (boot banner, late echo)
+  if( !in_block_ )
+  {
+    return;
+  }
+
+  if( s.compare(0, 4, "END:") == 0 )
+  {
+    in_block_ = false;
+    current_.ok = (s == "END:OK");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if( pending_.empty() )
+    {
+      return;
+    }
+    Pending done = std::move(pending_.front());
+    pending_.pop_front();
+    window_.notify_all();
+    lock.unlock();
+
+    current_.command = done.command;
+    done.promise.set_value(std::move(current_));
+    return;
+  }
+
+  Field f;
+  size_t c1 = s.find(':');
+  if( c1 == std::string::npos )
+  {
+    f.value = s;
+  }
+  else if( c1 == 1 && (s[0] == '#' || s[0] == 'W' || s[0] == 'E') )
+  {
+    // message lines have no name: "#:<text>", "W:<text>", "E:<text>"
+    f.type = s.substr(0, c1);
+    f.value = s.substr(c1 + 1);
+  }
+  else
+  {
+    size_t c2 = s.find(':', c1 + 1);
+    f.type = s.substr(0, c1);
+    if( c2 == std::string::npos )
+    {
+      f.value = s.substr(c1 + 1);
+    }
+    else
+    {
+      f.name = s.substr(c1 + 1, c2 - c1 - 1);
+      f.value = s.substr(c2 + 1);
+    }
+  }
+  current_.fields.push_back(std::move(f));
+}
+
+void CommandClient::fail_pending(const std::string & why)
+{
+  std::deque<Pending> failed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed.swap(pending_);
+    window_.notify_all();
+  }
+
+  for( Pending & p : failed )
+  {
+    p.promise.set_exception(std::make_exception_ptr(std::runtime_error(why + ": " + p.command)));
+  }
+}
+
+} // namespace marionette
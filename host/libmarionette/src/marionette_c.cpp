@@ -0,0 +1,244 @@
+/*! \file marionette_c.cpp
+ *
+ * C interface, see marionette/marionette.h
+ */
+
+#include "marionette/marionette.h"
+
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "marionette/command_client.h"
+#include "marionette/stream_decoder.h"
+
+using marionette::CommandClient;
+using marionette::Response;
+using marionette::StreamDecoder;
+
+struct mn_client
+{
+  CommandClient client;
+  std::mutex mutex;
+  std::map<int64_t, std::future<Response> > tickets;
+  int64_t next_ticket = 0;
+};
+
+struct mn_decoder
+{
+  StreamDecoder decoder;
+};
+
+static thread_local std::string last_error;
+
+static void set_error(const std::exception & e)
+{
+  last_error = e.what();
+}
+
+static int copy_response(const Response & r, char * buf, size_t len)
+{
+  std::string text;
+
+  for( const marionette::Field & f : r.fields )
+  {
+    text += f.type;
+    text += ':';
+    if( !f.name.empty() )
+    {
+      text += f.name;
+      text += ':';
+    }
+    text += f.value;
+    text += '\n';
+  }
+
+  if( buf && len > 0 )
+  {
+    size_t n = text.size() < len - 1 ? text.size() : len - 1;
+    std::memcpy(buf, text.data(), n);
+    buf[n] = '\0';
+  }
+
+  if( !r.ok )
+  {
+    last_error = r.error();
+  }
+  return r.ok ? 1 : 0;
+}
+
+const char * mn_last_error(void)
+{
+  return last_error.c_str();
+}
+
+mn_client_t * mn_client_open(const char * device, uint32_t max_in_flight)
+{
+  mn_client_t * c = new mn_client_t;
+  try
+  {
+    c->client.open(device, max_in_flight);
+  }
+  catch( const std::exception & e )
+  {
+    set_error(e);
+    delete c;
+    return nullptr;
+  }
+  return c;
+}
+
+void mn_client_close(mn_client_t * client)
+{
+  delete client;
+}
+
+int64_t mn_client_submit(mn_client_t * client, const char * cmd)
+{
+  try
+  {
+    std::future<Response> f = client->client.submit(cmd);
+    std::lock_guard<std::mutex> lock(client->mutex);
+    int64_t ticket = client->next_ticket++;
+    client->tickets.emplace(ticket, std::move(f));
+    return ticket;
+  }
+  catch( const std::exception & e )
+  {
+    set_error(e);
+    return -1;
+  }
+}
+
+int mn_client_result(mn_client_t * client, int64_t ticket, char * buf, size_t len)
+{
+  std::future<Response> f;
+  {
+    std::lock_guard<std::mutex> lock(client->mutex);
+    auto it = client->tickets.find(ticket);
+    if( it == client->tickets.end() )
+    {
+      last_error = "unknown ticket";
+      return -1;
+    }
+    f = std::move(it->second);
+    client->tickets.erase(it);
+  }
+
+  try
+  {
+    return copy_response(f.get(), buf, len);
+  }
+  catch( const std::exception & e )
+  {
+    set_error(e);
+    return -1;
+  }
+}
+
+int mn_client_command(mn_client_t * client, const char * cmd, char * buf, size_t len)
+{
+  try
+  {
+    return copy_response(client->client.command(cmd), buf, len);
+  }
+  catch( const std::exception & e )
+  {
+    set_error(e);
+    return -1;
+  }
+}
+
+mn_decoder_t * mn_decoder_new(void)
+{
+  return new mn_decoder_t;
+}
+
+void mn_decoder_free(mn_decoder_t * decoder)
+{
+  delete decoder;
+}
+
+int mn_decoder_attach(mn_decoder_t * decoder, uint32_t dev, uint16_t * seq, uint16_t * samples, size_t capacity)
+{
+  if( dev >= StreamDecoder::max_devices )
+  {
+    last_error = "invalid device";
+    return -1;
+  }
+  decoder->decoder.attach(dev, seq, samples, capacity);
+  return 0;
+}
+
+int mn_decoder_attach_present(mn_decoder_t * decoder, uint32_t dev, uint8_t * present)
+{
+  if( dev >= StreamDecoder::max_devices )
+  {
+    last_error = "invalid device";
+    return -1;
+  }
+  decoder->decoder.attach_present(dev, present);
+  return 0;
+}
+
+int mn_decoder_attach_digital(mn_decoder_t * decoder, uint32_t dev, uint16_t * digital)
+{
+  if( dev >= StreamDecoder::max_devices )
+  {
+    last_error = "invalid device";
+    return -1;
+  }
+  decoder->decoder.attach_digital(dev, digital);
+  return 0;
+}
+
+int mn_decoder_attach_timestamps(mn_decoder_t * decoder, uint32_t dev, uint16_t * seq, uint64_t * ticks, size_t capacity)
+{
+  if( dev >= StreamDecoder::max_devices )
+  {
+    last_error = "invalid device";
+    return -1;
+  }
+  decoder->decoder.attach_timestamps(dev, seq, ticks, capacity);
+  return 0;
+}
+
+size_t mn_decoder_feed(mn_decoder_t * decoder, const uint8_t * data, size_t len)
+{
+  return decoder->decoder.feed(data, len);
+}
+
+size_t mn_decoder_count(mn_decoder_t * decoder, uint32_t dev)
+{
+  return decoder->decoder.count(dev);
+}
+
+size_t mn_decoder_timestamp_count(mn_decoder_t * decoder, uint32_t dev)
+{
+  return decoder->decoder.timestamp_count(dev);
+}
+
+void mn_decoder_rewind(mn_decoder_t * decoder, uint32_t dev)
+{
+  decoder->decoder.rewind(dev);
+}
+
+void mn_decoder_reset(mn_decoder_t * decoder)
+{
+  decoder->decoder.reset();
+}
+
+void mn_decoder_stats(mn_decoder_t * decoder, mn_stream_stats_t * stats)
+{
+  const marionette::StreamStats & s = decoder->decoder.stats();
+
+  stats->bytes = s.bytes;
+  stats->records = s.records;
+  stats->timestamps = s.timestamps;
+  stats->dropped = s.dropped;
+  stats->gaps = s.gaps;
+  stats->malformed = s.malformed;
+  stats->other = s.other;
+}
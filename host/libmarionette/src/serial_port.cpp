@@ -0,0 +1,130 @@
+/*! \file serial_port.cpp
+ */
+
+#include "marionette/serial_port.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace marionette
+{
+
+static std::runtime_error os_error(const std::string & what)
+{
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+SerialPort::SerialPort() : fd_(-1)
+{
+}
+
+SerialPort::SerialPort(const std::string & device) : fd_(-1)
+{
+  open(device);
+}
+
+SerialPort::~SerialPort()
+{
+  close();
+}
+
+void SerialPort::open(const std::string & device)
+{
+  close();
+
+  fd_ = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if( fd_ < 0 )
+  {
+    throw os_error("open " + device);
+  }
+
+  // a regular file (recorded capture) needs no line settings
+  struct termios tio;
+  if( tcgetattr(fd_, &tio) == 0 )
+  {
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if( tcsetattr(fd_, TCSANOW, &tio) != 0 )
+    {
+      close();
+      throw os_error("tcsetattr " + device);
+    }
+  }
+}
+
+void SerialPort::close()
+{
+  if( fd_ >= 0 )
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+void SerialPort::write(const void * data, size_t len)
+{
+  const uint8_t * p = static_cast<const uint8_t *>(data);
+
+  while( len > 0 )
+  {
+    ssize_t n = ::write(fd_, p, len);
+    if( n < 0 )
+    {
+      if( errno == EINTR || errno == EAGAIN )
+      {
+        continue;
+      }
+      throw os_error("write");
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+size_t SerialPort::read(void * data, size_t len, int timeout_ms)
+{
+  struct pollfd pfd = { fd_, POLLIN, 0 };
+
+  int ready = ::poll(&pfd, 1, timeout_ms);
+  if( ready < 0 )
+  {
+    if( errno == EINTR )
+    {
+      return 0;
+    }
+    throw os_error("poll");
+  }
+  if( ready == 0 )
+  {
+    return 0;
+  }
+
+  ssize_t n = ::read(fd_, data, len);
+  if( n < 0 )
+  {
+    if( errno == EINTR || errno == EAGAIN )
+    {
+      return 0;
+    }
+    throw os_error("read");
+  }
+  return static_cast<size_t>(n);
+}
+
+void SerialPort::drain(int quiet_ms)
+{
+  uint8_t buffer[512];
+
+  while( read(buffer, sizeof(buffer), quiet_ms) > 0 )
+  {
+  }
+}
+
+} // namespace marionette
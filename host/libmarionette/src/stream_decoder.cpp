@@ -0,0 +1,414 @@
+/*! \file stream_decoder.cpp
+ */
+
+#include "marionette/stream_decoder.h"
+
+#include <cstring>
+
+namespace marionette
+{
+
+namespace
+{
+
+// value of a hex digit, 0x80 for anything else
+struct HexTable
+{
+  uint8_t v[256];
+
+  HexTable()
+  {
+    std::memset(v, 0x80, sizeof(v));
+    for( int i = 0; i < 10; i++ )
+    {
+      v['0' + i] = i;
+    }
+    for( int i = 0; i < 6; i++ )
+    {
+      v['A' + i] = 10 + i;
+      v['a' + i] = 10 + i;
+    }
+  }
+};
+
+const HexTable hex;
+
+// bit 15..0 value, bit 16+ set on a bad digit
+inline uint32_t hex16(const uint8_t * s)
+{
+  uint32_t a = hex.v[s[0]], b = hex.v[s[1]], c = hex.v[s[2]], d = hex.v[s[3]];
+  return ((a << 12) | (b << 8) | (c << 4) | d) | ((a | b | c | d) & 0x80) << 9;
+}
+
+// bit 7..0 value, bit 16+ set on a bad digit
+inline uint32_t hex8(const uint8_t * s)
+{
+  uint32_t a = hex.v[s[0]], b = hex.v[s[1]];
+  return ((a << 4) | b) | ((a | b) & 0x80) << 9;
+}
+
+inline bool is_dev(uint8_t c)
+{
+  return c >= '0' && c <= '9';
+}
+
+} // namespace
+
+StreamDecoder::StreamDecoder()
+{
+  std::memset(dev_, 0, sizeof(dev_));
+  reset();
+}
+
+void StreamDecoder::attach(unsigned dev, uint16_t * seq, uint16_t * samples, size_t capacity)
+{
+  if( dev >= max_devices )
+  {
+    return;
+  }
+  dev_[dev].seq = seq;
+  dev_[dev].samples = samples;
+  dev_[dev].capacity = (seq && samples) ? capacity : 0;
+  dev_[dev].count = 0;
+}
+
+void StreamDecoder::attach_present(unsigned dev, uint8_t * present)
+{
+  if( dev >= max_devices )
+  {
+    return;
+  }
+  dev_[dev].present = present;
+}
+
+void StreamDecoder::attach_digital(unsigned dev, uint16_t * digital)
+{
+  if( dev >= max_devices )
+  {
+    return;
+  }
+  dev_[dev].digital = digital;
+}
+
+void StreamDecoder::attach_timestamps(unsigned dev, uint16_t * seq, uint64_t * ticks, size_t capacity)
+{
+  if( dev >= max_devices )
+  {
+    return;
+  }
+  dev_[dev].ts_seq = seq;
+  dev_[dev].ts_ticks = ticks;
+  dev_[dev].ts_capacity = (seq && ticks) ? capacity : 0;
+  dev_[dev].ts_count = 0;
+}
+
+size_t StreamDecoder::count(unsigned dev) const
+{
+  return dev < max_devices ? dev_[dev].count : 0;
+}
+
+size_t StreamDecoder::timestamp_count(unsigned dev) const
+{
+  return dev < max_devices ? dev_[dev].ts_count : 0;
+}
+
+void StreamDecoder::rewind(unsigned dev)
+{
+  if( dev < max_devices )
+  {
+    dev_[dev].count = 0;
+    dev_[dev].ts_count = 0;
+  }
+}
+
+void StreamDecoder::reset()
+{
+  for( Device & d : dev_ )
+  {
+    d.count = 0;
+    d.ts_count = 0;
+    d.have_seq = false;
+  }
+  std::memset(&stats_, 0, sizeof(stats_));
+  carry_len_ = 0;
+  carry_overflow_ = false;
+}
+
+// s points at 'A', sample_len bytes are valid
+bool StreamDecoder::sample_record(const uint8_t * s)
+{
+  Device & d = dev_[s[1] - '0'];
+
+  uint32_t seq = hex16(s + 3);
+  uint32_t bad = seq;
+  uint32_t v[channels];
+
+  for( unsigned ch = 0; ch < channels; ch++ )
+  {
+    v[ch] = hex16(s + 7 + ch * 4);
+    bad |= v[ch];
+  }
+
+  if( bad & 0x10000 )
+  {
+    stats_.malformed++;
+    return false;
+  }
+
+  return store(d, seq, v, (1 << channels) - 1, no_digital);
+}
+
+// s points at 'M' or 'D', len bytes without line end
+bool StreamDecoder::masked_record(const uint8_t * s, size_t len)
+{
+  Device & d = dev_[s[1] - '0'];
+
+  bool has_digital = s[0] == 'D';
+  uint32_t seq = hex16(s + 3);
+  uint32_t mask = hex8(s + 7);
+  uint32_t bad = seq | mask;
+  uint32_t v[channels];
+  uint32_t digital = no_digital;
+  const uint8_t * p = s + masked_len;
+
+  if( bad & 0x10000 || mask >= (1u << channels) ||
+      len != masked_len + 4 * __builtin_popcount(mask) + (has_digital ? 4 : 0) )
+  {
+    stats_.malformed++;
+    return false;
+  }
+
+  for( unsigned ch = 0; ch < channels; ch++ )
+  {
+    if( mask & (1 << ch) )
+    {
+      v[ch] = hex16(p);
+      bad |= v[ch];
+      p += 4;
+    }
+    else
+    {
+      v[ch] = absent;
+    }
+  }
+
+  if( has_digital )
+  {
+    digital = hex16(p);
+    bad |= digital;
+    mask |= digital_present;
+  }
+
+  if( bad & 0x10000 )
+  {
+    stats_.malformed++;
+    return false;
+  }
+
+  return store(d, seq, v, mask, digital);
+}
+
+bool StreamDecoder::store(Device & d, uint32_t seq, const uint32_t * v, uint8_t mask, uint32_t digital)
+{
+  if( d.have_seq && seq != d.next_seq )
+  {
+    stats_.gaps++;
+  }
+  d.have_seq = true;
+  d.next_seq = seq + 1;
+
+  if( d.count >= d.capacity )
+  {
+    stats_.dropped++;
+    return false;
+  }
+
+  size_t i = d.count++;
+  d.seq[i] = seq;
+  for( unsigned ch = 0; ch < channels; ch++ )
+  {
+    d.samples[ch * d.capacity + i] = v[ch];
+  }
+  if( d.present )
+  {
+    d.present[i] = mask;
+  }
+  if( d.digital )
+  {
+    d.digital[i] = (digital == no_digital) ? 0 : digital;
+  }
+  stats_.records++;
+
+  return true;
+}
+
+// s points at 'T', timestamp_len bytes are valid
+bool StreamDecoder::timestamp_record(const uint8_t * s)
+{
+  Device & d = dev_[s[1] - '0'];
+
+  uint32_t seq = hex16(s + 3);
+  uint32_t bad = seq;
+  uint64_t ticks = 0;
+
+  for( unsigned i = 0; i < 4; i++ )
+  {
+    uint32_t v = hex16(s + 7 + i * 4);
+    bad |= v;
+    ticks = (ticks << 16) | (v & 0xffff);
+  }
+
+  if( bad & 0x10000 )
+  {
+    stats_.malformed++;
+    return false;
+  }
+
+  if( d.ts_count >= d.ts_capacity )
+  {
+    stats_.dropped++;
+    return false;
+  }
+
+  size_t i = d.ts_count++;
+  d.ts_seq[i] = seq;
+  d.ts_ticks[i] = ticks;
+  stats_.timestamps++;
+
+  return true;
+}
+
+// one line without '\n'
+void StreamDecoder::line(const uint8_t * s, size_t len)
+{
+  if( len > 0 && s[len - 1] == '\r' )
+  {
+    len--;
+  }
+  if( len == 0 )
+  {
+    return;
+  }
+
+  if( len < 3 || !is_dev(s[1]) || s[2] != ':' )
+  {
+    stats_.other++;
+    return;
+  }
+
+  if( s[0] == 'A' )
+  {
+    if( len == sample_len )
+    {
+      sample_record(s);
+    }
+    else
+    {
+      stats_.malformed++;
+    }
+  }
+  else if( s[0] == 'M' || s[0] == 'D' )
+  {
+    if( len >= masked_len )
+    {
+      masked_record(s, len);
+    }
+    else
+    {
+      stats_.malformed++;
+    }
+  }
+  else if( s[0] == 'T' )
+  {
+    if( len == timestamp_len )
+    {
+      timestamp_record(s);
+    }
+    else
+    {
+      stats_.malformed++;
+    }
+  }
+  else
+  {
+    stats_.other++;
+  }
+}
+
+size_t StreamDecoder::feed(const uint8_t * data, size_t len)
+{
+  const uint64_t before = stats_.records;
+  const uint8_t * p = data;
+  const uint8_t * end = data + len;
+
+  stats_.bytes += len;
+
+  // finish the line left over from the previous call
+  if( carry_len_ > 0 || carry_overflow_ )
+  {
+    const uint8_t * nl = static_cast<const uint8_t *>(std::memchr(p, '\n', len));
+    size_t take = (nl ? nl : end) - p;
+
+    if( !carry_overflow_ && carry_len_ + take <= carry_size )
+    {
+      std::memcpy(carry_ + carry_len_, p, take);
+      carry_len_ += take;
+    }
+    else
+    {
+      carry_overflow_ = true;
+    }
+
+    if( nl == nullptr )
+    {
+      return 0;
+    }
+
+    if( carry_overflow_ )
+    {
+      stats_.other++;
+    }
+    else
+    {
+      line(carry_, carry_len_);
+    }
+    carry_len_ = 0;
+    carry_overflow_ = false;
+    p = nl + 1;
+  }
+
+  while( p < end )
+  {
+    // fast path: a complete, well framed sample record
+    if( end - p >= ptrdiff_t(sample_len + 2) && p[0] == 'A' && is_dev(p[1]) && p[2] == ':' &&
+        p[sample_len] == '\r' && p[sample_len + 1] == '\n' )
+    {
+      sample_record(p);
+      p += sample_len + 2;
+      continue;
+    }
+
+    const uint8_t * nl = static_cast<const uint8_t *>(std::memchr(p, '\n', end - p));
+    if( nl == nullptr )
+    {
+      size_t rest = end - p;
+      if( rest <= carry_size )
+      {
+        std::memcpy(carry_, p, rest);
+        carry_len_ = rest;
+      }
+      else
+      {
+        carry_overflow_ = true;
+      }
+      break;
+    }
+
+    line(p, nl - p);
+    p = nl + 1;
+  }
+
+  return stats_.records - before;
+}
+
+} // namespace marionette
@@ -27,6 +27,24 @@
 // shared buffer for use in IO buffering and parsing strings
 uint8_t fetch_shared_buffer[FETCH_SHARED_BUFFER_SIZE];
 
+// commands share static buffers and peripherals, only one runs at a time
+static MUTEX_DECL(fetch_mutex);
+
+// shortest time between two progress records of a command
+#ifndef FETCH_PROGRESS_INTERVAL_MS
+#define FETCH_PROGRESS_INTERVAL_MS  500
+#endif
+
+// longest a fetch_sleep_ms waits before looking at the abort flag
+#ifndef FETCH_ABORT_POLL_MS
+#define FETCH_ABORT_POLL_MS         20
+#endif
+
+// set by fetch_abort, cleared when the next command starts
+static volatile bool fetch_abort_flag = false;
+
+static systime_t fetch_progress_time;
+
 bool fetch_parse_bytes( BaseSequentialStream * chp, uint32_t argc, char * argv[], uint8_t * output_str, uint32_t max_output_len, uint32_t * count )
 {
   uint8_t byte;
@@ -202,6 +220,32 @@ bool fetch_help_cmd( BaseSequentialStream * chp, uint32_t argc, char * argv[] )
   FETCH_HELP_DES(chp, "Display i2c help");
   FETCH_HELP_CMD(chp, "mbus.help");
   FETCH_HELP_DES(chp, "Display mbus help");
+  FETCH_HELP_CMD(chp, "sd.help");
+  FETCH_HELP_DES(chp, "Display sd card help");
+  FETCH_HELP_CMD(chp, "timer.help");
+  FETCH_HELP_DES(chp, "Display timer pulse help");
+  FETCH_HELP_CMD(chp, "sweep.help");
+  FETCH_HELP_DES(chp, "Display sweep help");
+  FETCH_HELP_CMD(chp, "time.help");
+  FETCH_HELP_DES(chp, "Display time help");
+  FETCH_HELP_CMD(chp, "sync.help");
+  FETCH_HELP_DES(chp, "Display multi-board sync help");
+  FETCH_HELP_CMD(chp, "dma.help");
+  FETCH_HELP_DES(chp, "Display dma stream allocation help");
+  FETCH_HELP_CMD(chp, "profile.help");
+  FETCH_HELP_DES(chp, "Display configuration profile help");
+  FETCH_HELP_CMD(chp, "ram.help");
+  FETCH_HELP_DES(chp, "Display buffer ram plan help");
+  FETCH_HELP_CMD(chp, "rule.help");
+  FETCH_HELP_DES(chp, "Display on-device trigger/action rule help");
+  FETCH_HELP_CMD(chp, "snapshot.help");
+  FETCH_HELP_DES(chp, "Display latest value telemetry snapshot help");
+  FETCH_HELP_CMD(chp, "script.help");
+  FETCH_HELP_DES(chp, "Display compiled command script help");
+  FETCH_HELP_CMD(chp, "irq.help");
+  FETCH_HELP_DES(chp, "Display interrupt latency measurement help");
+  FETCH_HELP_CMD(chp, "mixed.help");
+  FETCH_HELP_DES(chp, "Display mixed signal adc and gpio capture help");
   FETCH_HELP_CMD(chp, "clocks");
   FETCH_HELP_DES(chp, "Display info about internal clocks");
   FETCH_HELP_CMD(chp, "reset");
@@ -241,6 +285,10 @@ bool fetch_reset_cmd( BaseSequentialStream * chp, uint32_t argc, char * argv[] )
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
+  // first, so no rule fires into a peripheral while it is reset
+  fetch_rule_reset(chp);
+  fetch_script_reset(chp);
+
   // Add any new peripheral reset functions here
   fetch_adc_reset(chp);
   fetch_dac_reset(chp);
@@ -250,6 +298,14 @@ bool fetch_reset_cmd( BaseSequentialStream * chp, uint32_t argc, char * argv[] )
   fetch_mbus_reset(chp);
   fetch_sd_reset(chp);
   fetch_timer_reset(chp);
+  fetch_sweep_reset(chp);
+  fetch_sync_reset(chp);
+  fetch_snapshot_reset(chp);
+  fetch_irq_reset(chp);
+  fetch_mixed_reset(chp);
+
+  // last, reapplies the boot profile on top of the defaults
+  fetch_profile_reset(chp);
 
   // make sure all pin assignments are set to defaults
   // ~not needed at the moment~
@@ -273,18 +329,106 @@ void fetch_init(void)
   fetch_sd_init();
   fetch_timer_init();
   fetch_serial_init();
+  // after the adc and serial modules, sizes their buffers
+  fetch_ram_init();
+  fetch_sweep_init();
+  fetch_sync_init();
+  fetch_rule_init();
+  fetch_irq_init();
+  fetch_mixed_init();
+
+  // last, the boot profile configures the initialized modules
+  fetch_profile_init();
 }
 
-bool fetch_execute( BaseSequentialStream * chp, const char * input_line )
+/*! \brief Take the command lock
+ *
+ * Held by fetch_execute while a command runs. Other threads running
+ * pre-parsed commands take it too.
+ */
+void fetch_lock(void)
+{
+  chMtxLock(&fetch_mutex);
+}
+
+void fetch_unlock(void)
+{
+  chMtxUnlock(&fetch_mutex);
+}
+
+/*! \brief Ask the running command to stop
+ *
+ * Safe from any thread, e.g. a second shell session. Long running
+ * handlers poll fetch_abort_requested() and return early.
+ */
+void fetch_abort(void)
+{
+  fetch_abort_flag = true;
+}
+
+bool fetch_abort_requested(void)
+{
+  return fetch_abort_flag;
+}
+
+/*! \brief Cancellation point of long running handlers
+ *
+ * Returns false, after reporting the abort, once the command was aborted;
+ * the handler then cleans up and returns false. Otherwise reports
+ *
+ *   U32:progress:<done>,<total>
+ *
+ * at most every FETCH_PROGRESS_INTERVAL_MS, so a host can tell a slow
+ * command from a stuck one.
+ */
+bool fetch_checkpoint(BaseSequentialStream * chp, uint32_t done, uint32_t total)
 {
-  //FIXME add mutual exclusion to this function
+  uint32_t progress[2] = { done, total };
 
+  if( fetch_abort_flag )
+  {
+    util_message_error(chp, "aborted");
+    return false;
+  }
+
+  if( chVTTimeElapsedSinceX(fetch_progress_time) >= MS2ST(FETCH_PROGRESS_INTERVAL_MS) )
+  {
+    fetch_progress_time = chVTGetSystemTimeX();
+    util_message_uint32_array(chp, "progress", progress, 2);
+  }
+
+  return true;
+}
+
+/*! \brief Sleep that ends early on abort
+ *
+ * \return false if the command was aborted
+ */
+bool fetch_sleep_ms(uint32_t ms)
+{
+  while( ms > 0 && !fetch_abort_flag )
+  {
+    uint32_t slice = (ms < FETCH_ABORT_POLL_MS) ? ms : FETCH_ABORT_POLL_MS;
+    chThdSleepMilliseconds(slice);
+    ms -= slice;
+  }
+
+  return !fetch_abort_flag;
+}
+
+bool fetch_execute( BaseSequentialStream * chp, const char * input_line )
+{
   // add one to guarentee space for null at end
 	static char   output_buffer[ FETCH_MAX_LINE_CHARS + 1 ];
 	static char * argv[ FETCH_MAX_DATA_TOKS + 1 ];
   fetch_func_t func = NULL;
   uint32_t argc = 0;
 
+  fetch_lock();
+
+  fetch_abort_flag = false;
+  fetch_progress_time = chVTGetSystemTimeX();
+
   if( fetch_command_parser(input_line, FETCH_MAX_LINE_CHARS, output_buffer, FETCH_MAX_LINE_CHARS, &func, &argc, argv, FETCH_MAX_DATA_TOKS) == false )
   {
     util_message_error(chp, "Error parsing fetch command");
@@ -294,21 +438,27 @@ bool fetch_execute( BaseSequentialStream * chp, const char * input_line )
     DEBUG_VMSG(chp, "fsm_state_first_final: %d", fetch_parser_info.fsm_state_first_final);
     DEBUG_VMSG(chp, "fsm_state_error: %d", fetch_parser_info.fsm_state_error);
     DEBUG_VMSG(chp, "fsm_state_start: %d", fetch_parser_info.fsm_state_start);
+    fetch_unlock();
     return false;
   }
 
   // null terminate the argv list so that we can iterate till NULL
   argv[argc] = NULL;
 
+  bool ret = false;
+
   if( func != NULL )
   {
-    return func(chp, argc, argv);
+    ret = func(chp, argc, argv);
   }
   else
   {
     util_message_error(chp, "null function pointer");
-    return false;
   }
+
+  fetch_unlock();
+
+  return ret;
 }
 
 
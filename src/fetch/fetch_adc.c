@@ -7,6 +7,31 @@
   * @{
   */
 
+/*!
+ * <hr>
+ *
+ *  Multi-rate channels
+ *
+ *  adc.divisor(<dev>, <channel>, <n>) samples a channel only on every
+ *  n-th trigger. Channels with divisor 1 form the regular scan sequence,
+ *  converted by DMA on each timer trigger, so removing slow channels from
+ *  it shortens the conversion time of every trigger and raises the
+ *  highest usable rate by about the number of channels removed.
+ *
+ *  Slower channels are converted as injected conversions, at most
+ *  FETCH_ADC_INJECTED_MAX per trigger, started from the end of
+ *  conversion callback and collected in the next one. Their values
+ *  therefore belong to the trigger before the sample set they arrive in.
+ *  A channel with divisor 0 is not converted at all.
+ *
+ *  Each sample set carries a presence mask, bit i set when sample[i] was
+ *  converted for this set; the other entries repeat the last value.
+ *  mpipe sends sets with all channels present as before (A record) and
+ *  the others as M records with the mask and only the present samples.
+ *
+ * <hr>
+ */
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -20,13 +45,20 @@
 #include "util_general.h"
 #include "util_strings.h"
 #include "util_messages.h"
+#include "util_arg_parse.h"
 #include "util_io.h"
+#include "util_timestamp.h"
+#include "util_dma.h"
+#include "util_ring.h"
 
 #include "fetch_defs.h"
 #include "fetch.h"
 
 #include "fetch_adc.h"
-#include "mpipe.h"
+#include "fetch_filter.h"
+#include "fetch_stats.h"
+#include "fetch_irq.h"
+#include "fetch_mixed.h"
 
 #define FETCH_ADC_SAMPLE_DEPTH  1
 
@@ -40,10 +72,6 @@
 #define FETCH_ADC2_BUFFER_SIZE  (FETCH_ADC_SAMPLE_DEPTH * FETCH_ADC2_CH_COUNT)
 #define FETCH_ADC3_BUFFER_SIZE  (FETCH_ADC_SAMPLE_DEPTH * FETCH_ADC3_CH_COUNT)
 
-#ifndef FETCH_ADC_MEM_POOL_SIZE
-#define FETCH_ADC_MEM_POOL_SIZE 128
-#endif
-
 #ifndef FETCH_ADC_DEFAULT_SAMPLE_RATE
 #define FETCH_ADC_DEFAULT_SAMPLE_RATE  100
 #endif
@@ -55,6 +83,12 @@
 #define ADC_CR2_EXTSEL_TIM2_TRGO (ADC_CR2_EXTSEL_2 | ADC_CR2_EXTSEL_1) // 0b0110
 #define ADC_CR2_EXTSEL_TIM3_TRGO (ADC_CR2_EXTSEL_3)                    // 0b1000
 
+// injected conversions per trigger, the size of the injected sequence
+#define FETCH_ADC_INJECTED_MAX  4
+
+// collect injected results even without JEOC after this many triggers
+#define FETCH_ADC_INJECTED_AGE  2
+
 #define ADC_SMPR1(smp) (smp | (smp<<3) | (smp<<6) | (smp<<9) | (smp<<12) | (smp<<15) | (smp<<18) | (smp<<21) | (smp<<24))
 #define ADC_SMPR2(smp) (smp | (smp<<3) | (smp<<6) | (smp<<9) | (smp<<12) | (smp<<15) | (smp<<18) | (smp<<21) | (smp<<24) | (smp<<27))
 
@@ -64,8 +98,17 @@ static void fetch_adc_end_cb(ADCDriver * adcp, adcsample_t * buffer, size_t n);
 static adcsample_t adc2_sample_buffer[FETCH_ADC2_BUFFER_SIZE];
 static adcsample_t adc3_sample_buffer[FETCH_ADC3_BUFFER_SIZE];
 
-static adc_sample_set_t adc_sample_set_buffer[FETCH_ADC_MEM_POOL_SIZE];
-memory_pool_t adc_sample_set_pool;
+// indexed by fetch adc device, storage is carved from the ram arena,
+// see fetch_ram.c. The end of conversion callback is the only producer
+// of a ring, the mpipe adc thread of the device the only consumer.
+static util_ring_t adc_ring[2];
+static binary_semaphore_t adc_ring_sem[2];
+
+static fetch_adc_sample_hook_t adc_sample_hook = NULL;
+
+// most recent sample set of each fetch adc device, for single and snapshot
+static adc_sample_set_t adc_latest[2];
+static bool adc_latest_valid[2];
 
 static volatile uint16_t adc2_sequence_number = 0;
 static volatile uint16_t adc3_sequence_number = 0;
@@ -89,6 +132,31 @@ volatile adc_status_t adc3_status;
 static GPTConfig gpt2_cfg;
 static GPTConfig gpt3_cfg;
 
+/*! \brief per channel rates of one adc device, see adc.divisor
+ */
+typedef struct {
+  uint8_t divisor[ADC_SAMPLE_SET_SIZE];     //!< 0 = off, 1 = every trigger, n = every n-th
+  uint8_t countdown[ADC_SAMPLE_SET_SIZE];   //!< triggers until an injected channel is due
+  uint8_t regular[ADC_SAMPLE_SET_SIZE];     //!< sample index of each regular conversion
+  uint8_t regular_count;
+  uint8_t injected[FETCH_ADC_INJECTED_MAX]; //!< sample index of each pending injected conversion
+  uint8_t injected_count;
+  uint8_t injected_age;
+} adc_schedule_t;
+
+// indexed by fetch adc device
+static adc_schedule_t adc_schedule[2];
+
+// analog input of each sample index, must match the conversion groups below
+static const uint8_t adc_inputs[2][ADC_SAMPLE_SET_SIZE] =
+{
+  { 5, 6, 7,  8,  9, 14, 15 },  // dev 0, ADC3
+  { 2, 6, 7, 11, 13, 14, 15 },  // dev 1, ADC2
+};
+
+// streaming conversion groups, the regular channels of the schedule
+static ADCConversionGroup adc_stream_grp[2];
+
 /*! \brief ADC conversion group configuration
  */
 
@@ -122,6 +190,115 @@ static ADCConversionGroup adc3_conv_grp = {
 	.sqr3            = ADC_SQR3_SQ1_N(5) | ADC_SQR3_SQ2_N(6) | ADC_SQR3_SQ3_N(7) | ADC_SQR3_SQ4_N(8) | ADC_SQR3_SQ5_N(9) | ADC_SQR3_SQ6_N(14)
 };
 
+/*
+ * Build the streaming conversion group of a device from its full group
+ * and the channel divisors.
+ */
+static void adc_schedule_build(uint32_t dev)
+{
+  adc_schedule_t * sch = &adc_schedule[dev];
+  ADCConversionGroup * grp = &adc_stream_grp[dev];
+  uint32_t sqr[3] = { 0, 0, 0 };    // SQR3, SQR2, SQR1
+
+  *grp = (dev == 1) ? adc2_conv_grp : adc3_conv_grp;
+  grp->circular = true;
+
+  sch->regular_count = 0;
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( sch->divisor[i] == 1 )
+    {
+      uint32_t n = sch->regular_count++;
+      sqr[n / 6] |= (uint32_t)adc_inputs[dev][i] << (5 * (n % 6));
+      sch->regular[n] = i;
+    }
+    // slow channels are first converted on the first trigger
+    sch->countdown[i] = 1;
+  }
+  sch->injected_count = 0;
+  sch->injected_age = 0;
+
+  grp->num_channels = sch->regular_count;
+  grp->sqr3 = sqr[0];
+  grp->sqr2 = sqr[1];
+  grp->sqr1 = sqr[2] | ADC_SQR1_NUM_CH(sch->regular_count);
+}
+
+/*
+ * Called from the end of conversion callback. Fills samples with the
+ * regular results, the injected results of the previous trigger and the
+ * last value of everything else, starts the injected conversions that
+ * are due and returns the presence mask.
+ */
+static uint8_t adc_schedule_collect_i(uint32_t dev, ADCDriver * adcp, const adcsample_t * buffer, adcsample_t * samples)
+{
+  adc_schedule_t * sch = &adc_schedule[dev];
+  uint8_t present = 0;
+
+  memcpy(samples, adc_latest[dev].sample, sizeof(adcsample_t) * ADC_SAMPLE_SET_SIZE);
+
+  for( uint32_t k = 0; k < sch->regular_count; k++ )
+  {
+    samples[sch->regular[k]] = buffer[k];
+    present |= 1 << sch->regular[k];
+  }
+
+  if( sch->injected_count > 0 )
+  {
+    if( (adcp->adc->SR & ADC_SR_JEOC) || ++sch->injected_age >= FETCH_ADC_INJECTED_AGE )
+    {
+      volatile uint32_t * jdr = &adcp->adc->JDR1;
+
+      for( uint32_t k = 0; k < sch->injected_count; k++ )
+      {
+        samples[sch->injected[k]] = jdr[k];
+        present |= 1 << sch->injected[k];
+      }
+      adcp->adc->SR = ~ADC_SR_JEOC;
+      sch->injected_count = 0;
+      sch->injected_age = 0;
+    }
+  }
+
+  // due channels that do not fit keep countdown 0 and go next trigger
+  if( sch->injected_count == 0 )
+  {
+    uint32_t jsqr = 0;
+
+    for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+    {
+      if( sch->divisor[i] < 2 )
+      {
+        continue;
+      }
+      if( sch->countdown[i] > 0 )
+      {
+        sch->countdown[i]--;
+      }
+      if( sch->countdown[i] == 0 && sch->injected_count < FETCH_ADC_INJECTED_MAX )
+      {
+        sch->injected[sch->injected_count++] = i;
+        sch->countdown[i] = sch->divisor[i];
+      }
+    }
+
+    if( sch->injected_count > 0 )
+    {
+      // a sequence of n injected conversions runs JSQ(5-n) .. JSQ4
+      for( uint32_t k = 0; k < sch->injected_count; k++ )
+      {
+        jsqr |= (uint32_t)adc_inputs[dev][sch->injected[k]] << (5 * (4 - sch->injected_count + k));
+      }
+      jsqr |= (uint32_t)(sch->injected_count - 1) << 20;
+
+      adcp->adc->JSQR = jsqr;
+      adcp->adc->CR2 |= ADC_CR2_JSWSTART;
+    }
+  }
+
+  return present;
+}
+
 static void fetch_adc_error_cb(ADCDriver * adcp, adcerror_t err)
 {
   if( adcp == &ADCD2 )
@@ -156,106 +333,109 @@ static void fetch_adc_error_cb(ADCDriver * adcp, adcerror_t err)
 static void fetch_adc_end_cb(ADCDriver * adcp, adcsample_t * buffer, size_t n)
 {
 
-	(void) buffer;
 	(void) n;
   adc_sample_set_t *ssp;
-  uint16_t seq_num;
+  uint32_t dev = (adcp == &ADCD2) ? 1 : 0;
 
-  chSysLockFromISR();
-  ssp = chPoolAllocI(&adc_sample_set_pool);
-  chSysUnlockFromISR();
+  // first, latency to the trigger timer update
+  fetch_irq_adc_entry_i(dev);
 
-  if( ssp != NULL )
+  uint64_t timestamp = util_timestamp_now();
+  adcsample_t samples[ADC_SAMPLE_SET_SIZE];
+  uint8_t present;
+  uint8_t digital_flags = 0;
+  uint16_t digital = 0;
+  uint16_t sequence_number;
+  volatile adc_status_t * status = (dev == 1) ? &adc2_status : &adc3_status;
+
+  // single conversions use the full group, samples are in channel order
+  if( adcp->grpp == &adc_stream_grp[dev] )
+  {
+    present = adc_schedule_collect_i(dev, adcp, buffer, samples);
+    // only timer triggered conversions have a gpio word
+    digital_flags = fetch_mixed_word_i(dev, &digital);
+  }
+  else
+  {
+    memcpy(samples, buffer, sizeof(adcsample_t) * ADC_SAMPLE_SET_SIZE);
+    present = ADC_SAMPLE_SET_ALL;
+  }
+
+  fetch_filter_run_i(dev, samples, present);
+  fetch_stats_update_i(dev, samples, present);
+
+  // first, so threshold rules react before the sample set bookkeeping
+  if( adc_sample_hook != NULL )
   {
-    memcpy(ssp->sample, buffer, sizeof(adcsample_t) * ADC_SAMPLE_SET_SIZE);
+    adc_sample_hook(dev, samples, timestamp);
   }
 
   if( adcp == &ADCD2 )
   {
-    adc2_sequence_number++;
-    if( ssp != NULL )
-    {
-      ssp->sequence_number = adc2_sequence_number;
-      chSysLockFromISR();
-      if( chMBPostI(&mpipe_adc2_mb, (msg_t)ssp) != MSG_OK )
-      {
-        adc2_status.mpipe_overflow = true;
-      }
-      else
-      {
-        ssp->mem_ref_count++;
-      }
-#if 0
-      if( chMBPostI(&mcard_adc2_mb, (msg_t)ssp) != MSG_OK )
-      {
-        adc2_status.mcard_overflow = true;
-      }
-      else
-      {
-        ssp->mem_ref_count++;
-      }
-#endif
-      chSysUnlockFromISR();
-    }
-    else
-    {
-      adc2_status.mem_alloc_null = true;
-    }
+    sequence_number = ++adc2_sequence_number;
   }
-  else //ADCD3
+  else
   {
-    adc3_sequence_number++;
-    if( ssp != NULL )
-    {
-      ssp->sequence_number = adc3_sequence_number;
-      chSysLockFromISR();
-      if( chMBPostI(&mpipe_adc3_mb, (msg_t)ssp) != MSG_OK )
-      {
-        adc3_status.mpipe_overflow = true;
-      }
-      else
-      {
-        ssp->mem_ref_count++;
-      }
-#if 0
-      if( chMBPostI(&mcard_adc3_mb, (msg_t)ssp) != MSG_OK )
-      {
-        adc3_status.mcard_overflow = true;
-      }
-      else
-      {
-        ssp->mem_ref_count++;
-      }
-#endif
-      chSysUnlockFromISR();
-    }
-    else
-    {
-      adc3_status.mem_alloc_null = true;
-    }
+    sequence_number = ++adc3_sequence_number;
+  }
+
+  // filled in place, the ring needs no lock
+  ssp = util_ring_write_slot(&adc_ring[dev]);
+  if( ssp != NULL )
+  {
+    ssp->timestamp = timestamp;
+    ssp->sequence_number = sequence_number;
+    ssp->present = present;
+    ssp->digital_flags = digital_flags;
+    ssp->digital = digital;
+    memcpy(ssp->sample, samples, sizeof(adcsample_t) * ADC_SAMPLE_SET_SIZE);
+    util_ring_commit(&adc_ring[dev]);
+  }
+  else if( adc_ring[dev].count == 0 )
+  {
+    status->mem_alloc_null = true;
+  }
+  else
+  {
+    status->mpipe_overflow = true;
   }
 
-  if( ssp != NULL && ssp->mem_ref_count == 0 )
+  chSysLockFromISR();
+  adc_latest[dev].timestamp = timestamp;
+  adc_latest[dev].sequence_number = sequence_number;
+  adc_latest[dev].present = present;
+  adc_latest[dev].digital_flags = digital_flags;
+  adc_latest[dev].digital = digital;
+  memcpy(adc_latest[dev].sample, samples, sizeof(adcsample_t) * ADC_SAMPLE_SET_SIZE);
+  adc_latest_valid[dev] = true;
+  // the only kernel call of the hand off, wakes the consumer
+  if( ssp != NULL )
   {
-    // we were not able to enqueue it anywhere so lets free it imediately
-    chSysLockFromISR();
-    chPoolFreeI(&adc_sample_set_pool, ssp);
-    chSysUnlockFromISR();
+    chBSemSignalI(&adc_ring_sem[dev]);
   }
+  chSysUnlockFromISR();
 }
 
-void fetch_adc_free_sample_set( adc_sample_set_t *ssp )
+/*! \brief Oldest queued sample set of a device, consumer side
+ *
+ * Waits up to timeout for one. The set stays valid until
+ * fetch_adc_ring_release(). Only one thread per device may consume.
+ */
+adc_sample_set_t * fetch_adc_ring_read(uint32_t dev, systime_t timeout)
 {
-  if( ssp != NULL )
+  adc_sample_set_t * ssp = util_ring_read_slot(&adc_ring[dev]);
+
+  if( ssp == NULL && chBSemWaitTimeout(&adc_ring_sem[dev], timeout) == MSG_OK )
   {
-    chSysLock();
-    ssp->mem_ref_count--;
-    if( ssp->mem_ref_count <= 0 )
-    {
-      chPoolFreeI(&adc_sample_set_pool, ssp);
-    }
-    chSysUnlock();
+    ssp = util_ring_read_slot(&adc_ring[dev]);
   }
+
+  return ssp;
+}
+
+void fetch_adc_ring_release(uint32_t dev)
+{
+  util_ring_release(&adc_ring[dev]);
 }
 
 static ADCDriver * parse_adc_dev( char * str, int32_t * dev )
@@ -314,6 +494,14 @@ bool fetch_adc_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
   FETCH_HELP_DES(chp, "Configure adc device");
   FETCH_HELP_ARG(chp, "sample rate", "16 ... 1000000");
   FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "divisor(<dev>[, <channel>, <divisor>])");
+  FETCH_HELP_DES(chp, "Sample a channel on every n-th trigger only");
+  FETCH_HELP_ARG(chp, "channel", "0 ... 6");
+  FETCH_HELP_ARG(chp, "divisor", "0 = off | 1 = every trigger | 2 ... 255");
+  FETCH_HELP_DES(chp, "Without channel, reports the divisors of the device");
+  FETCH_HELP_BREAK(chp);
+  fetch_filter_help(chp);
+  fetch_stats_help(chp);
   FETCH_HELP_CMD(chp, "reset");
   FETCH_HELP_DES(chp, "Reset adc module");
   FETCH_HELP_BREAK(chp);
@@ -335,10 +523,26 @@ bool fetch_adc_single_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
   if( adc_drv == NULL )
   {
     util_message_error(chp, "invalid adc device");
-    false;
+    return false;
   }
 
-  // TODO add ability to sample from streamming state by grabbing the current sample set instead of trigging a conversion
+  // while streaming answer with the newest sample set instead of triggering a conversion
+  if( adc_drv->state == ADC_ACTIVE )
+  {
+    adc_sample_set_t set;
+
+    chSysLock();
+    bool valid = fetch_adc_latest_i(dev, &set);
+    chSysUnlock();
+
+    if( !valid )
+    {
+      util_message_error(chp, "no sample set yet");
+      return false;
+    }
+    util_message_uint16_array(chp, "samples", set.sample, (dev == 1) ? FETCH_ADC2_BUFFER_SIZE : FETCH_ADC3_BUFFER_SIZE);
+    return true;
+  }
 
   if( adc_drv->state != ADC_READY )
   {
@@ -377,7 +581,7 @@ bool fetch_adc_stream_start_cmd(BaseSequentialStream * chp, uint32_t argc, char
   if( adc_drv == NULL )
   {
     util_message_error(chp, "invalid adc device");
-    false;
+    return false;
   }
 
   if( adc_drv->state != ADC_READY )
@@ -386,21 +590,146 @@ bool fetch_adc_stream_start_cmd(BaseSequentialStream * chp, uint32_t argc, char
     return false;
   }
 
+  adc_schedule_build(dev);
+
+  chSysLock();
+  fetch_mixed_rearm_i(dev);
+  chSysUnlock();
+
   switch(dev)
   {
     case 1:
-      adc2_conv_grp.circular = true;
-      adcStartConversion( &ADCD2, &adc2_conv_grp, adc2_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
+      adcStartConversion( &ADCD2, &adc_stream_grp[1], adc2_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
       break;
     case 0:
-      adc3_conv_grp.circular = true;
-	    adcStartConversion( &ADCD3, &adc3_conv_grp, adc3_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
+	    adcStartConversion( &ADCD3, &adc_stream_grp[0], adc3_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
       break;
   }
 
 	return true;
 }
 
+/*! \brief Start streaming from an ISR or a locked section
+ *
+ * Returns false if the device is not in the ready state.
+ */
+bool fetch_adc_stream_start_i(uint32_t dev)
+{
+  switch(dev)
+  {
+    case 1:
+      if( ADCD2.state != ADC_READY )
+      {
+        return false;
+      }
+      adc_schedule_build(dev);
+      fetch_mixed_rearm_i(dev);
+      adcStartConversionI( &ADCD2, &adc_stream_grp[1], adc2_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
+      return true;
+    case 0:
+      if( ADCD3.state != ADC_READY )
+      {
+        return false;
+      }
+      adc_schedule_build(dev);
+      adcStartConversionI( &ADCD3, &adc_stream_grp[0], adc3_sample_buffer, FETCH_ADC_SAMPLE_DEPTH);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*! \brief Install a function called from the adc ISR with every sample set
+ *
+ * Called with the device, the raw samples and the sample set timestamp,
+ * NULL removes the hook.
+ */
+void fetch_adc_set_sample_hook(fetch_adc_sample_hook_t hook)
+{
+  chSysLock();
+  adc_sample_hook = hook;
+  chSysUnlock();
+}
+
+/*! \brief Copy the newest sample set of a device, call locked
+ *
+ * Returns false if the device has not converted anything yet.
+ */
+bool fetch_adc_latest_i(uint32_t dev, adc_sample_set_t * set)
+{
+  if( dev > 1 || !adc_latest_valid[dev] )
+  {
+    return false;
+  }
+
+  *set = adc_latest[dev];
+  return true;
+}
+
+/*! \brief Streaming state and sticky status of a device as FETCH_ADC_FLAG_* bits
+ *
+ * Unlike adc.status the status bits are not cleared.
+ */
+uint16_t fetch_adc_flags_i(uint32_t dev)
+{
+  ADCDriver * adcp = (dev == 1) ? &ADCD2 : &ADCD3;
+  volatile adc_status_t * status = (dev == 1) ? &adc2_status : &adc3_status;
+  uint16_t flags = 0;
+
+  if( adcp->state == ADC_ACTIVE )
+  {
+    flags |= FETCH_ADC_FLAG_ACTIVE;
+  }
+  if( dev <= 1 && adc_latest_valid[dev] )
+  {
+    flags |= FETCH_ADC_FLAG_VALID;
+  }
+  flags |= status->error_dmafailure ? FETCH_ADC_FLAG_DMAFAILURE : 0;
+  flags |= status->error_overflow ? FETCH_ADC_FLAG_OVERFLOW : 0;
+  flags |= status->mpipe_overflow ? FETCH_ADC_FLAG_MPIPE_OVERFLOW : 0;
+  flags |= status->mem_alloc_null ? FETCH_ADC_FLAG_MEM_ALLOC_NULL : 0;
+
+  return flags;
+}
+
+/*! \brief True when the ring of a device may be replaced, call locked
+ *
+ * The adc is stopped and no sample set is queued or being read.
+ */
+bool fetch_adc_ring_idle_i(uint32_t dev)
+{
+  ADCDriver * adcp = (dev == 1) ? &ADCD2 : &ADCD3;
+
+  return adcp->state != ADC_ACTIVE && util_ring_used(&adc_ring[dev]) == 0;
+}
+
+/*! \brief Replace the sample set ring storage of a device, call locked
+ *
+ * Fails, changing nothing, unless fetch_adc_ring_idle_i().
+ */
+bool fetch_adc_ring_load_i(uint32_t dev, adc_sample_set_t * sets, uint32_t count)
+{
+  if( !fetch_adc_ring_idle_i(dev) )
+  {
+    return false;
+  }
+
+  util_ring_init(&adc_ring[dev], sets, sizeof(adc_sample_set_t), count);
+  chBSemResetI(&adc_ring_sem[dev], true);
+
+  return true;
+}
+
+uint32_t fetch_adc_ring_count(uint32_t dev)
+{
+  return adc_ring[dev].count;
+}
+
+uint32_t fetch_adc_sample_rate(uint32_t dev)
+{
+  return (dev == 1) ? adc2_sample_rate : adc3_sample_rate;
+}
+
 /*! \brief Stop the current conversion
  */
 bool fetch_adc_stream_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
@@ -468,6 +797,73 @@ bool fetch_adc_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
 }
 
 
+/*! \brief Query or set the rate divisor of a channel
+ *
+ * Takes effect with the next adc.start, at least one channel of a device
+ * has to stay at divisor 1, it paces the sample sets.
+ */
+bool fetch_adc_divisor_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 3);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  int32_t dev;
+  uint32_t channel;
+  uint32_t divisor;
+  uint32_t regular = 0;
+  ADCDriver *adc_drv = parse_adc_dev(argv[0], &dev);
+
+  if( adc_drv == NULL )
+  {
+    util_message_error(chp, "invalid adc device");
+    return false;
+  }
+
+  if( argc == 1 )
+  {
+    util_message_uint8_array(chp, "divisor", adc_schedule[dev].divisor, ADC_SAMPLE_SET_SIZE);
+    return true;
+  }
+
+  FETCH_MIN_ARGS(chp, argc, 3);
+
+  if( !util_parse_uint32(argv[1], &channel) || channel >= ADC_SAMPLE_SET_SIZE )
+  {
+    util_message_error(chp, "invalid channel");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[2], &divisor) || divisor > 0xff )
+  {
+    util_message_error(chp, "invalid divisor");
+    return false;
+  }
+
+  if( adc_drv->state == ADC_ACTIVE )
+  {
+    util_message_error(chp, "stop the adc device first");
+    return false;
+  }
+
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( (i == channel) ? (divisor == 1) : (adc_schedule[dev].divisor[i] == 1) )
+    {
+      regular++;
+    }
+  }
+
+  if( regular == 0 )
+  {
+    util_message_error(chp, "one channel needs divisor 1");
+    return false;
+  }
+
+  adc_schedule[dev].divisor[channel] = divisor;
+
+  return true;
+}
+
 /*! \brief Process an ADC configure command
  */
 bool fetch_adc_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
@@ -518,6 +914,69 @@ bool fetch_adc_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
   return true;
 }
 
+/*! \brief Restart an adc trigger timer with the adc module settings
+ *
+ * Used by modules that borrow the trigger timer (e.g. sweeps).
+ */
+void fetch_adc_timer_restore(uint32_t dev)
+{
+  switch(dev)
+  {
+    case 1:
+      gptStopTimer(&GPTD2);
+      gptStart(&GPTD2, &gpt2_cfg);
+      gptStartContinuous( &GPTD2, adc2_timer_interval);
+      break;
+    case 0:
+      gptStopTimer(&GPTD3);
+      gptStart(&GPTD3, &gpt3_cfg);
+      gptStartContinuous( &GPTD3, adc3_timer_interval);
+      break;
+  }
+}
+
+void fetch_adc_profile_save(fetch_adc_profile_t * profile)
+{
+  profile->timer_interval[0] = adc3_timer_interval;
+  profile->timer_interval[1] = adc2_timer_interval;
+}
+
+/*! \brief Apply saved sample rates, a zero interval keeps the current rate
+ */
+void fetch_adc_profile_load(const fetch_adc_profile_t * profile)
+{
+  if( profile->timer_interval[1] != 0 )
+  {
+    adc2_timer_interval = profile->timer_interval[1];
+    adc2_sample_rate = FETCH_ADC_TIMER_FREQ / adc2_timer_interval;
+    fetch_adc_timer_restore(1);
+  }
+
+  if( profile->timer_interval[0] != 0 )
+  {
+    adc3_timer_interval = profile->timer_interval[0];
+    adc3_sample_rate = FETCH_ADC_TIMER_FREQ / adc3_timer_interval;
+    fetch_adc_timer_restore(0);
+  }
+}
+
+/*! \brief Restart sequence numbering, the next sample set is number 1
+ */
+void fetch_adc_sequence_reset(uint32_t dev)
+{
+  chSysLock();
+  switch(dev)
+  {
+    case 1:
+      adc2_sequence_number = 0;
+      break;
+    case 0:
+      adc3_sequence_number = 0;
+      break;
+  }
+  chSysUnlock();
+}
+
 bool fetch_adc_timer_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
@@ -539,13 +998,27 @@ bool fetch_adc_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
   return fetch_adc_reset(chp);
 }
 
+static void adc_schedule_reset(void)
+{
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    memset(adc_schedule[dev].divisor, 1, sizeof(adc_schedule[dev].divisor));
+  }
+}
+
 void fetch_adc_init(void)
 {
-  adcStart(&ADCD2,NULL);
-  adcStart(&ADCD3,NULL);
+  adc_schedule_reset();
+
+  util_dma_adc_start(&ADCD2,NULL);
+  util_dma_adc_start(&ADCD3,NULL);
  
-  chPoolObjectInit(&adc_sample_set_pool, sizeof(adc_sample_set_t), NULL);
-  chPoolLoadArray(&adc_sample_set_pool, adc_sample_set_buffer, FETCH_ADC_MEM_POOL_SIZE);
+  // no storage until fetch_ram_init loads the planned rings
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    util_ring_init(&adc_ring[dev], NULL, sizeof(adc_sample_set_t), 0);
+    chBSemObjectInit(&adc_ring_sem[dev], true);
+  }
   
   adc2_status.error_dmafailure = false;
   adc2_status.error_overflow = false;
@@ -586,6 +1059,9 @@ bool fetch_adc_reset(BaseSequentialStream * chp)
 {
 	adcStopConversion(&ADCD2);
   adcStopConversion(&ADCD3);
+  adc_schedule_reset();
+  fetch_filter_reset(chp);
+  fetch_stats_reset(chp);
   gptStopTimer(&GPTD2);
   gptStopTimer(&GPTD3);
   
@@ -14,6 +14,7 @@
                     | "test"i       %{ *func=fetch_test_cmd; }
                     | "test_data"i  %{ *func=fetch_test_data_cmd; }
                     | "clocks"i     %{ *func=fetch_clocks_cmd; }
+                    | "snapshot"i   %{ *func=fetch_snapshot_read_cmd; }
                   );
 
   gpio_commands = "gpio"i . cmd_delim . (
@@ -43,11 +44,18 @@
                     | "help"i       %{ *func=fetch_spi_help_cmd; }
                     | "clock_div"i  %{ *func=fetch_spi_clock_div_cmd; }
                     | "exchange"i   %{ *func=fetch_spi_exchange_cmd; } 
+                    | "slave"i      %{ *func=fetch_spi_slave_cmd; }
+                    | "slave_data"i %{ *func=fetch_spi_slave_data_cmd; }
+                    | "slave_read"i %{ *func=fetch_spi_slave_read_cmd; }
+                    | "slave_status"i %{ *func=fetch_spi_slave_status_cmd; }
+                    | "slave_stop"i %{ *func=fetch_spi_slave_stop_cmd; }
                   );
 
   dac_commands = "dac"i . cmd_delim . (
                       "help"i       %{ *func=fetch_dac_help_cmd; }
                     | "write"i      %{ *func=fetch_dac_write_cmd; }
+                    | "write_sync"i %{ *func=fetch_dac_write_sync_cmd; }
+                    | "wave"i       %{ *func=fetch_dac_wave_cmd; }
                     | "reset"i      %{ *func=fetch_dac_reset_cmd; }
                   );
 
@@ -66,6 +74,15 @@
                     | "stop"i       %{ *func=fetch_adc_stream_stop_cmd; }
                     | "status"i     %{ *func=fetch_adc_status_cmd; }
                     | "config"i     %{ *func=fetch_adc_config_cmd; }
+                    | "divisor"i    %{ *func=fetch_adc_divisor_cmd; }
+                    | "filter"i     %{ *func=fetch_filter_cmd; }
+                    | "filter_biquad"i %{ *func=fetch_filter_biquad_cmd; }
+                    | "filter_fir"i %{ *func=fetch_filter_fir_cmd; }
+                    | "filter_clear"i %{ *func=fetch_filter_clear_cmd; }
+                    | "stats"i      %{ *func=fetch_stats_cmd; }
+                    | "stats_reset"i %{ *func=fetch_stats_reset_cmd; }
+                    | "histogram"i  %{ *func=fetch_stats_histogram_cmd; }
+                    | "histogram_read"i %{ *func=fetch_stats_histogram_read_cmd; }
                     | "reset"i      %{ *func=fetch_adc_reset_cmd; }
                   );
 
@@ -79,7 +96,10 @@
                   );
 
   timer_commands = "timer"i . cmd_delim . (
-                    "help"i       %{ *func=NULL; /*FIXME*/ }
+                      "help"i       %{ *func=fetch_timer_help_cmd; }
+                    | "pulse"i      %{ *func=fetch_timer_pulse_cmd; }
+                    | "pulse_stop"i %{ *func=fetch_timer_pulse_stop_cmd; }
+                    | "reset"i      %{ *func=fetch_timer_reset_cmd; }
                   );
 
   mbus_commands = "mbus"i . cmd_delim . (
@@ -112,6 +132,115 @@
                     | "read_line"i    %{ *func=fetch_serial_read_line_cmd; }
                   );
 
+  sd_commands = "sd"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_sd_help_cmd; }
+                    | "connect"i      %{ *func=fetch_sd_connect_cmd; }
+                    | "disconnect"i   %{ *func=fetch_sd_disconnect_cmd; }
+                    | "mount"i        %{ *func=fetch_sd_mount_cmd; }
+                    | "unmount"i      %{ *func=fetch_sd_unmount_cmd; }
+                    | "format"i       %{ *func=fetch_sd_format_cmd; }
+                    | "open"i         %{ *func=fetch_sd_open_cmd; }
+                    | "close"i        %{ *func=fetch_sd_close_cmd; }
+                    | "unlink"i       %{ *func=fetch_sd_unlink_cmd; }
+                    | "read"i         %{ *func=fetch_sd_read_cmd; }
+                    | "write"i        %{ *func=fetch_sd_write_cmd; }
+                    | "tell"i         %{ *func=fetch_sd_tell_cmd; }
+                    | "seek"i         %{ *func=fetch_sd_seek_cmd; }
+                    | "dir"i          %{ *func=fetch_sd_dir_cmd; }
+                    | "status"i       %{ *func=fetch_sd_status_cmd; }
+                    | "usb"i          %{ *func=fetch_sd_usb_cmd; }
+                  );
+
+  sweep_commands = "sweep"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_sweep_help_cmd; }
+                    | "ac"i           %{ *func=fetch_sweep_ac_cmd; }
+                    | "dc"i           %{ *func=fetch_sweep_dc_cmd; }
+                    | "limit"i        %{ *func=fetch_sweep_limit_cmd; }
+                    | "reset"i        %{ *func=fetch_sweep_reset_cmd; }
+                  );
+
+  time_commands = "time"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_time_help_cmd; }
+                    | "now"i          %{ *func=fetch_time_now_cmd; }
+                    | "sync"i         %{ *func=fetch_time_sync_cmd; }
+                    | "freq"i         %{ *func=fetch_time_freq_cmd; }
+                  );
+
+  sync_commands = "sync"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_sync_help_cmd; }
+                    | "mode"i         %{ *func=fetch_sync_mode_cmd; }
+                    | "arm"i          %{ *func=fetch_sync_arm_cmd; }
+                    | "trigger"i      %{ *func=fetch_sync_trigger_cmd; }
+                    | "stop"i         %{ *func=fetch_sync_stop_cmd; }
+                    | "status"i       %{ *func=fetch_sync_status_cmd; }
+                    | "reset"i        %{ *func=fetch_sync_reset_cmd; }
+                  );
+
+  dma_commands = "dma"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_dma_help_cmd; }
+                    | "status"i       %{ *func=fetch_dma_status_cmd; }
+                    | "conflicts"i    %{ *func=fetch_dma_conflicts_cmd; }
+                  );
+
+  profile_commands = "profile"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_profile_help_cmd; }
+                    | "save"i         %{ *func=fetch_profile_save_cmd; }
+                    | "load"i         %{ *func=fetch_profile_load_cmd; }
+                    | "delete"i       %{ *func=fetch_profile_delete_cmd; }
+                    | "list"i         %{ *func=fetch_profile_list_cmd; }
+                    | "boot"i         %{ *func=fetch_profile_boot_cmd; }
+                    | "status"i       %{ *func=fetch_profile_status_cmd; }
+                  );
+
+  rule_commands = "rule"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_rule_help_cmd; }
+                    | "trigger"i      %{ *func=fetch_rule_trigger_cmd; }
+                    | "action"i       %{ *func=fetch_rule_action_cmd; }
+                    | "enable"i       %{ *func=fetch_rule_enable_cmd; }
+                    | "disable"i      %{ *func=fetch_rule_disable_cmd; }
+                    | "delete"i       %{ *func=fetch_rule_delete_cmd; }
+                    | "list"i         %{ *func=fetch_rule_list_cmd; }
+                    | "stats"i        %{ *func=fetch_rule_stats_cmd; }
+                    | "result"i       %{ *func=fetch_rule_result_cmd; }
+                    | "reset"i        %{ *func=fetch_rule_reset_cmd; }
+                  );
+
+  ram_commands = "ram"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_ram_help_cmd; }
+                    | "plan"i         %{ *func=fetch_ram_plan_cmd; }
+                    | "status"i       %{ *func=fetch_ram_status_cmd; }
+                  );
+
+  script_commands = "script"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_script_help_cmd; }
+                    | "load"i         %{ *func=fetch_script_load_cmd; }
+                    | "run"i          %{ *func=fetch_script_run_cmd; }
+                    | "info"i         %{ *func=fetch_script_info_cmd; }
+                    | "delete"i       %{ *func=fetch_script_delete_cmd; }
+                  );
+
+  irq_commands = "irq"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_irq_help_cmd; }
+                    | "start"i        %{ *func=fetch_irq_start_cmd; }
+                    | "stop"i         %{ *func=fetch_irq_stop_cmd; }
+                    | "probe"i        %{ *func=fetch_irq_probe_cmd; }
+                    | "load"i         %{ *func=fetch_irq_load_cmd; }
+                    | "stats"i        %{ *func=fetch_irq_stats_cmd; }
+                  );
+
+  mixed_commands = "mixed"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_mixed_help_cmd; }
+                    | "start"i        %{ *func=fetch_mixed_start_cmd; }
+                    | "stop"i         %{ *func=fetch_mixed_stop_cmd; }
+                    | "status"i       %{ *func=fetch_mixed_status_cmd; }
+                  );
+
+  snapshot_commands = "snapshot"i . cmd_delim . (
+                      "help"i         %{ *func=fetch_snapshot_help_cmd; }
+                    | "read"i         %{ *func=fetch_snapshot_read_cmd; }
+                    | "push"i         %{ *func=fetch_snapshot_push_cmd; }
+                  );
+
   fetch_command = ( root_commands   | 
                     gpio_commands   | 
                     spi_commands    | 
@@ -123,7 +252,19 @@
                     mbus_commands   |
                     mcard_commands  |
                     mpipe_commands  |
-                    serial_commands
+                    serial_commands |
+                    sd_commands     |
+                    sweep_commands  |
+                    time_commands   |
+                    sync_commands   |
+                    dma_commands    |
+                    profile_commands |
+                    rule_commands    |
+                    ram_commands     |
+                    snapshot_commands |
+                    irq_commands      |
+                    mixed_commands    |
+                    script_commands
                   ) @err{ fetch_parser_info.error_msg = "invalid command"; };
 
 }%%
@@ -14,6 +14,32 @@
  *  in the kernel_3_dev branch.
  *
  * <hr>
+ *
+ *  Synchronous outputs
+ *
+ *  Only channel 1 (PA4) of the internal DAC is usable on this board,
+ *  PA5 is the ULPI clock of the USB HS phy and enabling channel 2 would
+ *  drive it, so the internal dual mode is not available. Paired and
+ *  differential stimulus uses the external DAC124S085 instead: its
+ *  registers can be written without updating the outputs, dac.write_sync
+ *  loads all but the last listed channel that way and the last write
+ *  updates every output on the same SYNC edge. The cost is one 16 bit
+ *  SPI frame per channel, the same as separate dac.write calls.
+ *
+ *  There is no dma driven paired sample stream. The DAC124S085 latches a
+ *  frame on the rising edge of SYNC, which has to go high after every
+ *  16 bit frame; the F4 SPI holds its hardware NSS low for the whole
+ *  transfer, so SYNC is a gpio (spiSelect/spiUnselect) and every paired
+ *  sample needs the cpu. Streams of paired samples are one dac.write_sync
+ *  per sample, from a script or a rule.
+ *
+ *  The internal channel also has the hardware noise (LFSR) and triangle
+ *  generators. dac.wave runs one of them on TIM6 TRGO, the generated
+ *  value is added to the level last written with dac.write(4, ...)
+ *  without any cpu work per step. The ac sweep needs the trigger and
+ *  stops the generator.
+ *
+ * <hr>
  */
 
 #include <stdint.h>
@@ -31,6 +57,7 @@
 #include "util_messages.h"
 #include "util_io.h"
 #include "util_arg_parse.h"
+#include "util_dma.h"
 
 #include "fetch_defs.h"
 #include "fetch.h"
@@ -45,8 +72,16 @@
 SPIConfig spi4_cfg;
 DACConfig dac1_cfg;
 
+static GPTConfig gpt6_cfg;
+
+// DAC_CR channel 1 fields the wave generator owns, TSEL1 = 0 is TIM6 TRGO
+#define DAC_WAVE_CR_MASK  (DAC_CR_WAVE1 | DAC_CR_MAMP1 | DAC_CR_TSEL1 | DAC_CR_TEN1)
+
+static const char * dac_wave_modes[] = { "off", "noise", "triangle", NULL };
 
-static bool external_dac_write(uint16_t channel, uint16_t value)
+static uint32_t dac_wave_mode = FETCH_DAC_WAVE_OFF;
+
+static bool external_dac_write(uint16_t channel, uint16_t value, bool update)
 {
   uint8_t tx_data[2];
 
@@ -57,6 +92,12 @@ static bool external_dac_write(uint16_t channel, uint16_t value)
     return false;
   }
 
+  // not started if its dma streams were taken when fetch_dac_init ran
+  if( SPID4.state != SPI_READY )
+  {
+    return false;
+  }
+
   // set channel bits (15..16)
   value |= (channel << 14);
 
@@ -66,7 +107,10 @@ static bool external_dac_write(uint16_t channel, uint16_t value)
   // 1 = Write to specified register and update outputs
   // 2 = Write to all registers and update outputs
   // 3 = Power down outputs
-  value |= (1 << 12);
+  if( update )
+  {
+    value |= (1 << 12);
+  }
 
   // make sure the byte order is correct (MSBF 16bit)
   tx_data[0] = value >> 8;
@@ -79,6 +123,107 @@ static bool external_dac_write(uint16_t channel, uint16_t value)
   return true;
 }
 
+/*! \brief write a value to any dac channel
+ *
+ * Channels 0 ... 3 are the external DAC124S085, channel 4 is the internal dac.
+ */
+bool fetch_dac_write(uint16_t channel, uint16_t value)
+{
+  switch(channel)
+  {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      return external_dac_write(channel, value, true);
+    case 4:
+      if( value > 0xfff )
+      {
+        return false;
+      }
+      dacPutChannelX(&DACD1, 0, value);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*! \brief write several external dac channels, all outputs change together
+ */
+bool fetch_dac_write_sync(const uint16_t * channels, const uint16_t * values, uint32_t count)
+{
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    if( channels[i] > 3 || values[i] > 0xfff )
+    {
+      return false;
+    }
+  }
+
+  // a failed frame leaves the loaded registers without an update
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    if( !external_dac_write(channels[i], values[i], i == count - 1) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/*! \brief stop the internal dac wave generator
+ *
+ * The output keeps the last written level.
+ */
+void fetch_dac_wave_stop(void)
+{
+  gptStopTimer(&GPTD6);
+
+  chSysLock();
+  DAC->CR &= ~DAC_CR_EN1;
+  DAC->CR &= ~DAC_WAVE_CR_MASK;
+  DAC->CR |= DAC_CR_EN1;
+  chSysUnlock();
+
+  dac_wave_mode = FETCH_DAC_WAVE_OFF;
+}
+
+static bool dac_wave_start(uint32_t mode, uint32_t amplitude, uint32_t interval)
+{
+  uint32_t cr = DAC_CR_TEN1 | (amplitude << 8);
+
+  if( DACD1.state != DAC_READY )
+  {
+    return false;
+  }
+
+  switch( mode )
+  {
+    case FETCH_DAC_WAVE_NOISE:
+      cr |= DAC_CR_WAVE1_0;
+      break;
+    case FETCH_DAC_WAVE_TRIANGLE:
+      cr |= DAC_CR_WAVE1_1;
+      break;
+    default:
+      return false;
+  }
+
+  fetch_dac_wave_stop();
+
+  chSysLock();
+  DAC->CR &= ~DAC_CR_EN1;
+  DAC->CR |= cr;
+  DAC->CR |= DAC_CR_EN1;
+  chSysUnlock();
+
+  gptStartContinuous(&GPTD6, interval);
+  dac_wave_mode = mode;
+
+  return true;
+}
+
 bool fetch_dac_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
@@ -93,6 +238,17 @@ bool fetch_dac_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
   FETCH_HELP_ARG(chp,"channel","0 | 1 | 2 | 3 | HS");
   FETCH_HELP_ARG(chp,"value","12bit value to write");
   FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"write_sync(<channel>,<value>,<channel>,<value>[, ...])");
+  FETCH_HELP_DES(chp,"Write external DAC channels, all outputs update together");
+  FETCH_HELP_DES(chp,"One paired sample per call, there is no dma stream");
+  FETCH_HELP_ARG(chp,"channel","0 | 1 | 2 | 3");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"wave(<mode>[,<amplitude>,<rate>])");
+  FETCH_HELP_DES(chp,"Internal DAC noise/triangle generator on top of the written level");
+  FETCH_HELP_ARG(chp,"mode","off | noise | triangle");
+  FETCH_HELP_ARG(chp,"amplitude","0 ... 11 {triangle peak 2^(n+1)-1, noise lfsr bits n+1}");
+  FETCH_HELP_ARG(chp,"rate","generator steps per second, 16 ... 500000");
+  FETCH_HELP_BREAK(chp);
   FETCH_HELP_CMD(chp,"reset");
   FETCH_HELP_DES(chp,"Reset DAC module");
   FETCH_HELP_BREAK(chp);
@@ -119,22 +275,102 @@ bool fetch_dac_write_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
     return false;
   }
 
-  switch(channel)
+  if( !fetch_dac_write(channel, value) )
   {
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-      if( !external_dac_write(channel, value) )
+    util_message_error(chp, "error writing to dac");
+    return false;
+  }
+  return true;
+}
+
+bool fetch_dac_write_sync_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 8);
+  FETCH_MIN_ARGS(chp, argc, 4);
+  FETCH_MOD_ARGS(chp, argc, 2);
+
+  uint16_t channels[4];
+  uint16_t values[4];
+  uint32_t count = argc / 2;
+
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    if( !util_parse_uint16(argv[2*i], &channels[i]) || channels[i] > 3 )
+    {
+      util_message_error(chp, "invalid channel");
+      return false;
+    }
+    for( uint32_t k = 0; k < i; k++ )
+    {
+      if( channels[k] == channels[i] )
       {
-        util_message_error(chp, "error writing to external dac");
+        util_message_error(chp, "channel listed twice");
         return false;
       }
-      break;
-    case 4:
-      dacPutChannelX(&DACD1, 0, value);
-      break;
+    }
+    if( !util_parse_uint16(argv[2*i+1], &values[i]) || values[i] > 0xfff )
+    {
+      util_message_error(chp, "invalid value");
+      return false;
+    }
+  }
+
+  if( !fetch_dac_write_sync(channels, values, count) )
+  {
+    util_message_error(chp, "error writing to dac");
+    return false;
+  }
+  return true;
+}
+
+bool fetch_dac_wave_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 3);
+
+  uint32_t mode;
+  uint32_t amplitude;
+  uint32_t rate;
+
+  if( argc == 0 )
+  {
+    util_message_string_format(chp, "mode", "%s", dac_wave_modes[dac_wave_mode]);
+    return true;
+  }
+
+  if( !util_match_str_array(argv[0], &mode, dac_wave_modes) )
+  {
+    util_message_error(chp, "invalid mode");
+    return false;
+  }
+
+  if( mode == FETCH_DAC_WAVE_OFF )
+  {
+    FETCH_MAX_ARGS(chp, argc, 1);
+    fetch_dac_wave_stop();
+    return true;
   }
+
+  FETCH_MIN_ARGS(chp, argc, 3);
+
+  if( !util_parse_uint32(argv[1], &amplitude) || amplitude > 11 )
+  {
+    util_message_error(chp, "invalid amplitude");
+    return false;
+  }
+
+  // the interval has to fit the 16 bit TIM6 auto reload register
+  if( !util_parse_uint32(argv[2], &rate) || rate <= FETCH_DAC_WAVE_TIMER_FREQ / 0xffff || rate > FETCH_DAC_WAVE_TIMER_FREQ / 2 )
+  {
+    util_message_error(chp, "invalid rate");
+    return false;
+  }
+
+  if( !dac_wave_start(mode, amplitude, FETCH_DAC_WAVE_TIMER_FREQ / rate) )
+  {
+    util_message_error(chp, "dac busy");
+    return false;
+  }
+
   return true;
 }
 
@@ -151,31 +387,42 @@ void fetch_dac_init(void)
   dac1_cfg.init = 0;
   dac1_cfg.datamode = DAC_DHRM_12BIT_RIGHT;
 
-  dacStart(&DACD1, &dac1_cfg);
+  util_dma_dac_start(&DACD1, &dac1_cfg);
   
   spi4_cfg.end_cb = NULL;
   spi4_cfg.ssport = GPIOE;
   spi4_cfg.sspad = GPIOE_PE11_DAC_SPI4_NSS;
   spi4_cfg.cr1 = SPI_CR1_CPHA;
 
-  spiStart(&SPID4, &spi4_cfg);
+  util_dma_spi_start(&SPID4, &spi4_cfg);
+
+  gpt6_cfg.frequency = FETCH_DAC_WAVE_TIMER_FREQ;
+  gpt6_cfg.callback = NULL;
+  gpt6_cfg.cr2 = TIM_CR2_MMS_1; // 0b010 = TRGO on update event
+  gptStart(&GPTD6, &gpt6_cfg);
 
   dacPutChannelX(&DACD1, 0, 0);
-  external_dac_write(0,0);
-  external_dac_write(1,0);
-  external_dac_write(2,0);
-  external_dac_write(3,0);
+  external_dac_write(0,0,true);
+  external_dac_write(1,0,true);
+  external_dac_write(2,0,true);
+  external_dac_write(3,0,true);
 }
 
 
 bool fetch_dac_reset(BaseSequentialStream * chp)
 {
+  bool ok = true;
+
+  if( dac_wave_mode != FETCH_DAC_WAVE_OFF )
+  {
+    fetch_dac_wave_stop();
+  }
   dacPutChannelX(&DACD1, 0, 0);
-  external_dac_write(0,0);
-  external_dac_write(1,0);
-  external_dac_write(2,0);
-  external_dac_write(3,0);
-  return true;
+  ok = external_dac_write(0,0,true) && ok;
+  ok = external_dac_write(1,0,true) && ok;
+  ok = external_dac_write(2,0,true) && ok;
+  ok = external_dac_write(3,0,true) && ok;
+  return ok;
 }
 
 //! @}
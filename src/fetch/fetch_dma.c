@@ -0,0 +1,147 @@
+/*! \file fetch_dma.c
+  *
+  * Supporting Fetch DSL
+  *
+  * DMA stream allocation state.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_dma Fetch DMA
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  Read only view of util_dma: which peripheral holds each of the 16
+ *  streams, the boot time plan and failed claims. A command that starts a
+ *  driver fails with "dma streams in use" when its claim fails,
+ *  dma.conflicts then names the peripheral that was in the way.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_dma.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_dma.h"
+
+#define DMA_NAME_CHARS    12
+
+static void dma_stream_name(char * name, uint32_t stream)
+{
+  if( stream == UTIL_DMA_NO_STREAM )
+  {
+    chsnprintf(name, DMA_NAME_CHARS, "NONE");
+  }
+  else
+  {
+    chsnprintf(name, DMA_NAME_CHARS, "DMA%u_S%u", stream / 8 + 1, stream % 8);
+  }
+}
+
+bool fetch_dma_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "DMA Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "status");
+  FETCH_HELP_DES(chp, "Owner of every dma stream and the planned stream of every request");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "conflicts");
+  FETCH_HELP_DES(chp, "Failed stream claims per peripheral and the last blocking request");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_dma_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  char stream_name[DMA_NAME_CHARS];
+  char plan_name[DMA_NAME_CHARS];
+  util_dma_request_info_t info;
+  util_dma_owner_t owner;
+  const char * request;
+
+  for( uint32_t stream = 0; stream < UTIL_DMA_STREAMS; stream++ )
+  {
+    dma_stream_name(stream_name, stream);
+
+    if( util_dma_stream_owner(stream, &owner, &request) )
+    {
+      util_message_string_format(chp, stream_name, "%s", request);
+    }
+    else
+    {
+      util_message_string_format(chp, stream_name, "FREE");
+    }
+  }
+
+  for( uint32_t i = 0; i < util_dma_request_count(); i++ )
+  {
+    util_dma_request_info(i, &info);
+
+    if( info.planned == UTIL_DMA_NO_STREAM && info.stream == UTIL_DMA_NO_STREAM )
+    {
+      continue;
+    }
+
+    dma_stream_name(stream_name, info.stream);
+    dma_stream_name(plan_name, info.planned);
+
+    util_message_string_format(chp, (char *) info.name, "plan %s active %s ch %u",
+                               plan_name, stream_name, info.channel);
+
+    if( info.planned != info.configured )
+    {
+      dma_stream_name(plan_name, info.configured);
+      util_message_warning(chp, "%s moved from mcuconf %s", info.name, plan_name);
+    }
+  }
+
+  return true;
+}
+
+bool fetch_dma_conflicts_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  util_dma_conflict_t conflict;
+  uint32_t total = 0;
+
+  for( uint32_t owner = 0; owner < UTIL_DMA_OWNER_COUNT; owner++ )
+  {
+    util_dma_get_conflict(owner, &conflict);
+
+    if( conflict.count == 0 )
+    {
+      continue;
+    }
+
+    total += conflict.count;
+
+    util_message_string_format(chp, (char *) util_dma_owner_name(owner), "%u %s blocked by %s",
+                               conflict.count, conflict.request, util_dma_owner_name(conflict.blocked_by));
+  }
+
+  util_message_uint32(chp, "total", total);
+
+  return true;
+}
+
+/*! @} */
@@ -0,0 +1,422 @@
+/*! \file fetch_filter.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Per channel digital filters in the adc pipeline.
+  *
+  * \sa fetch_adc.c
+  * @defgroup fetch_filter Fetch Filter
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  Every adc channel can run a filter chain on the device: a cascade of
+ *  up to FETCH_FILTER_BIQUADS biquad sections followed by an FIR kernel
+ *  of up to FETCH_FILTER_FIR_TAPS taps. The chain runs in the end of
+ *  conversion callback on each sample set, before the rule hook, the
+ *  latest value snapshot and mpipe see the set, so everything downstream
+ *  gets the filtered value in place of the raw one. A channel running at
+ *  a divided rate (adc.divisor) is only filtered when it was converted,
+ *  the coefficients are for the channel's own rate.
+ *
+ *  The shell has no fractional numbers, coefficients are signed integers
+ *  in Q FETCH_FILTER_Q (value * 2^28, range -8 .. 8). Biquads use the
+ *  CMSIS-DSP arm_biquad_cascade_df2T_f32 layout {b0, b1, b2, a1, a2}
+ *  with the feedback coefficients already negated:
+ *
+ *    y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+ *
+ *  and are computed transposed direct form II in single precision on the
+ *  FPU. Outputs are rounded and clamped to the adc sample range.
+ *
+ *  The filter time of every set is measured with the DWT cycle counter,
+ *  adc.filter(<dev>) reports the average cycles per filtered sample and
+ *  the worst set, which against the core clock tells the rate headroom.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_filter.h"
+
+#define FILTER_Q_SCALE        ((float)(1UL << FETCH_FILTER_Q))
+#define FILTER_SAMPLE_MAX     0xffff
+
+typedef struct {
+  float coef[5];                            //!< b0, b1, b2, a1, a2
+  float state[2];
+} filter_biquad_t;
+
+typedef struct {
+  uint8_t biquad_count;
+  uint8_t fir_taps;
+  uint8_t fir_index;                        //!< oldest entry of the delay line
+  filter_biquad_t biquad[FETCH_FILTER_BIQUADS];
+  float fir_coef[FETCH_FILTER_FIR_TAPS];
+  float fir_delay[FETCH_FILTER_FIR_TAPS];
+} filter_chain_t;
+
+typedef struct {
+  uint8_t active;                           //!< bit i set: channel i has a chain
+  uint32_t sets;
+  uint32_t samples;
+  uint64_t cycles;
+  uint32_t cycles_max;                      //!< worst set
+} filter_device_t;
+
+// indexed by fetch adc device
+static filter_chain_t filter_chain[2][ADC_SAMPLE_SET_SIZE];
+static filter_device_t filter_device[2];
+
+static float filter_biquads(filter_chain_t * fc, float x)
+{
+  for( uint32_t i = 0; i < fc->biquad_count; i++ )
+  {
+    filter_biquad_t * bq = &fc->biquad[i];
+    float y = bq->coef[0] * x + bq->state[0];
+
+    bq->state[0] = bq->coef[1] * x + bq->coef[3] * y + bq->state[1];
+    bq->state[1] = bq->coef[2] * x + bq->coef[4] * y;
+    x = y;
+  }
+
+  return x;
+}
+
+static float filter_fir(filter_chain_t * fc, float x)
+{
+  uint32_t idx = fc->fir_index;
+  float y = 0.0f;
+
+  fc->fir_delay[idx] = x;
+
+  // h[0] pairs with the newest sample
+  for( uint32_t k = 0; k < fc->fir_taps; k++ )
+  {
+    y += fc->fir_coef[k] * fc->fir_delay[idx];
+    idx = (idx == 0) ? fc->fir_taps - 1 : idx - 1;
+  }
+
+  fc->fir_index = (fc->fir_index + 1 == fc->fir_taps) ? 0 : fc->fir_index + 1;
+
+  return y;
+}
+
+/*! \brief filter the present samples of one set in place
+ *
+ * Called from the adc end of conversion callback.
+ */
+void fetch_filter_run_i(uint32_t dev, adcsample_t * samples, uint8_t present)
+{
+  filter_device_t * fd = &filter_device[dev];
+  uint8_t run = fd->active & present;
+
+  if( run == 0 )
+  {
+    return;
+  }
+
+  uint32_t start = DWT->CYCCNT;
+  uint32_t count = 0;
+
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( (run & (1 << i)) == 0 )
+    {
+      continue;
+    }
+
+    filter_chain_t * fc = &filter_chain[dev][i];
+    float y = filter_biquads(fc, (float)samples[i]);
+
+    if( fc->fir_taps > 0 )
+    {
+      y = filter_fir(fc, y);
+    }
+
+    y += 0.5f;
+    if( y <= 0.0f )
+    {
+      samples[i] = 0;
+    }
+    else if( y >= (float)FILTER_SAMPLE_MAX )
+    {
+      samples[i] = FILTER_SAMPLE_MAX;
+    }
+    else
+    {
+      samples[i] = (adcsample_t)y;
+    }
+    count++;
+  }
+
+  uint32_t cycles = DWT->CYCCNT - start;
+
+  fd->sets++;
+  fd->samples += count;
+  fd->cycles += cycles;
+  if( cycles > fd->cycles_max )
+  {
+    fd->cycles_max = cycles;
+  }
+}
+
+static void filter_stats_clear_i(uint32_t dev)
+{
+  filter_device[dev].sets = 0;
+  filter_device[dev].samples = 0;
+  filter_device[dev].cycles = 0;
+  filter_device[dev].cycles_max = 0;
+}
+
+static void filter_update_active_i(uint32_t dev, uint32_t channel)
+{
+  filter_chain_t * fc = &filter_chain[dev][channel];
+
+  if( fc->biquad_count > 0 || fc->fir_taps > 0 )
+  {
+    filter_device[dev].active |= 1 << channel;
+  }
+  else
+  {
+    filter_device[dev].active &= ~(1 << channel);
+  }
+  filter_stats_clear_i(dev);
+}
+
+static bool filter_parse_dev_channel(BaseSequentialStream * chp, char * argv[], uint32_t * dev, uint32_t * channel)
+{
+  if( !util_parse_uint32(argv[0], dev) || *dev > 1 )
+  {
+    util_message_error(chp, "invalid adc device");
+    return false;
+  }
+
+  if( channel != NULL && (!util_parse_uint32(argv[1], channel) || *channel >= ADC_SAMPLE_SET_SIZE) )
+  {
+    util_message_error(chp, "invalid channel");
+    return false;
+  }
+
+  return true;
+}
+
+static bool filter_parse_coef(BaseSequentialStream * chp, char * arg, float * coef)
+{
+  int32_t value;
+
+  if( !util_parse_int32(arg, &value) )
+  {
+    util_message_error(chp, "invalid coefficient");
+    return false;
+  }
+
+  *coef = (float)value / FILTER_Q_SCALE;
+
+  return true;
+}
+
+void fetch_filter_help(BaseSequentialStream * chp)
+{
+  FETCH_HELP_CMD(chp, "filter(<dev>[, <channel>])");
+  FETCH_HELP_DES(chp, "Filter cycle counts of a device or the chain of a channel");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "filter_biquad(<dev>, <channel>, <b0>, <b1>, <b2>, <a1>, <a2>)");
+  FETCH_HELP_DES(chp, "Append a biquad section to the chain of a channel");
+  FETCH_HELP_ARG(chp, "b0 .. a2", "Q28 signed, a1 a2 negated as in CMSIS-DSP");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "filter_fir(<dev>, <channel>, <h0>, ...)");
+  FETCH_HELP_DES(chp, "Set the fir kernel run after the biquads");
+  FETCH_HELP_ARG(chp, "h0 ...", "Q28 signed, up to 16 taps");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "filter_clear(<dev>[, <channel>])");
+  FETCH_HELP_DES(chp, "Remove the filters of a channel or device");
+  FETCH_HELP_BREAK(chp);
+}
+
+bool fetch_filter_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+  uint32_t channel;
+
+  if( !filter_parse_dev_channel(chp, argv, &dev, (argc == 2) ? &channel : NULL) )
+  {
+    return false;
+  }
+
+  if( argc == 2 )
+  {
+    filter_chain_t fc;
+
+    chSysLock();
+    fc = filter_chain[dev][channel];
+    chSysUnlock();
+
+    util_message_uint32(chp, "biquads", fc.biquad_count);
+    for( uint32_t i = 0; i < fc.biquad_count; i++ )
+    {
+      int32_t coef[5];
+      for( uint32_t k = 0; k < 5; k++ )
+      {
+        coef[k] = (int32_t)(fc.biquad[i].coef[k] * FILTER_Q_SCALE);
+      }
+      util_message_int32_array(chp, "biquad", coef, 5);
+    }
+    util_message_uint32(chp, "fir_taps", fc.fir_taps);
+    return true;
+  }
+
+  filter_device_t fd;
+
+  chSysLock();
+  fd = filter_device[dev];
+  chSysUnlock();
+
+  util_message_hex_uint8(chp, "active", fd.active);
+  util_message_uint32(chp, "sets", fd.sets);
+  util_message_uint32(chp, "samples", fd.samples);
+  util_message_uint32(chp, "cycles_per_sample", (fd.samples > 0) ? (uint32_t)(fd.cycles / fd.samples) : 0);
+  util_message_uint32(chp, "cycles_max", fd.cycles_max);
+
+  return true;
+}
+
+bool fetch_filter_biquad_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 7);
+  FETCH_MIN_ARGS(chp, argc, 7);
+
+  uint32_t dev;
+  uint32_t channel;
+  filter_biquad_t bq;
+
+  if( !filter_parse_dev_channel(chp, argv, &dev, &channel) )
+  {
+    return false;
+  }
+
+  for( uint32_t k = 0; k < 5; k++ )
+  {
+    if( !filter_parse_coef(chp, argv[2 + k], &bq.coef[k]) )
+    {
+      return false;
+    }
+  }
+  bq.state[0] = 0.0f;
+  bq.state[1] = 0.0f;
+
+  filter_chain_t * fc = &filter_chain[dev][channel];
+
+  if( fc->biquad_count >= FETCH_FILTER_BIQUADS )
+  {
+    util_message_error(chp, "chain full");
+    return false;
+  }
+
+  // the section is complete before the isr can run it
+  chSysLock();
+  fc->biquad[fc->biquad_count] = bq;
+  fc->biquad_count++;
+  filter_update_active_i(dev, channel);
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_filter_fir_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2 + FETCH_FILTER_FIR_TAPS);
+  FETCH_MIN_ARGS(chp, argc, 3);
+
+  uint32_t dev;
+  uint32_t channel;
+  uint32_t taps = argc - 2;
+  float coef[FETCH_FILTER_FIR_TAPS];
+
+  if( !filter_parse_dev_channel(chp, argv, &dev, &channel) )
+  {
+    return false;
+  }
+
+  for( uint32_t k = 0; k < taps; k++ )
+  {
+    if( !filter_parse_coef(chp, argv[2 + k], &coef[k]) )
+    {
+      return false;
+    }
+  }
+
+  filter_chain_t * fc = &filter_chain[dev][channel];
+
+  chSysLock();
+  memcpy(fc->fir_coef, coef, sizeof(float) * taps);
+  memset(fc->fir_delay, 0, sizeof(fc->fir_delay));
+  fc->fir_index = 0;
+  fc->fir_taps = taps;
+  filter_update_active_i(dev, channel);
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_filter_clear_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+  uint32_t channel;
+
+  if( !filter_parse_dev_channel(chp, argv, &dev, (argc == 2) ? &channel : NULL) )
+  {
+    return false;
+  }
+
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( argc == 2 && i != channel )
+    {
+      continue;
+    }
+    chSysLock();
+    filter_chain[dev][i].biquad_count = 0;
+    filter_chain[dev][i].fir_taps = 0;
+    filter_update_active_i(dev, i);
+    chSysUnlock();
+  }
+
+  return true;
+}
+
+bool fetch_filter_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  chSysLock();
+  memset(filter_chain, 0, sizeof(filter_chain));
+  memset(filter_device, 0, sizeof(filter_device));
+  chSysUnlock();
+
+  return true;
+}
+
+/*! @} */
@@ -15,6 +15,7 @@
 #include "util_strings.h"
 #include "util_general.h"
 #include "util_io.h"
+#include "util_pin_db.h"
 #include "util_arg_parse.h"
 
 #include "fetch_defs.h"
@@ -23,46 +24,19 @@
 #include "fetch_parser.h"
 
 
-// this defines which pins we are allowed to manipulate through the gpio module
-#define PORT_A_GPIO_MASK 0x8003
-#define PORT_C_GPIO_MASK 0x2000
-#define PORT_B_GPIO_MASK 0xc300
-#define PORT_E_GPIO_MASK 0x23ef
-#define PORT_D_GPIO_MASK 0x1bfb
-#define PORT_G_GPIO_MASK 0xffff
-#define PORT_F_GPIO_MASK 0xf803
-#define PORT_I_GPIO_MASK 0x0d1f
-#define PORT_H_GPIO_MASK 0xde6c
-
 typedef struct {
   uint16_t a, b, c, d, e, f, g, h, i;
 } port_states_t;
 
+static stm32_gpio_t * const profile_ports[FETCH_GPIO_PROFILE_PORTS] = {
+  GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI
+};
 
-static bool valid_gpio_port_pin( ioportid_t port, uint32_t pin )
+/*! \brief check a pin against the gpio module access masks
+ */
+bool fetch_gpio_pin_allowed( ioportid_t port, uint32_t pin )
 {
-  switch( (uint32_t)port )
-  {
-    case GPIOA_BASE:
-      return (bool)(PORT_A_GPIO_MASK & (1<<pin));
-    case GPIOB_BASE:
-      return (bool)(PORT_B_GPIO_MASK & (1<<pin));
-    case GPIOC_BASE:
-      return (bool)(PORT_C_GPIO_MASK & (1<<pin));
-    case GPIOD_BASE:
-      return (bool)(PORT_D_GPIO_MASK & (1<<pin));
-    case GPIOE_BASE:
-      return (bool)(PORT_E_GPIO_MASK & (1<<pin));
-    case GPIOF_BASE:
-      return (bool)(PORT_G_GPIO_MASK & (1<<pin));
-    case GPIOG_BASE:
-      return (bool)(PORT_G_GPIO_MASK & (1<<pin));
-    case GPIOH_BASE:
-      return (bool)(PORT_H_GPIO_MASK & (1<<pin));
-    case GPIOI_BASE:
-      return (bool)(PORT_I_GPIO_MASK & (1<<pin));
-  }
-  return false;
+  return util_pin_gpio_allowed(port, pin);
 }
 
 static void write_all( port_states_t set_mask, port_states_t clear_mask )
@@ -186,7 +160,7 @@ bool fetch_gpio_shift_out_cmd( BaseSequentialStream * chp, uint32_t argc, char *
     return false;
   }
 
-  if( !valid_gpio_port_pin(pp_io.port, pp_io.pin) )
+  if( !util_pin_gpio_allowed(pp_io.port, pp_io.pin) )
   {
     util_message_error(chp, "restricted access data io pin");
     return false;
@@ -205,7 +179,7 @@ bool fetch_gpio_shift_out_cmd( BaseSequentialStream * chp, uint32_t argc, char *
     }
   }
   
-  if( !valid_gpio_port_pin(pp_clk.port, pp_clk.pin) )
+  if( !util_pin_gpio_allowed(pp_clk.port, pp_clk.pin) )
   {
     util_message_error(chp, "restricted access clock io pin");
     return false;
@@ -245,6 +219,8 @@ bool fetch_gpio_shift_out_cmd( BaseSequentialStream * chp, uint32_t argc, char *
 
   // this is half the clock period
   uint32_t ms_delay = 500 / rate;
+  uint32_t total_bits = bits;
+  bool ok = true;
 
   if( pp_clk.port )
   {
@@ -252,11 +228,11 @@ bool fetch_gpio_shift_out_cmd( BaseSequentialStream * chp, uint32_t argc, char *
   }
   palClearPad(pp_io.port, pp_io.pin);
 
-  chThdSleepMilliseconds(ms_delay);
+  ok = fetch_sleep_ms(ms_delay);
 
-  for( uint32_t i = 0; i < byte_count && bits > 0; i++ )
+  for( uint32_t i = 0; ok && i < byte_count && bits > 0; i++ )
   {
-    for( uint32_t b = 0; b < 8; b++ )
+    for( uint32_t b = 0; ok && b < 8; b++ )
     {
       if( bits > 0 )
       {
@@ -270,21 +246,23 @@ bool fetch_gpio_shift_out_cmd( BaseSequentialStream * chp, uint32_t argc, char *
         }
         if( pp_clk.port )
         {
-          chThdSleepMilliseconds(ms_delay);
+          fetch_sleep_ms(ms_delay);
           palSetPad(pp_clk.port, pp_clk.pin);
-          chThdSleepMilliseconds(ms_delay);
+          fetch_sleep_ms(ms_delay);
           palClearPad(pp_clk.port, pp_clk.pin);
         }
         else
         {
-          chThdSleepMilliseconds(ms_delay * 2);
+          fetch_sleep_ms(ms_delay * 2);
         }
         bits--;
+        ok = fetch_checkpoint(chp, total_bits - bits, total_bits);
       }
     }
   }
 
-  return true;
+  // an aborted shift still ends with the clock low
+  return ok;
 }
 
 bool fetch_gpio_read_cmd( BaseSequentialStream * chp, uint32_t argc, char * argv[] )
@@ -442,7 +420,7 @@ bool fetch_gpio_write_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
       return false;
     }
 
-    if( !valid_gpio_port_pin(pp.port,pp.pin) )
+    if( !util_pin_gpio_allowed(pp.port,pp.pin) )
     {
       util_message_error(chp, "restricted access io pin");
       return false;
@@ -561,54 +539,9 @@ bool fetch_gpio_write_port_cmd(BaseSequentialStream * chp, uint32_t argc, char *
   set_mask = port_state;
   clear_mask = ~port_state;
 
-  switch( (uint32_t)port )
-  {
-    case GPIOA_BASE:
-      set_mask &= PORT_A_GPIO_MASK;
-      clear_mask &= PORT_A_GPIO_MASK;
-      GPIOA->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOB_BASE:
-      set_mask &= PORT_B_GPIO_MASK;
-      clear_mask &= PORT_B_GPIO_MASK;
-      GPIOB->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOC_BASE:
-      set_mask &= PORT_C_GPIO_MASK;
-      clear_mask &= PORT_C_GPIO_MASK;
-      GPIOC->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOD_BASE:
-      set_mask &= PORT_D_GPIO_MASK;
-      clear_mask &= PORT_D_GPIO_MASK;
-      GPIOD->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOE_BASE:
-      set_mask &= PORT_E_GPIO_MASK;
-      clear_mask &= PORT_E_GPIO_MASK;
-      GPIOE->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOF_BASE:
-      set_mask &= PORT_F_GPIO_MASK;
-      clear_mask &= PORT_F_GPIO_MASK;
-      GPIOF->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOG_BASE:
-      set_mask &= PORT_G_GPIO_MASK;
-      clear_mask &= PORT_G_GPIO_MASK;
-      GPIOG->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOH_BASE:
-      set_mask &= PORT_H_GPIO_MASK;
-      clear_mask &= PORT_H_GPIO_MASK;
-      GPIOH->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-    case GPIOI_BASE:
-      set_mask &= PORT_I_GPIO_MASK;
-      clear_mask &= PORT_I_GPIO_MASK;
-      GPIOI->BSRR.W = (clear_mask << 16) | set_mask;
-      break;
-  }
+  set_mask &= util_pin_gpio_mask(port);
+  clear_mask &= util_pin_gpio_mask(port);
+  port->BSRR.W = (clear_mask << 16) | set_mask;
 
   return true;
 }
@@ -690,7 +623,7 @@ bool fetch_gpio_set_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
       return false;
     }
 
-    if( !valid_gpio_port_pin(pp.port,pp.pin) )
+    if( !util_pin_gpio_allowed(pp.port,pp.pin) )
     {
       util_message_error(chp, "restricted access io pin");
     }
@@ -751,7 +684,7 @@ bool fetch_gpio_clear_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
       return false;
     }
 
-    if( !valid_gpio_port_pin(pp.port,pp.pin) )
+    if( !util_pin_gpio_allowed(pp.port,pp.pin) )
     {
       util_message_error(chp, "restricted access io pin");
     }
@@ -808,7 +741,7 @@ bool fetch_gpio_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * arg
     return false;
   }
 
-  if( !valid_gpio_port_pin(pp.port, pp.pin) )
+  if( !util_pin_gpio_allowed(pp.port, pp.pin) )
   {
     util_message_error(chp, "port/pin not available as gpio");
     return false;
@@ -983,6 +916,91 @@ bool fetch_gpio_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
   return fetch_gpio_reset(chp);
 }
 
+/*
+ * One mask bit per pin to the per pin field masks of the 2 and 4 bit wide
+ * mode registers.
+ */
+static uint32_t pin_mask_2bit(uint16_t mask)
+{
+  uint32_t result = 0;
+
+  for( uint32_t pin = 0; pin < 16; pin++ )
+  {
+    if( mask & (1<<pin) )
+    {
+      result |= 3U << (pin*2);
+    }
+  }
+
+  return result;
+}
+
+static uint32_t pin_mask_4bit(uint8_t mask)
+{
+  uint32_t result = 0;
+
+  for( uint32_t pin = 0; pin < 8; pin++ )
+  {
+    if( mask & (1<<pin) )
+    {
+      result |= 0xfU << (pin*4);
+    }
+  }
+
+  return result;
+}
+
+/*! \brief Snapshot the configuration of all gpio module pins
+ *
+ * Bits of pins outside the gpio masks are left zero.
+ */
+void fetch_gpio_profile_save(fetch_gpio_profile_t * profile)
+{
+  for( uint32_t i = 0; i < FETCH_GPIO_PROFILE_PORTS; i++ )
+  {
+    stm32_gpio_t * port = profile_ports[i];
+    uint16_t mask = util_pin_db_gpio_mask[i];
+    uint32_t mask2 = pin_mask_2bit(mask);
+
+    profile->ports[i].moder = port->MODER & mask2;
+    profile->ports[i].otyper = port->OTYPER & mask;
+    profile->ports[i].ospeedr = port->OSPEEDR & mask2;
+    profile->ports[i].pupdr = port->PUPDR & mask2;
+    profile->ports[i].odr = port->ODR & mask;
+    profile->ports[i].afrl = port->AFRL & pin_mask_4bit(mask);
+    profile->ports[i].afrh = port->AFRH & pin_mask_4bit(mask >> 8);
+  }
+}
+
+/*! \brief Restore gpio module pins with direct register writes
+ *
+ * Pins outside the gpio masks keep their configuration. Output latches
+ * and alternate functions are set before the mode so no pin glitches
+ * through a stale level.
+ */
+void fetch_gpio_profile_load(const fetch_gpio_profile_t * profile)
+{
+  for( uint32_t i = 0; i < FETCH_GPIO_PROFILE_PORTS; i++ )
+  {
+    stm32_gpio_t * port = profile_ports[i];
+    const fetch_gpio_port_profile_t * p = &profile->ports[i];
+    uint16_t mask = util_pin_db_gpio_mask[i];
+    uint32_t mask2 = pin_mask_2bit(mask);
+    uint32_t mask_afrl = pin_mask_4bit(mask);
+    uint32_t mask_afrh = pin_mask_4bit(mask >> 8);
+
+    chSysLock();
+    port->ODR = (port->ODR & ~mask) | (p->odr & mask);
+    port->OTYPER = (port->OTYPER & ~mask) | (p->otyper & mask);
+    port->OSPEEDR = (port->OSPEEDR & ~mask2) | (p->ospeedr & mask2);
+    port->PUPDR = (port->PUPDR & ~mask2) | (p->pupdr & mask2);
+    port->AFRL = (port->AFRL & ~mask_afrl) | (p->afrl & mask_afrl);
+    port->AFRH = (port->AFRH & ~mask_afrh) | (p->afrh & mask_afrh);
+    port->MODER = (port->MODER & ~mask2) | (p->moder & mask2);
+    chSysUnlock();
+  }
+}
+
 void fetch_gpio_init(void)
 {
   // Init stuff goes here
@@ -992,26 +1010,9 @@ void fetch_gpio_init(void)
 bool fetch_gpio_reset( BaseSequentialStream * chp )
 {
   // reset all gpio pins
-  for(uint32_t pin = 0; pin < 16; pin++ )
-  {
-    if( PORT_A_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOA, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_B_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOB, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_C_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOC, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_D_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOD, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_E_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOE, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_F_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOF, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_G_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOG, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_H_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOH, pin, FETCH_DEFAULT_PIN_MODE);
-    if( PORT_I_GPIO_MASK & (1<<pin) )
-      palSetPadMode(GPIOI, pin, FETCH_DEFAULT_PIN_MODE);
+  for( uint32_t i = 0; i < UTIL_PIN_DB_PORTS; i++ )
+  {
+    palSetGroupMode(util_pin_port(i), util_pin_db_gpio_mask[i], 0, FETCH_DEFAULT_PIN_MODE);
   }
 
   return true;
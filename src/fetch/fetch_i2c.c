@@ -16,6 +16,7 @@
 #include "util_general.h"
 #include "util_io.h"
 #include "util_arg_parse.h"
+#include "util_dma.h"
 
 #include "fetch.h"
 #include "fetch_defs.h"
@@ -73,10 +74,10 @@ bool fetch_i2c_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
   FETCH_MAX_ARGS(chp, argc, 0);
 
   // make sure i2c is reset
-  i2cStop(&I2C_DRV);
+  util_dma_i2c_stop(&I2C_DRV);
 
   // apply configuration
-  i2cStart(&I2C_DRV, &i2c_cfg);
+  util_dma_i2c_start(&I2C_DRV, &i2c_cfg);
 
   return true;
 }
@@ -113,13 +114,13 @@ bool fetch_i2c_write_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
     case MSG_TIMEOUT:
       util_message_error(chp, "TIMEOUT");
       fetch_print_i2c_error(chp);
-      i2cStop(&I2C_DRV); // a simple start again doesnt seem to do it
-      i2cStart(&I2C_DRV, &i2c_cfg);
+      util_dma_i2c_stop(&I2C_DRV); // a simple start again doesnt seem to do it
+      util_dma_i2c_start(&I2C_DRV, &i2c_cfg);
       return false;
     case MSG_RESET:
       util_message_error(chp, "RESET");
       fetch_print_i2c_error(chp);
-      i2cStart(&I2C_DRV, &i2c_cfg);
+      util_dma_i2c_start(&I2C_DRV, &i2c_cfg);
       return false;
     case MSG_OK:
       return true;
@@ -162,13 +163,13 @@ bool fetch_i2c_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
     case MSG_TIMEOUT:
       util_message_error(chp, "TIMEOUT");
       fetch_print_i2c_error(chp);
-      i2cStop(&I2C_DRV); // a simple start again doesnt seem to do it
-      i2cStart(&I2C_DRV, &i2c_cfg);
+      util_dma_i2c_stop(&I2C_DRV); // a simple start again doesnt seem to do it
+      util_dma_i2c_start(&I2C_DRV, &i2c_cfg);
       return false;
     case MSG_RESET:
       util_message_error(chp, "RESET");
       fetch_print_i2c_error(chp);
-      i2cStart(&I2C_DRV, &i2c_cfg);
+      util_dma_i2c_start(&I2C_DRV, &i2c_cfg);
       return false;
     case MSG_OK:
       break;
@@ -228,7 +229,7 @@ void fetch_i2c_init(void)
 
 bool fetch_i2c_reset(BaseSequentialStream * chp)
 {
-  i2cStop(&I2C_DRV);
+  util_dma_i2c_stop(&I2C_DRV);
 
   return true;
 }
@@ -0,0 +1,550 @@
+/*! \file fetch_irq.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Interrupt latency and jitter measurement.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_irq Fetch IRQ
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  While irq.start is in effect, instrumented interrupts record how long
+ *  after their hardware event they ran:
+ *
+ *   - adc0, adc1: the end of conversion callback reads the counter of the
+ *     trigger timer (TIM3, TIM2). The counter restarts at the update that
+ *     triggers the conversion, so it holds trigger to callback time,
+ *     conversion and dma included, at the 1 us trigger timer resolution.
+ *   - probe: TIM14 at a chosen rate and priority, irq.probe. Its counter
+ *     at callback entry is the pure entry latency of that priority level,
+ *     at FETCH_IRQ_PROBE_FREQ resolution.
+ *   - usb_sof: DWT between SOF interrupts against the nominal period
+ *     per frame count step, 125 us microframes on a high speed link and
+ *     1 ms frames on full speed, read from the enumerated speed. The SOF
+ *     has no timer reference, the deviation of the period is the entry
+ *     jitter.
+ *   - spi: DWT from spi.exchange starting the transfer to the dma
+ *     completion callback. The spread is the completion jitter.
+ *
+ *  i2c has no completion callback in the driver and is not covered.
+ *
+ *  Every source keeps count, min, max, sum and sum of squares of its
+ *  values in core cycles, and a histogram of FETCH_IRQ_BINS bins of
+ *  <bin ns>. The first FETCH_IRQ_BASE_ENTRIES values of a source only fix
+ *  the histogram base, their minimum, so the bins resolve the jitter
+ *  instead of the constant part. Values below the base count in bin 0,
+ *  values past the last bin in the last one.
+ *
+ *  irq.load(<period us>, <busy us>[, <priority>]) adds a synthetic load:
+ *  TIM12 interrupts that busy wait, at any kernel interrupt priority.
+ *  Above, equal to or below the measured level it shows preemption,
+ *  tail chaining and the cost of being preempted.
+ *
+ *  +irqstats (or irq.stats) reports the sources, with their configured
+ *  nvic priority, in ns.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_irq.h"
+#include "usbcfg.h"
+
+// chibios header defining the stm32 timer peripheral registers
+#include "stm32_tim.h"
+
+#ifndef FETCH_IRQ_PROBE_FREQ
+#define FETCH_IRQ_PROBE_FREQ        (STM32_TIMCLK1 / 4)
+#endif
+
+// load periods are in us
+#define FETCH_IRQ_LOAD_FREQ         1000000
+
+// the frame number counts microframes on high speed, frames on full speed
+#define FETCH_IRQ_SOF_HS_PERIOD_NS  125000
+#define FETCH_IRQ_SOF_FS_PERIOD_NS  1000000
+
+#ifndef FETCH_IRQ_BASE_ENTRIES
+#define FETCH_IRQ_BASE_ENTRIES      16
+#endif
+
+#define FETCH_IRQ_DEFAULT_BIN_NS    100
+
+#define IRQ_NS_TO_CYCLES(ns)        ((uint32_t)(((uint64_t)(ns) * STM32_HCLK) / 1000000000))
+#define IRQ_CYCLES_TO_NS(c)         ((double)(c) * 1e9 / STM32_HCLK)
+
+typedef enum {
+  IRQ_SOURCE_ADC0,
+  IRQ_SOURCE_ADC1,
+  IRQ_SOURCE_PROBE,
+  IRQ_SOURCE_USB_SOF,
+  IRQ_SOURCE_SPI,
+  IRQ_SOURCE_COUNT
+} irq_source_id_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t base;
+  uint64_t sum;
+  uint64_t sum_sq;
+  uint32_t bins[FETCH_IRQ_BINS];
+} irq_source_t;
+
+static char * irq_source_names[IRQ_SOURCE_COUNT] =
+{
+  "adc0", "adc1", "probe", "usb_sof", "spi"
+};
+
+static char * irq_bin_names[IRQ_SOURCE_COUNT] =
+{
+  "adc0_bins", "adc1_bins", "probe_bins", "usb_sof_bins", "spi_bins"
+};
+
+static irq_source_t irq_sources[IRQ_SOURCE_COUNT];
+static volatile bool irq_measuring = false;
+static uint32_t irq_bin_ns = FETCH_IRQ_DEFAULT_BIN_NS;
+static uint32_t irq_bin_cycles;
+
+static uint32_t irq_probe_priority;
+static uint32_t irq_load_cycles;
+
+static uint32_t irq_sof_last_count;
+static uint32_t irq_sof_last_cycles;
+static bool irq_sof_valid;
+
+// transfer start per spi driver
+static struct {
+  SPIDriver * spip;
+  uint32_t cycles;
+} irq_spi_start[2];
+
+static GPTConfig irq_probe_gpt_cfg;
+static GPTConfig irq_load_gpt_cfg;
+
+/*
+ * Each source has one interrupt recording it, readers copy locked.
+ */
+static void irq_record_i(irq_source_id_t id, uint32_t cycles)
+{
+  irq_source_t * s = &irq_sources[id];
+
+  if( s->count == 0 || cycles < s->min )
+  {
+    s->min = cycles;
+  }
+  if( cycles > s->max )
+  {
+    s->max = cycles;
+  }
+  s->sum += cycles;
+  s->sum_sq += (uint64_t)cycles * cycles;
+  s->count++;
+
+  if( s->count <= FETCH_IRQ_BASE_ENTRIES )
+  {
+    s->base = s->min;
+    return;
+  }
+
+  uint32_t bin = (cycles > s->base) ? (cycles - s->base) / irq_bin_cycles : 0;
+
+  s->bins[(bin < FETCH_IRQ_BINS) ? bin : FETCH_IRQ_BINS - 1]++;
+}
+
+/*! \brief trigger timer latency, first thing in the adc end of
+ *  conversion callback
+ */
+void fetch_irq_adc_entry_i(uint32_t dev)
+{
+  if( !irq_measuring )
+  {
+    return;
+  }
+
+  GPTDriver * gptp = (dev == 1) ? &GPTD2 : &GPTD3;
+  uint32_t ticks = gptp->tim->CNT;
+
+  irq_record_i((dev == 1) ? IRQ_SOURCE_ADC1 : IRQ_SOURCE_ADC0, ticks * (STM32_HCLK / gptp->config->frequency));
+}
+
+/*! \brief stamp the start of a spi exchange, before spiExchange()
+ */
+void fetch_irq_spi_start(SPIDriver * spip)
+{
+  uint32_t slot = (irq_spi_start[0].spip == NULL || irq_spi_start[0].spip == spip) ? 0 : 1;
+
+  chSysLock();
+  irq_spi_start[slot].spip = spip;
+  irq_spi_start[slot].cycles = DWT->CYCCNT;
+  chSysUnlock();
+}
+
+/*! \brief spi end callback, set in the spi configurations of fetch_spi
+ */
+void fetch_irq_spi_end_cb(SPIDriver * spip)
+{
+  uint32_t now = DWT->CYCCNT;
+
+  if( !irq_measuring )
+  {
+    return;
+  }
+
+  for( uint32_t i = 0; i < 2; i++ )
+  {
+    if( irq_spi_start[i].spip == spip )
+    {
+      irq_record_i(IRQ_SOURCE_SPI, now - irq_spi_start[i].cycles);
+      return;
+    }
+  }
+}
+
+static uint32_t irq_sof_period_cycles(void)
+{
+  if( (serusbcfg.usbp->otg->DSTS & DSTS_ENUMSPD_MASK) == DSTS_ENUMSPD_HS_480 )
+  {
+    return IRQ_NS_TO_CYCLES(FETCH_IRQ_SOF_HS_PERIOD_NS);
+  }
+  return IRQ_NS_TO_CYCLES(FETCH_IRQ_SOF_FS_PERIOD_NS);
+}
+
+static void irq_sof_hook(uint32_t count, uint64_t timestamp)
+{
+  uint32_t cycles = (uint32_t)timestamp;
+
+  if( !irq_measuring )
+  {
+    return;
+  }
+
+  // a step of more than a few frames is a pause of the bus, not jitter
+  if( irq_sof_valid && count - irq_sof_last_count <= 8 )
+  {
+    uint32_t period = (count - irq_sof_last_count) * irq_sof_period_cycles();
+    uint32_t elapsed = cycles - irq_sof_last_cycles;
+
+    irq_record_i(IRQ_SOURCE_USB_SOF, (elapsed > period) ? elapsed - period : period - elapsed);
+  }
+
+  irq_sof_last_count = count;
+  irq_sof_last_cycles = cycles;
+  irq_sof_valid = true;
+}
+
+static void irq_probe_cb(GPTDriver * gptp)
+{
+  uint32_t ticks = gptp->tim->CNT;
+
+  if( !irq_measuring )
+  {
+    return;
+  }
+
+  irq_record_i(IRQ_SOURCE_PROBE, ticks * (STM32_HCLK / FETCH_IRQ_PROBE_FREQ));
+}
+
+static void irq_load_cb(GPTDriver * gptp)
+{
+  uint32_t start = DWT->CYCCNT;
+
+  (void)gptp;
+
+  while( DWT->CYCCNT - start < irq_load_cycles )
+  {
+  }
+}
+
+static void irq_clear(void)
+{
+  chSysLock();
+  memset(irq_sources, 0, sizeof(irq_sources));
+  irq_sof_valid = false;
+  chSysUnlock();
+}
+
+static void irq_probe_stop(void)
+{
+  if( GPTD14.state != GPT_STOP )
+  {
+    gptStopTimer(&GPTD14);
+    gptStop(&GPTD14);
+  }
+}
+
+static void irq_load_stop(void)
+{
+  if( GPTD12.state != GPT_STOP )
+  {
+    gptStopTimer(&GPTD12);
+    gptStop(&GPTD12);
+  }
+}
+
+static bool irq_parse_priority(BaseSequentialStream * chp, char * arg, uint32_t * priority)
+{
+  if( !util_parse_uint32(arg, priority) || !CORTEX_IS_VALID_KERNEL_PRIORITY(*priority) )
+  {
+    util_message_error(chp, "invalid priority");
+    return false;
+  }
+
+  return true;
+}
+
+bool fetch_irq_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "IRQ Latency Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "start([<bin ns>])");
+  FETCH_HELP_DES(chp, "Clear and start recording adc0, adc1, probe, usb_sof and spi");
+  FETCH_HELP_ARG(chp, "bin ns", "histogram bin width {100}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stop");
+  FETCH_HELP_DES(chp, "Stop recording, the probe and the load");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "probe(<rate>[, <priority>])");
+  FETCH_HELP_DES(chp, "Run the TIM14 latency probe");
+  FETCH_HELP_ARG(chp, "rate", "Hz, 0 = stop");
+  FETCH_HELP_ARG(chp, "priority", "nvic priority {STM32_ADC_IRQ_PRIORITY}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "load(<period us>, <busy us>[, <priority>])");
+  FETCH_HELP_DES(chp, "Busy wait <busy us> in a TIM12 interrupt every <period us>");
+  FETCH_HELP_ARG(chp, "period us", "2 ... 65535");
+  FETCH_HELP_ARG(chp, "busy us", "0 = stop ... period - 1");
+  FETCH_HELP_ARG(chp, "priority", "nvic priority {STM32_ADC_IRQ_PRIORITY}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stats");
+  FETCH_HELP_DES(chp, "Latency and jitter per source in ns, same as +irqstats");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_irq_start_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t bin_ns = FETCH_IRQ_DEFAULT_BIN_NS;
+
+  if( argc > 0 && (!util_parse_uint32(argv[0], &bin_ns) || IRQ_NS_TO_CYCLES(bin_ns) == 0) )
+  {
+    util_message_error(chp, "invalid bin width");
+    return false;
+  }
+
+  irq_measuring = false;
+  irq_bin_ns = bin_ns;
+  irq_bin_cycles = IRQ_NS_TO_CYCLES(bin_ns);
+  irq_clear();
+  irq_measuring = true;
+
+  return true;
+}
+
+bool fetch_irq_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  irq_measuring = false;
+  irq_probe_stop();
+  irq_load_stop();
+
+  return true;
+}
+
+bool fetch_irq_probe_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t rate;
+  uint32_t priority = STM32_ADC_IRQ_PRIORITY;
+
+  // the callback latency has to stay below one period
+  if( !util_parse_uint32(argv[0], &rate) || (rate != 0 && (rate <= FETCH_IRQ_PROBE_FREQ / 0xffff || rate > 100000)) )
+  {
+    util_message_error(chp, "invalid rate");
+    return false;
+  }
+
+  if( argc > 1 && !irq_parse_priority(chp, argv[1], &priority) )
+  {
+    return false;
+  }
+
+  irq_probe_stop();
+  if( rate == 0 )
+  {
+    return true;
+  }
+
+  irq_probe_priority = priority;
+  gptStart(&GPTD14, &irq_probe_gpt_cfg);
+  // re-enabling the vector replaces the STM32_GPT_TIM14_IRQ_PRIORITY level
+  nvicEnableVector(TIM8_TRG_COM_TIM14_IRQn, priority);
+  gptStartContinuous(&GPTD14, FETCH_IRQ_PROBE_FREQ / rate);
+
+  return true;
+}
+
+bool fetch_irq_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 3);
+  FETCH_MIN_ARGS(chp, argc, 2);
+
+  uint32_t period;
+  uint32_t busy;
+  uint32_t priority = STM32_ADC_IRQ_PRIORITY;
+
+  if( !util_parse_uint32(argv[0], &period) || period < 2 || period > 0xffff )
+  {
+    util_message_error(chp, "invalid period");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[1], &busy) || busy >= period )
+  {
+    util_message_error(chp, "invalid busy time");
+    return false;
+  }
+
+  if( argc > 2 && !irq_parse_priority(chp, argv[2], &priority) )
+  {
+    return false;
+  }
+
+  irq_load_stop();
+  if( busy == 0 )
+  {
+    return true;
+  }
+
+  irq_load_cycles = IRQ_NS_TO_CYCLES(busy * 1000);
+  gptStart(&GPTD12, &irq_load_gpt_cfg);
+  nvicEnableVector(TIM8_BRK_TIM12_IRQn, priority);
+  gptStartContinuous(&GPTD12, period);
+
+  return true;
+}
+
+bool fetch_irq_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  irq_source_t sources[IRQ_SOURCE_COUNT];
+  uint32_t count[IRQ_SOURCE_COUNT];
+  uint32_t priority[IRQ_SOURCE_COUNT];
+  double min[IRQ_SOURCE_COUNT];
+  double max[IRQ_SOURCE_COUNT];
+  double mean[IRQ_SOURCE_COUNT];
+  double std[IRQ_SOURCE_COUNT];
+  double jitter[IRQ_SOURCE_COUNT];
+  double base[IRQ_SOURCE_COUNT];
+
+  chSysLock();
+  memcpy(sources, irq_sources, sizeof(sources));
+  chSysUnlock();
+
+  priority[IRQ_SOURCE_ADC0] = STM32_ADC_ADC3_DMA_IRQ_PRIORITY;
+  priority[IRQ_SOURCE_ADC1] = STM32_ADC_ADC2_DMA_IRQ_PRIORITY;
+  priority[IRQ_SOURCE_PROBE] = irq_probe_priority;
+  priority[IRQ_SOURCE_USB_SOF] = STM32_USB_OTG2_IRQ_PRIORITY;
+  priority[IRQ_SOURCE_SPI] = STM32_SPI_SPI2_IRQ_PRIORITY;
+
+  for( uint32_t i = 0; i < IRQ_SOURCE_COUNT; i++ )
+  {
+    irq_source_t * s = &sources[i];
+
+    count[i] = s->count;
+    if( s->count == 0 )
+    {
+      min[i] = max[i] = mean[i] = std[i] = jitter[i] = base[i] = 0.0;
+      continue;
+    }
+    double m = (double)s->sum / s->count;
+    double m2 = (double)s->sum_sq - (double)s->sum * m;
+
+    min[i] = IRQ_CYCLES_TO_NS(s->min);
+    max[i] = IRQ_CYCLES_TO_NS(s->max);
+    mean[i] = IRQ_CYCLES_TO_NS(m);
+    std[i] = (m2 > 0.0) ? IRQ_CYCLES_TO_NS(sqrt(m2 / s->count)) : 0.0;
+    jitter[i] = IRQ_CYCLES_TO_NS(s->max - s->min);
+    base[i] = IRQ_CYCLES_TO_NS(s->base);
+  }
+
+  util_message_bool(chp, "measuring", irq_measuring);
+  util_message_string_array(chp, "sources", irq_source_names, IRQ_SOURCE_COUNT);
+  util_message_uint32_array(chp, "priority", priority, IRQ_SOURCE_COUNT);
+  util_message_uint32_array(chp, "count", count, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "min_ns", min, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "max_ns", max, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "mean_ns", mean, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "std_ns", std, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "jitter_ns", jitter, IRQ_SOURCE_COUNT);
+  util_message_double_array(chp, "base_ns", base, IRQ_SOURCE_COUNT);
+  util_message_uint32(chp, "bin_ns", irq_bin_ns);
+
+  for( uint32_t i = 0; i < IRQ_SOURCE_COUNT; i++ )
+  {
+    util_message_uint32_array(chp, irq_bin_names[i], sources[i].bins, FETCH_IRQ_BINS);
+  }
+
+  return true;
+}
+
+bool fetch_irq_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  irq_measuring = false;
+  irq_probe_stop();
+  irq_load_stop();
+  irq_clear();
+
+  return true;
+}
+
+void fetch_irq_init(void)
+{
+  memset(&irq_probe_gpt_cfg, 0, sizeof(irq_probe_gpt_cfg));
+  irq_probe_gpt_cfg.frequency = FETCH_IRQ_PROBE_FREQ;
+  irq_probe_gpt_cfg.callback = irq_probe_cb;
+
+  memset(&irq_load_gpt_cfg, 0, sizeof(irq_load_gpt_cfg));
+  irq_load_gpt_cfg.frequency = FETCH_IRQ_LOAD_FREQ;
+  irq_load_gpt_cfg.callback = irq_load_cb;
+
+  irq_probe_priority = STM32_ADC_IRQ_PRIORITY;
+  irq_bin_cycles = IRQ_NS_TO_CYCLES(irq_bin_ns);
+  irq_clear();
+
+  usb_set_sof_hook(irq_sof_hook);
+}
+
+/*! @} */
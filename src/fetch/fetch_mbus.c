@@ -9,6 +9,7 @@
 #include "util_strings.h"
 #include "util_general.h"
 #include "util_io.h"
+#include "util_dma.h"
 
 #include "fetch_defs.h"
 #include "fetch_mbus.h"
@@ -44,6 +45,9 @@ typedef enum
 
 mbus_select_t mbus_select = MBUS_SEL_NONE;
 
+// result of the last mbus.read_analog, reported in snapshots
+static adcsample_t mbus_last_analog[2];
+
 typedef enum 
 {
   MBUS_PIN_MODE_FLOAT = 0,
@@ -104,7 +108,7 @@ static void fetch_mbus_set_pin_mode(mbus_pin_mode_t mode)
   }
 }
 
-static uint8_t fetch_mbus_i2c_scan(void)
+static uint8_t fetch_mbus_i2c_scan(BaseSequentialStream * chp)
 {
   //uint8_t address_list[] = {0x50}; // FIXME add i2c eeprom addresses here
   uint8_t rx_buffer;
@@ -113,13 +117,19 @@ static uint8_t fetch_mbus_i2c_scan(void)
 
   for( uint8_t address = 1; address <= 0x7f; address++)
   {
+    // up to 50ms per address
+    if( !fetch_checkpoint(chp, address - 1, 0x7f) )
+    {
+      return 0;
+    }
+
     switch( i2cMasterReceiveTimeout(&I2CD1, address, &rx_buffer, 1, MS2ST(50)) )
     {
       case MSG_TIMEOUT:
-        i2cStart(&I2CD1, &i2c1_cfg);
+        util_dma_i2c_start(&I2CD1, &i2c1_cfg);
         break;
       case MSG_RESET:
-        i2cStart(&I2CD1, &i2c1_cfg);
+        util_dma_i2c_start(&I2CD1, &i2c1_cfg);
         break;
       case MSG_OK:
         return address;
@@ -256,7 +266,12 @@ bool fetch_mbus_detect_cmd(BaseSequentialStream * chp, uint32_t argc, char * arg
     // check for i2c eeprom
     fetch_mbus_set_pin_mode(MBUS_PIN_MODE_I2C);
 
-    uint8_t address = fetch_mbus_i2c_scan();
+    uint8_t address = fetch_mbus_i2c_scan(chp);
+
+    if( fetch_abort_requested() )
+    {
+      return false;
+    }
 
     if( address > 0 )
     {
@@ -289,19 +304,33 @@ bool fetch_mbus_read_analog_cmd(BaseSequentialStream * chp, uint32_t argc, char
   }
 
   adcConvert( &ADCD3, &adc3_mbus_conv_grp, mbus_samples, 2);
+
+  chSysLock();
+  mbus_last_analog[0] = mbus_samples[0];
+  mbus_last_analog[1] = mbus_samples[1];
+  chSysUnlock();
+
   util_message_uint16_array(chp, "values", mbus_samples, 2);
 
   return true;
 }
 
 
+/*! \brief values of the last mbus.read_analog, zero before the first, call locked
+ */
+void fetch_mbus_last_analog_i(adcsample_t values[2])
+{
+  values[0] = mbus_last_analog[0];
+  values[1] = mbus_last_analog[1];
+}
+
 bool fetch_mbus_read_eeprom_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
   fetch_mbus_set_pin_mode(MBUS_PIN_MODE_I2C);
   
-  uint8_t address = 0x50;//fetch_mbus_i2c_scan();
+  uint8_t address = 0x50;//fetch_mbus_i2c_scan(chp);
 
   if( address == 0 )
   {
@@ -316,12 +345,12 @@ bool fetch_mbus_read_eeprom_cmd(BaseSequentialStream * chp, uint32_t argc, char
   {
     case MSG_TIMEOUT:
       util_message_error(chp, "i2c timeout");
-      i2cStart(&I2CD1, &i2c1_cfg);
+      util_dma_i2c_start(&I2CD1, &i2c1_cfg);
       return false;
     case MSG_RESET:
       util_message_error(chp, "i2c error");
       util_message_hex_uint32(chp, "error_flags", i2cGetErrors(&I2CD1));
-      i2cStart(&I2CD1, &i2c1_cfg);
+      util_dma_i2c_start(&I2CD1, &i2c1_cfg);
       return false;
     case MSG_OK:
     default:
@@ -341,9 +370,9 @@ bool fetch_mbus_write_eeprom_cmd(BaseSequentialStream * chp, uint32_t argc, char
 
 void fetch_mbus_init(void)
 {
-  adcStart(&ADCD3, NULL);
+  util_dma_adc_start(&ADCD3, NULL);
   
-  i2cStart(&I2CD1, &i2c1_cfg);
+  util_dma_i2c_start(&I2CD1, &i2c1_cfg);
 
   mbus_select = MBUS_SEL_NONE;
 
@@ -0,0 +1,355 @@
+/*! \file fetch_mixed.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Mixed signal capture, adc samples and a gpio port on one trigger.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_mixed Fetch Mixed Signal
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  The adc 1 trigger timer (TIM2) also triggers a dma read of one gpio
+ *  port input register, so every adc 1 sample set carries the port state
+ *  of the trigger that started its conversion.
+ *
+ *  TIM8 runs in reset slave mode on ITR1, the TIM2 TRGO that starts the
+ *  conversions. Its trigger dma request (TIM8_TRIG, DMA2 stream 7
+ *  channel 7) copies GPIOx->IDR into a small circular buffer, in hardware
+ *  and at the highest dma priority, a few bus cycles after the adc
+ *  trigger. The end of conversion callback pairs the words with sample
+ *  sets in order (fetch_mixed_word_i), so a late callback still gets the
+ *  word of its own trigger.
+ *
+ *  A conversion without a new word (a trigger was missed) gets no word,
+ *  more than half the buffer pending means the pairing was lost and it
+ *  restarts from the newest word. Both mark the set
+ *  ADC_SAMPLE_DIGITAL_SKEW and are counted in mixed.status.
+ *
+ *  The words travel with the sample sets, through the adc ring to mpipe
+ *  as D records, and in adc latest for snapshots. They follow sync.arm
+ *  like the samples, boards on one sync line capture on the same edge.
+ *
+ *  Limits:
+ *   - adc 1 only. TIM3, the adc 0 trigger, is no trigger input of TIM8,
+ *     and TIM1, which it could trigger, belongs to timer.pulse.
+ *   - One port, a dma stream reads one address. <mask> clears the pins
+ *     of no interest.
+ *   - TIM2 runs from boot, so words arrive before adc 1 converts.
+ *     mixed.start and every adc 1 start rearm the pairing, the first
+ *     conversion after either pairs with the newest word and the
+ *     sets after it follow in order. Either start order works.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_io.h"
+#include "util_dma.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+#include "fetch_parser.h"
+
+#include "fetch_adc.h"
+#include "fetch_mixed.h"
+
+// chibios header defining the stm32 timer peripheral registers
+#include "stm32_tim.h"
+
+// gpio words in flight between the dma and the end of conversion callback
+#ifndef FETCH_MIXED_DEPTH
+#define FETCH_MIXED_DEPTH           16
+#endif
+
+// TIM8 only detects triggers, its count is not used
+#define FETCH_MIXED_TIMER_FREQ      1000000
+
+// the stream raises no interrupts
+#define FETCH_MIXED_DMA_IRQ_PRIORITY  STM32_ADC_ADC2_DMA_IRQ_PRIORITY
+
+// fetch adc device triggered by TIM2
+#define FETCH_MIXED_ADC_DEV         1
+
+static uint16_t mixed_buffer[FETCH_MIXED_DEPTH];
+static const stm32_dma_stream_t * mixed_dma = NULL;
+static ioportid_t mixed_port = NULL;
+static uint16_t mixed_mask = 0xffff;
+static volatile bool mixed_capturing = false;
+
+// buffer index of the next word to pair
+static uint32_t mixed_next;
+
+// false until the first conversion after a (re)start picked its word
+static volatile bool mixed_synced = false;
+
+// no word written since mixed.start
+static volatile bool mixed_untouched = false;
+
+static uint32_t mixed_paired;
+static uint32_t mixed_missed;
+static uint32_t mixed_resyncs;
+
+static GPTConfig mixed_gpt_cfg;
+
+static void mixed_stop(void)
+{
+  if( mixed_dma == NULL )
+  {
+    return;
+  }
+
+  chSysLock();
+  mixed_capturing = false;
+  GPTD8.tim->DIER = 0;
+  GPTD8.tim->SMCR = 0;
+  chSysUnlock();
+
+  gptStop(&GPTD8);
+  dmaStreamDisable(mixed_dma);
+  dmaStreamRelease(mixed_dma);
+  util_dma_release(UTIL_DMA_TIM8_TRIG);
+  mixed_dma = NULL;
+}
+
+/*! \brief gpio word for the sample set being completed
+ *
+ * Called from the adc end of conversion callback of timer triggered
+ * conversions. Returns ADC_SAMPLE_DIGITAL_xxx flags, 0 while not
+ * capturing.
+ */
+uint8_t fetch_mixed_word_i(uint32_t dev, uint16_t * word)
+{
+  if( dev != FETCH_MIXED_ADC_DEV || !mixed_capturing )
+  {
+    return 0;
+  }
+
+  uint32_t ndtr = dmaStreamGetTransactionSize(mixed_dma);
+  uint32_t written = (FETCH_MIXED_DEPTH - ndtr) % FETCH_MIXED_DEPTH;
+  uint8_t flags = ADC_SAMPLE_DIGITAL_VALID;
+
+  if( !mixed_synced )
+  {
+    if( mixed_untouched && ndtr == FETCH_MIXED_DEPTH )
+    {
+      // converting since before mixed.start, no word of its trigger
+      mixed_missed++;
+      return ADC_SAMPLE_DIGITAL_SKEW;
+    }
+    // the trigger of this conversion wrote the newest word
+    mixed_next = (written + FETCH_MIXED_DEPTH - 1) % FETCH_MIXED_DEPTH;
+    mixed_synced = true;
+  }
+  mixed_untouched = false;
+
+  uint32_t pending = (written + FETCH_MIXED_DEPTH - mixed_next) % FETCH_MIXED_DEPTH;
+
+  if( pending == 0 )
+  {
+    mixed_missed++;
+    return ADC_SAMPLE_DIGITAL_SKEW;
+  }
+
+  if( pending > FETCH_MIXED_DEPTH / 2 )
+  {
+    mixed_next = (written + FETCH_MIXED_DEPTH - 1) % FETCH_MIXED_DEPTH;
+    mixed_resyncs++;
+    flags |= ADC_SAMPLE_DIGITAL_SKEW;
+  }
+
+  *word = mixed_buffer[mixed_next] & mixed_mask;
+  mixed_next = (mixed_next + 1) % FETCH_MIXED_DEPTH;
+  mixed_paired++;
+
+  return flags;
+}
+
+/*! \brief Pair the next conversion with the newest word
+ *
+ * Called when adc 1 starts, words written while it was stopped belong
+ * to no sample set.
+ */
+void fetch_mixed_rearm_i(uint32_t dev)
+{
+  if( dev == FETCH_MIXED_ADC_DEV )
+  {
+    mixed_synced = false;
+  }
+}
+
+bool fetch_mixed_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Mixed Signal Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "start(<port>[, <mask>])");
+  FETCH_HELP_DES(chp, "Read <port> on every adc 1 trigger, stream as D records");
+  FETCH_HELP_DES(chp, "Before or after adc.start(1), pairing starts at the next conversion");
+  FETCH_HELP_ARG(chp, "port", "A | B | C | D | E | F | G | H | I");
+  FETCH_HELP_ARG(chp, "mask", "pins to keep {0xffff}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stop");
+  FETCH_HELP_DES(chp, "Stop reading the port, adc 1 continues without words");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "status");
+  FETCH_HELP_DES(chp, "Query capture state and pairing counts");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_mixed_start_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  ioportid_t port;
+  uint16_t mask = 0xffff;
+  uint32_t channel;
+  stm32_tim_t * tim;
+
+  if( !fetch_gpio_port_parser(argv[0], FETCH_MAX_DATA_STRLEN, &port) )
+  {
+    util_message_error(chp, "invalid port");
+    return false;
+  }
+
+  if( argc > 1 && !util_parse_uint16(argv[1], &mask) )
+  {
+    util_message_error(chp, "invalid mask");
+    return false;
+  }
+
+  if( mixed_dma != NULL )
+  {
+    util_message_error(chp, "capture running, stop first");
+    return false;
+  }
+
+  if( !util_dma_claim(UTIL_DMA_TIM8_TRIG) )
+  {
+    util_message_error(chp, "dma streams in use");
+    return false;
+  }
+
+  mixed_dma = util_dma_stream(UTIL_DMA_TIM8_TRIG, 0, &channel);
+  if( dmaStreamAllocate(mixed_dma, FETCH_MIXED_DMA_IRQ_PRIORITY, NULL, NULL) )
+  {
+    util_dma_release(UTIL_DMA_TIM8_TRIG);
+    mixed_dma = NULL;
+    util_message_error(chp, "dma streams in use");
+    return false;
+  }
+
+  mixed_port = port;
+  mixed_mask = mask;
+  mixed_next = 0;
+  mixed_synced = false;
+  mixed_untouched = true;
+  mixed_paired = 0;
+  mixed_missed = 0;
+  mixed_resyncs = 0;
+
+  // direct mode, a fifo would hold words back until it fills
+  dmaStreamSetPeripheral(mixed_dma, &port->IDR);
+  dmaStreamSetMemory0(mixed_dma, mixed_buffer);
+  dmaStreamSetTransactionSize(mixed_dma, FETCH_MIXED_DEPTH);
+  dmaStreamSetFIFO(mixed_dma, 0);
+  dmaStreamSetMode(mixed_dma, STM32_DMA_CR_CHSEL(channel) | STM32_DMA_CR_PL(3) | STM32_DMA_CR_DIR_P2M |
+                   STM32_DMA_CR_PSIZE_HWORD | STM32_DMA_CR_MSIZE_HWORD | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC);
+  dmaStreamEnable(mixed_dma);
+
+  gptStart(&GPTD8, &mixed_gpt_cfg);
+  tim = GPTD8.tim;
+
+  chSysLock();
+  // reset mode on ITR1 (TIM2 TRGO), every adc 1 trigger is a TIM8 trigger event
+  tim->ARR = 0xffff;
+  tim->SR = 0;
+  tim->SMCR = STM32_TIM_SMCR_TS(1) | STM32_TIM_SMCR_SMS(4);
+  tim->DIER = STM32_TIM_DIER_TDE;
+  tim->CR1 |= STM32_TIM_CR1_CEN;
+  mixed_capturing = true;
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_mixed_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  mixed_stop();
+
+  return true;
+}
+
+bool fetch_mixed_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  uint32_t paired;
+  uint32_t missed;
+  uint32_t resyncs;
+
+  chSysLock();
+  paired = mixed_paired;
+  missed = mixed_missed;
+  resyncs = mixed_resyncs;
+  chSysUnlock();
+
+  util_message_bool(chp, "capturing", mixed_capturing);
+  if( mixed_port != NULL )
+  {
+    util_message_string_format(chp, "port", "%c", 'A' + UTIL_PIN_PORT_INDEX(mixed_port));
+  }
+  util_message_hex_uint16(chp, "mask", mixed_mask);
+  util_message_uint32(chp, "adc_dev", FETCH_MIXED_ADC_DEV);
+  util_message_uint32(chp, "paired", paired);
+  util_message_uint32(chp, "missed", missed);
+  util_message_uint32(chp, "resyncs", resyncs);
+
+  return true;
+}
+
+bool fetch_mixed_reset(BaseSequentialStream * chp)
+{
+  (void) chp;
+
+  mixed_stop();
+  mixed_port = NULL;
+  mixed_mask = 0xffff;
+
+  return true;
+}
+
+void fetch_mixed_init(void)
+{
+  memset(&mixed_gpt_cfg, 0, sizeof(mixed_gpt_cfg));
+
+  mixed_gpt_cfg.frequency = FETCH_MIXED_TIMER_FREQ;
+  mixed_gpt_cfg.callback = NULL;
+
+  mixed_dma = NULL;
+  mixed_port = NULL;
+  mixed_capturing = false;
+}
+
+/*! @} */
@@ -7,6 +7,7 @@
 #include "hal.h"
 #include "util_messages.h"
 #include "util_io.h"
+#include "util_pin_db.h"
 
 #include "fetch_defs.h"
 #include "fetch.h"
@@ -295,122 +296,48 @@ bool fetch_string_parser( const char * input_str, uint32_t max_input_len, char *
 
   delim = [\-_.:];
 
-  digital_port_pin    = 'D'i . 'IO'i? . delim? .
-                        (
-                          '0'? . '0' %{ pp->port = GPIOG; pp->pin = 0; } |
-                          '0'? . '1' %{ pp->port = GPIOG; pp->pin = 1; } |
-                          '0'? . '2' %{ pp->port = GPIOG; pp->pin = 2; } |
-                          '0'? . '3' %{ pp->port = GPIOG; pp->pin = 3; } |
-                          '0'? . '4' %{ pp->port = GPIOG; pp->pin = 4; } |
-                          '0'? . '5' %{ pp->port = GPIOG; pp->pin = 5; } |
-                          '0'? . '6' %{ pp->port = GPIOG; pp->pin = 6; } |
-                          '0'? . '7' %{ pp->port = GPIOG; pp->pin = 7; } |
-                          '0'? . '8' %{ pp->port = GPIOE; pp->pin = 0; } |
-                          '0'? . '9' %{ pp->port = GPIOE; pp->pin = 7; } |
-                          '10' %{ pp->port = GPIOE; pp->pin =  8; } |
-                          '11' %{ pp->port = GPIOF; pp->pin = 11; } |
-                          '12' %{ pp->port = GPIOF; pp->pin = 12; } |
-                          '13' %{ pp->port = GPIOF; pp->pin = 13; } |
-                          '14' %{ pp->port = GPIOF; pp->pin = 14; } |
-                          '15' %{ pp->port = GPIOF; pp->pin = 15; } |
-                          '16' %{ pp->port = GPIOH; pp->pin =  2; } |
-                          '17' %{ pp->port = GPIOH; pp->pin =  3; } |
-                          '18' %{ pp->port = GPIOH; pp->pin =  5; } |
-                          '19' %{ pp->port = GPIOH; pp->pin =  6; } |
-                          '20' %{ pp->port = GPIOH; pp->pin =  9; } |
-                          '21' %{ pp->port = GPIOH; pp->pin = 14; } |
-                          '22' %{ pp->port = GPIOB; pp->pin =  8; } |
-                          '23' %{ pp->port = GPIOB; pp->pin =  9; } |
-                          '24' %{ pp->port = GPIOE; pp->pin =  5; } |
-                          '25' %{ pp->port = GPIOE; pp->pin =  6; } |
-                          '26' %{ pp->port = GPIOE; pp->pin =  9; } |
-                          '27' %{ pp->port = GPIOE; pp->pin = 13; } |
-                          '28' %{ pp->port = GPIOH; pp->pin = 10; } |
-                          '29' %{ pp->port = GPIOH; pp->pin = 11; } |
-                          '30' %{ pp->port = GPIOH; pp->pin = 12; } |
-                          '31' %{ pp->port = GPIOA; pp->pin = 15; } |
-                          '32' %{ pp->port = GPIOI; pp->pin =  1; } |
-                          '33' %{ pp->port = GPIOI; pp->pin =  0; } |
-                          '34' %{ pp->port = GPIOI; pp->pin =  2; } |
-                          '35' %{ pp->port = GPIOI; pp->pin =  3; } |
-                          '36' %{ pp->port = GPIOH; pp->pin = 15; } |
-                          '37' %{ pp->port = GPIOD; pp->pin =  7; } |
-                          '38' %{ pp->port = GPIOG; pp->pin = 13; } |
-                          '39' %{ pp->port = GPIOG; pp->pin =  8; } |
-                          '40' %{ pp->port = GPIOG; pp->pin = 12; } |
-                          '41' %{ pp->port = GPIOG; pp->pin = 14; } |
-                          '42' %{ pp->port = GPIOG; pp->pin =  9; } |
-                          '43' %{ pp->port = GPIOG; pp->pin = 11; } |
-                          '44' %{ pp->port = GPIOF; pp->pin =  0; } |
-                          '45' %{ pp->port = GPIOF; pp->pin =  1; } |
-                          '46' %{ pp->port = GPIOE; pp->pin =  1; } |
-                          '47' %{ pp->port = GPIOG; pp->pin = 15; } |
-                          '48' %{ pp->port = GPIOA; pp->pin =  0; } |
-                          '49' %{ pp->port = GPIOA; pp->pin =  1; } |
-                          '50' %{ pp->port = GPIOE; pp->pin =  2; } |
-                          '51' %{ pp->port = GPIOE; pp->pin =  3; } |
-                          '52' %{ pp->port = GPIOD; pp->pin =  8; } |
-                          '53' %{ pp->port = GPIOD; pp->pin =  9; } |
-                          '54' %{ pp->port = GPIOD; pp->pin = 11; } |
-                          '55' %{ pp->port = GPIOD; pp->pin = 12; } |
-                          '56' %{ pp->port = GPIOD; pp->pin =  5; } |
-                          '57' %{ pp->port = GPIOD; pp->pin =  6; } |
-                          '58' %{ pp->port = GPIOD; pp->pin =  3; } |
-                          '59' %{ pp->port = GPIOD; pp->pin =  4; } |
-                          '60' %{ pp->port = GPIOI; pp->pin =  8; } |
-                          '61' %{ pp->port = GPIOI; pp->pin = 11; } |
-                          '62' %{ pp->port = GPIOD; pp->pin =  1; } |
-                          '63' %{ pp->port = GPIOG; pp->pin = 10; } |
-                          '64' %{ pp->port = GPIOB; pp->pin = 15; } |
-                          '65' %{ pp->port = GPIOI; pp->pin =  4; } |
-                          '66' %{ pp->port = GPIOD; pp->pin =  0; } |
-                          '67' %{ pp->port = GPIOC; pp->pin = 13; } |
-                          '68' %{ pp->port = GPIOI; pp->pin = 10; } |
-                          '69' %{ pp->port = GPIOB; pp->pin = 14; }
-                        );
-  timer_port_pin      = ( 'TIMER'i ) . delim? . 
-                        (
-                          ('0' . delim . '0') %{ pp->port = GPIOB; pp->pin =  8; } |
-                          ('0' . delim . '1') %{ pp->port = GPIOB; pp->pin =  9; } |
-                          ('1' . delim . '0') %{ pp->port = GPIOE; pp->pin =  5; } |
-                          ('1' . delim . '1') %{ pp->port = GPIOE; pp->pin =  6; } |
-                          ('2' . delim . '0') %{ pp->port = GPIOE; pp->pin =  9; } |
-                          ('2' . delim . '1') %{ pp->port = GPIOE; pp->pin = 13; } |
-                          ('3' . delim . '0') %{ pp->port = GPIOH; pp->pin = 10; } |
-                          ('3' . delim . '1') %{ pp->port = GPIOH; pp->pin = 11; } |
-                          ('3' . delim . '2') %{ pp->port = GPIOH; pp->pin = 12; } |
-                          ('4' . delim . '0') %{ pp->port = GPIOA; pp->pin = 15; } 
-                        );
-
-  spi_port_pin        = 'SPI'i . delim? .
-                        (
-                          '0' . delim? . 'SCK'i  %{ pp->port = GPIOI; pp->pin =  1; } | 
-                          '0' . delim? . 'MOSI'i %{ pp->port = GPIOI; pp->pin =  3; } | 
-                          '0' . delim? . 'MISO'i %{ pp->port = GPIOI; pp->pin =  2; } | 
-                          '0' . delim? . 'NSS'i  %{ pp->port = GPIOI; pp->pin =  0; } |
-                          '1' . delim? . 'SCK'i  %{ pp->port = GPIOG; pp->pin = 13; } | 
-                          '1' . delim? . 'MOSI'i %{ pp->port = GPIOG; pp->pin = 14; } | 
-                          '1' . delim? . 'MISO'i %{ pp->port = GPIOG; pp->pin = 12; } | 
-                          '1' . delim? . 'NSS'i  %{ pp->port = GPIOG; pp->pin =  8; }
-                        );
-  i2c_port_pin        = 'I2C'i . delim? . ( '0' . delim? )? .
-                        (
-                          'SDA'i %{ pp->port = GPIOF; pp->pin =  0; } |
-                          'SCL'i %{ pp->port = GPIOF; pp->pin =  1; }
-                        );
-  uart_port_pin       = ('UART'i | 'USART'i | 'SERIAL'i ) . delim? .
-                        (
-                          '0' . delim? . 'TX'i  %{ pp->port = GPIOA; pp->pin =  0; } |
-                          '0' . delim? . 'RX'i  %{ pp->port = GPIOA; pp->pin =  1; } |
-                          '1' . delim? . 'TX'i  %{ pp->port = GPIOD; pp->pin =  8; } |
-                          '1' . delim? . 'RX'i  %{ pp->port = GPIOD; pp->pin =  9; } |
-                          '1' . delim? . 'CTS'i %{ pp->port = GPIOD; pp->pin = 11; } |
-                          '1' . delim? . 'RTS'i %{ pp->port = GPIOD; pp->pin = 12; } |
-                          '2' . delim? . 'TX'i  %{ pp->port = GPIOD; pp->pin =  5; } |
-                          '2' . delim? . 'RX'i  %{ pp->port = GPIOD; pp->pin =  6; } |
-                          '2' . delim? . 'CTS'i %{ pp->port = GPIOD; pp->pin =  3; } |
-                          '2' . delim? . 'RTS'i %{ pp->port = GPIOD; pp->pin =  4; }
-                        );
+  # named pins only collect class, unit and signal, the board pin
+  # database (util_pin_db.c) maps them to a port and pin
+  action unit_digit   { pin_unit = pin_unit * 10 + (*p-'0'); }
+  action unit_start   { pin_unit = 0; }
+  action signal_digit { pin_signal = *p-'0'; }
+
+  action lookup_dio   { pin_idx = util_pin_lookup(UTIL_PIN_CLASS_DIO,   pin_unit, 0); }
+  action lookup_timer { pin_idx = util_pin_lookup(UTIL_PIN_CLASS_TIMER, pin_unit, pin_signal); }
+  action lookup_spi   { pin_idx = util_pin_lookup(UTIL_PIN_CLASS_SPI,   pin_unit, pin_signal); }
+  action lookup_i2c   { pin_idx = util_pin_lookup(UTIL_PIN_CLASS_I2C,   pin_unit, pin_signal); }
+  action lookup_uart  { pin_idx = util_pin_lookup(UTIL_PIN_CLASS_UART,  pin_unit, pin_signal); }
+
+  unit                = [0-9]{1,2} >unit_start $unit_digit;
+
+  digital_port_pin    = ( 'D'i . 'IO'i? . delim? . unit ) %lookup_dio;
+
+  timer_port_pin      = ( 'TIMER'i . delim? . unit . delim . [0-9] @signal_digit ) %lookup_timer;
+
+  spi_port_pin        = ( 'SPI'i . delim? . unit . delim? .
+                          (
+                            'SCK'i  @{ pin_signal = UTIL_PIN_SPI_SCK; }  |
+                            'MOSI'i @{ pin_signal = UTIL_PIN_SPI_MOSI; } |
+                            'MISO'i @{ pin_signal = UTIL_PIN_SPI_MISO; } |
+                            'NSS'i  @{ pin_signal = UTIL_PIN_SPI_NSS; }
+                          )
+                        ) %lookup_spi;
+
+  i2c_port_pin        = ( 'I2C'i . delim? . ( unit . delim? )? .
+                          (
+                            'SDA'i @{ pin_signal = UTIL_PIN_I2C_SDA; } |
+                            'SCL'i @{ pin_signal = UTIL_PIN_I2C_SCL; }
+                          )
+                        ) %lookup_i2c;
+
+  uart_port_pin       = ( ( 'UART'i | 'USART'i | 'SERIAL'i ) . delim? . unit . delim? .
+                          (
+                            'TX'i  @{ pin_signal = UTIL_PIN_UART_TX; }  |
+                            'RX'i  @{ pin_signal = UTIL_PIN_UART_RX; }  |
+                            'CTS'i @{ pin_signal = UTIL_PIN_UART_CTS; } |
+                            'RTS'i @{ pin_signal = UTIL_PIN_UART_RTS; }
+                          )
+                        ) %lookup_uart;
 
   main := ( stm_port_pin | digital_port_pin | timer_port_pin | spi_port_pin | i2c_port_pin | uart_port_pin ) . 0? @{ fbreak; };
 
@@ -424,6 +351,10 @@ bool fetch_gpio_parser( const char * input_str, uint32_t max_input_len, port_pin
   const char * pe = input_str + max_input_len;
   const char * eof = pe;
 
+  uint32_t pin_unit = 0;
+  uint32_t pin_signal = 0;
+  uint32_t pin_idx = UTIL_PIN_DB_NONE;
+
   // FIXME add chDbgAssert statements for pointers
 
   pp->port = NULL;
@@ -437,14 +368,25 @@ bool fetch_gpio_parser( const char * input_str, uint32_t max_input_len, port_pin
   %% write init;
   %% write exec;
 
+  if( pin_idx != UTIL_PIN_DB_NONE )
+  {
+    util_pin_port_pin(pin_idx, pp);
+  }
+
   fetch_parser_info.fsm_state = cs;
   fetch_parser_info.offset = (p-input_str);
   
-  if( cs >= %%{ write first_final; }%% )
+  if( cs >= %%{ write first_final; }%% && pp->port != NULL )
   {
     fetch_parser_info.error = false;
     return true;
   }
+  else if( cs >= %%{ write first_final; }%% )
+  {
+    fetch_parser_info.error = true;
+    fetch_parser_info.error_msg = "No such pin on this board";
+    return false;
+  }
   else
   {
     fetch_parser_info.error = true;
@@ -572,3 +514,120 @@ bool fetch_hex_string_parser( const char * input_str, uint32_t max_input_len, ch
   }
 }
 
+
+/*
+ * Script lexer, one token per call. The statements and expressions are
+ * compiled by fetch_script.c, commands inside a script go through
+ * fetch_command_parser as usual.
+ */
+
+#define SCRIPT_TOKEN(t) do{ \
+          tok->type = (t); tok->start = ts - input_str; tok->len = te - ts; \
+        }while(0)
+
+#define SCRIPT_OP(op) do{ \
+          SCRIPT_TOKEN(FETCH_SCRIPT_TOK_OP); tok->value = (op); \
+        }while(0)
+
+static int32_t script_number(const char * s, const char * e, uint32_t base)
+{
+  uint32_t value = 0;
+
+  for( ; s < e; s++ )
+  {
+    value = value * base + hex_value(*s);
+  }
+
+  return (int32_t)value;
+}
+
+%%{
+  machine fetch_script_lexer;
+
+  ident = ( '_' | alpha ) . ( '_' | '.' | alnum )*;
+  name  = ( '_' | alpha ) . ( '_' | alnum )*;
+
+  main := |*
+    [ \t\r\n]+;
+    '#' . [^\n]*;
+
+    # keywords before ident, the first pattern wins a tie
+    'repeat'          => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_REPEAT); fbreak; };
+    'while'           => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_WHILE); fbreak; };
+    'if'              => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_IF); fbreak; };
+    'else'            => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_ELSE); fbreak; };
+    'print'           => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_PRINT); fbreak; };
+    'echo'            => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_ECHO); fbreak; };
+    'wait'            => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_WAIT); fbreak; };
+    ident             => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_IDENT); fbreak; };
+    '$' . name        => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_VAR); fbreak; };
+    '@' . name        => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_CAPTURE); fbreak; };
+
+    digit+            => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_NUMBER); tok->value = script_number(ts, te, 10); fbreak; };
+    '0' [xX] xdigit+  => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_NUMBER); tok->value = script_number(ts + 2, te, 16); fbreak; };
+    '0' [bB] [01]+    => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_NUMBER); tok->value = script_number(ts + 2, te, 2); fbreak; };
+
+    '('               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_LPAREN); fbreak; };
+    ')'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_RPAREN); fbreak; };
+    '{'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_LBRACE); fbreak; };
+    '}'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_RBRACE); fbreak; };
+    '['               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_LBRACKET); fbreak; };
+    ']'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_RBRACKET); fbreak; };
+    ','               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_COMMA); fbreak; };
+    ';'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_SEMI); fbreak; };
+    '='               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_ASSIGN); fbreak; };
+    '!'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_NOT); fbreak; };
+    '~'               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_INV); fbreak; };
+
+    '||'              => { SCRIPT_OP(FETCH_SCRIPT_OP_LOR); fbreak; };
+    '&&'              => { SCRIPT_OP(FETCH_SCRIPT_OP_LAND); fbreak; };
+    '=='              => { SCRIPT_OP(FETCH_SCRIPT_OP_EQ); fbreak; };
+    '!='              => { SCRIPT_OP(FETCH_SCRIPT_OP_NE); fbreak; };
+    '<'               => { SCRIPT_OP(FETCH_SCRIPT_OP_LT); fbreak; };
+    '>'               => { SCRIPT_OP(FETCH_SCRIPT_OP_GT); fbreak; };
+    '<='              => { SCRIPT_OP(FETCH_SCRIPT_OP_LE); fbreak; };
+    '>='              => { SCRIPT_OP(FETCH_SCRIPT_OP_GE); fbreak; };
+    '|'               => { SCRIPT_OP(FETCH_SCRIPT_OP_OR); fbreak; };
+    '^'               => { SCRIPT_OP(FETCH_SCRIPT_OP_XOR); fbreak; };
+    '&'               => { SCRIPT_OP(FETCH_SCRIPT_OP_AND); fbreak; };
+    '<<'              => { SCRIPT_OP(FETCH_SCRIPT_OP_SHL); fbreak; };
+    '>>'              => { SCRIPT_OP(FETCH_SCRIPT_OP_SHR); fbreak; };
+    '+'               => { SCRIPT_OP(FETCH_SCRIPT_OP_ADD); fbreak; };
+    '-'               => { SCRIPT_OP(FETCH_SCRIPT_OP_SUB); fbreak; };
+    '*'               => { SCRIPT_OP(FETCH_SCRIPT_OP_MUL); fbreak; };
+    '/'               => { SCRIPT_OP(FETCH_SCRIPT_OP_DIV); fbreak; };
+    '%'               => { SCRIPT_OP(FETCH_SCRIPT_OP_MOD); fbreak; };
+
+    any               => { SCRIPT_TOKEN(FETCH_SCRIPT_TOK_INVALID); fbreak; };
+  *|;
+
+  write data;
+}%%
+
+/*! \brief scan the first token of the input
+ *
+ * Whitespace and # comments are skipped, FETCH_SCRIPT_TOK_END once the
+ * input is used up. tok->start is relative to input_str.
+ */
+bool fetch_script_lexer( const char * input_str, uint32_t max_input_len, fetch_script_token_t * tok )
+{
+  uint32_t cs;
+  int act;
+  const char * ts;
+  const char * te;
+  const char * p = input_str;
+  const char * pe = input_str + max_input_len;
+  const char * eof = pe;
+
+  tok->type = FETCH_SCRIPT_TOK_END;
+  tok->start = max_input_len;
+  tok->len = 0;
+  tok->value = 0;
+
+  %% write init;
+  %% write exec;
+
+  (void)act;
+
+  return tok->type != FETCH_SCRIPT_TOK_INVALID;
+}
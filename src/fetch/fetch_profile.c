@@ -0,0 +1,869 @@
+/*! \file fetch_profile.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Named configuration profiles in internal flash.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_profile Fetch Profile
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  A profile is a snapshot of the host visible peripheral setup:
+ *
+ *   - gpio module pins, mode/pull/type/speed/alternate function/latch
+ *   - spi configuration and which devices are started
+ *   - serial rates, started devices and timeouts
+ *   - adc trigger rates
+ *   - shell prompt and echo flags
+ *   - the ram buffer plan
+ *
+ *  Loading applies the snapshot in one go, gpio by direct register writes,
+ *  so a station is configured with a single profile.load. A profile marked
+ *  with profile.boot is loaded by fetch_init and again by the fetch reset
+ *  command.
+ *
+ *  Storage is a log in two flash sectors of bank 2. Every save, delete or
+ *  boot selection appends a CRC protected record to the active sector and
+ *  the newest record for a name wins, so a sector is erased only after it
+ *  filled up (a few hundred saves). Then the live records are copied to
+ *  the other sector, which is erased first and gets its header with the
+ *  next generation number last. A reset at any point leaves the old
+ *  sector, or the complete new one, as the newest valid sector.
+ *
+ *  Selecting a sector walks its log once and keeps the newest record of
+ *  each name in a ram index (FETCH_PROFILE_MAX_NAMES names), load, list
+ *  and compaction look names up there instead of rescanning flash.
+ *
+ *  Erasing a 128 kB sector takes 1-2 s, the save that triggers a
+ *  compaction takes that long.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_timestamp.h"
+#include "util_flash.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_gpio.h"
+#include "fetch_spi.h"
+#include "fetch_serial.h"
+#include "fetch_adc.h"
+#include "fetch_ram.h"
+#include "mshell.h"
+
+#include "fetch_profile.h"
+
+// last two 128 kB sectors of bank 2, far above the firmware image
+#ifndef FETCH_PROFILE_SECTOR_A
+#define FETCH_PROFILE_SECTOR_A      22
+#endif
+
+#ifndef FETCH_PROFILE_SECTOR_B
+#define FETCH_PROFILE_SECTOR_B      23
+#endif
+
+#define PROFILE_SECTOR_MAGIC        0x5350434d    // "MCPS"
+#define PROFILE_RECORD_MAGIC        0x5250434d    // "MCPR"
+#define PROFILE_DATA_VERSION        3
+
+#define PROFILE_NAME_CHARS          16
+
+// distinct profile names the store holds
+#ifndef FETCH_PROFILE_MAX_NAMES
+#define FETCH_PROFILE_MAX_NAMES     32
+#endif
+
+typedef enum {
+  PROFILE_RECORD_DATA = 1,
+  PROFILE_RECORD_DELETE,
+  PROFILE_RECORD_BOOT
+} profile_record_type_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t crc;
+} profile_sector_header_t;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t type;
+  uint16_t length;                  //!< payload bytes following the header
+  char name[PROFILE_NAME_CHARS];    //!< NUL padded
+  uint32_t crc;                     //!< over the header up to here and the payload
+} profile_record_header_t;
+
+typedef struct {
+  uint16_t version;
+  uint16_t size;
+  fetch_gpio_profile_t gpio;
+  fetch_spi_profile_t spi;
+  fetch_serial_profile_t serial;
+  fetch_adc_profile_t adc;
+  fetch_ram_profile_t ram;
+  uint8_t show_prompt;
+  uint8_t echo_chars;
+} profile_data_t;
+
+typedef struct {
+  uint32_t sector;
+  uint32_t base;
+  uint32_t size;
+  uint32_t generation;
+  uint32_t write_offset;          //!< first free byte, from the sector base
+  bool valid;
+} profile_store_t;
+
+/*
+ * The newest DATA record of each name and the newest BOOT record, built by
+ * one walk of the log when a sector is selected and kept current by
+ * profile_append. Lookups don't touch the log.
+ */
+typedef struct {
+  const profile_record_header_t * data[FETCH_PROFILE_MAX_NAMES];
+  uint32_t count;
+  const profile_record_header_t * boot;
+  bool overflow;                  //!< the log holds more names than fit
+} profile_index_t;
+
+static profile_store_t store;
+static profile_index_t profile_index;
+static profile_data_t profile_buffer;
+
+static const char * const profile_type_names[] = { "", "DATA", "DELETE", "BOOT" };
+
+/*
+ * CRC-32 (IEEE), a nibble at a time from a 16 entry table. The STM32 CRC
+ * unit computes a different (non reflected) CRC-32, it would orphan the
+ * stored profiles.
+ */
+static const uint32_t profile_crc32_table[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+  0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+  0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static uint32_t profile_crc32(uint32_t crc, const void * data, uint32_t length)
+{
+  const uint8_t * bytes = data;
+
+  crc = ~crc;
+
+  for( uint32_t i = 0; i < length; i++ )
+  {
+    crc ^= bytes[i];
+    crc = (crc >> 4) ^ profile_crc32_table[crc & 0xf];
+    crc = (crc >> 4) ^ profile_crc32_table[crc & 0xf];
+  }
+
+  return ~crc;
+}
+
+static uint32_t profile_record_crc(const profile_record_header_t * header, const void * payload)
+{
+  uint32_t crc = profile_crc32(0, header, offsetof(profile_record_header_t, crc));
+
+  return profile_crc32(crc, payload, header->length);
+}
+
+static uint32_t profile_record_size(uint32_t length)
+{
+  return sizeof(profile_record_header_t) + ((length + 3) & ~3U);
+}
+
+static bool profile_sector_header_valid(const profile_sector_header_t * header)
+{
+  return header->magic == PROFILE_SECTOR_MAGIC &&
+         header->crc == profile_crc32(0, header, offsetof(profile_sector_header_t, crc));
+}
+
+static bool profile_name_equal(const char * stored, const char * name)
+{
+  return strncmp(stored, name, PROFILE_NAME_CHARS) == 0;
+}
+
+/*
+ * Walk the records of the active sector. Returns the header at *offset and
+ * advances it, NULL at the end of the log. Records with a bad CRC are
+ * skipped, an unreadable length ends the walk.
+ */
+static const profile_record_header_t * profile_next_record(uint32_t * offset)
+{
+  while( *offset + sizeof(profile_record_header_t) <= store.size )
+  {
+    const profile_record_header_t * header = (const profile_record_header_t *)(store.base + *offset);
+
+    if( header->magic != PROFILE_RECORD_MAGIC )
+    {
+      return NULL;
+    }
+
+    uint32_t size = profile_record_size(header->length);
+
+    if( *offset + size > store.size )
+    {
+      return NULL;
+    }
+
+    *offset += size;
+
+    if( header->crc == profile_record_crc(header, header + 1) )
+    {
+      return header;
+    }
+  }
+
+  return NULL;
+}
+
+static int32_t profile_index_slot(const char * name)
+{
+  for( uint32_t i = 0; i < profile_index.count; i++ )
+  {
+    if( profile_name_equal(profile_index.data[i]->name, name) )
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * Account for a record newer than all indexed ones.
+ */
+static void profile_index_add(const profile_record_header_t * header)
+{
+  int32_t slot;
+
+  switch( header->type )
+  {
+    case PROFILE_RECORD_DATA:
+      if( (slot = profile_index_slot(header->name)) >= 0 )
+      {
+        profile_index.data[slot] = header;
+      }
+      else if( profile_index.count < FETCH_PROFILE_MAX_NAMES )
+      {
+        profile_index.data[profile_index.count++] = header;
+      }
+      else
+      {
+        profile_index.overflow = true;
+      }
+      break;
+    case PROFILE_RECORD_DELETE:
+      if( (slot = profile_index_slot(header->name)) >= 0 )
+      {
+        profile_index.count--;
+        memmove(&profile_index.data[slot], &profile_index.data[slot + 1],
+                (profile_index.count - slot) * sizeof(profile_index.data[0]));
+      }
+      break;
+    case PROFILE_RECORD_BOOT:
+      profile_index.boot = header;
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Newest record of a name: a DATA record, or NULL if the name was never
+ * saved or its last record is a DELETE.
+ */
+static const profile_record_header_t * profile_find(const char * name)
+{
+  int32_t slot = profile_index_slot(name);
+
+  return (slot < 0) ? NULL : profile_index.data[slot];
+}
+
+static const profile_record_header_t * profile_find_boot(void)
+{
+  return profile_index.boot;
+}
+
+static void profile_store_select(uint32_t sector, uint32_t generation)
+{
+  const profile_record_header_t * header;
+  uint32_t offset = sizeof(profile_sector_header_t);
+
+  store.sector = sector;
+  store.base = util_flash_sector_address(sector);
+  store.size = util_flash_sector_size(sector);
+  store.generation = generation;
+  store.valid = true;
+
+  memset(&profile_index, 0, sizeof(profile_index));
+
+  while( (header = profile_next_record(&offset)) != NULL )
+  {
+    profile_index_add(header);
+  }
+
+  store.write_offset = offset;
+
+  // a record whose length runs past the sector ends the walk early
+  header = (const profile_record_header_t *)(store.base + offset);
+
+  if( offset + sizeof(profile_record_header_t) <= store.size && header->magic == PROFILE_RECORD_MAGIC )
+  {
+    store.write_offset = store.size;
+  }
+
+  // the header of a record is written last, a save cut short by a reset
+  // leaves payload words behind the log, that tail is not reusable
+  for( offset = store.write_offset; offset < store.size; offset += sizeof(uint32_t) )
+  {
+    if( *(const uint32_t *)(store.base + offset) != UTIL_FLASH_ERASED_WORD )
+    {
+      store.write_offset = store.size;
+      break;
+    }
+  }
+}
+
+static bool profile_write_sector_header(uint32_t sector, uint32_t generation)
+{
+  profile_sector_header_t header;
+
+  header.magic = PROFILE_SECTOR_MAGIC;
+  header.generation = generation;
+  header.crc = profile_crc32(0, &header, offsetof(profile_sector_header_t, crc));
+
+  return util_flash_program(util_flash_sector_address(sector), (const uint32_t *) &header,
+                            sizeof(header) / sizeof(uint32_t));
+}
+
+static bool profile_write_record(uint32_t sector, uint32_t offset, const profile_record_header_t * header, const void * payload)
+{
+  uint32_t address = util_flash_sector_address(sector) + offset;
+  uint32_t tail[1];
+  uint32_t whole = header->length & ~3U;
+
+  if( !util_flash_program(address + sizeof(*header), payload, whole / sizeof(uint32_t)) )
+  {
+    return false;
+  }
+
+  if( header->length & 3 )
+  {
+    tail[0] = UTIL_FLASH_ERASED_WORD;
+    memcpy(tail, (const uint8_t *) payload + whole, header->length & 3);
+
+    if( !util_flash_program(address + sizeof(*header) + whole, tail, 1) )
+    {
+      return false;
+    }
+  }
+
+  // header last, the record only exists once its magic is written
+  return util_flash_program(address, (const uint32_t *) header, sizeof(*header) / sizeof(uint32_t));
+}
+
+/*! \brief find the newest valid sector, format the store if there is none
+ */
+static bool profile_store_open(void)
+{
+  const profile_sector_header_t * a = (const profile_sector_header_t *) util_flash_sector_address(FETCH_PROFILE_SECTOR_A);
+  const profile_sector_header_t * b = (const profile_sector_header_t *) util_flash_sector_address(FETCH_PROFILE_SECTOR_B);
+  bool a_valid = profile_sector_header_valid(a);
+  bool b_valid = profile_sector_header_valid(b);
+
+  store.valid = false;
+
+  if( a_valid && (!b_valid || (int32_t)(a->generation - b->generation) > 0) )
+  {
+    profile_store_select(FETCH_PROFILE_SECTOR_A, a->generation);
+  }
+  else if( b_valid )
+  {
+    profile_store_select(FETCH_PROFILE_SECTOR_B, b->generation);
+  }
+  else
+  {
+    if( !util_flash_erase_sector(FETCH_PROFILE_SECTOR_A) ||
+        !profile_write_sector_header(FETCH_PROFILE_SECTOR_A, 1) )
+    {
+      return false;
+    }
+
+    profile_store_select(FETCH_PROFILE_SECTOR_A, 1);
+  }
+
+  return true;
+}
+
+/*! \brief copy the live records into the other sector and make it active
+ *
+ * The live records are the newest DATA record of each name and the newest
+ * BOOT record, straight from the index.
+ */
+static bool profile_store_compact(void)
+{
+  uint32_t target = (store.sector == FETCH_PROFILE_SECTOR_A) ? FETCH_PROFILE_SECTOR_B : FETCH_PROFILE_SECTOR_A;
+  uint32_t target_offset = sizeof(profile_sector_header_t);
+  const profile_record_header_t * header;
+
+  // names missing from the index would be lost
+  if( profile_index.overflow || !util_flash_erase_sector(target) )
+  {
+    return false;
+  }
+
+  for( uint32_t i = 0; i <= profile_index.count; i++ )
+  {
+    header = (i < profile_index.count) ? profile_index.data[i] : profile_index.boot;
+
+    if( header == NULL )
+    {
+      continue;
+    }
+
+    if( !profile_write_record(target, target_offset, header, header + 1) )
+    {
+      return false;
+    }
+
+    target_offset += profile_record_size(header->length);
+  }
+
+  if( !profile_write_sector_header(target, store.generation + 1) )
+  {
+    return false;
+  }
+
+  profile_store_select(target, store.generation + 1);
+
+  return true;
+}
+
+static bool profile_append(profile_record_type_t type, const char * name, const void * payload, uint32_t length)
+{
+  profile_record_header_t header;
+
+  if( !store.valid && !profile_store_open() )
+  {
+    return false;
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.magic = PROFILE_RECORD_MAGIC;
+  header.type = type;
+  header.length = length;
+  strncpy(header.name, name, PROFILE_NAME_CHARS);
+  header.crc = profile_record_crc(&header, payload);
+
+  if( store.write_offset + profile_record_size(length) > store.size )
+  {
+    if( !profile_store_compact() || store.write_offset + profile_record_size(length) > store.size )
+    {
+      return false;
+    }
+  }
+
+  uint32_t offset = store.write_offset;
+
+  if( !profile_write_record(store.sector, offset, &header, payload) )
+  {
+    // the record may be half written, walk the log again
+    profile_store_select(store.sector, store.generation);
+    return false;
+  }
+
+  store.write_offset += profile_record_size(length);
+  profile_index_add((const profile_record_header_t *)(store.base + offset));
+
+  return true;
+}
+
+static bool profile_valid_name(const char * name)
+{
+  uint32_t length = strlen(name);
+
+  if( length == 0 || length >= PROFILE_NAME_CHARS || util_match_str((char *) name, "NONE") )
+  {
+    return false;
+  }
+
+  for( uint32_t i = 0; i < length; i++ )
+  {
+    char c = name[i];
+
+    if( !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-') )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void profile_capture(profile_data_t * data)
+{
+  bool show_prompt;
+  bool echo_chars;
+
+  memset(data, 0, sizeof(*data));
+
+  data->version = PROFILE_DATA_VERSION;
+  data->size = sizeof(*data);
+
+  fetch_gpio_profile_save(&data->gpio);
+  fetch_spi_profile_save(&data->spi);
+  fetch_serial_profile_save(&data->serial);
+  fetch_adc_profile_save(&data->adc);
+  fetch_ram_profile_save(&data->ram);
+
+  mshell_get_options(&show_prompt, &echo_chars);
+  data->show_prompt = show_prompt;
+  data->echo_chars = echo_chars;
+}
+
+/*
+ * Returns NULL, or why a part of the profile was not applied. The other
+ * parts are applied anyway.
+ */
+static const char * profile_apply(const profile_data_t * data)
+{
+  const char * error;
+
+  // first, moving serial queues needs the devices stopped
+  error = fetch_ram_profile_load(&data->ram);
+  fetch_gpio_profile_load(&data->gpio);
+  if( !fetch_spi_profile_load(&data->spi) && error == NULL )
+  {
+    error = "spi dma streams in use";
+  }
+  fetch_serial_profile_load(&data->serial);
+  fetch_adc_profile_load(&data->adc);
+  mshell_set_options(data->show_prompt, data->echo_chars);
+
+  return error;
+}
+
+/*
+ * Copy a stored profile out of flash, NULL on a format mismatch.
+ */
+static const profile_data_t * profile_read(const profile_record_header_t * header)
+{
+  const profile_data_t * stored = (const profile_data_t *)(header + 1);
+
+  if( header->length != sizeof(profile_data_t) ||
+      stored->version != PROFILE_DATA_VERSION ||
+      stored->size != sizeof(profile_data_t) )
+  {
+    return NULL;
+  }
+
+  memcpy(&profile_buffer, stored, sizeof(profile_buffer));
+
+  return &profile_buffer;
+}
+
+static bool profile_load_boot(void)
+{
+  const profile_record_header_t * boot;
+  const profile_record_header_t * header;
+  const profile_data_t * data;
+
+  if( !store.valid && !profile_store_open() )
+  {
+    return false;
+  }
+
+  boot = profile_find_boot();
+
+  if( boot == NULL || boot->name[0] == '\0' )
+  {
+    return true;
+  }
+
+  header = profile_find(boot->name);
+
+  if( header == NULL || (data = profile_read(header)) == NULL )
+  {
+    return false;
+  }
+
+  return profile_apply(data) == NULL;
+}
+
+bool fetch_profile_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Profile Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "save(<name>)");
+  FETCH_HELP_DES(chp, "Store gpio, spi, serial, adc rate and shell settings in flash");
+  FETCH_HELP_ARG(chp, "name", "up to 15 chars, letters, digits, '_' and '-'");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "load(<name>)");
+  FETCH_HELP_DES(chp, "Apply a stored profile");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "delete(<name>)");
+  FETCH_HELP_DES(chp, "Remove a stored profile");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "list");
+  FETCH_HELP_DES(chp, "List stored profiles");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "boot([<name> | NONE])");
+  FETCH_HELP_DES(chp, "Get/set the profile applied at boot and on reset");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "status");
+  FETCH_HELP_DES(chp, "Query flash store usage");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_profile_save_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  if( !profile_valid_name(argv[0]) )
+  {
+    util_message_error(chp, "invalid profile name");
+    return false;
+  }
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  if( profile_find(argv[0]) == NULL && profile_index.count >= FETCH_PROFILE_MAX_NAMES )
+  {
+    util_message_error(chp, "too many profiles, delete one first");
+    return false;
+  }
+
+  profile_capture(&profile_buffer);
+
+  if( !profile_append(PROFILE_RECORD_DATA, argv[0], &profile_buffer, sizeof(profile_buffer)) )
+  {
+    util_message_error(chp, "flash write failed");
+    return false;
+  }
+
+  util_message_uint32(chp, "size", sizeof(profile_buffer));
+
+  return true;
+}
+
+bool fetch_profile_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  const profile_record_header_t * header;
+  const profile_data_t * data;
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  if( (header = profile_find(argv[0])) == NULL )
+  {
+    util_message_error(chp, "profile not found");
+    return false;
+  }
+
+  if( (data = profile_read(header)) == NULL )
+  {
+    util_message_error(chp, "profile saved by another firmware version");
+    return false;
+  }
+
+  uint64_t start = util_timestamp_now();
+  const char * error = profile_apply(data);
+  uint64_t elapsed = util_timestamp_now() - start;
+
+  if( error != NULL )
+  {
+    util_message_error(chp, "%s", error);
+    return false;
+  }
+
+  util_message_uint32(chp, "load_us", elapsed / (UTIL_TIMESTAMP_FREQ / 1000000));
+
+  return true;
+}
+
+bool fetch_profile_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  if( profile_find(argv[0]) == NULL )
+  {
+    util_message_error(chp, "profile not found");
+    return false;
+  }
+
+  if( !profile_append(PROFILE_RECORD_DELETE, argv[0], NULL, 0) )
+  {
+    util_message_error(chp, "flash write failed");
+    return false;
+  }
+
+  return true;
+}
+
+bool fetch_profile_list_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  char name[PROFILE_NAME_CHARS + 1];
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  for( uint32_t i = 0; i < profile_index.count; i++ )
+  {
+    memcpy(name, profile_index.data[i]->name, PROFILE_NAME_CHARS);
+    name[PROFILE_NAME_CHARS] = '\0';
+    util_message_string_format(chp, "profile", "%s", name);
+  }
+
+  util_message_uint32(chp, "count", profile_index.count);
+
+  return true;
+}
+
+bool fetch_profile_boot_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  const profile_record_header_t * boot;
+  char name[PROFILE_NAME_CHARS + 1];
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  if( argc == 1 )
+  {
+    bool none = util_match_str(argv[0], "NONE");
+
+    if( !none && profile_find(argv[0]) == NULL )
+    {
+      util_message_error(chp, "profile not found");
+      return false;
+    }
+
+    if( !profile_append(PROFILE_RECORD_BOOT, none ? "" : argv[0], NULL, 0) )
+    {
+      util_message_error(chp, "flash write failed");
+      return false;
+    }
+  }
+
+  boot = profile_find_boot();
+
+  if( boot == NULL || boot->name[0] == '\0' )
+  {
+    util_message_string_format(chp, "boot", "NONE");
+  }
+  else
+  {
+    memcpy(name, boot->name, PROFILE_NAME_CHARS);
+    name[PROFILE_NAME_CHARS] = '\0';
+    util_message_string_format(chp, "boot", "%s", name);
+  }
+
+  return true;
+}
+
+bool fetch_profile_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  const profile_record_header_t * header;
+  uint32_t offset = sizeof(profile_sector_header_t);
+  uint32_t counts[4] = {0, 0, 0, 0};
+
+  if( !store.valid && !profile_store_open() )
+  {
+    util_message_error(chp, "profile store unavailable");
+    return false;
+  }
+
+  while( (header = profile_next_record(&offset)) != NULL )
+  {
+    if( header->type < 4 )
+    {
+      counts[header->type]++;
+    }
+  }
+
+  util_message_uint32(chp, "sector", store.sector);
+  util_message_hex_uint32(chp, "address", store.base);
+  util_message_uint32(chp, "generation", store.generation);
+  util_message_uint32(chp, "used", store.write_offset);
+  util_message_uint32(chp, "size", store.size);
+  util_message_uint32(chp, "profile_size", sizeof(profile_data_t));
+
+  for( uint32_t type = PROFILE_RECORD_DATA; type <= PROFILE_RECORD_BOOT; type++ )
+  {
+    util_message_uint32(chp, (char *) profile_type_names[type], counts[type]);
+  }
+
+  return true;
+}
+
+void fetch_profile_init(void)
+{
+  store.valid = false;
+
+  profile_load_boot();
+}
+
+/*! \brief reapply the boot profile after the modules were reset
+ */
+bool fetch_profile_reset(BaseSequentialStream * chp)
+{
+  (void) chp;
+
+  return profile_load_boot();
+}
+
+/*! @} */
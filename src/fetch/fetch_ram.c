@@ -0,0 +1,341 @@
+/*! \file fetch_ram.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Runtime split of buffer RAM.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_ram Fetch RAM
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  One static arena holds the buffers whose useful size depends on the
+ *  rig rather than on the firmware:
+ *
+ *   - serial receive queues, per device, 0 keeps the small queue built
+ *     into the ChibiOS driver (SERIAL_BUFFERS_SIZE)
+ *   - the adc sample set rings, the capture RAM of each adc device
+ *
+ *  ram.plan carves the arena in that order, so changing an adc ring does
+ *  not move the serial queues. A plan only applies when the buffers it
+ *  moves are idle: the adc of a moved ring stopped with the ring drained
+ *  by mpipe, and the affected serial devices stopped. Plans are part of
+ *  configuration profiles, so a boot profile sizes the buffers at start.
+ *
+ *  ram.status turns the split into limits: how long each ring bridges at
+ *  the configured adc rate, the highest adc rate that survives a
+ *  FETCH_RAM_STALL_MS consumer stall, and how long each started serial
+ *  queue takes to fill.
+ *
+ *  Thread stacks, the shell one included, stay static.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_serial.h"
+#include "fetch_ram.h"
+
+#ifndef FETCH_RAM_ARENA_SIZE
+#define FETCH_RAM_ARENA_SIZE        32768
+#endif
+
+// per device, together the size of the former shared pool
+#ifndef FETCH_RAM_ADC_RING_SETS
+#define FETCH_RAM_ADC_RING_SETS     64
+#endif
+
+// consumer stall an adc ring has to bridge for ram.status adc_max_rate
+#ifndef FETCH_RAM_STALL_MS
+#define FETCH_RAM_STALL_MS          20
+#endif
+
+#define RAM_ADC_SETS_MIN            4
+#define RAM_SERIAL_RX_MIN           16
+#define RAM_ALIGN(n)                (((n) + 7) & ~7U)
+
+typedef struct {
+  uint32_t serial_rx[FETCH_SERIAL_PROFILE_DEVICES];
+  uint32_t adc_ring[2];
+  uint32_t used;
+} ram_layout_t;
+
+static uint8_t ram_arena[FETCH_RAM_ARENA_SIZE] __attribute__((aligned(8)));
+static fetch_ram_profile_t ram_plan;
+static ram_layout_t ram_current;
+static bool ram_planned = false;
+
+/*
+ * Arena offsets for a plan, false if it does not fit.
+ */
+static bool ram_layout(const fetch_ram_profile_t * plan, ram_layout_t * layout)
+{
+  uint32_t offset = 0;
+
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    layout->serial_rx[dev] = offset;
+    offset += RAM_ALIGN(plan->serial_rx_size[dev]);
+  }
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    layout->adc_ring[dev] = offset;
+    offset += RAM_ALIGN(plan->adc_ring_sets[dev] * sizeof(adc_sample_set_t));
+  }
+
+  layout->used = offset;
+
+  return offset <= FETCH_RAM_ARENA_SIZE;
+}
+
+static bool ram_serial_moves(const fetch_ram_profile_t * plan, const ram_layout_t * layout, uint32_t dev)
+{
+  return !ram_planned ||
+         plan->serial_rx_size[dev] != ram_plan.serial_rx_size[dev] ||
+         (plan->serial_rx_size[dev] != 0 && layout->serial_rx[dev] != ram_current.serial_rx[dev]);
+}
+
+/*
+ * Apply a plan, NULL on success or the reason it was refused. With
+ * stop_serial, serial devices whose queue moves are stopped instead of
+ * refusing the plan.
+ */
+static const char * ram_apply(const fetch_ram_profile_t * plan, bool stop_serial)
+{
+  ram_layout_t layout;
+  bool adc_moves[2];
+
+  if( plan->adc_ring_sets[0] < RAM_ADC_SETS_MIN || plan->adc_ring_sets[1] < RAM_ADC_SETS_MIN )
+  {
+    return "invalid plan";
+  }
+
+  if( !ram_layout(plan, &layout) )
+  {
+    return "plan exceeds ram arena";
+  }
+
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    if( ram_serial_moves(plan, &layout, dev) && serial_drivers[dev]->state != SD_STOP )
+    {
+      if( !stop_serial )
+      {
+        return "serial device started, stop first";
+      }
+      sdStop(serial_drivers[dev]);
+    }
+  }
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    adc_moves[dev] = !ram_planned ||
+                     plan->adc_ring_sets[dev] != ram_plan.adc_ring_sets[dev] ||
+                     layout.adc_ring[dev] != ram_current.adc_ring[dev];
+  }
+
+  chSysLock();
+
+  // check both before loading either, a refused plan changes nothing
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    if( adc_moves[dev] && !fetch_adc_ring_idle_i(dev) )
+    {
+      chSysUnlock();
+      return "adc busy, stop streams first";
+    }
+  }
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    if( adc_moves[dev] )
+    {
+      fetch_adc_ring_load_i(dev, (adc_sample_set_t *)&ram_arena[layout.adc_ring[dev]], plan->adc_ring_sets[dev]);
+    }
+  }
+
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    if( ram_serial_moves(plan, &layout, dev) )
+    {
+      fetch_serial_rx_buffer_i(dev, plan->serial_rx_size[dev] ? &ram_arena[layout.serial_rx[dev]] : NULL,
+                               plan->serial_rx_size[dev]);
+    }
+  }
+
+  ram_plan = *plan;
+  ram_current = layout;
+  ram_planned = true;
+
+  chSysUnlock();
+
+  return NULL;
+}
+
+bool fetch_ram_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "RAM Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "plan([<adc0 sets>, <adc1 sets>[, <serial rx>...]])");
+  FETCH_HELP_DES(chp, "Get/set how the buffer arena is split");
+  FETCH_HELP_ARG(chp, "adc0 sets", "sample set ring size of adc device 0 {capture RAM}");
+  FETCH_HELP_ARG(chp, "adc1 sets", "sample set ring size of adc device 1 {capture RAM}");
+  FETCH_HELP_ARG(chp, "serial rx", "receive queue bytes for serial 0, 1, 2 {0 = driver default}");
+  FETCH_HELP_DES(chp, "adc streams and the resized serial devices must be stopped");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "status");
+  FETCH_HELP_DES(chp, "Query arena use and the resulting rate/depth limits");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_ram_plan_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2 + FETCH_SERIAL_PROFILE_DEVICES);
+
+  fetch_ram_profile_t plan;
+  const char * error;
+
+  if( argc > 0 )
+  {
+    FETCH_MIN_ARGS(chp, argc, 2);
+
+    memset(&plan, 0, sizeof(plan));
+
+    for( uint32_t dev = 0; dev < 2; dev++ )
+    {
+      if( !util_parse_uint32(argv[dev], &plan.adc_ring_sets[dev]) || plan.adc_ring_sets[dev] < RAM_ADC_SETS_MIN )
+      {
+        util_message_error(chp, "invalid adc sample set count");
+        return false;
+      }
+    }
+
+    for( uint32_t dev = 0; dev + 2 < argc; dev++ )
+    {
+      uint32_t size;
+
+      if( !util_parse_uint32(argv[dev + 2], &size) || (size != 0 && size < RAM_SERIAL_RX_MIN) )
+      {
+        util_message_error(chp, "invalid serial rx size");
+        return false;
+      }
+      plan.serial_rx_size[dev] = size;
+    }
+
+    ram_layout_t layout;
+
+    if( !ram_layout(&plan, &layout) )
+    {
+      util_message_error(chp, "plan needs %u of %u bytes", layout.used, FETCH_RAM_ARENA_SIZE);
+      return false;
+    }
+
+    if( (error = ram_apply(&plan, false)) != NULL )
+    {
+      util_message_error(chp, "%s", error);
+      return false;
+    }
+  }
+
+  util_message_uint32_array(chp, "adc_sets", ram_plan.adc_ring_sets, 2);
+  util_message_uint32_array(chp, "serial_rx", ram_plan.serial_rx_size, FETCH_SERIAL_PROFILE_DEVICES);
+
+  return true;
+}
+
+bool fetch_ram_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  uint32_t adc_sets[2];
+  uint32_t adc_buffer_ms[2];
+  uint32_t adc_max_rate[2];
+  uint32_t serial_rx[FETCH_SERIAL_PROFILE_DEVICES];
+  uint32_t serial_fill_ms[FETCH_SERIAL_PROFILE_DEVICES];
+
+  util_message_uint32(chp, "arena_size", FETCH_RAM_ARENA_SIZE);
+  util_message_uint32(chp, "arena_used", ram_current.used);
+
+  // capture depth per adc device
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    uint32_t rate = fetch_adc_sample_rate(dev);
+
+    adc_sets[dev] = fetch_adc_ring_count(dev);
+    adc_buffer_ms[dev] = rate ? (uint32_t)(((uint64_t)adc_sets[dev] * 1000) / rate) : 0;
+    adc_max_rate[dev] = (adc_sets[dev] * 1000) / FETCH_RAM_STALL_MS;
+  }
+  util_message_uint32_array(chp, "adc_sets", adc_sets, 2);
+  util_message_uint32(chp, "adc_set_bytes", sizeof(adc_sample_set_t));
+  util_message_uint32_array(chp, "adc_buffer_ms", adc_buffer_ms, 2);
+  util_message_uint32_array(chp, "adc_max_rate", adc_max_rate, 2);
+  util_message_uint32(chp, "stall_ms", FETCH_RAM_STALL_MS);
+
+  // 10 bit times per byte
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    uint32_t speed = fetch_serial_speed(dev);
+
+    serial_rx[dev] = fetch_serial_rx_size(dev);
+    serial_fill_ms[dev] = speed ? (uint32_t)(((uint64_t)serial_rx[dev] * 10 * 1000) / speed) : 0;
+  }
+  util_message_uint32_array(chp, "serial_rx", serial_rx, FETCH_SERIAL_PROFILE_DEVICES);
+  util_message_uint32_array(chp, "serial_fill_ms", serial_fill_ms, FETCH_SERIAL_PROFILE_DEVICES);
+
+  return true;
+}
+
+void fetch_ram_profile_save(fetch_ram_profile_t * profile)
+{
+  *profile = ram_plan;
+}
+
+/*! \brief apply a stored plan, NULL or the reason it was refused
+ */
+const char * fetch_ram_profile_load(const fetch_ram_profile_t * profile)
+{
+  // the serial profile restarts devices afterwards
+  return ram_apply(profile, true);
+}
+
+/*! \brief Carve the default plan, after the adc and serial modules are
+ *  initialized and before anything streams
+ */
+void fetch_ram_init(void)
+{
+  fetch_ram_profile_t plan;
+
+  memset(&plan, 0, sizeof(plan));
+  plan.adc_ring_sets[0] = FETCH_RAM_ADC_RING_SETS;
+  plan.adc_ring_sets[1] = FETCH_RAM_ADC_RING_SETS;
+
+  ram_planned = false;
+  ram_apply(&plan, true);
+}
+
+/*! @} */
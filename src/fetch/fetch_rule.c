@@ -0,0 +1,1298 @@
+/*! \file fetch_rule.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Event triggered action rules.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_rule Fetch Rule
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  A rule binds one trigger to one action and runs on the device, so the
+ *  reaction does not wait for a host round trip.
+ *
+ *  Triggers:
+ *
+ *   - EXTI:   edge on a gpio pin, one rule per EXTI line (pin number)
+ *   - ADC:    a channel of a streaming adc crosses a level
+ *   - TIMER:  periodic, TIM5 with a 1 us tick, one rule at a time
+ *   - SERIAL: a byte pattern arrives on a started serial device
+ *
+ *  Actions:
+ *
+ *   - SET, CLEAR, TOGGLE: gpio pin
+ *   - DAC:     internal dac value
+ *   - CAPTURE: start adc streaming
+ *   - FETCH:   any fetch command, parsed when the action is set
+ *
+ *  The fast actions (all but FETCH) run directly in the trigger interrupt,
+ *  a few hundred ns after the ISR entry. FETCH actions are handed to the
+ *  rule worker thread, which runs at HIGHPRIO and takes the fetch command
+ *  lock, so it waits for a shell command that is running. Their output is
+ *  kept per rule and read back with rule.result.
+ *
+ *  Serial patterns are matched by the worker as bytes are queued, without
+ *  consuming them, so the reaction time starts when the worker sees the
+ *  data rather than at the stop bit.
+ *
+ *  Every firing records the reaction time, trigger timestamp (ISR entry)
+ *  to action start, and the action run time, see rule.stats. A trigger
+ *  that fires while its FETCH action is still pending counts as overrun.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+#include "memstreams.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_timestamp.h"
+#include "util_io.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+#include "fetch_parser.h"
+
+#include "fetch_gpio.h"
+#include "fetch_adc.h"
+#include "fetch_serial.h"
+#include "fetch_rule.h"
+
+#ifndef FETCH_RULE_COUNT
+#define FETCH_RULE_COUNT            8
+#endif
+
+#ifndef FETCH_RULE_ACTION_CHARS
+#define FETCH_RULE_ACTION_CHARS     128
+#endif
+
+#ifndef FETCH_RULE_ACTION_TOKS
+#define FETCH_RULE_ACTION_TOKS      16
+#endif
+
+#ifndef FETCH_RULE_RESULT_CHARS
+#define FETCH_RULE_RESULT_CHARS     256
+#endif
+
+#ifndef FETCH_RULE_WA_SIZE
+#define FETCH_RULE_WA_SIZE          4096
+#endif
+
+#ifndef FETCH_RULE_PRIO
+#define FETCH_RULE_PRIO             HIGHPRIO
+#endif
+
+#define RULE_PATTERN_MAX            16
+#define RULE_TIMER_FREQ             1000000
+#define RULE_TIMER_MIN_PERIOD       10
+#define RULE_EXTI_LINES             16
+#define RULE_NONE                   (-1)
+#define RULE_EXTI_CLAIMED           (-2)
+
+#define RULE_EVENT_PENDING          EVENT_MASK(0)
+#define RULE_EVENT_SERIAL(dev)      EVENT_MASK(1 + (dev))
+
+#if FETCH_RULE_COUNT > 32
+#error "rule pending mask is 32 bits"
+#endif
+
+typedef enum {
+  RULE_TRIGGER_NONE,
+  RULE_TRIGGER_EXTI,
+  RULE_TRIGGER_ADC,
+  RULE_TRIGGER_TIMER,
+  RULE_TRIGGER_SERIAL
+} rule_trigger_t;
+
+typedef enum {
+  RULE_ACTION_NONE,
+  RULE_ACTION_SET,
+  RULE_ACTION_CLEAR,
+  RULE_ACTION_TOGGLE,
+  RULE_ACTION_DAC,
+  RULE_ACTION_CAPTURE,
+  RULE_ACTION_FETCH
+} rule_action_t;
+
+typedef enum {
+  RULE_EDGE_RISING,
+  RULE_EDGE_FALLING,
+  RULE_EDGE_BOTH
+} rule_edge_t;
+
+static const str_table_t rule_trigger_table[] = {
+  {"NONE",    RULE_TRIGGER_NONE},
+  {"EXTI",    RULE_TRIGGER_EXTI},
+  {"ADC",     RULE_TRIGGER_ADC},
+  {"TIMER",   RULE_TRIGGER_TIMER},
+  {"SERIAL",  RULE_TRIGGER_SERIAL},
+  {NULL, 0}
+};
+
+static const str_table_t rule_action_table[] = {
+  {"NONE",    RULE_ACTION_NONE},
+  {"SET",     RULE_ACTION_SET},
+  {"CLEAR",   RULE_ACTION_CLEAR},
+  {"TOGGLE",  RULE_ACTION_TOGGLE},
+  {"DAC",     RULE_ACTION_DAC},
+  {"CAPTURE", RULE_ACTION_CAPTURE},
+  {"FETCH",   RULE_ACTION_FETCH},
+  {NULL, 0}
+};
+
+static const str_table_t rule_edge_table[] = {
+  {"RISING",  RULE_EDGE_RISING},
+  {"FALLING", RULE_EDGE_FALLING},
+  {"BOTH",    RULE_EDGE_BOTH},
+  {NULL, 0}
+};
+
+static const uint32_t rule_exti_edge_mode[] = {
+  EXT_CH_MODE_RISING_EDGE,
+  EXT_CH_MODE_FALLING_EDGE,
+  EXT_CH_MODE_BOTH_EDGES
+};
+
+typedef struct {
+  ioportid_t port;
+  char name;
+  uint32_t exti_mode;
+} rule_port_t;
+
+static const rule_port_t rule_ports[] = {
+  {GPIOA, 'A', EXT_MODE_GPIOA},
+  {GPIOB, 'B', EXT_MODE_GPIOB},
+  {GPIOC, 'C', EXT_MODE_GPIOC},
+  {GPIOD, 'D', EXT_MODE_GPIOD},
+  {GPIOE, 'E', EXT_MODE_GPIOE},
+  {GPIOF, 'F', EXT_MODE_GPIOF},
+  {GPIOG, 'G', EXT_MODE_GPIOG},
+  {GPIOH, 'H', EXT_MODE_GPIOH},
+  {GPIOI, 'I', EXT_MODE_GPIOI}
+};
+
+#define RULE_PORT_COUNT   (sizeof(rule_ports)/sizeof(rule_ports[0]))
+
+typedef struct {
+  uint32_t count;
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+} rule_latency_t;
+
+typedef struct {
+  rule_trigger_t trigger;
+  rule_edge_t edge;
+  port_pin_t pin;
+  uint32_t dev;
+  uint32_t index;
+  uint16_t level;
+  int8_t adc_above;
+  uint32_t period;
+  uint8_t pattern[RULE_PATTERN_MAX];
+  uint8_t pattern_fail[RULE_PATTERN_MAX];
+  uint32_t pattern_len;
+  uint32_t match_len;
+
+  rule_action_t action;
+  port_pin_t action_pin;
+  uint32_t action_value;
+  fetch_func_t func;
+  uint32_t argc;
+  char * argv[FETCH_RULE_ACTION_TOKS + 1];
+  char tokens[FETCH_RULE_ACTION_CHARS + 1];
+  char source[FETCH_RULE_ACTION_CHARS + 1];
+
+  char result[FETCH_RULE_RESULT_CHARS];
+  uint32_t result_len;
+  bool result_ok;
+  bool result_valid;
+
+  bool enabled;
+  uint32_t remaining;
+  uint32_t fires;
+  uint32_t overruns;
+  uint64_t trigger_time;
+  rule_latency_t react;
+  rule_latency_t run;
+} rule_t;
+
+static rule_t rules[FETCH_RULE_COUNT];
+
+static volatile uint32_t rule_pending = 0;
+static int8_t rule_exti_line[RULE_EXTI_LINES];
+static int8_t rule_timer = RULE_NONE;
+static uint8_t * rule_serial_scan[FETCH_SERIAL_PROFILE_DEVICES];
+
+static thread_t * rule_worker_tp = NULL;
+static THD_WORKING_AREA(rule_worker_wa, FETCH_RULE_WA_SIZE);
+static event_listener_t rule_serial_listeners[FETCH_SERIAL_PROFILE_DEVICES];
+static MemoryStream rule_result_stream;
+
+static EXTConfig rule_ext_cfg;
+static GPTConfig rule_gpt_cfg;
+
+static const rule_port_t * rule_port_lookup(ioportid_t port)
+{
+  for( uint32_t i = 0; i < RULE_PORT_COUNT; i++ )
+  {
+    if( rule_ports[i].port == port )
+    {
+      return &rule_ports[i];
+    }
+  }
+  return NULL;
+}
+
+static void rule_latency_add(rule_latency_t * lat, uint64_t cycles)
+{
+  if( lat->count == 0 || cycles < lat->min )
+  {
+    lat->min = cycles;
+  }
+  if( cycles > lat->max )
+  {
+    lat->max = cycles;
+  }
+  lat->total += cycles;
+  lat->count++;
+}
+
+static uint32_t rule_cycles_to_ns(uint64_t cycles)
+{
+  uint64_t ns = (cycles * 1000) / (UTIL_TIMESTAMP_FREQ / 1000000);
+  return (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+}
+
+/*! \brief stop a trigger, called locked
+ */
+static void rule_disarm_i(rule_t * rule)
+{
+  if( !rule->enabled )
+  {
+    return;
+  }
+
+  switch( rule->trigger )
+  {
+    case RULE_TRIGGER_EXTI:
+      extChannelDisableI(&EXTD1, rule->pin.pin);
+      rule_exti_line[rule->pin.pin] = RULE_NONE;
+      break;
+    case RULE_TRIGGER_TIMER:
+      gptStopTimerI(&GPTD5);
+      rule_timer = RULE_NONE;
+      break;
+    default:
+      break;
+  }
+
+  rule->enabled = false;
+}
+
+static void rule_fast_action_i(rule_t * rule)
+{
+  switch( rule->action )
+  {
+    case RULE_ACTION_SET:
+      palSetPad(rule->action_pin.port, rule->action_pin.pin);
+      break;
+    case RULE_ACTION_CLEAR:
+      palClearPad(rule->action_pin.port, rule->action_pin.pin);
+      break;
+    case RULE_ACTION_TOGGLE:
+      palTogglePad(rule->action_pin.port, rule->action_pin.pin);
+      break;
+    case RULE_ACTION_DAC:
+      dacPutChannelX(&DACD1, 0, rule->action_value);
+      break;
+    case RULE_ACTION_CAPTURE:
+      fetch_adc_stream_start_i(rule->action_value);
+      break;
+    default:
+      break;
+  }
+}
+
+/*! \brief a trigger fired, called locked from ISRs and the worker
+ */
+static void rule_fire_i(uint32_t id, uint64_t timestamp)
+{
+  rule_t * rule = &rules[id];
+
+  if( !rule->enabled )
+  {
+    return;
+  }
+
+  rule->fires++;
+
+  if( rule->remaining > 0 && --rule->remaining == 0 )
+  {
+    rule_disarm_i(rule);
+  }
+
+  if( rule->action == RULE_ACTION_FETCH )
+  {
+    if( rule_pending & (1 << id) )
+    {
+      rule->overruns++;
+      return;
+    }
+    rule->trigger_time = timestamp;
+    rule_pending |= (1 << id);
+    chEvtSignalI(rule_worker_tp, RULE_EVENT_PENDING);
+  }
+  else
+  {
+    uint64_t start = util_timestamp_now();
+    rule_fast_action_i(rule);
+    uint64_t end = util_timestamp_now();
+
+    rule_latency_add(&rule->react, start - timestamp);
+    rule_latency_add(&rule->run, end - start);
+  }
+}
+
+static void rule_exti_cb(EXTDriver * extp, expchannel_t channel)
+{
+  uint64_t timestamp = util_timestamp_now();
+
+  (void) extp;
+
+  chSysLockFromISR();
+  if( channel < RULE_EXTI_LINES && rule_exti_line[channel] >= 0 )
+  {
+    rule_fire_i(rule_exti_line[channel], timestamp);
+  }
+  chSysUnlockFromISR();
+}
+
+static void rule_timer_cb(GPTDriver * gptp)
+{
+  uint64_t timestamp = util_timestamp_now();
+
+  (void) gptp;
+
+  chSysLockFromISR();
+  if( rule_timer != RULE_NONE )
+  {
+    rule_fire_i(rule_timer, timestamp);
+  }
+  chSysUnlockFromISR();
+}
+
+static void rule_adc_hook(uint32_t dev, const adcsample_t * samples, uint64_t timestamp)
+{
+  chSysLockFromISR();
+  for( uint32_t i = 0; i < FETCH_RULE_COUNT; i++ )
+  {
+    rule_t * rule = &rules[i];
+
+    if( !rule->enabled || rule->trigger != RULE_TRIGGER_ADC || rule->dev != dev )
+    {
+      continue;
+    }
+
+    int8_t above = (samples[rule->index] >= rule->level) ? 1 : 0;
+
+    if( rule->adc_above >= 0 && above != rule->adc_above )
+    {
+      if( rule->edge == RULE_EDGE_BOTH ||
+          (rule->edge == RULE_EDGE_RISING && above) ||
+          (rule->edge == RULE_EDGE_FALLING && !above) )
+      {
+        rule_fire_i(i, timestamp);
+      }
+    }
+    rule->adc_above = above;
+  }
+  chSysUnlockFromISR();
+}
+
+/*! \brief feed new serial bytes through the pattern matchers
+ *
+ * Only reads the input queue buffer, the bytes stay queued for serial.read.
+ */
+static void rule_serial_scan_dev(uint32_t dev)
+{
+  input_queue_t * iqp = &serial_drivers[dev]->iqueue;
+  uint8_t * wrptr;
+  uint8_t * p;
+  uint64_t timestamp = util_timestamp_now();
+
+  chSysLock();
+  wrptr = iqp->q_wrptr;
+  p = rule_serial_scan[dev];
+  // the queue storage moves when the ram plan changes
+  if( p != NULL && (p < iqp->q_buffer || p >= iqp->q_top) )
+  {
+    p = wrptr;
+  }
+  rule_serial_scan[dev] = wrptr;
+  chSysUnlock();
+
+  while( p != NULL && p != wrptr )
+  {
+    uint8_t byte = *p;
+
+    if( ++p >= iqp->q_top )
+    {
+      p = iqp->q_buffer;
+    }
+
+    chSysLock();
+    for( uint32_t i = 0; i < FETCH_RULE_COUNT; i++ )
+    {
+      rule_t * rule = &rules[i];
+
+      if( !rule->enabled || rule->trigger != RULE_TRIGGER_SERIAL || rule->dev != dev )
+      {
+        continue;
+      }
+
+      // KMP step, falls back along the pattern on a mismatch
+      while( rule->match_len > 0 && rule->pattern[rule->match_len] != byte )
+      {
+        rule->match_len = rule->pattern_fail[rule->match_len - 1];
+      }
+      if( rule->pattern[rule->match_len] == byte )
+      {
+        rule->match_len++;
+      }
+      if( rule->match_len == rule->pattern_len )
+      {
+        rule->match_len = rule->pattern_fail[rule->match_len - 1];
+        rule_fire_i(i, timestamp);
+      }
+    }
+    chSysUnlock();
+  }
+}
+
+static void rule_run_fetch(uint32_t id)
+{
+  rule_t * rule = &rules[id];
+
+  fetch_lock();
+
+  // the rule may have been changed while the action was pending
+  if( rule->action == RULE_ACTION_FETCH && rule->func != NULL )
+  {
+    uint64_t start = util_timestamp_now();
+
+    msObjectInit(&rule_result_stream, (uint8_t *)rule->result, FETCH_RULE_RESULT_CHARS, 0);
+    bool ok = rule->func((BaseSequentialStream *)&rule_result_stream, rule->argc, rule->argv);
+
+    uint64_t end = util_timestamp_now();
+
+    chSysLock();
+    rule->result_len = rule_result_stream.eos;
+    rule->result_ok = ok;
+    rule->result_valid = true;
+    rule_latency_add(&rule->react, start - rule->trigger_time);
+    rule_latency_add(&rule->run, end - start);
+    chSysUnlock();
+  }
+
+  chSysLock();
+  rule_pending &= ~(1 << id);
+  chSysUnlock();
+
+  fetch_unlock();
+}
+
+static void rule_worker_thread(void * p)
+{
+  (void) p;
+
+  chRegSetThreadName("rule");
+
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    chEvtRegisterMask(chnGetEventSource(serial_drivers[dev]), &rule_serial_listeners[dev], RULE_EVENT_SERIAL(dev));
+  }
+
+  while( true )
+  {
+    eventmask_t events = chEvtWaitAny(ALL_EVENTS);
+
+    for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+    {
+      if( events & RULE_EVENT_SERIAL(dev) )
+      {
+        eventflags_t flags = chEvtGetAndClearFlags(&rule_serial_listeners[dev]);
+
+        if( flags & CHN_INPUT_AVAILABLE )
+        {
+          rule_serial_scan_dev(dev);
+        }
+      }
+    }
+
+    chSysLock();
+    uint32_t pending = rule_pending;
+    chSysUnlock();
+
+    for( uint32_t id = 0; id < FETCH_RULE_COUNT; id++ )
+    {
+      if( pending & (1 << id) )
+      {
+        rule_run_fetch(id);
+      }
+    }
+  }
+}
+
+static void rule_clear_stats(rule_t * rule)
+{
+  chSysLock();
+  rule->fires = 0;
+  rule->overruns = 0;
+  memset(&rule->react, 0, sizeof(rule->react));
+  memset(&rule->run, 0, sizeof(rule->run));
+  chSysUnlock();
+}
+
+static void rule_delete(uint32_t id)
+{
+  rule_t * rule = &rules[id];
+
+  chSysLock();
+  rule_disarm_i(rule);
+  rule_pending &= ~(1 << id);
+  chSysUnlock();
+
+  memset(rule, 0, sizeof(*rule));
+}
+
+static bool parse_rule_id(BaseSequentialStream * chp, char * arg, uint32_t * id)
+{
+  if( !util_parse_uint32(arg, id) || *id >= FETCH_RULE_COUNT )
+  {
+    util_message_error(chp, "invalid rule id");
+    return false;
+  }
+  return true;
+}
+
+static bool parse_rule_pin(BaseSequentialStream * chp, char * arg, port_pin_t * pp)
+{
+  if( !fetch_gpio_parser(arg, FETCH_MAX_DATA_STRLEN, pp) )
+  {
+    util_message_error(chp, "invalid io pin");
+    return false;
+  }
+
+  if( !fetch_gpio_pin_allowed(pp->port, pp->pin) || rule_port_lookup(pp->port) == NULL )
+  {
+    util_message_error(chp, "restricted access io pin");
+    return false;
+  }
+  return true;
+}
+
+static void rule_print_trigger(BaseSequentialStream * chp, rule_t * rule)
+{
+  switch( rule->trigger )
+  {
+    case RULE_TRIGGER_EXTI:
+      util_message_string_format(chp, "trigger", "EXTI,P%c%u,%s", rule_port_lookup(rule->pin.port)->name,
+                                 rule->pin.pin, rule_edge_table[rule->edge].str);
+      break;
+    case RULE_TRIGGER_ADC:
+      util_message_string_format(chp, "trigger", "ADC,%u,%u,%u,%s", rule->dev, rule->index, rule->level,
+                                 rule_edge_table[rule->edge].str);
+      break;
+    case RULE_TRIGGER_TIMER:
+      util_message_string_format(chp, "trigger", "TIMER,%u", rule->period);
+      break;
+    case RULE_TRIGGER_SERIAL:
+      util_message_string_format(chp, "trigger", "SERIAL,%u", rule->dev);
+      util_message_hex_uint8_array(chp, "pattern", rule->pattern, rule->pattern_len);
+      break;
+    default:
+      util_message_string_format(chp, "trigger", "NONE");
+      break;
+  }
+}
+
+static void rule_print_action(BaseSequentialStream * chp, rule_t * rule)
+{
+  switch( rule->action )
+  {
+    case RULE_ACTION_SET:
+    case RULE_ACTION_CLEAR:
+    case RULE_ACTION_TOGGLE:
+      util_message_string_format(chp, "action", "%s,P%c%u", rule_action_table[rule->action].str,
+                                 rule_port_lookup(rule->action_pin.port)->name, rule->action_pin.pin);
+      break;
+    case RULE_ACTION_DAC:
+    case RULE_ACTION_CAPTURE:
+      util_message_string_format(chp, "action", "%s,%u", rule_action_table[rule->action].str, rule->action_value);
+      break;
+    case RULE_ACTION_FETCH:
+      util_message_string_format(chp, "action", "FETCH,%s", rule->source);
+      break;
+    default:
+      util_message_string_format(chp, "action", "NONE");
+      break;
+  }
+}
+
+static void rule_print_latency(BaseSequentialStream * chp, const char * name, rule_latency_t * lat)
+{
+  char label[24];
+
+  chsnprintf(label, sizeof(label), "%s_min_ns", name);
+  util_message_uint32(chp, label, rule_cycles_to_ns(lat->min));
+  chsnprintf(label, sizeof(label), "%s_avg_ns", name);
+  util_message_uint32(chp, label, lat->count ? rule_cycles_to_ns(lat->total / lat->count) : 0);
+  chsnprintf(label, sizeof(label), "%s_max_ns", name);
+  util_message_uint32(chp, label, rule_cycles_to_ns(lat->max));
+}
+
+bool fetch_rule_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Rule Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "trigger(<id>, EXTI, <io>, <edge>)");
+  FETCH_HELP_CMD(chp, "trigger(<id>, ADC, <dev>, <index>, <level>, <edge>)");
+  FETCH_HELP_CMD(chp, "trigger(<id>, TIMER, <period us>)");
+  FETCH_HELP_CMD(chp, "trigger(<id>, SERIAL, <dev>, <pattern>...)");
+  FETCH_HELP_DES(chp, "Set the event that fires a rule, the rule must be disabled");
+  FETCH_HELP_ARG(chp, "id", "0 ... 7");
+  FETCH_HELP_ARG(chp, "edge", "RISING | FALLING | BOTH {ADC: crossing the level}");
+  FETCH_HELP_ARG(chp, "index", "channel position in the adc sample set");
+  FETCH_HELP_ARG(chp, "pattern", "up to 16 bytes, same format as serial.write");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "action(<id>, SET | CLEAR | TOGGLE, <io>)");
+  FETCH_HELP_CMD(chp, "action(<id>, DAC, <value>)");
+  FETCH_HELP_CMD(chp, "action(<id>, CAPTURE, <dev>)");
+  FETCH_HELP_CMD(chp, "action(<id>, FETCH, <command>)");
+  FETCH_HELP_DES(chp, "Set what a rule does, all but FETCH run in the trigger interrupt");
+  FETCH_HELP_ARG(chp, "value", "internal dac value");
+  FETCH_HELP_ARG(chp, "command", "quoted fetch command, e.g. \"spi.exchange(1,h0f00)\"");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "enable(<id>[, <count>])");
+  FETCH_HELP_DES(chp, "Arm a rule, disarm after count firings {0 = never}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "disable(<id>)");
+  FETCH_HELP_DES(chp, "Disarm a rule");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "delete(<id>)");
+  FETCH_HELP_DES(chp, "Disarm and clear a rule");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "list");
+  FETCH_HELP_DES(chp, "List configured rules");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stats(<id>[, CLEAR])");
+  FETCH_HELP_DES(chp, "Query firings and reaction/run times");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "result(<id>)");
+  FETCH_HELP_DES(chp, "Query output of the last FETCH action");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "reset");
+  FETCH_HELP_DES(chp, "Delete all rules");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_rule_trigger_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 2);
+
+  uint32_t id;
+  uint32_t trigger;
+  uint32_t edge;
+  uint32_t value;
+  rule_t * rule;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+  rule = &rules[id];
+
+  if( rule->enabled )
+  {
+    util_message_error(chp, "rule enabled, disable first");
+    return false;
+  }
+
+  if( !util_match_str_table(argv[1], &trigger, rule_trigger_table) )
+  {
+    util_message_error(chp, "invalid trigger");
+    return false;
+  }
+
+  switch( trigger )
+  {
+    case RULE_TRIGGER_EXTI:
+    {
+      port_pin_t pp;
+
+      FETCH_MIN_ARGS(chp, argc, 4);
+      FETCH_MAX_ARGS(chp, argc, 4);
+
+      if( !parse_rule_pin(chp, argv[2], &pp) )
+      {
+        return false;
+      }
+      if( !util_match_str_table(argv[3], &edge, rule_edge_table) )
+      {
+        util_message_error(chp, "invalid edge");
+        return false;
+      }
+
+      rule->pin = pp;
+      rule->edge = edge;
+      break;
+    }
+    case RULE_TRIGGER_ADC:
+    {
+      uint32_t dev;
+      uint32_t index;
+
+      FETCH_MIN_ARGS(chp, argc, 6);
+      FETCH_MAX_ARGS(chp, argc, 6);
+
+      if( !util_parse_uint32(argv[2], &dev) || dev > 1 )
+      {
+        util_message_error(chp, "invalid adc device");
+        return false;
+      }
+      if( !util_parse_uint32(argv[3], &index) || index >= ADC_SAMPLE_SET_SIZE )
+      {
+        util_message_error(chp, "invalid sample index");
+        return false;
+      }
+      if( !util_parse_uint32(argv[4], &value) || value > 0xfff )
+      {
+        util_message_error(chp, "invalid level");
+        return false;
+      }
+      if( !util_match_str_table(argv[5], &edge, rule_edge_table) )
+      {
+        util_message_error(chp, "invalid edge");
+        return false;
+      }
+
+      rule->dev = dev;
+      rule->index = index;
+      rule->level = value;
+      rule->edge = edge;
+      break;
+    }
+    case RULE_TRIGGER_TIMER:
+      FETCH_MIN_ARGS(chp, argc, 3);
+      FETCH_MAX_ARGS(chp, argc, 3);
+
+      if( !util_parse_uint32(argv[2], &value) || value < RULE_TIMER_MIN_PERIOD )
+      {
+        util_message_error(chp, "invalid period");
+        return false;
+      }
+
+      rule->period = value;
+      break;
+    case RULE_TRIGGER_SERIAL:
+    {
+      uint8_t pattern[RULE_PATTERN_MAX];
+      uint32_t len = 0;
+      uint32_t dev;
+
+      FETCH_MIN_ARGS(chp, argc, 4);
+
+      if( !util_parse_uint32(argv[2], &dev) || dev >= FETCH_SERIAL_PROFILE_DEVICES )
+      {
+        util_message_error(chp, "invalid serial device");
+        return false;
+      }
+      if( !fetch_parse_bytes(chp, argc - 3, &argv[3], pattern, sizeof(pattern), &len) || len == 0 )
+      {
+        util_message_error(chp, "invalid pattern");
+        return false;
+      }
+
+      rule->dev = dev;
+      memcpy(rule->pattern, pattern, len);
+      rule->pattern_len = len;
+
+      // KMP failure table, longest proper prefix that is also a suffix
+      rule->pattern_fail[0] = 0;
+      for( uint32_t i = 1, k = 0; i < len; i++ )
+      {
+        while( k > 0 && pattern[i] != pattern[k] )
+        {
+          k = rule->pattern_fail[k - 1];
+        }
+        if( pattern[i] == pattern[k] )
+        {
+          k++;
+        }
+        rule->pattern_fail[i] = k;
+      }
+      break;
+    }
+    default:
+      FETCH_MAX_ARGS(chp, argc, 2);
+      break;
+  }
+
+  rule->trigger = trigger;
+
+  return true;
+}
+
+bool fetch_rule_action_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 2);
+
+  uint32_t id;
+  uint32_t action;
+  uint32_t value;
+  rule_t * rule;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+  rule = &rules[id];
+
+  if( rule->enabled )
+  {
+    util_message_error(chp, "rule enabled, disable first");
+    return false;
+  }
+
+  if( !util_match_str_table(argv[1], &action, rule_action_table) )
+  {
+    util_message_error(chp, "invalid action");
+    return false;
+  }
+
+  switch( action )
+  {
+    case RULE_ACTION_SET:
+    case RULE_ACTION_CLEAR:
+    case RULE_ACTION_TOGGLE:
+    {
+      port_pin_t pp;
+
+      FETCH_MIN_ARGS(chp, argc, 3);
+      FETCH_MAX_ARGS(chp, argc, 3);
+
+      if( !parse_rule_pin(chp, argv[2], &pp) )
+      {
+        return false;
+      }
+
+      rule->action_pin = pp;
+      break;
+    }
+    case RULE_ACTION_DAC:
+      FETCH_MIN_ARGS(chp, argc, 3);
+      FETCH_MAX_ARGS(chp, argc, 3);
+
+      if( !util_parse_uint32(argv[2], &value) || value > 0xfff )
+      {
+        util_message_error(chp, "invalid dac value");
+        return false;
+      }
+
+      rule->action_value = value;
+      break;
+    case RULE_ACTION_CAPTURE:
+      FETCH_MIN_ARGS(chp, argc, 3);
+      FETCH_MAX_ARGS(chp, argc, 3);
+
+      if( !util_parse_uint32(argv[2], &value) || value > 1 )
+      {
+        util_message_error(chp, "invalid adc device");
+        return false;
+      }
+
+      rule->action_value = value;
+      break;
+    case RULE_ACTION_FETCH:
+    {
+      uint32_t len = 0;
+
+      FETCH_MIN_ARGS(chp, argc, 3);
+      FETCH_MAX_ARGS(chp, argc, 3);
+
+      if( !fetch_parse_bytes(chp, 1, &argv[2], (uint8_t *)rule->source, FETCH_RULE_ACTION_CHARS, &len) )
+      {
+        util_message_error(chp, "invalid command string");
+        return false;
+      }
+      rule->source[len] = '\0';
+
+      if( !fetch_command_parser(rule->source, FETCH_RULE_ACTION_CHARS, rule->tokens, FETCH_RULE_ACTION_CHARS,
+                                &rule->func, &rule->argc, rule->argv, FETCH_RULE_ACTION_TOKS) || rule->func == NULL )
+      {
+        util_message_error(chp, "error parsing fetch command");
+        util_message_error(chp, "offset: %d", fetch_parser_info.offset);
+        util_message_error(chp, "error_msg: %s", fetch_parser_info.error_msg);
+        rule->func = NULL;
+        rule->action = RULE_ACTION_NONE;
+        return false;
+      }
+      rule->argv[rule->argc] = NULL;
+      rule->result_valid = false;
+      break;
+    }
+    default:
+      FETCH_MAX_ARGS(chp, argc, 2);
+      break;
+  }
+
+  rule->action = action;
+
+  return true;
+}
+
+bool fetch_rule_enable_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 2);
+
+  uint32_t id;
+  uint32_t count = 0;
+  rule_t * rule;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+  rule = &rules[id];
+
+  if( argc == 2 && !util_parse_uint32(argv[1], &count) )
+  {
+    util_message_error(chp, "invalid count");
+    return false;
+  }
+
+  if( rule->enabled )
+  {
+    util_message_error(chp, "rule already enabled");
+    return false;
+  }
+
+  if( rule->trigger == RULE_TRIGGER_NONE || rule->action == RULE_ACTION_NONE )
+  {
+    util_message_error(chp, "rule needs a trigger and an action");
+    return false;
+  }
+
+  rule->remaining = count;
+
+  switch( rule->trigger )
+  {
+    case RULE_TRIGGER_EXTI:
+    {
+      EXTChannelConfig ch_cfg;
+
+      if( rule_exti_line[rule->pin.pin] == RULE_EXTI_CLAIMED )
+      {
+        util_message_error(chp, "exti line %u used by another module", rule->pin.pin);
+        return false;
+      }
+
+      if( rule_exti_line[rule->pin.pin] != RULE_NONE )
+      {
+        util_message_error(chp, "exti line %u used by rule %d", rule->pin.pin, rule_exti_line[rule->pin.pin]);
+        return false;
+      }
+
+      ch_cfg.mode = rule_exti_edge_mode[rule->edge] | EXT_CH_MODE_AUTOSTART | rule_port_lookup(rule->pin.port)->exti_mode;
+      ch_cfg.cb = rule_exti_cb;
+
+      chSysLock();
+      rule_exti_line[rule->pin.pin] = id;
+      rule->enabled = true;
+      chSysUnlock();
+
+      extSetChannelMode(&EXTD1, rule->pin.pin, &ch_cfg);
+      break;
+    }
+    case RULE_TRIGGER_ADC:
+      chSysLock();
+      rule->adc_above = -1;
+      rule->enabled = true;
+      chSysUnlock();
+      break;
+    case RULE_TRIGGER_TIMER:
+      if( rule_timer != RULE_NONE )
+      {
+        util_message_error(chp, "timer used by rule %d", rule_timer);
+        return false;
+      }
+
+      chSysLock();
+      rule_timer = id;
+      rule->enabled = true;
+      gptStartContinuousI(&GPTD5, rule->period);
+      chSysUnlock();
+      break;
+    case RULE_TRIGGER_SERIAL:
+      chSysLock();
+      rule->match_len = 0;
+      // only bytes received from now on
+      rule_serial_scan[rule->dev] = serial_drivers[rule->dev]->iqueue.q_wrptr;
+      rule->enabled = true;
+      chSysUnlock();
+      break;
+    default:
+      break;
+  }
+
+  return true;
+}
+
+bool fetch_rule_disable_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  chSysLock();
+  rule_disarm_i(&rules[id]);
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_rule_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  rule_delete(id);
+
+  return true;
+}
+
+bool fetch_rule_list_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  for( uint32_t id = 0; id < FETCH_RULE_COUNT; id++ )
+  {
+    rule_t * rule = &rules[id];
+
+    if( rule->trigger == RULE_TRIGGER_NONE && rule->action == RULE_ACTION_NONE )
+    {
+      continue;
+    }
+
+    util_message_uint32(chp, "id", id);
+    rule_print_trigger(chp, rule);
+    rule_print_action(chp, rule);
+    util_message_bool(chp, "enabled", rule->enabled);
+    util_message_uint32(chp, "remaining", rule->remaining);
+  }
+
+  return true;
+}
+
+bool fetch_rule_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 2);
+
+  uint32_t id;
+  uint32_t fires;
+  uint32_t overruns;
+  rule_latency_t react;
+  rule_latency_t run;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  if( argc == 2 )
+  {
+    if( !util_match_str(argv[1], "CLEAR") )
+    {
+      util_message_error(chp, "invalid option");
+      return false;
+    }
+    rule_clear_stats(&rules[id]);
+    return true;
+  }
+
+  chSysLock();
+  fires = rules[id].fires;
+  overruns = rules[id].overruns;
+  react = rules[id].react;
+  run = rules[id].run;
+  chSysUnlock();
+
+  util_message_uint32(chp, "fires", fires);
+  util_message_uint32(chp, "overruns", overruns);
+  util_message_uint32(chp, "runs", run.count);
+  rule_print_latency(chp, "react", &react);
+  rule_print_latency(chp, "run", &run);
+
+  return true;
+}
+
+bool fetch_rule_result_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+  rule_t * rule;
+
+  if( !parse_rule_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+  rule = &rules[id];
+
+  if( rule->action != RULE_ACTION_FETCH || !rule->result_valid )
+  {
+    util_message_error(chp, "no fetch action result");
+    return false;
+  }
+
+  // the worker only writes results while holding the command lock
+  util_message_bool(chp, "success", rule->result_ok);
+  util_message_string_escape(chp, "output", rule->result, rule->result_len);
+  if( rule->result_len >= FETCH_RULE_RESULT_CHARS )
+  {
+    util_message_warning(chp, "output truncated");
+  }
+
+  return true;
+}
+
+bool fetch_rule_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  return fetch_rule_reset(chp);
+}
+
+void fetch_rule_init(void)
+{
+  memset(rules, 0, sizeof(rules));
+  memset(rule_serial_scan, 0, sizeof(rule_serial_scan));
+  memset(rule_exti_line, RULE_NONE, sizeof(rule_exti_line));
+  rule_timer = RULE_NONE;
+  rule_pending = 0;
+
+  // channels are set per rule with extSetChannelMode
+  memset(&rule_ext_cfg, 0, sizeof(rule_ext_cfg));
+  extStart(&EXTD1, &rule_ext_cfg);
+
+  memset(&rule_gpt_cfg, 0, sizeof(rule_gpt_cfg));
+  rule_gpt_cfg.frequency = RULE_TIMER_FREQ;
+  rule_gpt_cfg.callback = rule_timer_cb;
+  gptStart(&GPTD5, &rule_gpt_cfg);
+
+  fetch_adc_set_sample_hook(rule_adc_hook);
+
+  if( rule_worker_tp == NULL )
+  {
+    rule_worker_tp = chThdCreateStatic(rule_worker_wa, sizeof(rule_worker_wa), FETCH_RULE_PRIO, rule_worker_thread, NULL);
+  }
+}
+
+/*! \brief Hand an exti line to another module
+ *
+ * EXTD1 is started here, other modules get a line of it through this
+ * call so rules and they can not take the same line. Fails if a rule or
+ * another module has the line.
+ */
+bool fetch_rule_exti_claim(ioportid_t port, uint32_t pin, uint32_t edge_mode, extcallback_t cb)
+{
+  const rule_port_t * rp = rule_port_lookup(port);
+  EXTChannelConfig ch_cfg;
+
+  if( rp == NULL || pin >= RULE_EXTI_LINES )
+  {
+    return false;
+  }
+
+  chSysLock();
+  if( rule_exti_line[pin] != RULE_NONE )
+  {
+    chSysUnlock();
+    return false;
+  }
+  rule_exti_line[pin] = RULE_EXTI_CLAIMED;
+  chSysUnlock();
+
+  ch_cfg.mode = edge_mode | EXT_CH_MODE_AUTOSTART | rp->exti_mode;
+  ch_cfg.cb = cb;
+  extSetChannelMode(&EXTD1, pin, &ch_cfg);
+
+  return true;
+}
+
+/*! \brief Give back a line taken with fetch_rule_exti_claim
+ */
+void fetch_rule_exti_release(uint32_t pin)
+{
+  if( pin >= RULE_EXTI_LINES )
+  {
+    return;
+  }
+
+  chSysLock();
+  if( rule_exti_line[pin] == RULE_EXTI_CLAIMED )
+  {
+    extChannelDisableI(&EXTD1, pin);
+    rule_exti_line[pin] = RULE_NONE;
+  }
+  chSysUnlock();
+}
+
+bool fetch_rule_reset(BaseSequentialStream * chp)
+{
+  (void) chp;
+
+  for( uint32_t id = 0; id < FETCH_RULE_COUNT; id++ )
+  {
+    rule_delete(id);
+  }
+
+  return true;
+}
+
+/*! @} */
@@ -0,0 +1,1553 @@
+/*! \file fetch_script.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Compiled command scripts with loops, variables and result capture.
+  *
+  * \sa fetch_parser.rl
+  * @defgroup fetch_script Fetch Script
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  A script is compiled once by script.load into a small bytecode
+ *  program and run by script.run, so a polling loop costs one command
+ *  handler call plus a few VM steps per pass instead of a host round trip.
+ *
+ *  Example, write a register, poll a status bit, read four bytes:
+ *
+ *    spi.exchange(0, DIO4, 0, 0x06)
+ *    spi.exchange(0, DIO4, 0, 0x05, 0)
+ *    $n = 0
+ *    while((@rx[1] & 0x01) == 0, 50) { spi.exchange(0, DIO4, 0, 0x05, 0); $n = $n + 1 }
+ *    spi.exchange(0, DIO4, 0, 0x03, 0, 0, 0, 0, 0, 0, 0)
+ *    echo
+ *    print($n)
+ *
+ *  Statements, separated by whitespace or ';':
+ *
+ *   - command[(args)]       any fetch command, arguments may use $vars
+ *   - $var = expr
+ *   - repeat(expr) { ... }
+ *   - while(cond[, timeout ms]) { ... }, the timeout is a run error
+ *   - if(cond) { ... } [else { ... }]
+ *   - print(expr[, ...])    S32:print:<values>
+ *   - echo                  forward the output of the last command
+ *   - wait(ms)
+ *
+ *  Expressions are 32 bit signed: numbers (decimal, 0x, 0b), $vars,
+ *  @name[index] and the C operators - ! ~ * / % + - << >> & ^ | == !=
+ *  < > <= >= && ||, with the bitwise operators binding tighter than the
+ *  compares, so '$s & 0x80 == 0' reads as expected. >> is logical.
+ *
+ *  Command output is not forwarded, it is kept as the capture buffer.
+ *  @name[index] reads value <index> of the last '<type>:<name>:' line
+ *  in it, hex for H types, so '@rx[1]' is the second byte spi.exchange
+ *  received. Reading a value the last command did not report, or a
+ *  failing command, ends the run; the failing command's output is
+ *  forwarded.
+ *
+ *  Commands without variables are parsed at load time; with variables
+ *  they keep a template that is expanded and parsed when they run.
+ *  Scripts run under the command lock, so a rule FETCH action can run
+ *  one too. Loops are cancellation points of +abort.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+#include "memstreams.h"
+
+#include "mshell_sync.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_timestamp.h"
+#include "util_io.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+#include "fetch_parser.h"
+
+#include "fetch_script.h"
+
+#ifndef FETCH_SCRIPT_COUNT
+#define FETCH_SCRIPT_COUNT          4
+#endif
+
+#ifndef FETCH_SCRIPT_CODE_WORDS
+#define FETCH_SCRIPT_CODE_WORDS     256
+#endif
+
+// parsed command tokens, templates and capture names
+#ifndef FETCH_SCRIPT_POOL_CHARS
+#define FETCH_SCRIPT_POOL_CHARS     1024
+#endif
+
+#ifndef FETCH_SCRIPT_COMMANDS
+#define FETCH_SCRIPT_COMMANDS       16
+#endif
+
+#ifndef FETCH_SCRIPT_CMD_TOKS
+#define FETCH_SCRIPT_CMD_TOKS       16
+#endif
+
+// including one hidden counter per repeat
+#ifndef FETCH_SCRIPT_VARS
+#define FETCH_SCRIPT_VARS           16
+#endif
+
+#ifndef FETCH_SCRIPT_STACK
+#define FETCH_SCRIPT_STACK          16
+#endif
+
+// nested blocks and parentheses
+#ifndef FETCH_SCRIPT_DEPTH
+#define FETCH_SCRIPT_DEPTH          16
+#endif
+
+// while loops with a timeout
+#ifndef FETCH_SCRIPT_TIMERS
+#define FETCH_SCRIPT_TIMERS         4
+#endif
+
+#ifndef FETCH_SCRIPT_CAPTURE_CHARS
+#define FETCH_SCRIPT_CAPTURE_CHARS  512
+#endif
+
+#ifndef FETCH_SCRIPT_NAME_CHARS
+#define FETCH_SCRIPT_NAME_CHARS     12
+#endif
+
+#define SCRIPT_PRINT_MAX            8
+
+#if FETCH_SCRIPT_POOL_CHARS > 0xffff
+#error FETCH_SCRIPT_POOL_CHARS should fit the uint16_t pool offsets
+#endif
+
+// marks a variable in a command template, followed by the slot + 1
+#define SCRIPT_VAR_MARK             '\x01'
+
+// one code word: opcode in the low byte, argument above it
+#define SCRIPT_WORD(op, arg)        ((uint32_t)(op) | ((uint32_t)(arg) << 8))
+#define SCRIPT_WORD_OP(w)           ((w) & 0xff)
+#define SCRIPT_WORD_ARG(w)          ((w) >> 8)
+
+typedef enum {
+  SCRIPT_END,
+  SCRIPT_PUSH,        //!< next word is the value
+  SCRIPT_LOAD,        //!< arg var slot
+  SCRIPT_STORE,       //!< arg var slot, pops
+  SCRIPT_DEC,         //!< arg var slot
+  SCRIPT_BINARY,      //!< arg fetch_script_op_t, pops two, pushes one
+  SCRIPT_NEG,
+  SCRIPT_NOT,
+  SCRIPT_INV,
+  SCRIPT_JMP,         //!< arg target
+  SCRIPT_JZ,          //!< arg target, pops
+  SCRIPT_LOOP,        //!< arg target, backward jump and cancellation point
+  SCRIPT_CMD,         //!< arg command index
+  SCRIPT_CAPTURE,     //!< arg pool offset of the name, pops the index
+  SCRIPT_PRINT,       //!< arg value count, pops them
+  SCRIPT_ECHO,
+  SCRIPT_WAIT,        //!< pops ms
+  SCRIPT_ARM,         //!< arg timer, pops ms
+  SCRIPT_EXPIRED      //!< arg timer
+} script_opcode_t;
+
+typedef struct {
+  fetch_func_t func;                            //!< NULL for a template
+  uint16_t argc;
+  uint16_t text;                                //!< pool offset of the template
+  uint16_t argv[FETCH_SCRIPT_CMD_TOKS];         //!< pool offsets of the tokens
+} script_cmd_t;
+
+/*
+ * Only offsets, no pointers, so a compiled script can be copied.
+ */
+typedef struct {
+  bool loaded;
+  uint16_t code_len;
+  uint16_t pool_len;
+  uint8_t cmd_count;
+  uint8_t var_count;
+  uint8_t timer_count;
+  uint8_t stack_max;
+  uint32_t code[FETCH_SCRIPT_CODE_WORDS];
+  char pool[FETCH_SCRIPT_POOL_CHARS];
+  script_cmd_t cmds[FETCH_SCRIPT_COMMANDS];
+  char var_names[FETCH_SCRIPT_VARS][FETCH_SCRIPT_NAME_CHARS];  //!< "" for repeat counters
+  int32_t vars[FETCH_SCRIPT_VARS];              //!< values after the last run
+  uint32_t runs;
+  uint32_t steps;
+  uint32_t time_us;
+  bool ok;
+} script_t;
+
+typedef struct {
+  BaseSequentialStream * chp;
+  const char * src;
+  uint32_t len;
+  uint32_t pos;                                 //!< lexer position after tok
+  fetch_script_token_t tok;                     //!< current token, start is absolute
+  script_t * s;
+  uint32_t sp;                                  //!< stack depth at this point of the code
+  uint32_t depth;
+} script_compiler_t;
+
+static script_t scripts[FETCH_SCRIPT_COUNT];
+
+// compile target, copied to the slot on success
+static script_t script_scratch;
+
+// the VM runs under the command lock, one at a time
+static char script_line[FETCH_MAX_LINE_CHARS + 1];
+static char script_tokens[FETCH_MAX_LINE_CHARS + 1];
+static char script_capture[FETCH_SCRIPT_CAPTURE_CHARS];
+static uint32_t script_capture_len;
+static MemoryStream script_capture_stream;
+
+static const uint8_t script_prec[FETCH_SCRIPT_OP_COUNT] = {
+  [FETCH_SCRIPT_OP_LOR]  = 1,
+  [FETCH_SCRIPT_OP_LAND] = 2,
+  [FETCH_SCRIPT_OP_EQ]   = 3,
+  [FETCH_SCRIPT_OP_NE]   = 3,
+  [FETCH_SCRIPT_OP_LT]   = 3,
+  [FETCH_SCRIPT_OP_GT]   = 3,
+  [FETCH_SCRIPT_OP_LE]   = 3,
+  [FETCH_SCRIPT_OP_GE]   = 3,
+  [FETCH_SCRIPT_OP_OR]   = 4,
+  [FETCH_SCRIPT_OP_XOR]  = 5,
+  [FETCH_SCRIPT_OP_AND]  = 6,
+  [FETCH_SCRIPT_OP_SHL]  = 7,
+  [FETCH_SCRIPT_OP_SHR]  = 7,
+  [FETCH_SCRIPT_OP_ADD]  = 8,
+  [FETCH_SCRIPT_OP_SUB]  = 8,
+  [FETCH_SCRIPT_OP_MUL]  = 9,
+  [FETCH_SCRIPT_OP_DIV]  = 9,
+  [FETCH_SCRIPT_OP_MOD]  = 9,
+};
+
+/*
+ * Compiler
+ */
+
+static bool script_error(script_compiler_t * c, const char * msg)
+{
+  util_message_error(c->chp, "script: %s", msg);
+  util_message_error(c->chp, "offset: %u", c->tok.start);
+  return false;
+}
+
+static bool script_next(script_compiler_t * c)
+{
+  if( !fetch_script_lexer(c->src + c->pos, c->len - c->pos, &c->tok) )
+  {
+    c->tok.start += c->pos;
+    return script_error(c, "invalid character");
+  }
+
+  c->tok.start += c->pos;
+  c->pos = c->tok.start + c->tok.len;
+
+  return true;
+}
+
+static bool script_seek(script_compiler_t * c, uint32_t pos)
+{
+  c->pos = pos;
+  return script_next(c);
+}
+
+static bool script_expect(script_compiler_t * c, fetch_script_tok_t type, const char * msg)
+{
+  if( c->tok.type != type )
+  {
+    return script_error(c, msg);
+  }
+
+  return script_next(c);
+}
+
+/*! \brief append a code word, delta is the change of the stack depth
+ */
+static bool script_emit(script_compiler_t * c, uint32_t word, int32_t delta)
+{
+  if( c->s->code_len >= FETCH_SCRIPT_CODE_WORDS )
+  {
+    return script_error(c, "script too long");
+  }
+
+  c->s->code[c->s->code_len++] = word;
+  c->sp += delta;
+
+  if( c->sp > FETCH_SCRIPT_STACK )
+  {
+    return script_error(c, "expression too complex");
+  }
+  if( c->sp > c->s->stack_max )
+  {
+    c->s->stack_max = c->sp;
+  }
+
+  return true;
+}
+
+static void script_patch(script_compiler_t * c, uint32_t at, uint32_t target)
+{
+  c->s->code[at] = SCRIPT_WORD(SCRIPT_WORD_OP(c->s->code[at]), target);
+}
+
+static bool script_push(script_compiler_t * c, int32_t value)
+{
+  return script_emit(c, SCRIPT_WORD(SCRIPT_PUSH, 0), 1) && script_emit(c, (uint32_t)value, 0);
+}
+
+/*! \brief copy a string into the pool, returns the offset or -1
+ */
+static int32_t script_pool_add(script_compiler_t * c, const char * str, uint32_t len)
+{
+  script_t * s = c->s;
+
+  if( s->pool_len + len + 1 > FETCH_SCRIPT_POOL_CHARS )
+  {
+    script_error(c, "out of string space");
+    return -1;
+  }
+
+  int32_t offset = s->pool_len;
+  memcpy(&s->pool[offset], str, len);
+  s->pool[offset + len] = '\0';
+  s->pool_len += len + 1;
+
+  return offset;
+}
+
+/*! \brief slot of a variable name, created on assignment
+ *
+ * \return slot or -1
+ */
+static int32_t script_var(script_compiler_t * c, const char * name, uint32_t len, bool create)
+{
+  script_t * s = c->s;
+
+  if( len == 0 || len >= FETCH_SCRIPT_NAME_CHARS )
+  {
+    script_error(c, "variable name too long");
+    return -1;
+  }
+
+  for( uint32_t i = 0; i < s->var_count; i++ )
+  {
+    if( strncmp(s->var_names[i], name, len) == 0 && s->var_names[i][len] == '\0' )
+    {
+      return i;
+    }
+  }
+
+  if( !create )
+  {
+    script_error(c, "variable used before assignment");
+    return -1;
+  }
+
+  if( s->var_count >= FETCH_SCRIPT_VARS )
+  {
+    script_error(c, "too many variables");
+    return -1;
+  }
+
+  memcpy(s->var_names[s->var_count], name, len);
+  s->var_names[s->var_count][len] = '\0';
+
+  return s->var_count++;
+}
+
+static int32_t script_hidden_var(script_compiler_t * c)
+{
+  script_t * s = c->s;
+
+  if( s->var_count >= FETCH_SCRIPT_VARS )
+  {
+    script_error(c, "too many variables");
+    return -1;
+  }
+
+  s->var_names[s->var_count][0] = '\0';
+
+  return s->var_count++;
+}
+
+static bool script_expr(script_compiler_t * c, uint32_t min_prec);
+
+static bool script_enter(script_compiler_t * c)
+{
+  if( ++c->depth > FETCH_SCRIPT_DEPTH )
+  {
+    return script_error(c, "nesting too deep");
+  }
+
+  return true;
+}
+
+static bool script_unary(script_compiler_t * c)
+{
+  fetch_script_token_t tok = c->tok;
+  bool ok;
+
+  if( !script_enter(c) )
+  {
+    return false;
+  }
+
+  switch( tok.type )
+  {
+    case FETCH_SCRIPT_TOK_NUMBER:
+      ok = script_push(c, tok.value) && script_next(c);
+      break;
+
+    case FETCH_SCRIPT_TOK_VAR:
+    {
+      int32_t slot = script_var(c, c->src + tok.start + 1, tok.len - 1, false);
+      ok = slot >= 0 && script_emit(c, SCRIPT_WORD(SCRIPT_LOAD, slot), 1) && script_next(c);
+      break;
+    }
+
+    case FETCH_SCRIPT_TOK_CAPTURE:
+    {
+      int32_t name = script_pool_add(c, c->src + tok.start + 1, tok.len - 1);
+      ok = name >= 0 && script_next(c);
+      if( ok && c->tok.type == FETCH_SCRIPT_TOK_LBRACKET )
+      {
+        ok = script_next(c) && script_expr(c, 1) &&
+             script_expect(c, FETCH_SCRIPT_TOK_RBRACKET, "missing ]");
+      }
+      else if( ok )
+      {
+        ok = script_push(c, 0);
+      }
+      ok = ok && script_emit(c, SCRIPT_WORD(SCRIPT_CAPTURE, name), 0);
+      break;
+    }
+
+    case FETCH_SCRIPT_TOK_LPAREN:
+      ok = script_next(c) && script_expr(c, 1) &&
+           script_expect(c, FETCH_SCRIPT_TOK_RPAREN, "missing )");
+      break;
+
+    case FETCH_SCRIPT_TOK_OP:
+      if( tok.value != FETCH_SCRIPT_OP_SUB )
+      {
+        ok = script_error(c, "value expected");
+        break;
+      }
+      ok = script_next(c) && script_unary(c) && script_emit(c, SCRIPT_WORD(SCRIPT_NEG, 0), 0);
+      break;
+
+    case FETCH_SCRIPT_TOK_NOT:
+      ok = script_next(c) && script_unary(c) && script_emit(c, SCRIPT_WORD(SCRIPT_NOT, 0), 0);
+      break;
+
+    case FETCH_SCRIPT_TOK_INV:
+      ok = script_next(c) && script_unary(c) && script_emit(c, SCRIPT_WORD(SCRIPT_INV, 0), 0);
+      break;
+
+    default:
+      ok = script_error(c, "value expected");
+      break;
+  }
+
+  c->depth--;
+
+  return ok;
+}
+
+/*! \brief precedence climbing, operators of at least min_prec
+ */
+static bool script_expr(script_compiler_t * c, uint32_t min_prec)
+{
+  if( !script_unary(c) )
+  {
+    return false;
+  }
+
+  while( c->tok.type == FETCH_SCRIPT_TOK_OP && script_prec[c->tok.value] >= min_prec )
+  {
+    fetch_script_op_t op = c->tok.value;
+
+    if( !script_next(c) || !script_expr(c, script_prec[op] + 1) ||
+        !script_emit(c, SCRIPT_WORD(SCRIPT_BINARY, op), -1) )
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool script_paren_expr(script_compiler_t * c)
+{
+  return script_expect(c, FETCH_SCRIPT_TOK_LPAREN, "missing (") &&
+         script_expr(c, 1) &&
+         script_expect(c, FETCH_SCRIPT_TOK_RPAREN, "missing )");
+}
+
+static bool script_func_allowed(fetch_func_t func)
+{
+  return func != fetch_script_load_cmd && func != fetch_script_run_cmd &&
+         func != fetch_script_delete_cmd && func != fetch_reset_cmd;
+}
+
+/*! \brief expand a template, variables as decimal
+ */
+static bool script_expand(const char * tmpl, const int32_t * vars, char * out, uint32_t max)
+{
+  uint32_t n = 0;
+
+  for( ; *tmpl != '\0'; tmpl++ )
+  {
+    if( *tmpl == SCRIPT_VAR_MARK )
+    {
+      char number[12];
+      uint32_t len;
+
+      tmpl++;
+      len = chsnprintf(number, sizeof(number), "%d", vars[(uint8_t)*tmpl - 1]);
+      if( n + len >= max )
+      {
+        return false;
+      }
+      memcpy(&out[n], number, len);
+      n += len;
+    }
+    else
+    {
+      if( n + 1 >= max )
+      {
+        return false;
+      }
+      out[n++] = *tmpl;
+    }
+  }
+
+  out[n] = '\0';
+
+  return true;
+}
+
+/*! \brief command statement, tok is the command name
+ */
+static bool script_command(script_compiler_t * c)
+{
+  script_t * s = c->s;
+  const char * src = c->src;
+  uint32_t start = c->tok.start;
+  uint32_t end = c->pos;
+  bool has_var = false;
+
+  if( s->cmd_count >= FETCH_SCRIPT_COMMANDS )
+  {
+    return script_error(c, "too many commands");
+  }
+
+  // raw argument list up to the matching ')', fetch_command_parser checks it
+  uint32_t p = end;
+  while( p < c->len && (src[p] == ' ' || src[p] == '\t') )
+  {
+    p++;
+  }
+  if( p < c->len && src[p] == '(' )
+  {
+    uint32_t depth = 0;
+    char quote = 0;
+
+    for( ; p < c->len; p++ )
+    {
+      if( quote )
+      {
+        if( src[p] == '\\' )
+        {
+          p++;
+        }
+        else if( src[p] == quote )
+        {
+          quote = 0;
+        }
+      }
+      else if( src[p] == '\'' || src[p] == '\"' )
+      {
+        quote = src[p];
+      }
+      else if( src[p] == '$' )
+      {
+        has_var = true;
+      }
+      else if( src[p] == '(' )
+      {
+        depth++;
+      }
+      else if( src[p] == ')' && --depth == 0 )
+      {
+        break;
+      }
+    }
+    if( p >= c->len )
+    {
+      return script_error(c, "missing ) of command");
+    }
+    end = p + 1;
+  }
+
+  if( end - start > FETCH_MAX_LINE_CHARS )
+  {
+    return script_error(c, "command too long");
+  }
+
+  script_cmd_t * cmd = &s->cmds[s->cmd_count];
+  char * argv[FETCH_SCRIPT_CMD_TOKS + 1];
+  fetch_func_t func;
+  uint32_t argc;
+
+  memset(cmd, 0, sizeof(*cmd));
+
+  if( has_var )
+  {
+    // $name -> SCRIPT_VAR_MARK, slot + 1
+    static const int32_t zeros[FETCH_SCRIPT_VARS];
+    uint32_t n = 0;
+    char quote = 0;
+
+    for( p = start; p < end; p++ )
+    {
+      char ch = src[p];
+
+      if( quote )
+      {
+        if( ch == '\\' && p + 1 < end )
+        {
+          script_line[n++] = ch;
+          ch = src[++p];
+        }
+        else if( ch == quote )
+        {
+          quote = 0;
+        }
+      }
+      else if( ch == '\'' || ch == '\"' )
+      {
+        quote = ch;
+      }
+      else if( ch == '$' )
+      {
+        uint32_t name = ++p;
+        while( p < end && (src[p] == '_' || (src[p] >= '0' && src[p] <= '9') ||
+               (src[p] >= 'a' && src[p] <= 'z') || (src[p] >= 'A' && src[p] <= 'Z')) )
+        {
+          p++;
+        }
+        c->tok.start = name - 1;
+        int32_t slot = script_var(c, &src[name], p - name, false);
+        if( slot < 0 )
+        {
+          return false;
+        }
+        script_line[n++] = SCRIPT_VAR_MARK;
+        script_line[n++] = slot + 1;
+        p--;
+        continue;
+      }
+      script_line[n++] = ch;
+    }
+
+    int32_t text = script_pool_add(c, script_line, n);
+    if( text < 0 )
+    {
+      return false;
+    }
+
+    // check the syntax once, with every variable 0
+    if( !script_expand(&s->pool[text], zeros, script_line, sizeof(script_line)) )
+    {
+      return script_error(c, "command too long");
+    }
+    if( !fetch_command_parser(script_line, strlen(script_line) + 1, script_tokens, FETCH_MAX_LINE_CHARS,
+                              &func, &argc, argv, FETCH_SCRIPT_CMD_TOKS) || func == NULL )
+    {
+      c->tok.start = start + fetch_parser_info.offset;
+      return script_error(c, fetch_parser_info.error_msg ? fetch_parser_info.error_msg : "invalid command");
+    }
+    cmd->func = NULL;
+    cmd->text = text;
+  }
+  else
+  {
+    memcpy(script_line, &src[start], end - start);
+    script_line[end - start] = '\0';
+
+    char * base = &s->pool[s->pool_len];
+    if( !fetch_command_parser(script_line, end - start + 1, base, FETCH_SCRIPT_POOL_CHARS - s->pool_len,
+                              &func, &argc, argv, FETCH_SCRIPT_CMD_TOKS) || func == NULL )
+    {
+      c->tok.start = start + fetch_parser_info.offset;
+      return script_error(c, fetch_parser_info.error_msg ? fetch_parser_info.error_msg : "invalid command");
+    }
+
+    for( uint32_t i = 0; i < argc; i++ )
+    {
+      cmd->argv[i] = argv[i] - s->pool;
+    }
+    if( argc > 0 )
+    {
+      s->pool_len = (argv[argc - 1] - s->pool) + strlen(argv[argc - 1]) + 1;
+    }
+    cmd->func = func;
+    cmd->argc = argc;
+  }
+
+  if( !script_func_allowed(func) )
+  {
+    c->tok.start = start;
+    return script_error(c, "command not allowed in a script");
+  }
+
+  s->cmd_count++;
+
+  return script_emit(c, SCRIPT_WORD(SCRIPT_CMD, s->cmd_count - 1), 0) && script_seek(c, end);
+}
+
+static bool script_statement(script_compiler_t * c);
+
+static bool script_block(script_compiler_t * c)
+{
+  if( !script_expect(c, FETCH_SCRIPT_TOK_LBRACE, "missing {") || !script_enter(c) )
+  {
+    return false;
+  }
+
+  while( c->tok.type != FETCH_SCRIPT_TOK_RBRACE )
+  {
+    if( c->tok.type == FETCH_SCRIPT_TOK_END )
+    {
+      return script_error(c, "missing }");
+    }
+    if( !script_statement(c) )
+    {
+      return false;
+    }
+  }
+
+  c->depth--;
+
+  return script_next(c);
+}
+
+static bool script_repeat(script_compiler_t * c)
+{
+  int32_t counter = script_hidden_var(c);
+
+  if( counter < 0 || !script_next(c) || !script_paren_expr(c) ||
+      !script_emit(c, SCRIPT_WORD(SCRIPT_STORE, counter), -1) )
+  {
+    return false;
+  }
+
+  uint32_t loop = c->s->code_len;
+
+  if( !script_emit(c, SCRIPT_WORD(SCRIPT_LOAD, counter), 1) || !script_push(c, 0) ||
+      !script_emit(c, SCRIPT_WORD(SCRIPT_BINARY, FETCH_SCRIPT_OP_GT), -1) )
+  {
+    return false;
+  }
+
+  uint32_t out = c->s->code_len;
+
+  if( !script_emit(c, SCRIPT_WORD(SCRIPT_JZ, 0), -1) ||
+      !script_emit(c, SCRIPT_WORD(SCRIPT_DEC, counter), 0) ||
+      !script_block(c) ||
+      !script_emit(c, SCRIPT_WORD(SCRIPT_LOOP, loop), 0) )
+  {
+    return false;
+  }
+
+  script_patch(c, out, c->s->code_len);
+
+  return true;
+}
+
+/*
+ *  [timeout; ARM t]
+ *  loop: cond; JZ end; [EXPIRED t]; body; LOOP loop
+ *  end:
+ *
+ * The timeout is written after the condition but runs once before it,
+ * so it is compiled first and the lexer goes back for the condition.
+ */
+static bool script_while(script_compiler_t * c)
+{
+  if( !script_next(c) || !script_expect(c, FETCH_SCRIPT_TOK_LPAREN, "missing (") )
+  {
+    return false;
+  }
+
+  uint32_t cond = c->tok.start;
+  uint32_t depth = 0;
+  int32_t timer = -1;
+
+  while( depth > 0 || (c->tok.type != FETCH_SCRIPT_TOK_COMMA && c->tok.type != FETCH_SCRIPT_TOK_RPAREN) )
+  {
+    if( c->tok.type == FETCH_SCRIPT_TOK_END )
+    {
+      return script_error(c, "missing )");
+    }
+    if( c->tok.type == FETCH_SCRIPT_TOK_LPAREN || c->tok.type == FETCH_SCRIPT_TOK_LBRACKET )
+    {
+      depth++;
+    }
+    else if( c->tok.type == FETCH_SCRIPT_TOK_RPAREN || c->tok.type == FETCH_SCRIPT_TOK_RBRACKET )
+    {
+      depth--;
+    }
+    if( !script_next(c) )
+    {
+      return false;
+    }
+  }
+
+  if( c->tok.type == FETCH_SCRIPT_TOK_COMMA )
+  {
+    if( c->s->timer_count >= FETCH_SCRIPT_TIMERS )
+    {
+      return script_error(c, "too many while timeouts");
+    }
+    timer = c->s->timer_count++;
+
+    if( !script_next(c) || !script_expr(c, 1) ||
+        !script_emit(c, SCRIPT_WORD(SCRIPT_ARM, timer), -1) )
+    {
+      return false;
+    }
+    if( c->tok.type != FETCH_SCRIPT_TOK_RPAREN )
+    {
+      return script_error(c, "missing )");
+    }
+  }
+
+  uint32_t after = c->pos;
+  uint32_t loop = c->s->code_len;
+
+  if( !script_seek(c, cond) || !script_expr(c, 1) )
+  {
+    return false;
+  }
+  if( c->tok.type != FETCH_SCRIPT_TOK_COMMA && c->tok.type != FETCH_SCRIPT_TOK_RPAREN )
+  {
+    return script_error(c, "missing )");
+  }
+  if( !script_seek(c, after) )
+  {
+    return false;
+  }
+
+  uint32_t out = c->s->code_len;
+
+  if( !script_emit(c, SCRIPT_WORD(SCRIPT_JZ, 0), -1) )
+  {
+    return false;
+  }
+  if( timer >= 0 && !script_emit(c, SCRIPT_WORD(SCRIPT_EXPIRED, timer), 0) )
+  {
+    return false;
+  }
+  if( !script_block(c) || !script_emit(c, SCRIPT_WORD(SCRIPT_LOOP, loop), 0) )
+  {
+    return false;
+  }
+
+  script_patch(c, out, c->s->code_len);
+
+  return true;
+}
+
+static bool script_if(script_compiler_t * c)
+{
+  if( !script_next(c) || !script_paren_expr(c) )
+  {
+    return false;
+  }
+
+  uint32_t skip = c->s->code_len;
+
+  if( !script_emit(c, SCRIPT_WORD(SCRIPT_JZ, 0), -1) || !script_block(c) )
+  {
+    return false;
+  }
+
+  if( c->tok.type != FETCH_SCRIPT_TOK_ELSE )
+  {
+    script_patch(c, skip, c->s->code_len);
+    return true;
+  }
+
+  uint32_t done = c->s->code_len;
+
+  if( !script_emit(c, SCRIPT_WORD(SCRIPT_JMP, 0), 0) )
+  {
+    return false;
+  }
+  script_patch(c, skip, c->s->code_len);
+
+  if( !script_next(c) )
+  {
+    return false;
+  }
+  if( c->tok.type == FETCH_SCRIPT_TOK_IF )
+  {
+    if( !script_enter(c) || !script_if(c) )
+    {
+      return false;
+    }
+    c->depth--;
+  }
+  else if( !script_block(c) )
+  {
+    return false;
+  }
+
+  script_patch(c, done, c->s->code_len);
+
+  return true;
+}
+
+static bool script_statement(script_compiler_t * c)
+{
+  switch( c->tok.type )
+  {
+    case FETCH_SCRIPT_TOK_SEMI:
+      return script_next(c);
+
+    case FETCH_SCRIPT_TOK_VAR:
+    {
+      int32_t slot = script_var(c, c->src + c->tok.start + 1, c->tok.len - 1, true);
+      return slot >= 0 && script_next(c) &&
+             script_expect(c, FETCH_SCRIPT_TOK_ASSIGN, "missing =") &&
+             script_expr(c, 1) &&
+             script_emit(c, SCRIPT_WORD(SCRIPT_STORE, slot), -1);
+    }
+
+    case FETCH_SCRIPT_TOK_REPEAT:
+      return script_repeat(c);
+
+    case FETCH_SCRIPT_TOK_WHILE:
+      return script_while(c);
+
+    case FETCH_SCRIPT_TOK_IF:
+      return script_if(c);
+
+    case FETCH_SCRIPT_TOK_PRINT:
+    {
+      uint32_t count = 0;
+
+      if( !script_next(c) || !script_expect(c, FETCH_SCRIPT_TOK_LPAREN, "missing (") )
+      {
+        return false;
+      }
+      do
+      {
+        if( ++count > SCRIPT_PRINT_MAX )
+        {
+          return script_error(c, "too many print values");
+        }
+        if( !script_expr(c, 1) )
+        {
+          return false;
+        }
+      } while( c->tok.type == FETCH_SCRIPT_TOK_COMMA && script_next(c) );
+
+      return script_expect(c, FETCH_SCRIPT_TOK_RPAREN, "missing )") &&
+             script_emit(c, SCRIPT_WORD(SCRIPT_PRINT, count), -(int32_t)count);
+    }
+
+    case FETCH_SCRIPT_TOK_ECHO:
+      if( !script_next(c) )
+      {
+        return false;
+      }
+      if( c->tok.type == FETCH_SCRIPT_TOK_LPAREN &&
+          (!script_next(c) || !script_expect(c, FETCH_SCRIPT_TOK_RPAREN, "missing )")) )
+      {
+        return false;
+      }
+      return script_emit(c, SCRIPT_WORD(SCRIPT_ECHO, 0), 0);
+
+    case FETCH_SCRIPT_TOK_WAIT:
+      return script_next(c) && script_paren_expr(c) &&
+             script_emit(c, SCRIPT_WORD(SCRIPT_WAIT, 0), -1);
+
+    case FETCH_SCRIPT_TOK_IDENT:
+      return script_command(c);
+
+    default:
+      return script_error(c, "statement expected");
+  }
+}
+
+static bool script_compile(BaseSequentialStream * chp, const char * src, uint32_t len, script_t * s)
+{
+  script_compiler_t c;
+
+  memset(s, 0, sizeof(*s));
+  memset(&c, 0, sizeof(c));
+  c.chp = chp;
+  c.src = src;
+  c.len = len;
+  c.s = s;
+
+  if( !script_next(&c) )
+  {
+    return false;
+  }
+
+  while( c.tok.type != FETCH_SCRIPT_TOK_END )
+  {
+    if( !script_statement(&c) )
+    {
+      return false;
+    }
+  }
+
+  if( !script_emit(&c, SCRIPT_WORD(SCRIPT_END, 0), 0) )
+  {
+    return false;
+  }
+
+  s->loaded = true;
+
+  return true;
+}
+
+/*
+ * VM
+ */
+
+/*! \brief value <index> of the last '<type>:<name>:' line of the capture
+ */
+static bool script_capture_value(const char * name, int32_t index, int32_t * value)
+{
+  const char * buf = script_capture;
+  const char * found = NULL;
+  const char * found_end = NULL;
+  uint32_t name_len = strlen(name);
+  bool hex = false;
+  uint32_t i = 0;
+
+  while( i < script_capture_len )
+  {
+    const char * line = &buf[i];
+    const char * end = memchr(line, '\n', script_capture_len - i);
+    uint32_t line_len = (end != NULL) ? (uint32_t)(end - line) : script_capture_len - i;
+    const char * type_end = memchr(line, ':', line_len);
+
+    i += line_len + 1;
+
+    // S is a string, S8/S16/S32 are numbers
+    if( type_end == NULL || (type_end - line == 1 && line[0] == 'S') )
+    {
+      continue;
+    }
+
+    const char * field = type_end + 1;
+    uint32_t rest = line_len - (field - line);
+
+    if( rest > name_len && memcmp(field, name, name_len) == 0 && field[name_len] == ':' )
+    {
+      found = field + name_len + 1;
+      found_end = line + line_len;
+      hex = (line[0] == 'H');
+    }
+  }
+
+  if( found == NULL || index < 0 )
+  {
+    return false;
+  }
+
+  for( ; index > 0 && found < found_end; found++ )
+  {
+    if( *found == ',' )
+    {
+      index--;
+    }
+  }
+
+  bool negative = (found < found_end && *found == '-');
+  uint32_t result = 0;
+  uint32_t digits = 0;
+
+  if( negative )
+  {
+    found++;
+  }
+
+  for( ; found < found_end; found++, digits++ )
+  {
+    char ch = *found;
+
+    if( ch >= '0' && ch <= '9' )
+    {
+      result = result * (hex ? 16 : 10) + (ch - '0');
+    }
+    else if( hex && ch >= 'A' && ch <= 'F' )
+    {
+      result = result * 16 + (ch - 'A' + 10);
+    }
+    else if( hex && ch >= 'a' && ch <= 'f' )
+    {
+      result = result * 16 + (ch - 'a' + 10);
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if( digits == 0 )
+  {
+    return false;
+  }
+
+  *value = negative ? -(int32_t)result : (int32_t)result;
+
+  return true;
+}
+
+static void script_echo(BaseSequentialStream * chp)
+{
+  if( chp == NULL || script_capture_len == 0 )
+  {
+    return;
+  }
+
+  chBSemWait( &mshell_sync_sem );
+  streamWrite(chp, (const uint8_t *)script_capture, script_capture_len);
+  chBSemSignal( &mshell_sync_sem );
+}
+
+static bool script_run_command(BaseSequentialStream * chp, script_t * s, uint32_t index, const int32_t * vars)
+{
+  static char * argv[FETCH_SCRIPT_CMD_TOKS + 1];
+  const script_cmd_t * cmd = &s->cmds[index];
+  fetch_func_t func = cmd->func;
+  uint32_t argc = cmd->argc;
+
+  if( func != NULL )
+  {
+    for( uint32_t i = 0; i < argc; i++ )
+    {
+      argv[i] = &s->pool[cmd->argv[i]];
+    }
+  }
+  else if( !script_expand(&s->pool[cmd->text], vars, script_line, sizeof(script_line)) ||
+           !fetch_command_parser(script_line, strlen(script_line) + 1, script_tokens, FETCH_MAX_LINE_CHARS,
+                                 &func, &argc, argv, FETCH_SCRIPT_CMD_TOKS) || func == NULL )
+  {
+    util_message_error(chp, "command %u: invalid arguments", index);
+    util_message_error(chp, "line: %s", script_line);
+    return false;
+  }
+
+  argv[argc] = NULL;
+
+  msObjectInit(&script_capture_stream, (uint8_t *)script_capture, FETCH_SCRIPT_CAPTURE_CHARS, 0);
+  bool ok = func((BaseSequentialStream *)&script_capture_stream, argc, argv);
+  script_capture_len = script_capture_stream.eos;
+
+  if( !ok )
+  {
+    script_echo(chp);
+    util_message_error(chp, "command %u failed", index);
+  }
+
+  return ok;
+}
+
+static int32_t script_binary(fetch_script_op_t op, int32_t a, int32_t b)
+{
+  switch( op )
+  {
+    case FETCH_SCRIPT_OP_LOR:   return a || b;
+    case FETCH_SCRIPT_OP_LAND:  return a && b;
+    case FETCH_SCRIPT_OP_EQ:    return a == b;
+    case FETCH_SCRIPT_OP_NE:    return a != b;
+    case FETCH_SCRIPT_OP_LT:    return a < b;
+    case FETCH_SCRIPT_OP_GT:    return a > b;
+    case FETCH_SCRIPT_OP_LE:    return a <= b;
+    case FETCH_SCRIPT_OP_GE:    return a >= b;
+    case FETCH_SCRIPT_OP_OR:    return a | b;
+    case FETCH_SCRIPT_OP_XOR:   return a ^ b;
+    case FETCH_SCRIPT_OP_AND:   return a & b;
+    case FETCH_SCRIPT_OP_SHL:   return (int32_t)((uint32_t)a << (b & 31));
+    case FETCH_SCRIPT_OP_SHR:   return (int32_t)((uint32_t)a >> (b & 31));
+    case FETCH_SCRIPT_OP_ADD:   return (int32_t)((uint32_t)a + (uint32_t)b);
+    case FETCH_SCRIPT_OP_SUB:   return (int32_t)((uint32_t)a - (uint32_t)b);
+    case FETCH_SCRIPT_OP_MUL:   return (int32_t)((uint32_t)a * (uint32_t)b);
+    // b == 0 is caught by the caller, -1 would overflow on INT32_MIN
+    case FETCH_SCRIPT_OP_DIV:   return (b == -1) ? (int32_t)(0 - (uint32_t)a) : a / b;
+    case FETCH_SCRIPT_OP_MOD:   return (b == -1) ? 0 : a % b;
+    default:                    return 0;
+  }
+}
+
+/*! \brief run a loaded script
+ *
+ * The stack depth was checked by the compiler.
+ */
+static bool script_execute(BaseSequentialStream * chp, script_t * s, uint32_t * steps)
+{
+  int32_t stack[FETCH_SCRIPT_STACK];
+  int32_t vars[FETCH_SCRIPT_VARS];
+  uint64_t deadline[FETCH_SCRIPT_TIMERS];
+  uint32_t sp = 0;
+  uint32_t pc = 0;
+  bool ok = false;
+
+  memset(vars, 0, sizeof(vars));
+  script_capture_len = 0;
+  *steps = 0;
+
+  while( true )
+  {
+    uint32_t word = s->code[pc++];
+    uint32_t arg = SCRIPT_WORD_ARG(word);
+
+    (*steps)++;
+
+    switch( SCRIPT_WORD_OP(word) )
+    {
+      case SCRIPT_END:
+        ok = true;
+        goto done;
+
+      case SCRIPT_PUSH:
+        stack[sp++] = (int32_t)s->code[pc++];
+        break;
+
+      case SCRIPT_LOAD:
+        stack[sp++] = vars[arg];
+        break;
+
+      case SCRIPT_STORE:
+        vars[arg] = stack[--sp];
+        break;
+
+      case SCRIPT_DEC:
+        vars[arg]--;
+        break;
+
+      case SCRIPT_BINARY:
+        sp--;
+        if( (arg == FETCH_SCRIPT_OP_DIV || arg == FETCH_SCRIPT_OP_MOD) && stack[sp] == 0 )
+        {
+          util_message_error(chp, "division by zero");
+          goto done;
+        }
+        stack[sp - 1] = script_binary(arg, stack[sp - 1], stack[sp]);
+        break;
+
+      case SCRIPT_NEG:
+        stack[sp - 1] = (int32_t)(0 - (uint32_t)stack[sp - 1]);
+        break;
+
+      case SCRIPT_NOT:
+        stack[sp - 1] = !stack[sp - 1];
+        break;
+
+      case SCRIPT_INV:
+        stack[sp - 1] = ~stack[sp - 1];
+        break;
+
+      case SCRIPT_JMP:
+        pc = arg;
+        break;
+
+      case SCRIPT_JZ:
+        if( stack[--sp] == 0 )
+        {
+          pc = arg;
+        }
+        break;
+
+      case SCRIPT_LOOP:
+        if( !fetch_checkpoint(chp, *steps, 0) )
+        {
+          goto done;
+        }
+        pc = arg;
+        break;
+
+      case SCRIPT_CMD:
+        if( !script_run_command(chp, s, arg, vars) )
+        {
+          goto done;
+        }
+        break;
+
+      case SCRIPT_CAPTURE:
+        if( !script_capture_value(&s->pool[arg], stack[sp - 1], &stack[sp - 1]) )
+        {
+          util_message_error(chp, "no value @%s[%d] in the last command output", &s->pool[arg], stack[sp - 1]);
+          goto done;
+        }
+        break;
+
+      case SCRIPT_PRINT:
+        sp -= arg;
+        util_message_int32_array(chp, "print", &stack[sp], arg);
+        break;
+
+      case SCRIPT_ECHO:
+        script_echo(chp);
+        break;
+
+      case SCRIPT_WAIT:
+      {
+        int32_t ms = stack[--sp];
+        if( !fetch_sleep_ms((ms > 0) ? ms : 0) )
+        {
+          util_message_error(chp, "aborted");
+          goto done;
+        }
+        break;
+      }
+
+      case SCRIPT_ARM:
+      {
+        int32_t ms = stack[--sp];
+        deadline[arg] = util_timestamp_now() + (uint64_t)((ms > 0) ? ms : 0) * (UTIL_TIMESTAMP_FREQ / 1000);
+        break;
+      }
+
+      case SCRIPT_EXPIRED:
+        if( util_timestamp_now() >= deadline[arg] )
+        {
+          util_message_error(chp, "while timeout");
+          goto done;
+        }
+        break;
+
+      default:
+        util_message_error(chp, "invalid opcode %u at %u", SCRIPT_WORD_OP(word), pc - 1);
+        goto done;
+    }
+  }
+
+done:
+  memcpy(s->vars, vars, sizeof(s->vars));
+
+  return ok;
+}
+
+/*
+ * Commands
+ */
+
+static bool script_parse_id(BaseSequentialStream * chp, char * arg, uint32_t * id)
+{
+  if( !util_parse_uint32(arg, id) || *id >= FETCH_SCRIPT_COUNT )
+  {
+    util_message_error(chp, "invalid script id");
+    return false;
+  }
+
+  return true;
+}
+
+bool fetch_script_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  (void)argv;
+
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Script Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "load(<id>,<source>[,<source> ...])");
+  FETCH_HELP_DES(chp, "Compile a script, the source strings are joined");
+  FETCH_HELP_ARG(chp, "id", "0 ... 3");
+  FETCH_HELP_ARG(chp, "source", "statements, see below");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "run(<id>)");
+  FETCH_HELP_DES(chp, "Run a script, reports steps and time_us");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "info(<id>)");
+  FETCH_HELP_DES(chp, "Code size, variables after the last run and run stats");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "delete(<id>)");
+  FETCH_HELP_DES(chp, "Delete a script");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_DES(chp, "Statements:");
+  FETCH_HELP_ARG(chp, "command[(<args>)]", "fetch command, args may use $var");
+  FETCH_HELP_ARG(chp, "$var = <expr>", "32 bit signed variable");
+  FETCH_HELP_ARG(chp, "repeat(<expr>) { }", "loop a number of times");
+  FETCH_HELP_ARG(chp, "while(<expr>[,<ms>]) { }", "loop, error after the timeout");
+  FETCH_HELP_ARG(chp, "if(<expr>) { } [else { }]", "condition");
+  FETCH_HELP_ARG(chp, "print(<expr>[,<expr> ...])", "S32:print:<values>");
+  FETCH_HELP_ARG(chp, "echo", "output of the last command");
+  FETCH_HELP_ARG(chp, "wait(<ms>)", "sleep");
+  FETCH_HELP_DES(chp, "Values: 12 | 0x0c | 0b1100 | $var | @name[<index>] {last command output}");
+  FETCH_HELP_DES(chp, "Operators: - ! ~ * / % + - << >> & ^ | == != < > <= >= && ||");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_script_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 2);
+
+  uint32_t id;
+  uint32_t count;
+
+  if( !script_parse_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  if( !fetch_parse_bytes(chp, argc - 1, &argv[1], fetch_shared_buffer, FETCH_SHARED_BUFFER_SIZE, &count) )
+  {
+    return false;
+  }
+
+  if( !script_compile(chp, (const char *)fetch_shared_buffer, count, &script_scratch) )
+  {
+    return false;
+  }
+
+  memcpy(&scripts[id], &script_scratch, sizeof(script_t));
+
+  util_message_uint32(chp, "code_words", scripts[id].code_len);
+  util_message_uint32(chp, "commands", scripts[id].cmd_count);
+
+  return true;
+}
+
+bool fetch_script_run_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+  uint32_t steps;
+
+  if( !script_parse_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  script_t * s = &scripts[id];
+
+  if( !s->loaded )
+  {
+    util_message_error(chp, "script not loaded");
+    return false;
+  }
+
+  uint64_t start = util_timestamp_now();
+  bool ok = script_execute(chp, s, &steps);
+  uint64_t us = (util_timestamp_now() - start) / (UTIL_TIMESTAMP_FREQ / 1000000);
+
+  s->runs++;
+  s->steps = steps;
+  s->time_us = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+  s->ok = ok;
+
+  util_message_uint32(chp, "steps", s->steps);
+  util_message_uint32(chp, "time_us", s->time_us);
+
+  return ok;
+}
+
+bool fetch_script_info_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+  char * names[FETCH_SCRIPT_VARS];
+  int32_t values[FETCH_SCRIPT_VARS];
+  uint32_t count = 0;
+
+  if( !script_parse_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  script_t * s = &scripts[id];
+
+  util_message_bool(chp, "loaded", s->loaded);
+  if( !s->loaded )
+  {
+    return true;
+  }
+
+  for( uint32_t i = 0; i < s->var_count; i++ )
+  {
+    // skip the repeat counters
+    if( s->var_names[i][0] != '\0' )
+    {
+      names[count] = s->var_names[i];
+      values[count] = s->vars[i];
+      count++;
+    }
+  }
+
+  util_message_uint32(chp, "code_words", s->code_len);
+  util_message_uint32(chp, "pool_chars", s->pool_len);
+  util_message_uint32(chp, "commands", s->cmd_count);
+  util_message_uint32(chp, "stack", s->stack_max);
+  util_message_string_array(chp, "vars", names, count);
+  util_message_int32_array(chp, "values", values, count);
+  util_message_uint32(chp, "runs", s->runs);
+  util_message_bool(chp, "ok", s->ok);
+  util_message_uint32(chp, "steps", s->steps);
+  util_message_uint32(chp, "time_us", s->time_us);
+
+  return true;
+}
+
+bool fetch_script_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 1);
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t id;
+
+  if( !script_parse_id(chp, argv[0], &id) )
+  {
+    return false;
+  }
+
+  memset(&scripts[id], 0, sizeof(script_t));
+
+  return true;
+}
+
+bool fetch_script_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  memset(scripts, 0, sizeof(scripts));
+
+  return true;
+}
+
+/*! @} */
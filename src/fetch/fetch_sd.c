@@ -16,9 +16,12 @@
 #include "util_general.h"
 #include "util_io.h"
 #include "util_arg_parse.h"
+#include "util_dma.h"
 
 #include "ff.h"
 
+#include "usb_msd.h"
+
 #include "fetch.h"
 #include "fetch_defs.h"
 #include "fetch_sd.h"
@@ -47,6 +50,48 @@ static fetch_command_t fetch_sd_commands[] = {
 FATFS filesystem;
 FIL file_obj;
 
+static bool sd_mounted = false;
+static bool sd_file_open = false;
+
+static const str_table_t sd_usb_table[] = {
+  {"OFF", 0},
+  {"ON",  1},
+  {NULL, 0}
+};
+
+/*! \brief FatFs and the usb mass storage function are exclusive */
+static bool sd_check_local(BaseSequentialStream * chp)
+{
+  if( usb_msd_is_attached() )
+  {
+    util_message_error(chp, "card is exported over usb, sd.usb(OFF) first");
+    return false;
+  }
+  return true;
+}
+
+/*! \brief close the open file and unmount, the first error is returned */
+static FRESULT sd_unmount(void)
+{
+  FRESULT err = FR_OK;
+
+  if( sd_file_open )
+  {
+    err = f_close(&file_obj);
+    sd_file_open = false;
+  }
+  if( sd_mounted )
+  {
+    FRESULT mount_err = f_mount(NULL, "", 0);
+    if( err == FR_OK )
+    {
+      err = mount_err;
+    }
+    sd_mounted = false;
+  }
+  return err;
+}
+
 static bool fatfs_error_check(BaseSequentialStream * chp, FRESULT err)
 {
   switch(err)
@@ -149,6 +194,8 @@ bool fetch_sd_disconnect_cmd(BaseSequentialStream * chp, uint32_t argc, char * a
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
+  usb_msd_detach();
+  sd_unmount();
   sdcDisconnect(&SDCD1);
 
   // power off card
@@ -161,20 +208,37 @@ bool fetch_sd_mount_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
-  return fatfs_error_check(chp, f_mount(&filesystem, "", 1) );
+  if( !sd_check_local(chp) )
+  {
+    return false;
+  }
+
+  if( !fatfs_error_check(chp, f_mount(&filesystem, "", 1)) )
+  {
+    return false;
+  }
+
+  sd_mounted = true;
+  return true;
 }
 
 bool fetch_sd_unmount_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
-  return fatfs_error_check(chp, f_mount(NULL, NULL, 0) );
+  // closing flushes the open file's buffers to the card
+  return fatfs_error_check(chp, sd_unmount());
 }
 
 bool fetch_sd_format_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
+  if( !sd_check_local(chp) )
+  {
+    return false;
+  }
+
   return fatfs_error_check(chp, f_mkfs("", 0, 0) );
 }
 
@@ -183,19 +247,28 @@ bool fetch_sd_open_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
   FETCH_MAX_ARGS(chp, argc, 1);
   FETCH_MIN_ARGS(chp, argc, 1);
 
-  return fatfs_error_check(chp, f_open(&file_obj, argv[0], FA_READ+FA_WRITE+FA_OPEN_ALWAYS)); 
+  if( !fatfs_error_check(chp, f_open(&file_obj, argv[0], FA_READ+FA_WRITE+FA_OPEN_ALWAYS)) )
+  {
+    return false;
+  }
+
+  sd_file_open = true;
+  return true;
 }
 
 bool fetch_sd_close_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
 
+  sd_file_open = false;
+
   return fatfs_error_check(chp, f_close(&file_obj));
 }
 
 bool fetch_sd_unlink_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
-  FETCH_MAX_ARGS(chp, argc, 0);
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
   
   return fatfs_error_check(chp, f_unlink(argv[0]));
 }
@@ -278,6 +351,69 @@ bool fetch_sd_dir_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 
 bool fetch_sd_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  util_message_bool(chp, "connected", blkGetDriverState(&SDCD1) == BLK_READY);
+  util_message_bool(chp, "mounted", sd_mounted);
+  util_message_bool(chp, "file_open", sd_file_open);
+  util_message_bool(chp, "usb", usb_msd_is_attached());
+
+  return true;
+}
+
+bool fetch_sd_usb_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t on;
+  usb_msd_status_t status;
+
+  if( argc == 1 )
+  {
+    if( !util_match_str_table(argv[0], &on, sd_usb_table) )
+    {
+      util_message_error(chp, "expected ON or OFF");
+      return false;
+    }
+
+    if( on && !USB_USE_MSD )
+    {
+      util_message_error(chp, "built without USB_USE_MSD");
+      return false;
+    }
+
+    if( on )
+    {
+      if( blkGetDriverState(&SDCD1) != BLK_READY )
+      {
+        util_message_error(chp, "card not connected, sd.connect first");
+        return false;
+      }
+
+      // hand the card over, FatFs must not touch it any more
+      sd_unmount();
+
+      if( !usb_msd_attach((BaseBlockDevice *)&SDCD1) )
+      {
+        util_message_error(chp, "usb_msd_attach failed");
+        return false;
+      }
+    }
+    else
+    {
+      usb_msd_detach();
+    }
+  }
+
+  usb_msd_get_status(&status);
+
+  util_message_bool(chp, "usb", status.attached);
+  util_message_bool(chp, "ejected", status.ejected);
+  util_message_uint32(chp, "blocks", status.blocks);
+  util_message_uint32(chp, "read_blocks", status.read_blocks);
+  util_message_uint32(chp, "write_blocks", status.write_blocks);
+  util_message_uint32(chp, "errors", status.errors);
+
   return true;
 }
 
@@ -290,7 +426,51 @@ bool fetch_sd_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
   FETCH_HELP_BREAK(chp);
   FETCH_HELP_TITLE(chp,"SD Help");
   FETCH_HELP_BREAK(chp);
-  FETCH_HELP_CMD(chp,"FIXME");
+  FETCH_HELP_CMD(chp,"connect");
+  FETCH_HELP_DES(chp,"Power up and connect the card");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"disconnect");
+  FETCH_HELP_DES(chp,"Disconnect and power down the card");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"mount");
+  FETCH_HELP_DES(chp,"Mount the FAT file system");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"unmount");
+  FETCH_HELP_DES(chp,"Unmount the file system");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"format");
+  FETCH_HELP_DES(chp,"Create a FAT file system");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"open(<name>)");
+  FETCH_HELP_DES(chp,"Open (create) a file for read/write");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"close");
+  FETCH_HELP_DES(chp,"Close the open file");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"read");
+  FETCH_HELP_DES(chp,"Read up to 64 bytes from the open file");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"write(<string>)");
+  FETCH_HELP_DES(chp,"Write to the open file");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"tell");
+  FETCH_HELP_DES(chp,"File position");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"seek(<offset>)");
+  FETCH_HELP_DES(chp,"Set file position");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"unlink(<name>)");
+  FETCH_HELP_DES(chp,"Delete a file");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"dir");
+  FETCH_HELP_DES(chp,"List the root directory");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"status");
+  FETCH_HELP_DES(chp,"Card, file system and usb state");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"usb([<ON|OFF>])");
+  FETCH_HELP_DES(chp,"Export the card as a usb mass storage device {needs USB_USE_MSD}");
+  FETCH_HELP_DES(chp,"ON unmounts the file system, eject on the host before OFF");
   FETCH_HELP_BREAK(chp);
 
 	return true;
@@ -302,12 +482,16 @@ void fetch_sd_init(void)
   palSetPad(GPIOA, GPIOA_PA10_SDIO_PWR);
 
   // start sdio peripheral
-  sdcStart(&SDCD1,0);
+  util_dma_sdc_start(&SDCD1,0);
 }
 
 bool fetch_sd_reset(BaseSequentialStream * chp)
 {
-  // TODO
+  (void) chp;
+
+  usb_msd_detach();
+  sd_unmount();
+
   return true;
 }
 
@@ -24,6 +24,14 @@
 
 #define SERIAL_DRIVER_COUNT 3
 
+#ifndef FETCH_SERIAL_ABORT_POLL_MS
+#define FETCH_SERIAL_ABORT_POLL_MS  20
+#endif
+
+#if SERIAL_DRIVER_COUNT != FETCH_SERIAL_PROFILE_DEVICES
+#error FETCH_SERIAL_PROFILE_DEVICES does not match the serial devices
+#endif
+
 SerialConfig serial_configs[SERIAL_DRIVER_COUNT];
 event_listener_t serial_events[SERIAL_DRIVER_COUNT];
 SerialDriver * serial_drivers[SERIAL_DRIVER_COUNT] = { &SD4, &SD3, &SD2 };
@@ -31,6 +39,28 @@ SerialDriver * serial_drivers[SERIAL_DRIVER_COUNT] = { &SD4, &SD3, &SD2 };
 uint32_t tx_timeout_ms = 100;
 uint32_t rx_timeout_ms = 100;
 
+/*
+ * One byte within rx_timeout_ms. Waits in slices so an abort ends a long
+ * timeout early, returns false on timeout or abort.
+ */
+static bool serial_read_byte( SerialDriver * sdp, uint8_t * byte )
+{
+  uint32_t remaining = rx_timeout_ms;
+
+  do
+  {
+    uint32_t slice = (remaining < FETCH_SERIAL_ABORT_POLL_MS) ? remaining : FETCH_SERIAL_ABORT_POLL_MS;
+
+    if( sdReadTimeout(sdp, byte, 1, MS2ST(slice)) == 1 )
+    {
+      return true;
+    }
+    remaining -= slice;
+  } while( remaining > 0 && !fetch_abort_requested() );
+
+  return false;
+}
+
 static SerialDriver * parse_serial_dev( char * str, uint32_t * dev )
 {
   uint32_t dev_id = str[0] - '0';
@@ -186,7 +216,7 @@ bool fetch_serial_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * arg
 
   for( rx_count=0; rx_count < max_count; rx_count++ )
   {
-    if( sdReadTimeout(serial_drv, &byte, 1, MS2ST(rx_timeout_ms)) != 1 )
+    if( !serial_read_byte(serial_drv, &byte) )
     {
       break;
     }
@@ -204,6 +234,13 @@ bool fetch_serial_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * arg
   util_message_string_escape(chp,"str",(char*)fetch_shared_buffer,rx_count);
   util_message_hex_uint8_array(chp,"hex",fetch_shared_buffer,rx_count);
 
+  // what arrived before the abort is reported above
+  if( fetch_abort_requested() )
+  {
+    util_message_error(chp, "aborted");
+    return false;
+  }
+
   return true;
 }
 
@@ -313,7 +350,7 @@ bool fetch_serial_read_line_cmd(BaseSequentialStream * chp, uint32_t argc, char
 
   for( rx_count=0; rx_count < max_count; rx_count++ )
   {
-    if( sdReadTimeout(serial_drv, &byte, 1, MS2ST(rx_timeout_ms)) != 1 )
+    if( !serial_read_byte(serial_drv, &byte) )
     {
       break;
     }
@@ -337,6 +374,13 @@ bool fetch_serial_read_line_cmd(BaseSequentialStream * chp, uint32_t argc, char
   util_message_string_escape(chp,"str",(char*)fetch_shared_buffer,rx_count);
   util_message_hex_uint8_array(chp,"hex",fetch_shared_buffer,rx_count);
 
+  // what arrived before the abort is reported above
+  if( fetch_abort_requested() )
+  {
+    util_message_error(chp, "aborted");
+    return false;
+  }
+
   return true;
 }
 
@@ -415,6 +459,85 @@ bool fetch_serial_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * arg
 	return true;
 }
 
+void fetch_serial_profile_save(fetch_serial_profile_t * profile)
+{
+  for( uint32_t i = 0; i < SERIAL_DRIVER_COUNT; i++ )
+  {
+    profile->started[i] = serial_drivers[i]->state == SD_READY;
+    profile->speed[i] = serial_configs[i].speed;
+  }
+
+  profile->tx_timeout_ms = tx_timeout_ms;
+  profile->rx_timeout_ms = rx_timeout_ms;
+}
+
+void fetch_serial_profile_load(const fetch_serial_profile_t * profile)
+{
+  for( uint32_t i = 0; i < SERIAL_DRIVER_COUNT; i++ )
+  {
+    sdStop(serial_drivers[i]);
+    serial_configs[i].speed = profile->speed[i];
+
+    if( profile->started[i] )
+    {
+      sdStart(serial_drivers[i], &serial_configs[i]);
+    }
+  }
+
+  tx_timeout_ms = profile->tx_timeout_ms;
+  rx_timeout_ms = profile->rx_timeout_ms;
+}
+
+/*! \brief Point the receive queue of a stopped device at new storage, call locked
+ *
+ * NULL selects the buffer built into the driver.
+ */
+bool fetch_serial_rx_buffer_i(uint32_t dev, uint8_t * buffer, size_t size)
+{
+  SerialDriver * sdp = serial_drivers[dev];
+
+  if( sdp->state != SD_STOP )
+  {
+    return false;
+  }
+
+  if( buffer == NULL )
+  {
+    buffer = sdp->ib;
+    size = SERIAL_BUFFERS_SIZE;
+  }
+
+  iqObjectInit(&sdp->iqueue, buffer, size, sdp->iqueue.q_notify, sdp->iqueue.q_link);
+
+  return true;
+}
+
+size_t fetch_serial_rx_size(uint32_t dev)
+{
+  return serial_drivers[dev]->iqueue.q_top - serial_drivers[dev]->iqueue.q_buffer;
+}
+
+/*! \brief configured rate, 0 if the device is stopped
+ */
+uint32_t fetch_serial_speed(uint32_t dev)
+{
+  return (serial_drivers[dev]->state == SD_READY) ? serial_configs[dev].speed : 0;
+}
+
+/*! \brief pending channel event flags, without clearing them like serial.status
+ */
+eventflags_t fetch_serial_flags_i(uint32_t dev)
+{
+  return serial_events[dev].flags;
+}
+
+/*! \brief bytes waiting in the receive queue
+ */
+size_t fetch_serial_rx_pending_i(uint32_t dev)
+{
+  return iqGetFullI(&serial_drivers[dev]->iqueue);
+}
+
 void fetch_serial_init(void)
 {
   for( uint32_t i = 0; i < SERIAL_DRIVER_COUNT; i++ )
@@ -0,0 +1,205 @@
+/*! \file fetch_snapshot.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Latest value telemetry of all inputs in one record.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_snapshot Fetch Snapshot
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  A dashboard used to poll gpio.read_all, adc.single per device,
+ *  adc.status, mbus.read_analog and serial.status, one framed round trip
+ *  each, and adc.single refused to run while streaming.
+ *
+ *  snapshot.read answers with one fetch_snapshot_t, a fixed binary layout
+ *  sent as an H8 byte array. Everything in it is copied inside a single
+ *  locked section, so the values belong to one instant:
+ *
+ *   - adc: the newest sample set the conversion ISR saw, with its
+ *     timestamp, sequence number, rate and sticky status flags
+ *   - gpio: input data registers of ports A..I
+ *   - serial: started rate, queued receive bytes, pending event flags
+ *     (not cleared, serial.status still sees them)
+ *   - mbus: the result of the last mbus.read_analog, the mbus analog pins
+ *     share ADC3 with streaming and are not sampled in the background
+ *
+ *  snapshot.push(<ms>) makes mpipe emit the same record every <ms> as
+ *
+ *    V:<hex bytes>
+ *
+ *  which costs no shell round trip at all.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_timestamp.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_mbus.h"
+#include "fetch_serial.h"
+#include "fetch_snapshot.h"
+
+// fastest mpipe push
+#ifndef FETCH_SNAPSHOT_PUSH_MIN_MS
+#define FETCH_SNAPSHOT_PUSH_MIN_MS  5
+#endif
+
+static uint32_t snapshot_sequence = 0;
+static volatile uint32_t snapshot_push_ms = 0;
+
+static ioportid_t const snapshot_ports[FETCH_SNAPSHOT_GPIO_PORTS] =
+{
+  GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI
+};
+
+/*! \brief Fill in a snapshot of all inputs
+ *
+ * Safe from any thread, the copy is done locked.
+ */
+void fetch_snapshot_take(fetch_snapshot_t * snap)
+{
+  adc_sample_set_t set;
+  adcsample_t mbus[2];
+
+  memset(snap, 0, sizeof(*snap));
+  snap->version = FETCH_SNAPSHOT_VERSION;
+  snap->size = sizeof(*snap);
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    snap->adc[dev].sample_rate = fetch_adc_sample_rate(dev);
+  }
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    snap->serial[dev].speed = fetch_serial_speed(dev);
+  }
+
+  chSysLock();
+
+  snap->timestamp = util_timestamp_now();
+  snap->sequence = snapshot_sequence++;
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    if( fetch_adc_latest_i(dev, &set) )
+    {
+      snap->adc[dev].timestamp = set.timestamp;
+      snap->adc[dev].sequence_number = set.sequence_number;
+      memcpy(snap->adc[dev].sample, set.sample, sizeof(snap->adc[dev].sample));
+    }
+    snap->adc[dev].flags = fetch_adc_flags_i(dev);
+  }
+
+  for( uint32_t i = 0; i < FETCH_SNAPSHOT_GPIO_PORTS; i++ )
+  {
+    snap->gpio[i] = palReadPort(snapshot_ports[i]);
+  }
+
+  fetch_mbus_last_analog_i(mbus);
+  snap->mbus_analog[0] = mbus[0];
+  snap->mbus_analog[1] = mbus[1];
+
+  for( uint32_t dev = 0; dev < FETCH_SERIAL_PROFILE_DEVICES; dev++ )
+  {
+    snap->serial[dev].rx_pending = fetch_serial_rx_pending_i(dev);
+    snap->serial[dev].flags = fetch_serial_flags_i(dev) & ~FETCH_SNAPSHOT_SERIAL_READY;
+    if( serial_drivers[dev]->state == SD_READY )
+    {
+      snap->serial[dev].flags |= FETCH_SNAPSHOT_SERIAL_READY;
+    }
+  }
+
+  chSysUnlock();
+}
+
+/*! \brief mpipe push period in ms, 0 = off
+ */
+uint32_t fetch_snapshot_push_period(void)
+{
+  return snapshot_push_ms;
+}
+
+bool fetch_snapshot_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Snapshot Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "read");
+  FETCH_HELP_DES(chp, "Latest adc, gpio, mbus and serial state as one binary record");
+  FETCH_HELP_DES(chp, "layout: fetch_snapshot_t in fetch_snapshot.h");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "push([<period>])");
+  FETCH_HELP_DES(chp, "Emit the record on mpipe as V:<hex>");
+  FETCH_HELP_ARG(chp, "period", "ms between records {0 = off}");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_snapshot_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  fetch_snapshot_t snap;
+
+  fetch_snapshot_take(&snap);
+  util_message_hex_uint8_array(chp, "snapshot", (uint8_t *)&snap, sizeof(snap));
+
+  return true;
+}
+
+bool fetch_snapshot_push_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t period;
+
+  if( argc == 0 )
+  {
+    util_message_uint32(chp, "period", snapshot_push_ms);
+    return true;
+  }
+
+  if( !util_parse_uint32(argv[0], &period) || (period != 0 && period < FETCH_SNAPSHOT_PUSH_MIN_MS) )
+  {
+    util_message_error(chp, "invalid period");
+    return false;
+  }
+
+  snapshot_push_ms = period;
+
+  return true;
+}
+
+bool fetch_snapshot_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  snapshot_push_ms = 0;
+
+  return true;
+}
+
+/*! @} */
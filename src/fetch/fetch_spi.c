@@ -16,10 +16,13 @@
 #include "util_general.h"
 #include "util_io.h"
 #include "util_arg_parse.h"
+#include "util_dma.h"
 
 #include "fetch.h"
 #include "fetch_defs.h"
 #include "fetch_spi.h"
+#include "fetch_spi_slave.h"
+#include "fetch_irq.h"
 #include "fetch_parser.h"
 
 #ifndef FETCH_MAX_SPI_BYTES
@@ -28,6 +31,10 @@
 
 #define SPI_DRIVER_COUNT 2
 
+#if SPI_DRIVER_COUNT != FETCH_SPI_PROFILE_DEVICES
+#error FETCH_SPI_PROFILE_DEVICES does not match the spi devices
+#endif
+
 static SPIDriver * spi_drivers[SPI_DRIVER_COUNT] = { &SPID2, &SPID6 };
 static SPIConfig  spi_configs[SPI_DRIVER_COUNT];
 
@@ -53,6 +60,13 @@ static SPIDriver * parse_spi_dev( char * str, uint32_t * dev )
   return spi_drivers[dev_id];
 }
 
+/*! \brief driver of a fetch spi device
+ */
+SPIDriver * fetch_spi_driver(uint32_t dev)
+{
+  return (dev < SPI_DRIVER_COUNT) ? spi_drivers[dev] : NULL;
+}
+
 bool fetch_spi_clock_div_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
@@ -94,7 +108,13 @@ bool fetch_spi_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
     return false;
   }
 
-  spi_configs[spi_dev].end_cb = NULL;
+  if( fetch_spi_slave_active(spi_dev) )
+  {
+    util_message_error(chp, "device in slave mode");
+    return false;
+  }
+
+  spi_configs[spi_dev].end_cb = fetch_irq_spi_end_cb;
   spi_configs[spi_dev].ssport = NULL;
   spi_configs[spi_dev].sspad = 0;
   spi_configs[spi_dev].cr1 = 0;
@@ -169,7 +189,11 @@ bool fetch_spi_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
       break;
   }
 
-  spiStart(spi_drv, &spi_configs[spi_dev]);
+  if( !util_dma_spi_start(spi_drv, &spi_configs[spi_dev]) )
+  {
+    util_message_error(chp, "dma streams in use");
+    return false;
+  }
 
   return true;
 }
@@ -193,6 +217,12 @@ bool fetch_spi_exchange_cmd(BaseSequentialStream * chp, uint32_t argc, char * ar
     return false;
   }
 
+  if( fetch_spi_slave_active(spi_dev) )
+  {
+    util_message_error(chp, "device in slave mode");
+    return false;
+  }
+
   if( spi_drv->state != SPI_READY )
   {
     util_message_error(chp, "SPI driver not ready");
@@ -236,6 +266,7 @@ bool fetch_spi_exchange_cmd(BaseSequentialStream * chp, uint32_t argc, char * ar
     }
   }
 
+  fetch_irq_spi_start(spi_drv);
   spiExchange(spi_drv, byte_count, tx_buffer, rx_buffer);
 
   if( pp_cs.port != NULL )
@@ -261,7 +292,8 @@ bool fetch_spi_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
   FETCH_MAX_ARGS(chp, argc, 1);
   FETCH_MIN_ARGS(chp, argc, 1);
 
-  SPIDriver * spi_drv = parse_spi_dev(argv[0], NULL);
+  uint32_t spi_dev;
+  SPIDriver * spi_drv = parse_spi_dev(argv[0], &spi_dev);
   
   if( spi_drv == NULL )
   {
@@ -269,7 +301,8 @@ bool fetch_spi_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
     return false;
   }
 
-  spiStop(spi_drv);
+  fetch_spi_slave_stop(spi_dev);
+  util_dma_spi_stop(spi_drv);
 
   return true;
 }
@@ -304,10 +337,44 @@ bool fetch_spi_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]
   FETCH_HELP_CMD(chp,"clock_div");
   FETCH_HELP_DES(chp,"Query possible clock rates");
   FETCH_HELP_BREAK(chp);
+  fetch_spi_slave_help(chp);
 
 	return true;
 }
 
+void fetch_spi_profile_save(fetch_spi_profile_t * profile)
+{
+  for( uint32_t i = 0; i < SPI_DRIVER_COUNT; i++ )
+  {
+    // slave mode is not part of a profile
+    profile->started[i] = spi_drivers[i]->state != SPI_STOP && !fetch_spi_slave_active(i);
+    profile->cr1[i] = spi_configs[i].cr1;
+  }
+}
+
+bool fetch_spi_profile_load(const fetch_spi_profile_t * profile)
+{
+  bool ok = true;
+
+  for( uint32_t i = 0; i < SPI_DRIVER_COUNT; i++ )
+  {
+    fetch_spi_slave_stop(i);
+    util_dma_spi_stop(spi_drivers[i]);
+
+    spi_configs[i].end_cb = fetch_irq_spi_end_cb;
+    spi_configs[i].ssport = NULL;
+    spi_configs[i].sspad = 0;
+    spi_configs[i].cr1 = profile->cr1[i];
+
+    if( profile->started[i] && !util_dma_spi_start(spi_drivers[i], &spi_configs[i]) )
+    {
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
 void fetch_spi_init(void)
 {
   // put spi initialization stuff here
@@ -316,9 +383,11 @@ void fetch_spi_init(void)
 
 bool fetch_spi_reset(BaseSequentialStream * chp)
 {
+  fetch_spi_slave_reset(chp);
+
   for( uint32_t i = 0; i < SPI_DRIVER_COUNT; i++ )
   {
-    spiStop(spi_drivers[i]);
+    util_dma_spi_stop(spi_drivers[i]);
   }
 
   return true;
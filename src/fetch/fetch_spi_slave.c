@@ -0,0 +1,758 @@
+/*! \file fetch_spi_slave.c
+  *
+  * Supporting Fetch DSL
+  *
+  * SPI slave emulation and bus sniffing.
+  *
+  * \sa fetch_spi.c
+  * @defgroup fetch_spi_slave Fetch SPI Slave
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  spi.slave(<dev>, <mode>, <cpol>, <cpha>, <bit order>) turns a spi
+ *  device around: a master outside drives SCK and NSS (SPIn.NSS of the
+ *  pin table) and the device receives every byte with a circular dma
+ *  stream into a ring of FETCH_SPI_SLAVE_RING bytes. The cpu never
+ *  touches single bytes, so the ring keeps up with the full slave clock
+ *  of PCLK/2.
+ *
+ *  Modes:
+ *
+ *   - respond: every frame clocks out the response buffer from its first
+ *     byte on, the buffer repeats if the frame is longer
+ *   - regmap: FETCH_SPI_SLAVE_REGS registers behind an address pointer.
+ *     A one byte frame sets the pointer, a frame whose first byte has
+ *     bit 7 set writes the following bytes from register (byte & 0x7f)
+ *     on and leaves the pointer there. Every frame clocks out the
+ *     registers from the pointer, wrapping at the end. A read takes two
+ *     frames, address then data: the answer has to be queued in the dma
+ *     stream before the address byte is in.
+ *   - sniff: receive only, MISO is not driven. To see both directions
+ *     of a bus, run both devices as sniffers, one of them with MOSI wired
+ *     to the MISO line.
+ *
+ *  spi.slave_data loads the response buffer or the registers,
+ *  spi.slave_read reads them back.
+ *
+ *  Both NSS edges raise an exti interrupt, the line is claimed from the
+ *  rule module. The falling edge timestamps the frame and notes the ring
+ *  position, the rising edge closes it and, when transmitting, restarts
+ *  the transmit stream for the next frame. That takes a rcc reset of the
+ *  peripheral, the byte already in the transmit buffer can not be taken
+ *  back any other way, so the master has to keep NSS high for a few
+ *  microseconds between frames.
+ *
+ *  mpipe drains the frames in bulk as
+ *
+ *    P<dev>:<timestamp><length><status><bytes>
+ *
+ *  64 bit timestamp of the falling edge, 16 bit length, 8 bit status
+ *  (FETCH_SPI_SLAVE_TRUNCATED, FETCH_SPI_SLAVE_OVERRUN), then the bytes,
+ *  all hex. Bursts up to the ring size are taken at any clock, the
+ *  sustained rate is bound by the mpipe link. A frame that was already
+ *  overwritten when mpipe came to it goes out without bytes and flagged.
+ *  The ring position is followed by the exti interrupt and the mpipe
+ *  poll, no more than a ring of bytes may pass between two of them.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_io.h"
+#include "util_pin_db.h"
+#include "util_dma.h"
+#include "util_timestamp.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+#include "fetch_rule.h"
+#include "fetch_spi.h"
+#include "fetch_spi_slave.h"
+
+// receive ring per device, power of two
+#ifndef FETCH_SPI_SLAVE_RING
+#define FETCH_SPI_SLAVE_RING        8192
+#endif
+
+// frames waiting for mpipe per device, power of two
+#ifndef FETCH_SPI_SLAVE_FRAMES
+#define FETCH_SPI_SLAVE_FRAMES      64
+#endif
+
+// response buffer size and register count, addresses are 7 bit
+#ifndef FETCH_SPI_SLAVE_REGS
+#define FETCH_SPI_SLAVE_REGS        128
+#endif
+
+#if (FETCH_SPI_SLAVE_RING & (FETCH_SPI_SLAVE_RING - 1)) != 0 || FETCH_SPI_SLAVE_RING > 32768
+#error FETCH_SPI_SLAVE_RING must be a power of two up to 32768
+#endif
+
+#if (FETCH_SPI_SLAVE_FRAMES & (FETCH_SPI_SLAVE_FRAMES - 1)) != 0
+#error FETCH_SPI_SLAVE_FRAMES must be a power of two
+#endif
+
+#if FETCH_SPI_SLAVE_REGS > 128
+#error FETCH_SPI_SLAVE_REGS is limited to 7 bit addresses
+#endif
+
+#define SLAVE_RING_MASK             (FETCH_SPI_SLAVE_RING - 1)
+#define SLAVE_REG_WRITE             0x80
+
+// bounded wait for the dma to take the last byte of a frame
+#define SLAVE_RXNE_SPINS            32
+
+typedef struct {
+  uint64_t timestamp;
+  uint32_t start;             //!< absolute receive count at NSS falling
+  uint32_t end;               //!< absolute receive count at NSS rising
+} slave_frame_t;
+
+typedef struct {
+  uint8_t mode;               //!< FETCH_SPI_SLAVE_*
+  uint16_t cr1;               //!< without SPE
+  port_pin_t nss;
+  uint32_t rx_base;           //!< absolute count at ring position 0 of this lap
+  uint32_t rx_last;           //!< ring position at the last look
+  bool in_frame;
+  uint64_t frame_timestamp;
+  uint32_t frame_start;
+  slave_frame_t frames[FETCH_SPI_SLAVE_FRAMES];
+  uint32_t frame_wr;
+  uint32_t frame_rd;
+  uint32_t response_len;
+  uint8_t reg_ptr;
+  uint32_t frames_total;
+  uint32_t frames_dropped;
+  uint32_t overruns;
+} slave_t;
+
+static slave_t slaves[FETCH_SPI_PROFILE_DEVICES];
+static SPIConfig slave_spi_configs[FETCH_SPI_PROFILE_DEVICES];
+
+// dma memory, kept out of slave_t
+static uint8_t slave_rx[FETCH_SPI_PROFILE_DEVICES][FETCH_SPI_SLAVE_RING];
+// the registers twice, a circular stream from any pointer wraps to register 0
+static uint8_t slave_tx[FETCH_SPI_PROFILE_DEVICES][2 * FETCH_SPI_SLAVE_REGS];
+
+static const char * slave_modes[] = { "off", "respond", "regmap", "sniff", NULL };
+
+static const uint32_t slave_signals[] = {
+  UTIL_PIN_SPI_SCK, UTIL_PIN_SPI_MOSI, UTIL_PIN_SPI_MISO, UTIL_PIN_SPI_NSS
+};
+
+#define SLAVE_SIGNAL_COUNT  (sizeof(slave_signals)/sizeof(slave_signals[0]))
+
+/*! \brief absolute receive count, called locked
+ *
+ * The ring position goes back to 0 at each lap, a smaller position than
+ * at the last look means one lap more.
+ */
+static uint32_t slave_rx_position_i(uint32_t dev)
+{
+  slave_t * sl = &slaves[dev];
+  uint32_t pos = FETCH_SPI_SLAVE_RING - dmaStreamGetTransactionSize(fetch_spi_driver(dev)->dmarx);
+
+  // NDTR reads the full size for an instant at the reload
+  pos &= SLAVE_RING_MASK;
+  if( pos < sl->rx_last )
+  {
+    sl->rx_base += FETCH_SPI_SLAVE_RING;
+  }
+  sl->rx_last = pos;
+
+  return sl->rx_base + pos;
+}
+
+static void slave_reg_write_i(uint32_t dev, uint32_t reg, uint8_t value)
+{
+  reg %= FETCH_SPI_SLAVE_REGS;
+  slave_tx[dev][reg] = value;
+  slave_tx[dev][reg + FETCH_SPI_SLAVE_REGS] = value;
+}
+
+/*! \brief (re)start the peripheral in slave mode, called locked
+ *
+ * The receive stream runs on untouched, a transmit stream is restarted
+ * from the response buffer or the register pointer.
+ */
+static void slave_spi_enable_i(uint32_t dev)
+{
+  SPIDriver * spip = fetch_spi_driver(dev);
+  slave_t * sl = &slaves[dev];
+
+  spip->spi->CR1 = 0;
+
+  if( sl->mode == FETCH_SPI_SLAVE_SNIFF )
+  {
+    spip->spi->CR2 = SPI_CR2_RXDMAEN;
+    spip->spi->CR1 = sl->cr1 | SPI_CR1_RXONLY | SPI_CR1_SPE;
+    return;
+  }
+
+  dmaStreamDisable(spip->dmatx);
+
+  // the byte already in the transmit buffer only goes with a reset
+  if( spip == &SPID2 )
+  {
+    rccResetAPB1(RCC_APB1RSTR_SPI2RST);
+  }
+  else
+  {
+    rccResetAPB2(RCC_APB2RSTR_SPI6RST);
+  }
+
+  if( sl->mode == FETCH_SPI_SLAVE_REGMAP )
+  {
+    dmaStreamSetMemory0(spip->dmatx, &slave_tx[dev][sl->reg_ptr]);
+    dmaStreamSetTransactionSize(spip->dmatx, FETCH_SPI_SLAVE_REGS);
+  }
+  else
+  {
+    dmaStreamSetMemory0(spip->dmatx, slave_tx[dev]);
+    dmaStreamSetTransactionSize(spip->dmatx, sl->response_len);
+  }
+  dmaStreamSetMode(spip->dmatx, (spip->txdmamode & (STM32_DMA_CR_CHSEL_MASK | STM32_DMA_CR_PL_MASK)) |
+                                STM32_DMA_CR_DIR_M2P | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC);
+  dmaStreamEnable(spip->dmatx);
+
+  spip->spi->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+  spip->spi->CR1 = sl->cr1 | SPI_CR1_SPE;
+}
+
+/*! \brief register map update at the end of a frame, called locked
+ */
+static void slave_regmap_frame_i(uint32_t dev, uint32_t start, uint32_t end)
+{
+  slave_t * sl = &slaves[dev];
+  uint8_t first = slave_rx[dev][start & SLAVE_RING_MASK];
+  uint32_t length = end - start;
+  uint32_t reg = (first & ~SLAVE_REG_WRITE) % FETCH_SPI_SLAVE_REGS;
+
+  if( length == 1 )
+  {
+    sl->reg_ptr = reg;
+    return;
+  }
+
+  // a read, the pointer stays
+  if( (first & SLAVE_REG_WRITE) == 0 )
+  {
+    return;
+  }
+
+  for( uint32_t i = 1; i < length && i <= FETCH_SPI_SLAVE_REGS; i++ )
+  {
+    slave_reg_write_i(dev, reg + i - 1, slave_rx[dev][(start + i) & SLAVE_RING_MASK]);
+  }
+  sl->reg_ptr = reg;
+}
+
+static void slave_nss_edge_i(uint32_t dev, uint64_t timestamp)
+{
+  slave_t * sl = &slaves[dev];
+  SPIDriver * spip = fetch_spi_driver(dev);
+  uint32_t end;
+
+  if( palReadPad(sl->nss.port, sl->nss.pin) == PAL_LOW )
+  {
+    sl->in_frame = true;
+    sl->frame_timestamp = timestamp;
+    sl->frame_start = slave_rx_position_i(dev);
+    return;
+  }
+
+  // NSS was already low when the slave started
+  if( !sl->in_frame )
+  {
+    return;
+  }
+  sl->in_frame = false;
+
+  for( uint32_t i = 0; i < SLAVE_RXNE_SPINS && (spip->spi->SR & SPI_SR_RXNE); i++ )
+  {
+  }
+
+  end = slave_rx_position_i(dev);
+  if( end == sl->frame_start )
+  {
+    return;
+  }
+
+  sl->frames_total++;
+  if( sl->frame_wr - sl->frame_rd >= FETCH_SPI_SLAVE_FRAMES )
+  {
+    sl->frames_dropped++;
+  }
+  else
+  {
+    slave_frame_t * fr = &sl->frames[sl->frame_wr & (FETCH_SPI_SLAVE_FRAMES - 1)];
+
+    fr->timestamp = sl->frame_timestamp;
+    fr->start = sl->frame_start;
+    fr->end = end;
+    sl->frame_wr++;
+  }
+
+  if( sl->mode == FETCH_SPI_SLAVE_REGMAP )
+  {
+    slave_regmap_frame_i(dev, sl->frame_start, end);
+  }
+
+  if( sl->mode != FETCH_SPI_SLAVE_SNIFF )
+  {
+    slave_spi_enable_i(dev);
+  }
+}
+
+static void slave_nss_cb(EXTDriver * extp, expchannel_t channel)
+{
+  uint64_t timestamp = util_timestamp_now();
+
+  (void) extp;
+
+  chSysLockFromISR();
+  for( uint32_t dev = 0; dev < FETCH_SPI_PROFILE_DEVICES; dev++ )
+  {
+    if( slaves[dev].mode != FETCH_SPI_SLAVE_OFF && slaves[dev].nss.pin == channel )
+    {
+      slave_nss_edge_i(dev, timestamp);
+    }
+  }
+  chSysUnlockFromISR();
+}
+
+static void slave_pins_reset(uint32_t dev)
+{
+  port_pin_t pp;
+
+  for( uint32_t i = 0; i < SLAVE_SIGNAL_COUNT; i++ )
+  {
+    if( util_pin_port_pin(util_pin_lookup(UTIL_PIN_CLASS_SPI, dev, slave_signals[i]), &pp) )
+    {
+      reset_alternate_mode(pp.port, pp.pin);
+    }
+  }
+}
+
+static bool slave_start(BaseSequentialStream * chp, uint32_t dev, uint32_t mode, uint16_t cr1)
+{
+  SPIDriver * spip = fetch_spi_driver(dev);
+  slave_t * sl = &slaves[dev];
+  port_pin_t pp;
+
+  fetch_spi_slave_stop(dev);
+  util_dma_spi_stop(spip);
+
+  // spiStart enables the clock and takes the dma streams, the master
+  // setup it leaves behind is replaced below
+  memset(&slave_spi_configs[dev], 0, sizeof(slave_spi_configs[dev]));
+  slave_spi_configs[dev].cr1 = cr1;
+  if( !util_dma_spi_start(spip, &slave_spi_configs[dev]) )
+  {
+    util_message_error(chp, "dma streams in use");
+    return false;
+  }
+  spip->spi->CR1 = 0;
+  spip->spi->CR2 = 0;
+
+  for( uint32_t i = 0; i < SLAVE_SIGNAL_COUNT; i++ )
+  {
+    if( !util_pin_port_pin(util_pin_lookup(UTIL_PIN_CLASS_SPI, dev, slave_signals[i]), &pp) )
+    {
+      continue;
+    }
+    if( slave_signals[i] == UTIL_PIN_SPI_NSS )
+    {
+      sl->nss = pp;
+    }
+    if( slave_signals[i] != UTIL_PIN_SPI_MISO || mode != FETCH_SPI_SLAVE_SNIFF )
+    {
+      set_alternate_mode(pp.port, pp.pin);
+    }
+  }
+
+  chSysLock();
+  sl->cr1 = cr1;
+  sl->rx_base = 0;
+  sl->rx_last = 0;
+  sl->in_frame = false;
+  sl->frame_wr = 0;
+  sl->frame_rd = 0;
+  sl->reg_ptr = 0;
+  sl->frames_total = 0;
+  sl->frames_dropped = 0;
+  sl->overruns = 0;
+  if( sl->response_len == 0 )
+  {
+    sl->response_len = 1;
+  }
+  chSysUnlock();
+
+  if( !fetch_rule_exti_claim(sl->nss.port, sl->nss.pin, EXT_CH_MODE_BOTH_EDGES, slave_nss_cb) )
+  {
+    slave_pins_reset(dev);
+    util_dma_spi_stop(spip);
+    util_message_error(chp, "nss exti line %u in use", sl->nss.pin);
+    return false;
+  }
+
+  dmaStreamSetPeripheral(spip->dmarx, &spip->spi->DR);
+  dmaStreamSetMemory0(spip->dmarx, slave_rx[dev]);
+  dmaStreamSetTransactionSize(spip->dmarx, FETCH_SPI_SLAVE_RING);
+  dmaStreamSetMode(spip->dmarx, (spip->rxdmamode & (STM32_DMA_CR_CHSEL_MASK | STM32_DMA_CR_PL_MASK)) |
+                                STM32_DMA_CR_DIR_P2M | STM32_DMA_CR_MINC | STM32_DMA_CR_CIRC);
+  dmaStreamEnable(spip->dmarx);
+  dmaStreamSetPeripheral(spip->dmatx, &spip->spi->DR);
+
+  chSysLock();
+  sl->mode = mode;
+  slave_spi_enable_i(dev);
+  chSysUnlock();
+
+  return true;
+}
+
+/*! \brief next captured frame, false if there is none
+ *
+ * Copies up to max bytes of it to data. Called from mpipe.
+ */
+bool fetch_spi_slave_read_frame(uint32_t dev, fetch_spi_slave_frame_t * frame, uint8_t * data, uint32_t max)
+{
+  slave_t * sl = &slaves[dev];
+  slave_frame_t fr;
+
+  chSysLock();
+  if( sl->mode == FETCH_SPI_SLAVE_OFF )
+  {
+    chSysUnlock();
+    return false;
+  }
+  // also keeps the lap count while no edges come
+  (void)slave_rx_position_i(dev);
+  if( sl->frame_rd == sl->frame_wr )
+  {
+    chSysUnlock();
+    return false;
+  }
+  fr = sl->frames[sl->frame_rd & (FETCH_SPI_SLAVE_FRAMES - 1)];
+  chSysUnlock();
+
+  frame->timestamp = fr.timestamp;
+  frame->length = fr.end - fr.start;
+  frame->copied = frame->length;
+  frame->status = 0;
+  if( frame->copied > max )
+  {
+    frame->copied = max;
+    frame->status |= FETCH_SPI_SLAVE_TRUNCATED;
+  }
+
+  for( uint32_t i = 0; i < frame->copied; i++ )
+  {
+    data[i] = slave_rx[dev][(fr.start + i) & SLAVE_RING_MASK];
+  }
+
+  // the copy is good if the dma had not come round to the frame yet
+  chSysLock();
+  if( slave_rx_position_i(dev) - fr.start > FETCH_SPI_SLAVE_RING )
+  {
+    frame->copied = 0;
+    frame->status |= FETCH_SPI_SLAVE_OVERRUN;
+    sl->overruns++;
+  }
+  sl->frame_rd++;
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_spi_slave_active(uint32_t dev)
+{
+  return dev < FETCH_SPI_PROFILE_DEVICES && slaves[dev].mode != FETCH_SPI_SLAVE_OFF;
+}
+
+/*! \brief back to a stopped spi driver
+ */
+void fetch_spi_slave_stop(uint32_t dev)
+{
+  slave_t * sl = &slaves[dev];
+  SPIDriver * spip = fetch_spi_driver(dev);
+
+  if( sl->mode == FETCH_SPI_SLAVE_OFF )
+  {
+    return;
+  }
+
+  fetch_rule_exti_release(sl->nss.pin);
+
+  chSysLock();
+  sl->mode = FETCH_SPI_SLAVE_OFF;
+  spip->spi->CR1 = 0;
+  spip->spi->CR2 = 0;
+  dmaStreamDisable(spip->dmarx);
+  dmaStreamDisable(spip->dmatx);
+  chSysUnlock();
+
+  slave_pins_reset(dev);
+  util_dma_spi_stop(spip);
+}
+
+static bool slave_parse_dev(BaseSequentialStream * chp, char * arg, uint32_t * dev)
+{
+  if( !util_parse_uint32(arg, dev) || *dev >= FETCH_SPI_PROFILE_DEVICES )
+  {
+    util_message_error(chp, "invalid device identifier");
+    return false;
+  }
+
+  return true;
+}
+
+void fetch_spi_slave_help(BaseSequentialStream * chp)
+{
+  FETCH_HELP_CMD(chp, "slave(<dev>,<mode>,<cpol>,<cpha>,<bit order>)");
+  FETCH_HELP_DES(chp, "Run SPI device as slave, frames go to mpipe as P<dev>:");
+  FETCH_HELP_ARG(chp, "mode", "respond | regmap | sniff");
+  FETCH_HELP_ARG(chp, "cpol", "0 | 1");
+  FETCH_HELP_ARG(chp, "cpha", "0 | 1");
+  FETCH_HELP_ARG(chp, "bit order", "0 {MSB} | 1 {LSB}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "slave_data(<dev>,<offset>,<data 0>[,<data 1> ...])");
+  FETCH_HELP_DES(chp, "Load response bytes or registers");
+  FETCH_HELP_DES(chp, "respond mode sends bytes 0 ... end of the last load");
+  FETCH_HELP_ARG(chp, "offset", "0 ... 127");
+  FETCH_HELP_ARG(chp, "data", "list of bytes or strings");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "slave_read(<dev>[,<offset>,<count>])");
+  FETCH_HELP_DES(chp, "Read back response bytes or registers");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "slave_status(<dev>)");
+  FETCH_HELP_DES(chp, "Mode, frame and overrun counts");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "slave_stop(<dev>)");
+  FETCH_HELP_DES(chp, "Stop slave mode, the device is left stopped");
+  FETCH_HELP_BREAK(chp);
+}
+
+bool fetch_spi_slave_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 5);
+  FETCH_MIN_ARGS(chp, argc, 5);
+
+  uint32_t dev;
+  uint32_t mode;
+  bool cpol;
+  bool cpha;
+  bool lsb;
+  uint16_t cr1 = 0;
+
+  if( !slave_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  if( !util_match_str_array(argv[1], &mode, slave_modes) || mode == FETCH_SPI_SLAVE_OFF )
+  {
+    util_message_error(chp, "invalid mode");
+    return false;
+  }
+
+  if( !util_parse_bool(argv[2], &cpol) )
+  {
+    util_message_error(chp, "invalid CPOL value");
+    return false;
+  }
+
+  if( !util_parse_bool(argv[3], &cpha) )
+  {
+    util_message_error(chp, "invalid CPHA value");
+    return false;
+  }
+
+  if( !util_parse_bool(argv[4], &lsb) )
+  {
+    util_message_error(chp, "invalid MSB/LSB value");
+    return false;
+  }
+
+  if( cpol )
+  {
+    cr1 |= SPI_CR1_CPOL;
+  }
+  if( cpha )
+  {
+    cr1 |= SPI_CR1_CPHA;
+  }
+  if( lsb )
+  {
+    cr1 |= SPI_CR1_LSBFIRST;
+  }
+
+  return slave_start(chp, dev, mode, cr1);
+}
+
+bool fetch_spi_slave_data_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MIN_ARGS(chp, argc, 3);
+
+  uint32_t dev;
+  uint32_t offset;
+  uint32_t count = 0;
+  uint8_t data[FETCH_SPI_SLAVE_REGS];
+
+  if( !slave_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[1], &offset) || offset >= FETCH_SPI_SLAVE_REGS )
+  {
+    util_message_error(chp, "invalid offset");
+    return false;
+  }
+
+  if( !fetch_parse_bytes(chp, argc - 2, &argv[2], data, FETCH_SPI_SLAVE_REGS - offset, &count) )
+  {
+    util_message_error(chp, "fetch_parse_bytes failed");
+    return false;
+  }
+
+  chSysLock();
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    slave_reg_write_i(dev, offset + i, data[i]);
+  }
+  slaves[dev].response_len = offset + count;
+  chSysUnlock();
+
+  return true;
+}
+
+bool fetch_spi_slave_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 3);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+  uint32_t offset = 0;
+  uint32_t count = FETCH_SPI_SLAVE_REGS;
+  uint8_t data[FETCH_SPI_SLAVE_REGS];
+
+  if( !slave_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  if( argc == 2 )
+  {
+    util_message_error(chp, "offset needs a count");
+    return false;
+  }
+
+  if( argc == 3 && (!util_parse_uint32(argv[1], &offset) || offset >= FETCH_SPI_SLAVE_REGS) )
+  {
+    util_message_error(chp, "invalid offset");
+    return false;
+  }
+
+  if( argc == 3 && (!util_parse_uint32(argv[2], &count) || count == 0 || offset + count > FETCH_SPI_SLAVE_REGS) )
+  {
+    util_message_error(chp, "invalid count");
+    return false;
+  }
+
+  chSysLock();
+  memcpy(data, &slave_tx[dev][offset], count);
+  chSysUnlock();
+
+  util_message_uint32(chp, "offset", offset);
+  util_message_hex_uint8_array(chp, "data", data, count);
+
+  return true;
+}
+
+bool fetch_spi_slave_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+  uint32_t received = 0;
+  uint32_t mode, frames, pending, dropped, overruns, response_len, reg_ptr;
+
+  if( !slave_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  chSysLock();
+  mode = slaves[dev].mode;
+  if( mode != FETCH_SPI_SLAVE_OFF )
+  {
+    received = slave_rx_position_i(dev);
+  }
+  frames = slaves[dev].frames_total;
+  pending = slaves[dev].frame_wr - slaves[dev].frame_rd;
+  dropped = slaves[dev].frames_dropped;
+  overruns = slaves[dev].overruns;
+  response_len = slaves[dev].response_len;
+  reg_ptr = slaves[dev].reg_ptr;
+  chSysUnlock();
+
+  util_message_string_format(chp, "mode", "%s", slave_modes[mode]);
+  util_message_uint32(chp, "received", received);
+  util_message_uint32(chp, "frames", frames);
+  util_message_uint32(chp, "pending", pending);
+  util_message_uint32(chp, "dropped", dropped);
+  util_message_uint32(chp, "overruns", overruns);
+  util_message_uint32(chp, "response_len", response_len);
+  util_message_uint32(chp, "reg_ptr", reg_ptr);
+
+  return true;
+}
+
+bool fetch_spi_slave_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+
+  if( !slave_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  fetch_spi_slave_stop(dev);
+
+  return true;
+}
+
+bool fetch_spi_slave_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  for( uint32_t dev = 0; dev < FETCH_SPI_PROFILE_DEVICES; dev++ )
+  {
+    fetch_spi_slave_stop(dev);
+    slaves[dev].response_len = 0;
+  }
+  memset(slave_tx, 0, sizeof(slave_tx));
+
+  return true;
+}
+
+/*! @} */
@@ -0,0 +1,300 @@
+/*! \file fetch_stats.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Running statistics of the adc channels.
+  *
+  * \sa fetch_adc.c
+  * @defgroup fetch_stats Fetch Stats
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  Every sample set the adc delivers, after the channel filters, is
+ *  added to per channel accumulators: count, sum, sum of squares, min
+ *  and max. Samples are 16 bit integers, so 64 bit integer sums stay
+ *  exact for far longer than any capture (2^32 samples of full scale
+ *  16 bit data fit), and the isr only adds. Mean, RMS and standard
+ *  deviation are computed from the sums when adc.stats reads them.
+ *
+ *  One channel at a time also feeds a histogram of FETCH_STATS_BINS
+ *  bins, one per 12 bit code; filtered values above the range count in
+ *  the last bin. adc.histogram(<dev>, <channel>) selects and clears it,
+ *  adc.histogram_read reads a range of bins, min and max from adc.stats
+ *  tell which range is worth reading.
+ *
+ *  Channels running at a divided rate only count converted samples.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_stats.h"
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t sum_sq;
+  adcsample_t min;
+  adcsample_t max;
+} stats_channel_t;
+
+// indexed by fetch adc device
+static stats_channel_t stats_channel[2][ADC_SAMPLE_SET_SIZE];
+
+static uint32_t stats_histogram[FETCH_STATS_BINS];
+static volatile int32_t stats_histogram_dev = -1;
+static volatile uint32_t stats_histogram_channel = 0;
+
+static void stats_clear_channel_i(stats_channel_t * sc)
+{
+  memset(sc, 0, sizeof(*sc));
+}
+
+/*! \brief add the present samples of one set
+ *
+ * Called from the adc end of conversion callback.
+ */
+void fetch_stats_update_i(uint32_t dev, const adcsample_t * samples, uint8_t present)
+{
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( (present & (1 << i)) == 0 )
+    {
+      continue;
+    }
+
+    stats_channel_t * sc = &stats_channel[dev][i];
+    uint32_t x = samples[i];
+
+    if( sc->count == 0 )
+    {
+      sc->min = x;
+      sc->max = x;
+    }
+    sc->count++;
+    sc->sum += x;
+    sc->sum_sq += x * x;
+    if( x < sc->min )
+    {
+      sc->min = x;
+    }
+    if( x > sc->max )
+    {
+      sc->max = x;
+    }
+  }
+
+  if( stats_histogram_dev == (int32_t)dev && (present & (1 << stats_histogram_channel)) )
+  {
+    uint32_t x = samples[stats_histogram_channel];
+
+    stats_histogram[(x < FETCH_STATS_BINS) ? x : FETCH_STATS_BINS - 1]++;
+  }
+}
+
+static bool stats_parse_dev(BaseSequentialStream * chp, char * arg, uint32_t * dev)
+{
+  if( !util_parse_uint32(arg, dev) || *dev > 1 )
+  {
+    util_message_error(chp, "invalid adc device");
+    return false;
+  }
+
+  return true;
+}
+
+void fetch_stats_help(BaseSequentialStream * chp)
+{
+  FETCH_HELP_CMD(chp, "stats(<dev>)");
+  FETCH_HELP_DES(chp, "Count, min, max, mean, rms and std of every channel");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stats_reset(<dev>)");
+  FETCH_HELP_DES(chp, "Restart the statistics of a device");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "histogram(<dev>, <channel>)");
+  FETCH_HELP_DES(chp, "Select and clear the histogram channel");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "histogram_read(<first bin>[, <count>])");
+  FETCH_HELP_DES(chp, "Read histogram bins");
+  FETCH_HELP_ARG(chp, "first bin", "0 ... 4095");
+  FETCH_HELP_ARG(chp, "count", "1 ... 256");
+  FETCH_HELP_BREAK(chp);
+}
+
+bool fetch_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+  stats_channel_t sc[ADC_SAMPLE_SET_SIZE];
+  double count[ADC_SAMPLE_SET_SIZE];
+  double mean[ADC_SAMPLE_SET_SIZE];
+  double rms[ADC_SAMPLE_SET_SIZE];
+  double std[ADC_SAMPLE_SET_SIZE];
+  uint16_t min[ADC_SAMPLE_SET_SIZE];
+  uint16_t max[ADC_SAMPLE_SET_SIZE];
+
+  if( !stats_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  chSysLock();
+  memcpy(sc, stats_channel[dev], sizeof(sc));
+  chSysUnlock();
+
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    count[i] = (double)sc[i].count;
+    min[i] = sc[i].min;
+    max[i] = sc[i].max;
+    if( sc[i].count == 0 )
+    {
+      mean[i] = rms[i] = std[i] = 0.0;
+      continue;
+    }
+    mean[i] = (double)sc[i].sum / count[i];
+    rms[i] = sqrt((double)sc[i].sum_sq / count[i]);
+    // population variance, sum_sq - sum * mean keeps the cancellation small
+    double m2 = (double)sc[i].sum_sq - (double)sc[i].sum * mean[i];
+    std[i] = (m2 > 0.0) ? sqrt(m2 / count[i]) : 0.0;
+  }
+
+  util_message_double_array(chp, "count", count, ADC_SAMPLE_SET_SIZE);
+  util_message_uint16_array(chp, "min", min, ADC_SAMPLE_SET_SIZE);
+  util_message_uint16_array(chp, "max", max, ADC_SAMPLE_SET_SIZE);
+  util_message_double_array(chp, "mean", mean, ADC_SAMPLE_SET_SIZE);
+  util_message_double_array(chp, "rms", rms, ADC_SAMPLE_SET_SIZE);
+  util_message_double_array(chp, "std", std, ADC_SAMPLE_SET_SIZE);
+
+  return true;
+}
+
+bool fetch_stats_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t dev;
+
+  if( !stats_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    chSysLock();
+    stats_clear_channel_i(&stats_channel[dev][i]);
+    chSysUnlock();
+  }
+
+  return true;
+}
+
+bool fetch_stats_histogram_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 2);
+
+  uint32_t dev;
+  uint32_t channel;
+
+  if( !stats_parse_dev(chp, argv[0], &dev) )
+  {
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[1], &channel) || channel >= ADC_SAMPLE_SET_SIZE )
+  {
+    util_message_error(chp, "invalid channel");
+    return false;
+  }
+
+  // detach first, the clear runs unlocked
+  stats_histogram_dev = -1;
+  memset(stats_histogram, 0, sizeof(stats_histogram));
+  stats_histogram_channel = channel;
+  stats_histogram_dev = dev;
+
+  return true;
+}
+
+bool fetch_stats_histogram_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  uint32_t first;
+  uint32_t count = FETCH_STATS_READ_MAX;
+  uint32_t bins[FETCH_STATS_READ_MAX];
+
+  if( !util_parse_uint32(argv[0], &first) || first >= FETCH_STATS_BINS )
+  {
+    util_message_error(chp, "invalid bin");
+    return false;
+  }
+
+  if( argc > 1 && (!util_parse_uint32(argv[1], &count) || count == 0 || count > FETCH_STATS_READ_MAX) )
+  {
+    util_message_error(chp, "invalid count");
+    return false;
+  }
+
+  if( first + count > FETCH_STATS_BINS )
+  {
+    count = FETCH_STATS_BINS - first;
+  }
+
+  chSysLock();
+  memcpy(bins, &stats_histogram[first], sizeof(uint32_t) * count);
+  chSysUnlock();
+
+  util_message_int32(chp, "histogram_dev", stats_histogram_dev);
+  util_message_uint32(chp, "histogram_channel", stats_histogram_channel);
+  util_message_uint32(chp, "first", first);
+  util_message_uint32_array(chp, "bins", bins, count);
+
+  return true;
+}
+
+bool fetch_stats_reset(BaseSequentialStream * chp)
+{
+  (void)chp;
+
+  stats_histogram_dev = -1;
+  memset(stats_histogram, 0, sizeof(stats_histogram));
+
+  for( uint32_t dev = 0; dev < 2; dev++ )
+  {
+    for( uint32_t i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+    {
+      chSysLock();
+      stats_clear_channel_i(&stats_channel[dev][i]);
+      chSysUnlock();
+    }
+  }
+
+  return true;
+}
+
+/*! @} */
@@ -0,0 +1,735 @@
+/*! \file fetch_sweep.c
+  *
+  * Supporting Fetch DSL
+  *
+  * On-device stimulus/response sweeps.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_sweep Fetch Sweep
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  AC sweep (Bode measurement)
+ *
+ *  For every frequency point a sine table is played out of the internal
+ *  DAC (DACD1 channel 1) by DMA while the response is captured on one
+ *  channel of ADC 1 (ADCD2). Both converters are triggered by TIM2_TRGO,
+ *  so every ADC sample is taken on the same timer edge that updates the
+ *  DAC output and the phase relation between them is fixed.
+ *
+ *  The DAC data holding register is preloaded with the last table entry
+ *  before the timer starts, so the output after trigger k is always
+ *  table[(k-1) mod N]. The response is demodulated against that
+ *  reference with a single bin DFT over an integer number of periods,
+ *  which also removes any DC offset.
+ *
+ *  TIM2 is borrowed from the adc module for the duration of the sweep
+ *  and handed back with fetch_adc_timer_restore().
+ *
+ * <hr>
+ *
+ *  DC sweep (source-measure)
+ *
+ *  Steps any dac channel linearly from start to stop. After each step
+ *  the sweep waits out the settling time on a TIM7 one-shot and then
+ *  averages a burst of back to back software triggered conversions of
+ *  the requested adc channels. An optional compliance window on the
+ *  first measured channel ends the sweep early.
+ *
+ *  Both sweeps number adc channels the same way: 0 ... 6 are the
+ *  channels of adc 0, 7 ... 13 those of adc 1, each in the scan order of
+ *  fetch_adc.c. The ac sweep only measures on adc 1.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_dac.h"
+#include "fetch_sweep.h"
+
+#ifndef FETCH_SWEEP_MAX_POINTS
+#define FETCH_SWEEP_MAX_POINTS        64
+#endif
+
+#ifndef FETCH_SWEEP_MAX_SAMPLES
+#define FETCH_SWEEP_MAX_SAMPLES       2048
+#endif
+
+#ifndef FETCH_SWEEP_MAX_STEPS
+#define FETCH_SWEEP_MAX_STEPS         256
+#endif
+
+#define FETCH_SWEEP_MAX_DC_CHANNELS   4
+#define FETCH_SWEEP_MAX_AVG           64
+#define FETCH_SWEEP_MAX_SETTLE_US     10000000
+
+// TIM7 one-shot used for settling, 16 bit at 1 MHz
+#define FETCH_SWEEP_SETTLE_FREQ       1000000
+#define FETCH_SWEEP_SETTLE_MAX_CHUNK  0xffff
+
+// dac table points per stimulus period
+#define FETCH_SWEEP_MIN_TABLE         8
+#define FETCH_SWEEP_MAX_TABLE         64
+
+// conversion rate limit for one adc channel at ADC_SAMPLE_56
+#ifndef FETCH_SWEEP_MAX_TRIGGER_RATE
+#define FETCH_SWEEP_MAX_TRIGGER_RATE  100000
+#endif
+
+#define FETCH_SWEEP_MIN_FREQ          1
+#define FETCH_SWEEP_MAX_FREQ          (FETCH_SWEEP_MAX_TRIGGER_RATE / FETCH_SWEEP_MIN_TABLE)
+
+// periods discarded before measuring to let the DUT settle
+#define FETCH_SWEEP_SETTLE_CYCLES     2
+#define FETCH_SWEEP_DEFAULT_CYCLES    8
+
+#define FETCH_SWEEP_DEFAULT_AMPLITUDE 1000
+#define FETCH_SWEEP_DEFAULT_OFFSET    2048
+
+// TIM2 is on APB1
+#define FETCH_SWEEP_TIMER_FREQ        STM32_TIMCLK1
+
+#define FETCH_SWEEP_ADC_CH_COUNT      7
+
+#define ADC_CR2_EXTSEL_TIM2_TRGO (ADC_CR2_EXTSEL_2 | ADC_CR2_EXTSEL_1) // 0b0110
+
+#define ADC_SMPR1(smp) (smp | (smp<<3) | (smp<<6) | (smp<<9) | (smp<<12) | (smp<<15) | (smp<<18) | (smp<<21) | (smp<<24))
+#define ADC_SMPR2(smp) (smp | (smp<<3) | (smp<<6) | (smp<<9) | (smp<<12) | (smp<<15) | (smp<<18) | (smp<<21) | (smp<<24) | (smp<<27))
+
+// DAC_CR TSEL1 = 0b100
+#define DAC_TRIGGER_TIM2_TRGO         4
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// same scan order as adc2_conv_grp in fetch_adc.c
+static const uint8_t adc2_channels[FETCH_SWEEP_ADC_CH_COUNT] = { 2, 6, 7, 11, 13, 14, 15 };
+
+#if (2 * FETCH_SWEEP_ADC_CH_COUNT * FETCH_SWEEP_MAX_AVG) > FETCH_SWEEP_MAX_SAMPLES
+#error "FETCH_SWEEP_MAX_SAMPLES too small for dc sweep averaging"
+#endif
+
+static dacsample_t sweep_dac_table[FETCH_SWEEP_MAX_TABLE];
+static float sweep_ref_sin[FETCH_SWEEP_MAX_TABLE];
+static float sweep_ref_cos[FETCH_SWEEP_MAX_TABLE];
+static adcsample_t sweep_adc_buffer[FETCH_SWEEP_MAX_SAMPLES];
+
+static double sweep_freq[FETCH_SWEEP_MAX_POINTS];
+static double sweep_gain[FETCH_SWEEP_MAX_POINTS];
+static double sweep_phase[FETCH_SWEEP_MAX_POINTS];
+
+static uint16_t sweep_dc_dac[FETCH_SWEEP_MAX_STEPS];
+static uint16_t sweep_dc_adc[FETCH_SWEEP_MAX_DC_CHANNELS][FETCH_SWEEP_MAX_STEPS];
+
+static uint16_t sweep_limit_low = 0;
+static uint16_t sweep_limit_high = 0xfff;
+
+static GPTConfig sweep_gpt_cfg;
+static GPTConfig sweep_settle_gpt_cfg;
+static binary_semaphore_t sweep_settle_sem;
+
+static ADCConversionGroup sweep_adc_grp = {
+	.circular        = false,
+	.num_channels    = 1,
+	.end_cb          = NULL,
+	.error_cb        = NULL,
+	/* HW dependent part.*/
+	.cr1             = 0,
+	.cr2             = ADC_CR2_EXTEN_0 | ADC_CR2_EXTSEL_TIM2_TRGO, // rising edge of TIM2_TRGO
+	.smpr1           = ADC_SMPR1(ADC_SAMPLE_56),
+	.smpr2           = ADC_SMPR2(ADC_SAMPLE_56),
+	.sqr1            = ADC_SQR1_NUM_CH(1),
+	.sqr2            = 0,
+	.sqr3            = 0
+};
+
+/*! \brief Software triggered scans for the dc sweep, same sequences as fetch_adc.c
+ */
+static const ADCConversionGroup sweep_adc2_dc_grp = {
+	.circular        = false,
+	.num_channels    = FETCH_SWEEP_ADC_CH_COUNT,
+	.end_cb          = NULL,
+	.error_cb        = NULL,
+	/* HW dependent part.*/
+	.cr1             = 0,
+	.cr2             = ADC_CR2_SWSTART,
+	.smpr1           = ADC_SMPR1(ADC_SAMPLE_480),
+	.smpr2           = ADC_SMPR2(ADC_SAMPLE_480),
+	.sqr1            = ADC_SQR1_NUM_CH(FETCH_SWEEP_ADC_CH_COUNT),
+	.sqr2            = ADC_SQR2_SQ7_N(15),
+	.sqr3            = ADC_SQR3_SQ1_N(2) | ADC_SQR3_SQ2_N(6) | ADC_SQR3_SQ3_N(7) | ADC_SQR3_SQ4_N(11) | ADC_SQR3_SQ5_N(13) | ADC_SQR3_SQ6_N(14)
+};
+
+static const ADCConversionGroup sweep_adc3_dc_grp = {
+	.circular        = false,
+	.num_channels    = FETCH_SWEEP_ADC_CH_COUNT,
+	.end_cb          = NULL,
+	.error_cb        = NULL,
+	/* HW dependent part.*/
+	.cr1             = 0,
+	.cr2             = ADC_CR2_SWSTART,
+	.smpr1           = ADC_SMPR1(ADC_SAMPLE_480),
+	.smpr2           = ADC_SMPR2(ADC_SAMPLE_480),
+	.sqr1            = ADC_SQR1_NUM_CH(FETCH_SWEEP_ADC_CH_COUNT),
+	.sqr2            = ADC_SQR2_SQ7_N(15),
+	.sqr3            = ADC_SQR3_SQ1_N(5) | ADC_SQR3_SQ2_N(6) | ADC_SQR3_SQ3_N(7) | ADC_SQR3_SQ4_N(8) | ADC_SQR3_SQ5_N(9) | ADC_SQR3_SQ6_N(14)
+};
+
+static const DACConversionGroup sweep_dac_grp = {
+	.num_channels    = 1,
+	.end_cb          = NULL,
+	.error_cb        = NULL,
+	.trigger         = DAC_TRG(DAC_TRIGGER_TIM2_TRGO)
+};
+
+typedef struct {
+  uint32_t table_size;
+  uint32_t cycles;
+  uint32_t interval;
+  double   frequency;
+} sweep_ac_point_t;
+
+/*! \brief pick table size, capture length and timer interval for a frequency
+ */
+static void sweep_ac_plan( double frequency, uint32_t cycles, sweep_ac_point_t * point )
+{
+  uint32_t table_size = FETCH_SWEEP_MAX_TRIGGER_RATE / frequency;
+
+  if( table_size > FETCH_SWEEP_MAX_TABLE )
+  {
+    table_size = FETCH_SWEEP_MAX_TABLE;
+  }
+  else if( table_size < FETCH_SWEEP_MIN_TABLE )
+  {
+    table_size = FETCH_SWEEP_MIN_TABLE;
+  }
+
+  if( (FETCH_SWEEP_SETTLE_CYCLES + cycles) * table_size > FETCH_SWEEP_MAX_SAMPLES )
+  {
+    cycles = (FETCH_SWEEP_MAX_SAMPLES / table_size) - FETCH_SWEEP_SETTLE_CYCLES;
+  }
+
+  point->table_size = table_size;
+  point->cycles = cycles;
+  point->interval = (uint32_t)((FETCH_SWEEP_TIMER_FREQ / (frequency * table_size)) + 0.5);
+  point->frequency = (double)FETCH_SWEEP_TIMER_FREQ / ((double)point->interval * table_size);
+}
+
+/*! \brief run a single frequency point and demodulate the response
+ */
+static bool sweep_ac_point( const sweep_ac_point_t * point, uint16_t amplitude, uint16_t offset, double * gain, double * phase )
+{
+  uint32_t n;
+  uint32_t count = (FETCH_SWEEP_SETTLE_CYCLES + point->cycles) * point->table_size;
+  uint32_t timeout_ms = ((uint64_t)count * point->interval * 2000) / FETCH_SWEEP_TIMER_FREQ + 100;
+  float sum_sin = 0;
+  float sum_cos = 0;
+  msg_t msg;
+
+  for( n = 0; n < point->table_size; n++ )
+  {
+    float angle = (2 * M_PI * n) / point->table_size;
+    int32_t value = offset + (int32_t)lrintf(amplitude * sinf(angle));
+
+    sweep_ref_sin[n] = sinf(angle);
+    sweep_ref_cos[n] = cosf(angle);
+
+    if( value < 0 )
+    {
+      value = 0;
+    }
+    else if( value > 0xfff )
+    {
+      value = 0xfff;
+    }
+    sweep_dac_table[n] = value;
+  }
+
+  gptStopTimer(&GPTD2);
+  fetch_dac_wave_stop();
+
+  // the first trigger latches this value, the dma refills the holding
+  // register from table[0] onwards
+  dacPutChannelX(&DACD1, 0, sweep_dac_table[point->table_size - 1]);
+  dacStartConversion(&DACD1, &sweep_dac_grp, sweep_dac_table, point->table_size);
+
+  chSysLock();
+  adcStartConversionI(&ADCD2, &sweep_adc_grp, sweep_adc_buffer, count);
+  gptStartContinuousI(&GPTD2, point->interval);
+  msg = osalThreadSuspendTimeoutS(&ADCD2.thread, MS2ST(timeout_ms));
+  if( msg == MSG_TIMEOUT )
+  {
+    adcStopConversionI(&ADCD2);
+  }
+  chSysUnlock();
+
+  gptStopTimer(&GPTD2);
+  dacStopConversion(&DACD1);
+
+  if( msg != MSG_OK )
+  {
+    return false;
+  }
+
+  // sample k was taken while the output held table[(k-1) mod N]
+  for( n = FETCH_SWEEP_SETTLE_CYCLES * point->table_size; n < count; n++ )
+  {
+    uint32_t ref = (n + point->table_size - 1) % point->table_size;
+
+    sum_sin += sweep_adc_buffer[n] * sweep_ref_sin[ref];
+    sum_cos += sweep_adc_buffer[n] * sweep_ref_cos[ref];
+  }
+
+  n = point->cycles * point->table_size;
+
+  *gain = (2.0 * sqrtf(sum_sin * sum_sin + sum_cos * sum_cos)) / ((double)n * amplitude);
+  *phase = atan2f(sum_cos, sum_sin) * (180.0 / M_PI);
+
+  return true;
+}
+
+static void sweep_settle_cb(GPTDriver * gptp)
+{
+  (void) gptp;
+
+  chSysLockFromISR();
+  chBSemSignalI(&sweep_settle_sem);
+  chSysUnlockFromISR();
+}
+
+/*! \brief block for a number of microseconds timed by TIM7
+ */
+static void sweep_settle( uint32_t us )
+{
+  while( us > 0 )
+  {
+    uint32_t chunk = us > FETCH_SWEEP_SETTLE_MAX_CHUNK ? FETCH_SWEEP_SETTLE_MAX_CHUNK : us;
+
+    us -= chunk;
+
+    // one-shot intervals below 2 ticks are not supported by the timer
+    if( chunk < 2 )
+    {
+      chunk = 2;
+    }
+
+    gptStartOneShot(&GPTD7, chunk);
+    chBSemWait(&sweep_settle_sem);
+  }
+}
+
+/*! \brief average every requested adc channel over a burst of scans
+ *
+ * Channels 0 ... 6 are adc 0 (ADCD3), 7 ... 13 are adc 1 (ADCD2).
+ */
+static void sweep_dc_measure( const uint8_t * channels, uint32_t channel_count, uint32_t avg, uint32_t step )
+{
+  adcsample_t * adc3_samples = &sweep_adc_buffer[0];
+  adcsample_t * adc2_samples = &sweep_adc_buffer[FETCH_SWEEP_ADC_CH_COUNT * FETCH_SWEEP_MAX_AVG];
+  bool adc3_used = false;
+  bool adc2_used = false;
+
+  for( uint32_t i = 0; i < channel_count; i++ )
+  {
+    if( channels[i] < FETCH_SWEEP_ADC_CH_COUNT )
+    {
+      adc3_used = true;
+    }
+    else
+    {
+      adc2_used = true;
+    }
+  }
+
+  if( adc3_used )
+  {
+    adcConvert(&ADCD3, &sweep_adc3_dc_grp, adc3_samples, avg);
+  }
+
+  if( adc2_used )
+  {
+    adcConvert(&ADCD2, &sweep_adc2_dc_grp, adc2_samples, avg);
+  }
+
+  for( uint32_t i = 0; i < channel_count; i++ )
+  {
+    adcsample_t * samples = adc3_samples;
+    uint32_t index = channels[i];
+    uint32_t sum = 0;
+
+    if( index >= FETCH_SWEEP_ADC_CH_COUNT )
+    {
+      samples = adc2_samples;
+      index -= FETCH_SWEEP_ADC_CH_COUNT;
+    }
+
+    for( uint32_t j = 0; j < avg; j++ )
+    {
+      sum += samples[(j * FETCH_SWEEP_ADC_CH_COUNT) + index];
+    }
+
+    sweep_dc_adc[i][step] = (sum + (avg / 2)) / avg;
+  }
+}
+
+bool fetch_sweep_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Sweep Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "ac(<adc ch>,<start>,<stop>,<points>[,<amplitude>[,<offset>[,<cycles>]]])");
+  FETCH_HELP_DES(chp, "Frequency response of internal DAC (ch 4) to ADC 1 channel");
+  FETCH_HELP_DES(chp, "Log spaced points, returns freq, gain and phase (deg) tables");
+  FETCH_HELP_ARG(chp, "adc ch", "7 ... 13 {adc 1 only, same numbers as dc, adc 1 must be stopped}");
+  FETCH_HELP_ARG(chp, "start", "1 ... 12500 {Hz}");
+  FETCH_HELP_ARG(chp, "stop", "1 ... 12500 {Hz}");
+  FETCH_HELP_ARG(chp, "points", "1 ... 64");
+  FETCH_HELP_ARG(chp, "amplitude", "1 ... 2047 {default 1000}");
+  FETCH_HELP_ARG(chp, "offset", "0 ... 4095 {default 2048}");
+  FETCH_HELP_ARG(chp, "cycles", "1 ... 64 {periods measured per point, default 8}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "dc(<dac ch>,<start>,<stop>,<steps>,<settle>,<adc ch>[,<adc ch> ...],<avg>)");
+  FETCH_HELP_DES(chp, "Step a dac channel and measure adc channels at each step");
+  FETCH_HELP_DES(chp, "Returns the dac values and one averaged table per adc channel");
+  FETCH_HELP_ARG(chp, "dac ch", "0 | 1 | 2 | 3 | 4 {4 = internal dac}");
+  FETCH_HELP_ARG(chp, "start", "0 ... 4095");
+  FETCH_HELP_ARG(chp, "stop", "0 ... 4095");
+  FETCH_HELP_ARG(chp, "steps", "1 ... 256");
+  FETCH_HELP_ARG(chp, "settle", "0 ... 10000000 {us after each step}");
+  FETCH_HELP_ARG(chp, "adc ch", "0 ... 6 {adc 0} | 7 ... 13 {adc 1}, up to 4 channels");
+  FETCH_HELP_ARG(chp, "avg", "1 ... 64 {conversions averaged per point}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "limit([<low>,<high>])");
+  FETCH_HELP_DES(chp, "Get/set the dc sweep compliance window on the first adc channel");
+  FETCH_HELP_DES(chp, "The sweep stops at the first reading outside the window");
+  FETCH_HELP_ARG(chp, "low", "0 ... 4095 {default 0}");
+  FETCH_HELP_ARG(chp, "high", "0 ... 4095 {default 4095}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "reset");
+  FETCH_HELP_DES(chp, "Reset sweep module");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_sweep_ac_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 7);
+  FETCH_MIN_ARGS(chp, argc, 4);
+
+  uint8_t channel;
+  uint32_t start;
+  uint32_t stop;
+  uint32_t points;
+  uint16_t amplitude = FETCH_SWEEP_DEFAULT_AMPLITUDE;
+  uint16_t offset = FETCH_SWEEP_DEFAULT_OFFSET;
+  uint32_t cycles = FETCH_SWEEP_DEFAULT_CYCLES;
+  sweep_ac_point_t point;
+  bool success = true;
+
+  if( !util_parse_uint8(argv[0], &channel) || channel >= (2 * FETCH_SWEEP_ADC_CH_COUNT) )
+  {
+    util_message_error(chp, "invalid adc channel");
+    return false;
+  }
+
+  if( channel < FETCH_SWEEP_ADC_CH_COUNT )
+  {
+    util_message_error(chp, "ac sweep measures on adc 1, channels 7 ... 13");
+    return false;
+  }
+  channel -= FETCH_SWEEP_ADC_CH_COUNT;
+
+  if( !util_parse_uint32(argv[1], &start) || start < FETCH_SWEEP_MIN_FREQ || start > FETCH_SWEEP_MAX_FREQ )
+  {
+    util_message_error(chp, "invalid start frequency");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[2], &stop) || stop < FETCH_SWEEP_MIN_FREQ || stop > FETCH_SWEEP_MAX_FREQ )
+  {
+    util_message_error(chp, "invalid stop frequency");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[3], &points) || points == 0 || points > FETCH_SWEEP_MAX_POINTS )
+  {
+    util_message_error(chp, "invalid number of points");
+    return false;
+  }
+
+  if( argc > 4 && (!util_parse_uint16(argv[4], &amplitude) || amplitude == 0 || amplitude > 2047) )
+  {
+    util_message_error(chp, "invalid amplitude");
+    return false;
+  }
+
+  if( argc > 5 && (!util_parse_uint16(argv[5], &offset) || offset > 0xfff) )
+  {
+    util_message_error(chp, "invalid offset");
+    return false;
+  }
+
+  if( argc > 6 && (!util_parse_uint32(argv[6], &cycles) || cycles == 0 || cycles > 64) )
+  {
+    util_message_error(chp, "invalid cycles");
+    return false;
+  }
+
+  if( ADCD2.state != ADC_READY )
+  {
+    util_message_error(chp, "ADC device not in ready state");
+    return false;
+  }
+
+  if( DACD1.state != DAC_READY )
+  {
+    util_message_error(chp, "DAC device not in ready state");
+    return false;
+  }
+
+  sweep_adc_grp.sqr3 = ADC_SQR3_SQ1_N(adc2_channels[channel]);
+  gptStart(&GPTD2, &sweep_gpt_cfg);
+
+  for( uint32_t i = 0; i < points; i++ )
+  {
+    double frequency = start;
+
+    if( points > 1 )
+    {
+      frequency = start * pow((double)stop / start, (double)i / (points - 1));
+    }
+
+    sweep_ac_plan(frequency, cycles, &point);
+    sweep_freq[i] = point.frequency;
+
+    if( !sweep_ac_point(&point, amplitude, offset, &sweep_gain[i], &sweep_phase[i]) )
+    {
+      util_message_error(chp, "adc capture failed at point %u", i);
+      success = false;
+      break;
+    }
+  }
+
+  dacPutChannelX(&DACD1, 0, 0);
+  fetch_adc_timer_restore(1);
+
+  if( !success )
+  {
+    return false;
+  }
+
+  util_message_double_array(chp, "freq", sweep_freq, points);
+  util_message_double_array(chp, "gain", sweep_gain, points);
+  util_message_double_array(chp, "phase", sweep_phase, points);
+
+  return true;
+}
+
+bool fetch_sweep_dc_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 6 + FETCH_SWEEP_MAX_DC_CHANNELS);
+  FETCH_MIN_ARGS(chp, argc, 7);
+
+  uint16_t dac_channel;
+  uint16_t start;
+  uint16_t stop;
+  uint32_t steps;
+  uint32_t settle_us;
+  uint32_t avg;
+  uint8_t channels[FETCH_SWEEP_MAX_DC_CHANNELS];
+  uint32_t channel_count = argc - 6;
+  uint32_t count = 0;
+  bool limit_hit = false;
+  char name[8];
+
+  if( !util_parse_uint16(argv[0], &dac_channel) || dac_channel > 4 )
+  {
+    util_message_error(chp, "invalid dac channel");
+    return false;
+  }
+
+  if( !util_parse_uint16(argv[1], &start) || start > 0xfff )
+  {
+    util_message_error(chp, "invalid start value");
+    return false;
+  }
+
+  if( !util_parse_uint16(argv[2], &stop) || stop > 0xfff )
+  {
+    util_message_error(chp, "invalid stop value");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[3], &steps) || steps == 0 || steps > FETCH_SWEEP_MAX_STEPS )
+  {
+    util_message_error(chp, "invalid number of steps");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[4], &settle_us) || settle_us > FETCH_SWEEP_MAX_SETTLE_US )
+  {
+    util_message_error(chp, "invalid settle time");
+    return false;
+  }
+
+  for( uint32_t i = 0; i < channel_count; i++ )
+  {
+    if( !util_parse_uint8(argv[5 + i], &channels[i]) || channels[i] >= (2 * FETCH_SWEEP_ADC_CH_COUNT) )
+    {
+      util_message_error(chp, "invalid adc channel");
+      return false;
+    }
+
+    ADCDriver * adc_drv = channels[i] < FETCH_SWEEP_ADC_CH_COUNT ? &ADCD3 : &ADCD2;
+
+    if( adc_drv->state != ADC_READY )
+    {
+      util_message_error(chp, "ADC device not in ready state");
+      return false;
+    }
+  }
+
+  if( !util_parse_uint32(argv[argc - 1], &avg) || avg == 0 || avg > FETCH_SWEEP_MAX_AVG )
+  {
+    util_message_error(chp, "invalid averaging count");
+    return false;
+  }
+
+  for( uint32_t i = 0; i < steps; i++ )
+  {
+    int32_t value = start;
+
+    if( steps > 1 )
+    {
+      value += (((int32_t)stop - (int32_t)start) * (int32_t)i) / (int32_t)(steps - 1);
+    }
+
+    sweep_dc_dac[i] = value;
+
+    if( !fetch_dac_write(dac_channel, value) )
+    {
+      util_message_error(chp, "error writing to dac");
+      fetch_dac_write(dac_channel, 0);
+      return false;
+    }
+
+    sweep_settle(settle_us);
+    sweep_dc_measure(channels, channel_count, avg, i);
+    count++;
+
+    if( sweep_dc_adc[0][i] < sweep_limit_low || sweep_dc_adc[0][i] > sweep_limit_high )
+    {
+      limit_hit = true;
+      break;
+    }
+  }
+
+  fetch_dac_write(dac_channel, 0);
+
+  util_message_uint32(chp, "steps", count);
+  util_message_bool(chp, "limit_hit", limit_hit);
+  util_message_uint16_array(chp, "dac", sweep_dc_dac, count);
+
+  for( uint32_t i = 0; i < channel_count; i++ )
+  {
+    chsnprintf(name, sizeof(name), "adc%u", channels[i]);
+    util_message_uint16_array(chp, name, sweep_dc_adc[i], count);
+  }
+
+  return true;
+}
+
+bool fetch_sweep_limit_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 2);
+
+  uint16_t low;
+  uint16_t high;
+
+  if( argc > 0 )
+  {
+    FETCH_MIN_ARGS(chp, argc, 2);
+
+    if( !util_parse_uint16(argv[0], &low) || low > 0xfff )
+    {
+      util_message_error(chp, "invalid low limit");
+      return false;
+    }
+
+    if( !util_parse_uint16(argv[1], &high) || high > 0xfff || high < low )
+    {
+      util_message_error(chp, "invalid high limit");
+      return false;
+    }
+
+    sweep_limit_low = low;
+    sweep_limit_high = high;
+  }
+
+  util_message_uint16(chp, "low", sweep_limit_low);
+  util_message_uint16(chp, "high", sweep_limit_high);
+
+  return true;
+}
+
+bool fetch_sweep_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  return fetch_sweep_reset(chp);
+}
+
+void fetch_sweep_init(void)
+{
+  memset(&sweep_gpt_cfg, 0, sizeof(sweep_gpt_cfg));
+
+  sweep_gpt_cfg.frequency = FETCH_SWEEP_TIMER_FREQ;
+  sweep_gpt_cfg.callback = NULL;
+  sweep_gpt_cfg.cr2 = TIM_CR2_MMS_1; // 0b010 = TRGO on update event
+
+  memset(&sweep_settle_gpt_cfg, 0, sizeof(sweep_settle_gpt_cfg));
+
+  sweep_settle_gpt_cfg.frequency = FETCH_SWEEP_SETTLE_FREQ;
+  sweep_settle_gpt_cfg.callback = sweep_settle_cb;
+
+  chBSemObjectInit(&sweep_settle_sem, true);
+  gptStart(&GPTD7, &sweep_settle_gpt_cfg);
+}
+
+bool fetch_sweep_reset(BaseSequentialStream * chp)
+{
+  (void) chp;
+
+  // sweeps run to completion inside the command, only the limits persist
+  sweep_limit_low = 0;
+  sweep_limit_high = 0xfff;
+
+  return true;
+}
+
+/*! @} */
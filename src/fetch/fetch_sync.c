@@ -0,0 +1,328 @@
+/*! \file fetch_sync.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Multi-board synchronized acquisition.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_sync Fetch Sync
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  Boards share one sync line. It is driven from SYNC OUT (PB8, TIM4 CH3)
+ *  of one board and wired to SYNC IN (PA15, TIM2 ETR) of every board,
+ *  including the driving one, so all boards see the same edge.
+ *
+ *  TIM2 is the adc 1 trigger timer. When armed it is slaved to its ETR
+ *  input:
+ *
+ *   - TRIGGER: trigger mode, the counter is held until the first rising
+ *     edge and then runs from the local clock
+ *   - CLOCK:   external clock mode 2, the counter only advances on sync
+ *     line edges. SYNC OUT drives a FETCH_SYNC_CLOCK_FREQ clock, so every
+ *     board counts the same reference and never drifts apart
+ *
+ *  Arming resets the adc 1 sequence number, so streams from all boards
+ *  line up by sequence number after the start. Sample set timestamps stay
+ *  on each board's own free running clock and do not line up across
+ *  boards; match sets by sequence number instead, or map each board's
+ *  timestamps onto host time (test/devtest/timesync.py).
+ *
+ *  Usage on every board: adc.config(1,<rate>), sync.mode(<mode>),
+ *  sync.arm, adc.start(1). Then sync.trigger on the driving board.
+ *
+ *  adc 0 (TIM3) has no external trigger input on the board and is not
+ *  synchronized.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_arg_parse.h"
+#include "util_io.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "fetch_adc.h"
+#include "fetch_sync.h"
+
+// chibios header defining the stm32 timer peripheral registers
+#include "stm32_tim.h"
+
+// must match FETCH_ADC_TIMER_FREQ so adc intervals keep their meaning
+#ifndef FETCH_SYNC_CLOCK_FREQ
+#define FETCH_SYNC_CLOCK_FREQ   1000000
+#endif
+
+#define FETCH_SYNC_TIMER_FREQ   STM32_TIMCLK1
+
+// ETR input filter, fCK_INT N=4
+#define FETCH_SYNC_ETR_FILTER   2
+
+typedef enum {
+  SYNC_MODE_NONE,
+  SYNC_MODE_TRIGGER,
+  SYNC_MODE_CLOCK
+} sync_mode_t;
+
+static const str_table_t sync_mode_table[] = {
+  {"NONE",    SYNC_MODE_NONE},
+  {"TRIGGER", SYNC_MODE_TRIGGER},
+  {"CLOCK",   SYNC_MODE_CLOCK},
+  {NULL, 0}
+};
+
+static sync_mode_t sync_mode = SYNC_MODE_NONE;
+static bool sync_armed = false;
+static bool sync_driving = false;
+static bool sync_out_used = false;
+
+static GPTConfig sync_clock_gpt_cfg;
+
+static void sync_out_stop(void)
+{
+  if( sync_driving )
+  {
+    gptStopTimer(&GPTD4);
+    gptStop(&GPTD4);
+    sync_driving = false;
+  }
+
+  if( sync_out_used )
+  {
+    palSetPadMode(GPIOB, GPIOB_PB8_TIM4_CH3, FETCH_DEFAULT_PIN_MODE);
+    sync_out_used = false;
+  }
+}
+
+static void sync_disarm(void)
+{
+  if( sync_armed )
+  {
+    GPTD2.tim->SMCR = 0;
+    fetch_adc_timer_restore(1);
+    reset_alternate_mode(GPIOA, GPIOA_PA15_TIM2_CH1_ETR);
+    sync_armed = false;
+  }
+}
+
+bool fetch_sync_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Sync Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "mode([<mode>])");
+  FETCH_HELP_DES(chp, "Get/set how the adc 1 trigger timer follows SYNC IN (PA15)");
+  FETCH_HELP_ARG(chp, "mode", "NONE | TRIGGER {start on edge} | CLOCK {count 1 MHz reference}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "arm");
+  FETCH_HELP_DES(chp, "Hold the adc 1 trigger timer until the sync line starts it");
+  FETCH_HELP_DES(chp, "Run after adc.config, followed by adc.start(1)");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "trigger");
+  FETCH_HELP_DES(chp, "Drive the sync line from SYNC OUT (PB8)");
+  FETCH_HELP_DES(chp, "TRIGGER mode sends one edge, CLOCK mode starts the reference clock");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "stop");
+  FETCH_HELP_DES(chp, "Stop driving the sync line and return to free running");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "status");
+  FETCH_HELP_DES(chp, "Query sync state");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_sync_mode_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+
+  uint32_t mode;
+
+  if( argc == 1 )
+  {
+    if( !util_match_str_table(argv[0], &mode, sync_mode_table) )
+    {
+      util_message_error(chp, "invalid sync mode");
+      return false;
+    }
+
+    if( sync_armed || sync_driving )
+    {
+      util_message_error(chp, "sync active, stop first");
+      return false;
+    }
+
+    sync_mode = mode;
+  }
+
+  util_message_string_format(chp, "mode", "%s", sync_mode_table[sync_mode].str);
+
+  return true;
+}
+
+bool fetch_sync_arm_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  stm32_tim_t * tim = GPTD2.tim;
+
+  if( sync_mode == SYNC_MODE_NONE )
+  {
+    util_message_error(chp, "sync mode not set");
+    return false;
+  }
+
+  if( ADCD2.state != ADC_READY )
+  {
+    util_message_error(chp, "adc 1 must be stopped");
+    return false;
+  }
+
+  set_alternate_mode(GPIOA, GPIOA_PA15_TIM2_CH1_ETR);
+
+  chSysLock();
+  tim->CR1 &= ~STM32_TIM_CR1_CEN;
+  tim->SMCR = 0;
+
+  switch( sync_mode )
+  {
+    case SYNC_MODE_TRIGGER:
+      // counter enabled by hardware on the first ETRF edge, UG also
+      // clears the prescaler so all boards start at the same phase
+      tim->EGR = STM32_TIM_EGR_UG;
+      tim->SR = 0;
+      tim->SMCR = STM32_TIM_SMCR_ETF(FETCH_SYNC_ETR_FILTER) | STM32_TIM_SMCR_TS(7) | STM32_TIM_SMCR_SMS(6);
+      break;
+    case SYNC_MODE_CLOCK:
+      // count every reference clock edge, no prescaler
+      tim->PSC = 0;
+      tim->EGR = STM32_TIM_EGR_UG;
+      tim->SR = 0;
+      tim->SMCR = STM32_TIM_SMCR_ETF(FETCH_SYNC_ETR_FILTER) | STM32_TIM_SMCR_ECE;
+      tim->CR1 |= STM32_TIM_CR1_CEN;
+      break;
+    default:
+      break;
+  }
+  chSysUnlock();
+
+  fetch_adc_sequence_reset(1);
+  sync_armed = true;
+
+  return true;
+}
+
+bool fetch_sync_trigger_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  switch( sync_mode )
+  {
+    case SYNC_MODE_TRIGGER:
+      // keep driving the line low afterwards so it does not float
+      palClearPad(GPIOB, GPIOB_PB8_TIM4_CH3);
+      palSetPadMode(GPIOB, GPIOB_PB8_TIM4_CH3, PAL_MODE_OUTPUT_PUSHPULL);
+      sync_out_used = true;
+      palSetPad(GPIOB, GPIOB_PB8_TIM4_CH3);
+      chThdSleepMilliseconds(1);
+      palClearPad(GPIOB, GPIOB_PB8_TIM4_CH3);
+      break;
+    case SYNC_MODE_CLOCK:
+      if( sync_driving )
+      {
+        util_message_error(chp, "reference clock already running");
+        return false;
+      }
+
+      gptStart(&GPTD4, &sync_clock_gpt_cfg);
+
+      // PWM mode 1 on CH3, 50% duty
+      GPTD4.tim->CCMR2 = STM32_TIM_CCMR2_OC3M(6) | STM32_TIM_CCMR2_OC3PE;
+      GPTD4.tim->CCR[2] = (FETCH_SYNC_TIMER_FREQ / FETCH_SYNC_CLOCK_FREQ) / 2;
+      GPTD4.tim->CCER = STM32_TIM_CCER_CC3E;
+
+      set_alternate_mode(GPIOB, GPIOB_PB8_TIM4_CH3);
+      gptStartContinuous(&GPTD4, FETCH_SYNC_TIMER_FREQ / FETCH_SYNC_CLOCK_FREQ);
+      sync_driving = true;
+      sync_out_used = true;
+      break;
+    default:
+      util_message_error(chp, "sync mode not set");
+      return false;
+  }
+
+  return true;
+}
+
+bool fetch_sync_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  sync_out_stop();
+  sync_disarm();
+
+  return true;
+}
+
+bool fetch_sync_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  util_message_string_format(chp, "mode", "%s", sync_mode_table[sync_mode].str);
+  util_message_bool(chp, "armed", sync_armed);
+  util_message_bool(chp, "driving", sync_driving);
+  util_message_bool(chp, "started", (GPTD2.tim->CR1 & STM32_TIM_CR1_CEN) != 0);
+  util_message_uint32(chp, "timer_count", GPTD2.tim->CNT);
+
+  return true;
+}
+
+bool fetch_sync_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  return fetch_sync_reset(chp);
+}
+
+void fetch_sync_init(void)
+{
+  memset(&sync_clock_gpt_cfg, 0, sizeof(sync_clock_gpt_cfg));
+
+  sync_clock_gpt_cfg.frequency = FETCH_SYNC_TIMER_FREQ;
+  sync_clock_gpt_cfg.callback = NULL;
+
+  sync_mode = SYNC_MODE_NONE;
+  sync_armed = false;
+  sync_driving = false;
+  sync_out_used = false;
+}
+
+bool fetch_sync_reset(BaseSequentialStream * chp)
+{
+  (void) chp;
+
+  sync_out_stop();
+  sync_disarm();
+  sync_mode = SYNC_MODE_NONE;
+
+  return true;
+}
+
+/*! @} */
@@ -0,0 +1,105 @@
+/*! \file fetch_time.c
+  *
+  * Supporting Fetch DSL
+  *
+  * Device time and host time correlation.
+  *
+  * \sa fetch.c
+  * @defgroup fetch_time Fetch Time
+  * @{
+  */
+
+/*!
+ * <hr>
+ *
+ *  All device timestamps (stream T records, time.now, time.sync) are 64 bit
+ *  counts of UTIL_TIMESTAMP_FREQ. The host maps them onto its own clock
+ *  with periodic time.sync pings:
+ *
+ *   - ticks is sampled while the command executes, so the host can bound it
+ *     between its send and receive times (offset, from the fastest pings)
+ *   - sof_count/sof_ticks pair the extended USB frame counter with the
+ *     device timestamp of that SOF. SOFs are generated by the host
+ *     controller, which gives a low jitter rate reference for estimating
+ *     drift between the two clocks
+ *
+ *  See test/devtest/timesync.py for the host side estimator.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "chprintf.h"
+
+#include "util_general.h"
+#include "util_messages.h"
+#include "util_timestamp.h"
+
+#include "fetch_defs.h"
+#include "fetch.h"
+
+#include "usbcfg.h"
+
+#include "fetch_time.h"
+
+bool fetch_time_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_LEGEND(chp);
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_TITLE(chp, "Time Help");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "now");
+  FETCH_HELP_DES(chp, "Current 64 bit device timestamp");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "sync");
+  FETCH_HELP_DES(chp, "Time sync ping, device timestamp and last USB SOF reference");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp, "freq");
+  FETCH_HELP_DES(chp, "Device timestamp frequency in Hz");
+  FETCH_HELP_BREAK(chp);
+
+  return true;
+}
+
+bool fetch_time_now_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  util_message_hex_uint64(chp, "ticks", util_timestamp_now());
+
+  return true;
+}
+
+bool fetch_time_sync_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  uint64_t ticks = util_timestamp_now();
+  uint32_t sof_count;
+  uint64_t sof_ticks;
+
+  usb_get_sof_reference(&sof_count, &sof_ticks);
+
+  util_message_hex_uint64(chp, "ticks", ticks);
+  util_message_uint32(chp, "sof_count", sof_count);
+  util_message_hex_uint64(chp, "sof_ticks", sof_ticks);
+
+  return true;
+}
+
+bool fetch_time_freq_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  util_message_uint32(chp, "freq", UTIL_TIMESTAMP_FREQ);
+
+  return true;
+}
+
+/*! @} */
@@ -9,10 +9,12 @@
 #include "util_strings.h"
 #include "util_general.h"
 #include "util_io.h"
+#include "util_arg_parse.h"
 
 #include "fetch_defs.h"
 #include "fetch_timer.h"
 #include "fetch.h"
+#include "fetch_parser.h"
 
 // chibios header defining the stm32 timer peripheral registers
 #include "stm32_tim.h"
@@ -45,6 +47,61 @@ typedef enum {
 #define STM32_TIM7_CLK  STM32_TIMCLK1
 #define STM32_TIM9_CLK  STM32_TIMCLK2
 
+/*
+ * One-pulse outputs
+ *
+ * timer.pulse puts the timer of the pin into one-pulse mode with the
+ * channel in PWM mode 2: the output goes active when the counter reaches
+ * CCR = delay and the update at ARR = delay + width - 1 stops the counter
+ * and ends the pulse. Everything runs in hardware once armed.
+ *
+ * Only TIM1 (PE9, PE13) and TIM9 (PE5, PE6) are free for this, TIM2 and
+ * TIM5 pace the adc and the rules, TIM4 drives SYNC OUT.
+ *
+ *  - count > 1 uses the TIM1 repetition counter, the burst is count
+ *    periods of delay low, width high. TIM9 has no repetition counter.
+ *  - trigger rising/falling holds the counter in slave trigger mode until
+ *    an edge on the timer's other CH1/CH2 pin: PE13 pulses after edges on
+ *    PE9, PE5 after PE6 and PE6 after PE5. The timer re-arms itself after
+ *    every pulse (burst), a delay line without cpu involvement.
+ *
+ * Delay and width are in ns and rounded to the timer tick. The prescaler
+ * is the smallest one that fits delay + width into the 16 bit counter,
+ * so short pulses get the full timer clock resolution.
+ */
+
+typedef struct {
+  GPTDriver * gptp;
+  uint32_t clock;
+  ioportid_t port;
+  uint32_t pin;
+  uint8_t channel;              //!< 0 .. 3 = CH1 .. CH4
+  uint8_t trigger_channel;      //!< input for the trigger edge, 0xff = none
+  bool repetition;              //!< has RCR
+} timer_pulse_out_t;
+
+static const timer_pulse_out_t timer_pulse_outs[] =
+{
+  { &GPTD1, STM32_TIM1_CLK, GPIOE,  9, 0, 0xff, true  },
+  { &GPTD1, STM32_TIM1_CLK, GPIOE, 13, 2, 0,    true  },
+  { &GPTD9, STM32_TIM9_CLK, GPIOE,  5, 0, 1,    false },
+  { &GPTD9, STM32_TIM9_CLK, GPIOE,  6, 1, 0,    false },
+};
+
+#define TIMER_PULSE_OUTS  (sizeof(timer_pulse_outs) / sizeof(timer_pulse_outs[0]))
+
+// pins of the trigger inputs, indexed by channel
+static const uint8_t timer_pulse_trigger_pin[2][2] =
+{
+  { 9, 0xff },                  // TIM1 CH1 PE9, CH2 not on the board
+  { 5, 6 },                     // TIM9 CH1 PE5, CH2 PE6
+};
+
+static const char * timer_pulse_triggers[] = { "none", "rising", "falling", NULL };
+
+static GPTConfig timer_pulse_gpt_cfg[2];
+static const timer_pulse_out_t * timer_pulse_armed[2] = { NULL, NULL };
+
 static void timer_init( void )
 {
   
@@ -111,6 +168,146 @@ static fetch_command_t fetch_timer_commands[] = {
   };
 #endif
 
+static const timer_pulse_out_t * timer_pulse_find( ioportid_t port, uint32_t pin )
+{
+  for( uint32_t i = 0; i < TIMER_PULSE_OUTS; i++ )
+  {
+    if( timer_pulse_outs[i].port == port && timer_pulse_outs[i].pin == pin )
+    {
+      return &timer_pulse_outs[i];
+    }
+  }
+  return NULL;
+}
+
+static uint32_t timer_pulse_slot( const timer_pulse_out_t * out )
+{
+  return (out->gptp == &GPTD1) ? 0 : 1;
+}
+
+/*
+ * Stop the timer of a pulse output and release its pins.
+ */
+static void timer_pulse_disarm( uint32_t slot )
+{
+  const timer_pulse_out_t * out = timer_pulse_armed[slot];
+  GPTDriver * gptp = (slot == 0) ? &GPTD1 : &GPTD9;
+
+  if( out == NULL )
+  {
+    return;
+  }
+
+  gptp->tim->CR1 = 0;
+  gptp->tim->SMCR = 0;
+  gptp->tim->CCER = 0;
+  gptp->tim->CCMR1 = 0;
+  gptp->tim->CCMR2 = 0;
+  gptp->tim->BDTR = 0;
+
+  reset_alternate_mode(out->port, out->pin);
+  for( uint32_t ch = 0; ch < 2; ch++ )
+  {
+    if( timer_pulse_trigger_pin[slot][ch] != 0xff && timer_pulse_trigger_pin[slot][ch] != out->pin )
+    {
+      reset_alternate_mode(GPIOE, timer_pulse_trigger_pin[slot][ch]);
+    }
+  }
+
+  gptStop(gptp);
+  timer_pulse_armed[slot] = NULL;
+}
+
+static void timer_pulse_ccmr( stm32_tim_t * tim, uint32_t channel, uint32_t bits )
+{
+  if( channel < 2 )
+  {
+    tim->CCMR1 |= bits << (8 * channel);
+  }
+  else
+  {
+    tim->CCMR2 |= bits << (8 * (channel - 2));
+  }
+}
+
+/*
+ * Arm a pulse output. delay and width are in timer ticks before the
+ * prescaler, trigger is an index into timer_pulse_triggers.
+ */
+static bool timer_pulse_arm( const timer_pulse_out_t * out, uint64_t delay, uint64_t width, uint32_t count, uint32_t trigger, uint32_t * psc_out )
+{
+  uint32_t slot = timer_pulse_slot(out);
+  uint64_t psc = (delay + width - 1) / 0x10000;
+  stm32_tim_t * tim;
+
+  if( psc > 0xffff )
+  {
+    return false;
+  }
+
+  delay /= (psc + 1);
+  width /= (psc + 1);
+  if( delay < 1 || width < 1 )
+  {
+    return false;
+  }
+
+  timer_pulse_disarm(slot);
+
+  // the driver only enables the clock and resets the timer, no interrupts
+  timer_pulse_gpt_cfg[slot].frequency = out->clock;
+  timer_pulse_gpt_cfg[slot].callback = NULL;
+  timer_pulse_gpt_cfg[slot].cr2 = 0;
+  gptStart(out->gptp, &timer_pulse_gpt_cfg[slot]);
+  tim = out->gptp->tim;
+
+  tim->CR1 = 0;
+  tim->PSC = psc;
+  tim->ARR = delay + width - 1;
+  tim->CCR[out->channel] = delay;
+  if( out->repetition )
+  {
+    tim->RCR = count - 1;
+  }
+  // load PSC and RCR, the counter stays stopped
+  tim->EGR = STM32_TIM_EGR_UG;
+  tim->SR = 0;
+
+  // PWM mode 2 with fast enable, active from CCR to ARR
+  timer_pulse_ccmr(tim, out->channel, STM32_TIM_CCMR1_OC1M(7) | STM32_TIM_CCMR1_OC1FE);
+  tim->CCER = STM32_TIM_CCER_CC1E << (4 * out->channel);
+
+  if( trigger != 0 )
+  {
+    uint32_t in = out->trigger_channel;
+
+    // CCxS = 01, input capture on TIx
+    timer_pulse_ccmr(tim, in, STM32_TIM_CCMR1_CC1S(1));
+    if( trigger == 2 )
+    {
+      tim->CCER |= STM32_TIM_CCER_CC1P << (4 * in);
+    }
+    // trigger mode, TS = 101 TI1FP1 or 110 TI2FP2
+    tim->SMCR = STM32_TIM_SMCR_SMS(6) | STM32_TIM_SMCR_TS(5 + in);
+    set_alternate_mode(GPIOE, timer_pulse_trigger_pin[slot][in]);
+  }
+
+  if( out->repetition )
+  {
+    tim->BDTR = STM32_TIM_BDTR_MOE;
+  }
+
+  set_alternate_mode(out->port, out->pin);
+  timer_pulse_armed[slot] = out;
+
+  // with a trigger the edge sets CEN
+  tim->CR1 = STM32_TIM_CR1_OPM | ((trigger == 0) ? STM32_TIM_CR1_CEN : 0);
+
+  *psc_out = psc;
+
+  return true;
+}
+
 bool fetch_timer_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
@@ -120,12 +317,111 @@ bool fetch_timer_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv
   FETCH_HELP_BREAK(chp);
   FETCH_HELP_TITLE(chp,"Timer Help");
   FETCH_HELP_BREAK(chp);
-  FETCH_HELP_CMD(chp,"FIXME");
+  FETCH_HELP_CMD(chp,"pulse(<pin>,<delay>,<width>[,<count>[,<trigger>]])");
+  FETCH_HELP_DES(chp,"Hardware one-pulse output");
+  FETCH_HELP_ARG(chp,"pin","PE9 | PE13 | PE5 | PE6 {TIMER2.0, TIMER2.1, TIMER1.0, TIMER1.1}");
+  FETCH_HELP_ARG(chp,"delay","ns before the pulse, at least one timer tick");
+  FETCH_HELP_ARG(chp,"width","pulse width in ns");
+  FETCH_HELP_ARG(chp,"count","pulses in the burst, 1 ... 256 {TIM1 pins only}");
+  FETCH_HELP_ARG(chp,"trigger","none | rising | falling {edge on the other channel pin}");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"pulse_stop(<pin>)");
+  FETCH_HELP_DES(chp,"Disarm a pulse output");
+  FETCH_HELP_BREAK(chp);
+  FETCH_HELP_CMD(chp,"reset");
+  FETCH_HELP_DES(chp,"Disarm all pulse outputs");
   FETCH_HELP_BREAK(chp);
 
 	return true;
 }
 
+bool fetch_timer_pulse_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 5);
+  FETCH_MIN_ARGS(chp, argc, 3);
+
+  port_pin_t pp;
+  uint32_t delay_ns;
+  uint32_t width_ns;
+  uint32_t count = 1;
+  uint32_t trigger = 0;
+  uint32_t psc;
+  const timer_pulse_out_t * out;
+
+  if( !fetch_gpio_parser(argv[0], FETCH_MAX_DATA_STRLEN, &pp) || (out = timer_pulse_find(pp.port, pp.pin)) == NULL )
+  {
+    util_message_error(chp, "invalid pin");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[1], &delay_ns) )
+  {
+    util_message_error(chp, "invalid delay");
+    return false;
+  }
+
+  if( !util_parse_uint32(argv[2], &width_ns) || width_ns == 0 )
+  {
+    util_message_error(chp, "invalid width");
+    return false;
+  }
+
+  if( argc > 3 && (!util_parse_uint32(argv[3], &count) || count == 0 || count > 256 || (count > 1 && !out->repetition)) )
+  {
+    util_message_error(chp, "invalid count");
+    return false;
+  }
+
+  if( argc > 4 && (!util_match_str_array(argv[4], &trigger, timer_pulse_triggers) || (trigger != 0 && out->trigger_channel == 0xff)) )
+  {
+    util_message_error(chp, "invalid trigger");
+    return false;
+  }
+
+  uint64_t delay = ((uint64_t)delay_ns * out->clock + 500000000) / 1000000000;
+  uint64_t width = ((uint64_t)width_ns * out->clock + 500000000) / 1000000000;
+
+  if( !timer_pulse_arm(out, delay, width, count, trigger, &psc) )
+  {
+    util_message_error(chp, "delay/width out of range");
+    return false;
+  }
+
+  // actual tick the timer runs at
+  util_message_uint32(chp, "tick_ps", (uint32_t)(((uint64_t)(psc + 1) * 1000000000000ULL) / out->clock));
+
+  return true;
+}
+
+bool fetch_timer_pulse_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 1);
+  FETCH_MIN_ARGS(chp, argc, 1);
+
+  port_pin_t pp;
+  const timer_pulse_out_t * out;
+
+  if( !fetch_gpio_parser(argv[0], FETCH_MAX_DATA_STRLEN, &pp) || (out = timer_pulse_find(pp.port, pp.pin)) == NULL )
+  {
+    util_message_error(chp, "invalid pin");
+    return false;
+  }
+
+  if( timer_pulse_armed[timer_pulse_slot(out)] == out )
+  {
+    timer_pulse_disarm(timer_pulse_slot(out));
+  }
+
+  return true;
+}
+
+bool fetch_timer_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
+{
+  FETCH_MAX_ARGS(chp, argc, 0);
+
+  return fetch_timer_reset(chp);
+}
+
 bool fetch_timer_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 {
   FETCH_MAX_ARGS(chp, argc, 0);
@@ -212,9 +508,8 @@ void fetch_timer_init(void)
 
 bool fetch_timer_reset(BaseSequentialStream * chp)
 {
-  // TODO
-  // disable all channels
-  // 
+  timer_pulse_disarm(0);
+  timer_pulse_disarm(1);
   return true;
 }
 
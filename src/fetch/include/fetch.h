@@ -65,6 +65,12 @@ extern uint8_t fetch_shared_buffer[FETCH_SHARED_BUFFER_SIZE];
 
 void fetch_init(void);
 bool fetch_execute( BaseSequentialStream * chp, const char * input_line );
+void fetch_lock(void);
+void fetch_unlock(void);
+void fetch_abort(void);
+bool fetch_abort_requested(void);
+bool fetch_checkpoint(BaseSequentialStream * chp, uint32_t done, uint32_t total);
+bool fetch_sleep_ms(uint32_t ms);
 
 bool fetch_parse_bytes( BaseSequentialStream * chp, uint32_t argc, char * argv[], uint8_t * output_str, uint32_t max_output_len, uint32_t * count );
 
@@ -16,21 +16,60 @@ extern "C" {
 #define ADC_SAMPLE_SET_SIZE 7
 
 typedef struct {
+  uint64_t timestamp;
   adcsample_t sample[ADC_SAMPLE_SET_SIZE];
   uint16_t sequence_number;
-  volatile int16_t mem_ref_count;
+  uint8_t present;                  //!< bit i set: sample[i] was converted for this set
+  uint8_t digital_flags;            //!< ADC_SAMPLE_DIGITAL_xxx, see fetch_mixed.c
+  uint16_t digital;                 //!< gpio port input word of the same trigger
 } adc_sample_set_t;
 
+#define ADC_SAMPLE_SET_ALL  ((1 << ADC_SAMPLE_SET_SIZE) - 1)
+
+/*! \brief adc_sample_set_t digital_flags bits */
+#define ADC_SAMPLE_DIGITAL_VALID        (1 << 0)
+#define ADC_SAMPLE_DIGITAL_SKEW         (1 << 1)
+
+/*! \brief fetch_adc_flags_i bits */
+#define FETCH_ADC_FLAG_ACTIVE           (1 << 0)
+#define FETCH_ADC_FLAG_VALID            (1 << 1)
+#define FETCH_ADC_FLAG_DMAFAILURE       (1 << 2)
+#define FETCH_ADC_FLAG_OVERFLOW         (1 << 3)
+#define FETCH_ADC_FLAG_MPIPE_OVERFLOW   (1 << 4)
+#define FETCH_ADC_FLAG_MEM_ALLOC_NULL   (1 << 5)
+
+/*! \brief trigger timer intervals, indexed by adc device */
+typedef struct {
+  uint16_t timer_interval[2];
+} fetch_adc_profile_t;
+
+/*! \brief called from the adc ISR, dev is the fetch adc device number */
+typedef void (*fetch_adc_sample_hook_t)(uint32_t dev, const adcsample_t * samples, uint64_t timestamp);
+
 bool fetch_adc_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_single_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_stream_start_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_stream_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_config_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_adc_divisor_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_timer_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_adc_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 
-void fetch_adc_free_sample_set( adc_sample_set_t *ssp );
+adc_sample_set_t * fetch_adc_ring_read(uint32_t dev, systime_t timeout);
+void fetch_adc_ring_release(uint32_t dev);
+void fetch_adc_timer_restore(uint32_t dev);
+void fetch_adc_profile_save(fetch_adc_profile_t * profile);
+void fetch_adc_profile_load(const fetch_adc_profile_t * profile);
+void fetch_adc_sequence_reset(uint32_t dev);
+bool fetch_adc_stream_start_i(uint32_t dev);
+void fetch_adc_set_sample_hook(fetch_adc_sample_hook_t hook);
+bool fetch_adc_ring_idle_i(uint32_t dev);
+bool fetch_adc_ring_load_i(uint32_t dev, adc_sample_set_t * sets, uint32_t count);
+uint32_t fetch_adc_ring_count(uint32_t dev);
+uint32_t fetch_adc_sample_rate(uint32_t dev);
+bool fetch_adc_latest_i(uint32_t dev, adc_sample_set_t * set);
+uint16_t fetch_adc_flags_i(uint32_t dev);
 
 bool fetch_adc_reset(BaseSequentialStream * chp);
 
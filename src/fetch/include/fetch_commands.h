@@ -6,13 +6,27 @@
 /* Include all header files that define fetch commands */
 #include "fetch.h"
 #include "fetch_adc.h"
+#include "fetch_filter.h"
+#include "fetch_stats.h"
 #include "fetch_dac.h"
 #include "fetch_gpio.h"
 #include "fetch_i2c.h"
 #include "fetch_mbus.h"
 #include "fetch_sd.h"
 #include "fetch_spi.h"
+#include "fetch_spi_slave.h"
 #include "fetch_timer.h"
 #include "fetch_serial.h"
+#include "fetch_sweep.h"
+#include "fetch_time.h"
+#include "fetch_sync.h"
+#include "fetch_dma.h"
+#include "fetch_profile.h"
+#include "fetch_rule.h"
+#include "fetch_ram.h"
+#include "fetch_snapshot.h"
+#include "fetch_script.h"
+#include "fetch_irq.h"
+#include "fetch_mixed.h"
 
 #endif
@@ -13,12 +13,26 @@ extern "C" {
 
 #include "dac.h"
 
+/*! \brief dac.wave modes, DAC_CR WAVE1 order */
+#define FETCH_DAC_WAVE_OFF        0
+#define FETCH_DAC_WAVE_NOISE      1
+#define FETCH_DAC_WAVE_TRIANGLE   2
+
+/*! \brief TIM6 tick rate, wave generator steps are whole ticks */
+#ifndef FETCH_DAC_WAVE_TIMER_FREQ
+#define FETCH_DAC_WAVE_TIMER_FREQ 1000000
+#endif
 
 void fetch_dac_init(void);
 bool fetch_dac_reset(BaseSequentialStream * chp);
+bool fetch_dac_write(uint16_t channel, uint16_t value);
+bool fetch_dac_write_sync(const uint16_t * channels, const uint16_t * values, uint32_t count);
+void fetch_dac_wave_stop(void);
 
 bool fetch_dac_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_dac_write_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_dac_write_sync_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_dac_wave_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_dac_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 
 #ifdef __cplusplus
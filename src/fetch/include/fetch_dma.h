@@ -0,0 +1,26 @@
+/*! \file fetch_dma.h
+ *
+ * @addtogroup fetch_dma
+ * @{
+ */
+
+#ifndef FETCH_DMA_H_
+#define FETCH_DMA_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_dma_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_dma_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_dma_conflicts_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
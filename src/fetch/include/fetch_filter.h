@@ -0,0 +1,45 @@
+/*! \file fetch_filter.h
+ *
+ * @addtogroup fetch_filter
+ * @{
+ */
+
+#ifndef FETCH_FILTER_H_
+#define FETCH_FILTER_H_
+
+#include <stdbool.h>
+
+#include "fetch_adc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef FETCH_FILTER_BIQUADS
+#define FETCH_FILTER_BIQUADS    4
+#endif
+
+#ifndef FETCH_FILTER_FIR_TAPS
+#define FETCH_FILTER_FIR_TAPS   16
+#endif
+
+/*! \brief fractional bits of the coefficient arguments */
+#define FETCH_FILTER_Q          28
+
+bool fetch_filter_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_filter_biquad_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_filter_fir_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_filter_clear_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_filter_help(BaseSequentialStream * chp);
+void fetch_filter_run_i(uint32_t dev, adcsample_t * samples, uint8_t present);
+
+bool fetch_filter_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
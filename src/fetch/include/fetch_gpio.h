@@ -10,6 +10,28 @@
 extern "C" {
 #endif
 
+#define FETCH_GPIO_PROFILE_PORTS  9
+
+/*! \brief gpio module pins of one port, register layout */
+typedef struct {
+  uint32_t moder;
+  uint32_t otyper;
+  uint32_t ospeedr;
+  uint32_t pupdr;
+  uint32_t odr;
+  uint32_t afrl;
+  uint32_t afrh;
+} fetch_gpio_port_profile_t;
+
+typedef struct {
+  fetch_gpio_port_profile_t ports[FETCH_GPIO_PROFILE_PORTS];
+} fetch_gpio_profile_t;
+
+void fetch_gpio_profile_save(fetch_gpio_profile_t * profile);
+void fetch_gpio_profile_load(const fetch_gpio_profile_t * profile);
+
+bool fetch_gpio_pin_allowed( ioportid_t port, uint32_t pin );
+
 void fetch_gpio_init(void);
 bool fetch_gpio_reset( BaseSequentialStream * chp );
 
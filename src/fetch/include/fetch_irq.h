@@ -0,0 +1,41 @@
+/*! \file fetch_irq.h
+ *
+ * @addtogroup fetch_irq
+ * @{
+ */
+
+#ifndef FETCH_IRQ_H_
+#define FETCH_IRQ_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief histogram bins per source */
+#ifndef FETCH_IRQ_BINS
+#define FETCH_IRQ_BINS          32
+#endif
+
+bool fetch_irq_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_irq_start_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_irq_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_irq_probe_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_irq_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_irq_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_irq_adc_entry_i(uint32_t dev);
+void fetch_irq_spi_start(SPIDriver * spip);
+void fetch_irq_spi_end_cb(SPIDriver * spip);
+
+bool fetch_irq_reset(BaseSequentialStream * chp);
+void fetch_irq_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
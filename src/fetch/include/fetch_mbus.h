@@ -7,6 +7,7 @@ extern "C" {
 
 bool fetch_mbus_reset(BaseSequentialStream * chp);
 void fetch_mbus_init(void);
+void fetch_mbus_last_analog_i(adcsample_t values[2]);
 
 bool fetch_mbus_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_mbus_select_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
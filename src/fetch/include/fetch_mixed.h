@@ -0,0 +1,33 @@
+/*! \file fetch_mixed.h
+ *
+ * @addtogroup fetch_mixed
+ * @{
+ */
+
+#ifndef FETCH_MIXED_H_
+#define FETCH_MIXED_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_mixed_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_mixed_start_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_mixed_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_mixed_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+uint8_t fetch_mixed_word_i(uint32_t dev, uint16_t * word);
+void fetch_mixed_rearm_i(uint32_t dev);
+
+bool fetch_mixed_reset(BaseSequentialStream * chp);
+void fetch_mixed_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -17,6 +17,65 @@ typedef struct {
 
 extern fetch_parser_info_t fetch_parser_info;
 
+/*! \brief token types of the script language, see fetch_script.c */
+typedef enum {
+  FETCH_SCRIPT_TOK_END,
+  FETCH_SCRIPT_TOK_INVALID,
+  FETCH_SCRIPT_TOK_IDENT,       //!< command name, may contain '.'
+  FETCH_SCRIPT_TOK_VAR,         //!< $name
+  FETCH_SCRIPT_TOK_CAPTURE,     //!< @name
+  FETCH_SCRIPT_TOK_NUMBER,      //!< value holds the number
+  FETCH_SCRIPT_TOK_REPEAT,
+  FETCH_SCRIPT_TOK_WHILE,
+  FETCH_SCRIPT_TOK_IF,
+  FETCH_SCRIPT_TOK_ELSE,
+  FETCH_SCRIPT_TOK_PRINT,
+  FETCH_SCRIPT_TOK_ECHO,
+  FETCH_SCRIPT_TOK_WAIT,
+  FETCH_SCRIPT_TOK_LPAREN,
+  FETCH_SCRIPT_TOK_RPAREN,
+  FETCH_SCRIPT_TOK_LBRACE,
+  FETCH_SCRIPT_TOK_RBRACE,
+  FETCH_SCRIPT_TOK_LBRACKET,
+  FETCH_SCRIPT_TOK_RBRACKET,
+  FETCH_SCRIPT_TOK_COMMA,
+  FETCH_SCRIPT_TOK_SEMI,
+  FETCH_SCRIPT_TOK_ASSIGN,
+  FETCH_SCRIPT_TOK_NOT,         //!< !
+  FETCH_SCRIPT_TOK_INV,         //!< ~
+  FETCH_SCRIPT_TOK_OP           //!< binary operator, value holds the fetch_script_op_t
+} fetch_script_tok_t;
+
+/*! \brief binary operators, '-' is also unary */
+typedef enum {
+  FETCH_SCRIPT_OP_LOR,
+  FETCH_SCRIPT_OP_LAND,
+  FETCH_SCRIPT_OP_EQ,
+  FETCH_SCRIPT_OP_NE,
+  FETCH_SCRIPT_OP_LT,
+  FETCH_SCRIPT_OP_GT,
+  FETCH_SCRIPT_OP_LE,
+  FETCH_SCRIPT_OP_GE,
+  FETCH_SCRIPT_OP_OR,
+  FETCH_SCRIPT_OP_XOR,
+  FETCH_SCRIPT_OP_AND,
+  FETCH_SCRIPT_OP_SHL,
+  FETCH_SCRIPT_OP_SHR,
+  FETCH_SCRIPT_OP_ADD,
+  FETCH_SCRIPT_OP_SUB,
+  FETCH_SCRIPT_OP_MUL,
+  FETCH_SCRIPT_OP_DIV,
+  FETCH_SCRIPT_OP_MOD,
+  FETCH_SCRIPT_OP_COUNT
+} fetch_script_op_t;
+
+typedef struct {
+  fetch_script_tok_t type;
+  uint32_t start;               //!< offset in the input
+  uint32_t len;
+  int32_t value;
+} fetch_script_token_t;
+
 bool fetch_command_parser( const char * input_str, uint32_t max_input_len, char * output_str, uint32_t max_output_len, fetch_func_t * func, uint32_t * argc, char * argv[], uint32_t max_args);
 
 bool fetch_string_parser( const char * input_str, uint32_t max_input_len, char * output_str, uint32_t max_output_len, uint32_t * output_len );
@@ -27,6 +86,8 @@ bool fetch_gpio_port_parser( const char * input_str, uint32_t max_input_len, iop
 
 bool fetch_hex_string_parser( const char * input_str, uint32_t max_input_len, char * output_str, uint32_t max_output_len, uint32_t * output_len );
 
+bool fetch_script_lexer( const char * input_str, uint32_t max_input_len, fetch_script_token_t * tok );
+
 #ifdef __cplusplus
 }
 #endif
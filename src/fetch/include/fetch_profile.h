@@ -0,0 +1,33 @@
+/*! \file fetch_profile.h
+ *
+ * @addtogroup fetch_profile
+ * @{
+ */
+
+#ifndef FETCH_PROFILE_H_
+#define FETCH_PROFILE_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_profile_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_save_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_list_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_boot_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_profile_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_profile_init(void);
+bool fetch_profile_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
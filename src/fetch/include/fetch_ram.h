@@ -0,0 +1,39 @@
+/*! \file fetch_ram.h
+ *
+ * @addtogroup fetch_ram
+ * @{
+ */
+
+#ifndef FETCH_RAM_H_
+#define FETCH_RAM_H_
+
+#include <stdbool.h>
+
+#include "fetch_serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief how the ram arena is split, also stored in profiles */
+typedef struct {
+  uint32_t adc_ring_sets[2];                             //!< sample sets per fetch adc device
+  uint32_t serial_rx_size[FETCH_SERIAL_PROFILE_DEVICES];  //!< 0 = buffer built into the driver
+} fetch_ram_profile_t;
+
+bool fetch_ram_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_ram_plan_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_ram_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_ram_profile_save(fetch_ram_profile_t * profile);
+const char * fetch_ram_profile_load(const fetch_ram_profile_t * profile);
+
+void fetch_ram_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,38 @@
+/*! \file fetch_rule.h
+ *
+ * @addtogroup fetch_rule
+ * @{
+ */
+
+#ifndef FETCH_RULE_H_
+#define FETCH_RULE_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_rule_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_trigger_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_action_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_enable_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_disable_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_list_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_result_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_rule_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_rule_init(void);
+bool fetch_rule_exti_claim(ioportid_t port, uint32_t pin, uint32_t edge_mode, extcallback_t cb);
+void fetch_rule_exti_release(uint32_t pin);
+bool fetch_rule_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
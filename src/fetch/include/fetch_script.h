@@ -0,0 +1,30 @@
+/*! \file fetch_script.h
+ *
+ * @addtogroup fetch_script
+ * @{
+ */
+
+#ifndef FETCH_SCRIPT_H_
+#define FETCH_SCRIPT_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_script_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_script_load_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_script_run_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_script_info_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_script_delete_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+bool fetch_script_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -27,6 +27,7 @@ bool fetch_sd_tell_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[])
 bool fetch_sd_seek_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_sd_dir_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_sd_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sd_usb_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_sd_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 
 
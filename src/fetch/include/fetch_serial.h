@@ -10,6 +10,27 @@
 extern "C" {
 #endif
 
+#define FETCH_SERIAL_PROFILE_DEVICES  3
+
+typedef struct {
+  uint8_t started[FETCH_SERIAL_PROFILE_DEVICES];
+  uint32_t speed[FETCH_SERIAL_PROFILE_DEVICES];
+  uint32_t tx_timeout_ms;
+  uint32_t rx_timeout_ms;
+} fetch_serial_profile_t;
+
+// fetch serial device number to driver
+extern SerialDriver * serial_drivers[FETCH_SERIAL_PROFILE_DEVICES];
+
+void fetch_serial_profile_save(fetch_serial_profile_t * profile);
+void fetch_serial_profile_load(const fetch_serial_profile_t * profile);
+
+bool fetch_serial_rx_buffer_i(uint32_t dev, uint8_t * buffer, size_t size);
+size_t fetch_serial_rx_size(uint32_t dev);
+uint32_t fetch_serial_speed(uint32_t dev);
+eventflags_t fetch_serial_flags_i(uint32_t dev);
+size_t fetch_serial_rx_pending_i(uint32_t dev);
+
 void fetch_serial_init(void);
 bool fetch_serial_reset(BaseSequentialStream * chp);
 
@@ -0,0 +1,71 @@
+/*! \file fetch_snapshot.h
+ *
+ * @addtogroup fetch_snapshot
+ * @{
+ */
+
+#ifndef FETCH_SNAPSHOT_H_
+#define FETCH_SNAPSHOT_H_
+
+#include <stdbool.h>
+
+#include "fetch_adc.h"
+#include "fetch_serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FETCH_SNAPSHOT_VERSION      1
+#define FETCH_SNAPSHOT_GPIO_PORTS   9
+
+/*! \brief fetch_snapshot_t.serial flags, low bits are the channel event flags */
+#define FETCH_SNAPSHOT_SERIAL_READY (1 << 15)
+
+/*! \brief latest value of every input, little endian, 128 bytes
+ *
+ * The layout only grows at the end, hosts check version and size.
+ */
+typedef struct {
+  uint64_t timestamp;                               //!< device timestamp of the snapshot
+  uint32_t sequence;                                //!< counts snapshots since boot
+  uint16_t version;                                 //!< FETCH_SNAPSHOT_VERSION
+  uint16_t size;                                    //!< sizeof(fetch_snapshot_t)
+  struct {
+    uint64_t timestamp;                             //!< timestamp of the sample set, 0 = none yet
+    uint32_t sample_rate;
+    uint16_t sequence_number;
+    uint16_t flags;                                 //!< FETCH_ADC_FLAG_*
+    uint16_t sample[ADC_SAMPLE_SET_SIZE];
+    uint16_t reserved;
+  } adc[2];                                         //!< indexed by fetch adc device
+  uint16_t gpio[FETCH_SNAPSHOT_GPIO_PORTS];         //!< input data of ports A..I
+  uint16_t mbus_analog[2];                          //!< last mbus.read_analog
+  uint16_t reserved;
+  struct {
+    uint32_t speed;                                 //!< 0 = stopped
+    uint16_t rx_pending;                            //!< bytes in the receive queue
+    uint16_t flags;                                 //!< FETCH_SNAPSHOT_SERIAL_READY | event flags
+  } serial[FETCH_SERIAL_PROFILE_DEVICES];
+} fetch_snapshot_t;
+
+#ifndef __cplusplus
+_Static_assert(sizeof(fetch_snapshot_t) == 128, "fetch_snapshot_t is 128 bytes on the wire, hosts decode it by offset");
+#endif
+
+bool fetch_snapshot_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_snapshot_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_snapshot_push_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_snapshot_take(fetch_snapshot_t * snap);
+uint32_t fetch_snapshot_push_period(void);
+
+bool fetch_snapshot_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -10,6 +10,18 @@
 extern "C" {
 #endif
 
+#define FETCH_SPI_PROFILE_DEVICES   2
+
+typedef struct {
+  uint8_t started[FETCH_SPI_PROFILE_DEVICES];
+  uint16_t cr1[FETCH_SPI_PROFILE_DEVICES];
+} fetch_spi_profile_t;
+
+void fetch_spi_profile_save(fetch_spi_profile_t * profile);
+bool fetch_spi_profile_load(const fetch_spi_profile_t * profile);
+
+SPIDriver * fetch_spi_driver(uint32_t dev);
+
 void fetch_spi_init(void);
 bool fetch_spi_reset(BaseSequentialStream * chp);
 
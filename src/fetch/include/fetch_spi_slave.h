@@ -0,0 +1,51 @@
+/*! \file fetch_spi_slave.h
+ *
+ * @addtogroup fetch_spi_slave
+ * @{
+ */
+
+#ifndef FETCH_SPI_SLAVE_H_
+#define FETCH_SPI_SLAVE_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FETCH_SPI_SLAVE_OFF         0
+#define FETCH_SPI_SLAVE_RESPOND     1
+#define FETCH_SPI_SLAVE_REGMAP      2
+#define FETCH_SPI_SLAVE_SNIFF       3
+
+/*! \brief fetch_spi_slave_frame_t.status */
+#define FETCH_SPI_SLAVE_TRUNCATED   (1 << 0)  //!< frame longer than the reader buffer
+#define FETCH_SPI_SLAVE_OVERRUN     (1 << 1)  //!< bytes overwritten before they were read
+
+typedef struct {
+  uint64_t timestamp;     //!< device timestamp of the NSS falling edge
+  uint32_t length;        //!< bytes clocked while NSS was low
+  uint32_t copied;        //!< bytes in the reader buffer, 0 on overrun
+  uint8_t status;         //!< FETCH_SPI_SLAVE_TRUNCATED | FETCH_SPI_SLAVE_OVERRUN
+} fetch_spi_slave_frame_t;
+
+bool fetch_spi_slave_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_spi_slave_data_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_spi_slave_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_spi_slave_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_spi_slave_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+bool fetch_spi_slave_read_frame(uint32_t dev, fetch_spi_slave_frame_t * frame, uint8_t * data, uint32_t max);
+bool fetch_spi_slave_active(uint32_t dev);
+void fetch_spi_slave_stop(uint32_t dev);
+
+void fetch_spi_slave_help(BaseSequentialStream * chp);
+bool fetch_spi_slave_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,42 @@
+/*! \file fetch_stats.h
+ *
+ * @addtogroup fetch_stats
+ * @{
+ */
+
+#ifndef FETCH_STATS_H_
+#define FETCH_STATS_H_
+
+#include <stdbool.h>
+
+#include "fetch_adc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief histogram bins, one per 12 bit code */
+#define FETCH_STATS_BINS        4096
+
+/*! \brief most bins per adc.histogram_read */
+#ifndef FETCH_STATS_READ_MAX
+#define FETCH_STATS_READ_MAX    256
+#endif
+
+bool fetch_stats_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_stats_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_stats_histogram_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_stats_histogram_read_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+void fetch_stats_help(BaseSequentialStream * chp);
+void fetch_stats_update_i(uint32_t dev, const adcsample_t * samples, uint8_t present);
+
+bool fetch_stats_reset(BaseSequentialStream * chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,32 @@
+/*! \file fetch_sweep.h
+ *
+ * @addtogroup fetch_sweep
+ * @{
+ */
+
+#ifndef FETCH_SWEEP_H_
+#define FETCH_SWEEP_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_sweep_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sweep_ac_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sweep_dc_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sweep_limit_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sweep_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+bool fetch_sweep_reset(BaseSequentialStream * chp);
+
+void fetch_sweep_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
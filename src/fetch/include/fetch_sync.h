@@ -0,0 +1,34 @@
+/*! \file fetch_sync.h
+ *
+ * @addtogroup fetch_sync
+ * @{
+ */
+
+#ifndef FETCH_SYNC_H_
+#define FETCH_SYNC_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_sync_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_mode_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_arm_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_trigger_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_status_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_sync_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+bool fetch_sync_reset(BaseSequentialStream * chp);
+
+void fetch_sync_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,27 @@
+/*! \file fetch_time.h
+ *
+ * @addtogroup fetch_time
+ * @{
+ */
+
+#ifndef FETCH_TIME_H_
+#define FETCH_TIME_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool fetch_time_help_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_time_now_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_time_sync_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_time_freq_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
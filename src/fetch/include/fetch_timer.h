@@ -16,6 +16,9 @@ bool fetch_timer_pwm_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[
 bool fetch_timer_cap_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_timer_clear_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 bool fetch_timer_count_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_timer_pulse_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_timer_pulse_stop_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
+bool fetch_timer_reset_cmd(BaseSequentialStream * chp, uint32_t argc, char * argv[]);
 
 #ifdef __cplusplus
 }
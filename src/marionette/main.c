@@ -38,7 +38,10 @@
 #include "util_version.h"
 #include "util_messages.h"
 #include "util_io.h"
+#include "util_timestamp.h"
+#include "util_dma.h"
 #include "usbcfg.h"
+#include "usb_msd.h"
 
 
 /*! \brief Show memory usage
@@ -114,6 +117,24 @@ static const mshell_config_t mshell_cfg =
 	commands
 };
 
+/*! \brief Second MShell session on the debug serial port
+ *
+ * Stays usable while the USB shell runs a long command, e.g. for +abort.
+ * It is not a third CDC interface: OTG HS has endpoints 1 to 5, a CDC
+ * function needs a bulk pair and a notification endpoint, SDU1/SDU2
+ * hold 1 to 4 and EP5 alone can not carry one (and is the mass storage
+ * pair with USE_MSD). Debug output is dropped once the session owns the
+ * port, see util_debug_stream_release.
+ */
+static const mshell_config_t mshell_aux_cfg =
+{
+	(BaseAsynchronousChannel *) &DEBUG_SERIAL,
+  "m1 > ", // prompt
+  true,   // show prompt
+  true,   // echo chars
+	commands
+};
+
 static const mpipe_config_t mpipe_cfg = 
 {
   (BaseAsynchronousChannel *) &SDU2
@@ -127,9 +148,12 @@ static void main_app(void)
   chprintf(DEBUG_CHP, "Marionette start\r\n");
   set_status_led(1,0,0);
 
+  util_timestamp_init();
+  util_dma_init();
+  // before fetch_init, the mpipe adc threads read the planned rings
+  mpipe_init();
 	fetch_init();
 	mshell_init();
-  mpipe_init();
 
 
 #if STM32_USB_USE_OTG2
@@ -147,6 +171,7 @@ static void main_app(void)
 	sduStart(&SDU1, &serusbcfg);
 	sduObjectInit(&SDU2);
 	sduStart(&SDU2, &serusbcfg2);
+	usb_msd_init();
 
 	usbDisconnectBus(serusbcfg.usbp);
 	chThdSleepMilliseconds(1000);
@@ -157,18 +182,24 @@ static void main_app(void)
   
   uint8_t led_blank_count = 0;
 
+  // session 1 owns the debug serial port from here on
+  util_debug_stream_release();
+
 	while (true)
 	{
     if( serusbcfg.usbp->state == USB_ACTIVE )
     {
-      mshell_start(&mshell_cfg);
+      mshell_start(0, &mshell_cfg);
       mpipe_start(&mpipe_cfg);
     }
     else
     {
-      mshell_stop();
+      mshell_stop(0);
       mpipe_stop();
     }
+
+    // restarts after ctrl-d
+    mshell_start(1, &mshell_aux_cfg);
     
     if( (++led_blank_count) >= 5 )
     {
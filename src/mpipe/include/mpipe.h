@@ -3,8 +3,6 @@
 
 #include <stdbool.h>
 
-extern mailbox_t mpipe_adc2_mb;
-extern mailbox_t mpipe_adc3_mb;
 extern mailbox_t mpipe_can_mb;
 
 typedef struct {
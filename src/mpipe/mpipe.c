@@ -11,13 +11,12 @@
 #include "util_version.h"
 
 #include "fetch_adc.h"
+#include "fetch_snapshot.h"
+#include "fetch_spi.h"
+#include "fetch_spi_slave.h"
 
 #include "mpipe.h"
 
-#ifndef MPIPE_ADC_MB_SIZE
-#define MPIPE_ADC_MB_SIZE 16
-#endif
-
 #ifndef MPIPE_CAN_MB_SIZE
 #define MPIPE_CAN_MB_SIZE 8
 #endif
@@ -38,6 +37,38 @@
 #define MPIPE_SERIAL_WA_SIZE  128
 #endif
 
+#ifndef MPIPE_SNAPSHOT_WA_SIZE
+#define MPIPE_SNAPSHOT_WA_SIZE  256
+#endif
+
+#ifndef MPIPE_SPI_WA_SIZE
+#define MPIPE_SPI_WA_SIZE  256
+#endif
+
+// longest spi slave frame sent with its bytes
+#ifndef MPIPE_SPI_FRAME_MAX
+#define MPIPE_SPI_FRAME_MAX  1024
+#endif
+
+// spi frames sent per device under one hold of the output mutex
+#ifndef MPIPE_SPI_BULK
+#define MPIPE_SPI_BULK  16
+#endif
+
+// above the shell sessions, streams keep flowing while commands run
+#ifndef MPIPE_PRIO
+#define MPIPE_PRIO  (NORMALPRIO + 1)
+#endif
+
+#ifndef MPIPE_INPUT_PRIO
+#define MPIPE_INPUT_PRIO  NORMALPRIO
+#endif
+
+// emit a timestamp record every N adc sample sets (and after any gap)
+#ifndef MPIPE_TIMESTAMP_INTERVAL
+#define MPIPE_TIMESTAMP_INTERVAL 64
+#endif
+
 // mutex used to control access to printing out on mpipe stream
 mutex_t mpipe_output_mutex;
 
@@ -46,18 +77,16 @@ thread_t * mpipe_adc2_tp = NULL;
 thread_t * mpipe_adc3_tp = NULL;
 thread_t * mpipe_can_tp = NULL;
 thread_t * mpipe_serial_tp = NULL;
+thread_t * mpipe_snapshot_tp = NULL;
+thread_t * mpipe_spi_tp = NULL;
 
 static THD_WORKING_AREA(mpipe_input_wa, MPIPE_INPUT_WA_SIZE);
 static THD_WORKING_AREA(mpipe_adc2_wa, MPIPE_ADC_WA_SIZE);
 static THD_WORKING_AREA(mpipe_adc3_wa, MPIPE_ADC_WA_SIZE);
 static THD_WORKING_AREA(mpipe_can_wa, MPIPE_CAN_WA_SIZE);
 static THD_WORKING_AREA(mpipe_serial_wa, MPIPE_SERIAL_WA_SIZE);
-
-msg_t mpipe_adc2_mb_buffer[MPIPE_ADC_MB_SIZE];
-mailbox_t mpipe_adc2_mb;
-
-msg_t mpipe_adc3_mb_buffer[MPIPE_ADC_MB_SIZE];
-mailbox_t mpipe_adc3_mb;
+static THD_WORKING_AREA(mpipe_snapshot_wa, MPIPE_SNAPSHOT_WA_SIZE);
+static THD_WORKING_AREA(mpipe_spi_wa, MPIPE_SPI_WA_SIZE);
 
 msg_t mpipe_can_mb_buffer[MPIPE_CAN_MB_SIZE];
 mailbox_t mpipe_can_mb;
@@ -116,7 +145,7 @@ static void print_hex16(BaseSequentialStream *chp, uint16_t data)
   print_hex_nibble(chp, data);
 }
 
-static void print_hex32(BaseSequentialStream *chp, uint16_t data)
+static void print_hex32(BaseSequentialStream *chp, uint32_t data)
 {
   print_hex_nibble(chp, data >> 28);
   print_hex_nibble(chp, data >> 24);
@@ -128,6 +157,76 @@ static void print_hex32(BaseSequentialStream *chp, uint16_t data)
   print_hex_nibble(chp, data);
 }
 
+/*! \brief print one adc sample set record
+ *
+ * A<dev>:<seq><sample 0>...<sample 6>
+ *
+ * Sets of a device running channels at divided rates (adc.divisor) that
+ * miss some channels go out as
+ *
+ * M<dev>:<seq><present mask><samples of the channels set in the mask>
+ *
+ * Sets with a gpio word from mixed signal capture (mixed.start) go out as
+ *
+ * D<dev>:<seq><present mask><samples of the channels set in the mask><word>
+ *
+ * Every MPIPE_TIMESTAMP_INTERVAL sets, and whenever the sequence number
+ * skips, the record is preceded by the 64 bit device timestamp of the set
+ *
+ * T<dev>:<seq><timestamp>
+ *
+ * Timestamps of the sets in between follow from the sample rate.
+ */
+static void print_adc_sample_set(BaseSequentialStream *chp, adc_sample_set_t * ssp, char dev, uint16_t * next_seq, uint32_t * since_timestamp)
+{
+  if( ssp->sequence_number != *next_seq || *since_timestamp >= MPIPE_TIMESTAMP_INTERVAL )
+  {
+    streamPut(chp, 'T');
+    streamPut(chp, dev);
+    streamPut(chp, ':');
+    print_hex16(chp, ssp->sequence_number);
+    print_hex32(chp, ssp->timestamp >> 32);
+    print_hex32(chp, ssp->timestamp);
+    streamPut(chp, '\r');
+    streamPut(chp, '\n');
+    *since_timestamp = 0;
+  }
+
+  bool digital = (ssp->digital_flags & ADC_SAMPLE_DIGITAL_VALID) != 0;
+
+  if( ssp->present == ADC_SAMPLE_SET_ALL && !digital )
+  {
+    streamPut(chp, 'A');
+    streamPut(chp, dev);
+    streamPut(chp, ':');
+    print_hex16(chp, ssp->sequence_number);
+  }
+  else
+  {
+    streamPut(chp, digital ? 'D' : 'M');
+    streamPut(chp, dev);
+    streamPut(chp, ':');
+    print_hex16(chp, ssp->sequence_number);
+    print_hex8(chp, ssp->present);
+  }
+  for( int i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
+  {
+    if( ssp->present & (1 << i) )
+    {
+      print_hex16(chp, ssp->sample[i]);
+    }
+  }
+  if( digital )
+  {
+    print_hex16(chp, ssp->digital);
+  }
+  streamPut(chp, '\r');
+  streamPut(chp, '\n');
+
+  *next_seq = ssp->sequence_number + 1;
+  (*since_timestamp)++;
+}
+
 static void print_serial_output(BaseSequentialStream *chp, SerialDriver *sdp, char dev)
 {
   static uint8_t uart_buffer[SERIAL_BUFFERS_SIZE];
@@ -191,32 +290,121 @@ static void mpipe_serial_thread(void * p)
   chThdExit(MSG_OK);
 }
 
+/* MARIONETTE -> PC */
+static void mpipe_snapshot_thread(void * p)
+{
+	BaseSequentialStream * chp   = (BaseSequentialStream*)p;
+	chRegSetThreadName("mpipe_snapshot");
+  static fetch_snapshot_t snap;
+  uint32_t period;
+
+  while(!chThdShouldTerminateX())
+  {
+    period = fetch_snapshot_push_period();
+    if( period == 0 )
+    {
+      chThdSleepMilliseconds(10);
+      continue;
+    }
+
+    fetch_snapshot_take(&snap);
+
+    // V:<snapshot bytes>
+    chMtxLock(&mpipe_output_mutex);
+    streamPut(chp, 'V');
+    streamPut(chp, ':');
+    for( uint32_t i = 0; i < sizeof(snap); i++ )
+    {
+      print_hex8(chp, ((uint8_t *)&snap)[i]);
+    }
+    streamPut(chp, '\r');
+    streamPut(chp, '\n');
+    chMtxUnlock(&mpipe_output_mutex);
+
+    chThdSleepMilliseconds(period);
+  }
+  chThdExit(MSG_OK);
+}
+
+/*! \brief print one spi slave frame record
+ *
+ * P<dev>:<timestamp><length><status><bytes>
+ *
+ * Frames longer than MPIPE_SPI_FRAME_MAX are cut and flagged truncated,
+ * overrun frames have no bytes.
+ */
+static void print_spi_frame(BaseSequentialStream *chp, fetch_spi_slave_frame_t * frame, uint8_t * data, char dev)
+{
+  streamPut(chp, 'P');
+  streamPut(chp, dev);
+  streamPut(chp, ':');
+  print_hex32(chp, frame->timestamp >> 32);
+  print_hex32(chp, frame->timestamp);
+  print_hex16(chp, frame->length);
+  print_hex8(chp, frame->status);
+  for( uint32_t i = 0; i < frame->copied; i++ )
+  {
+    print_hex8(chp, data[i]);
+  }
+  streamPut(chp, '\r');
+  streamPut(chp, '\n');
+}
+
+/* MARIONETTE -> PC */
+static void mpipe_spi_thread(void * p)
+{
+	BaseSequentialStream * chp   = (BaseSequentialStream*)p;
+	chRegSetThreadName("mpipe_spi");
+  static uint8_t data[MPIPE_SPI_FRAME_MAX];
+  fetch_spi_slave_frame_t frame;
+  bool idle;
+
+  while(!chThdShouldTerminateX())
+  {
+    idle = true;
+    for( uint32_t dev = 0; dev < FETCH_SPI_PROFILE_DEVICES; dev++ )
+    {
+      if( !fetch_spi_slave_active(dev) )
+      {
+        continue;
+      }
+
+      chMtxLock(&mpipe_output_mutex);
+      for( uint32_t n = 0; n < MPIPE_SPI_BULK && fetch_spi_slave_read_frame(dev, &frame, data, sizeof(data)); n++ )
+      {
+        print_spi_frame(chp, &frame, data, '0' + dev);
+        idle = false;
+      }
+      chMtxUnlock(&mpipe_output_mutex);
+    }
+
+    // the poll also follows the receive ring, keep it short
+    if( idle )
+    {
+      chThdSleepMilliseconds(1);
+    }
+  }
+  chThdExit(MSG_OK);
+}
+
 /* MARIONETTE -> PC */
 static void mpipe_adc2_thread(void * p)
 {
 	BaseSequentialStream * chp   = (BaseSequentialStream*)p;
 	chRegSetThreadName("mpipe_adc2");
   adc_sample_set_t *ssp;
-  msg_t msg;
+  uint16_t next_seq = 0;
+  uint32_t since_timestamp = MPIPE_TIMESTAMP_INTERVAL;
 
+  // ADC2 is fetch adc device 1
   while(!chThdShouldTerminateX())
   {
-    if( chMBFetch(&mpipe_adc2_mb, &msg, MS2ST(10)) == MSG_OK )
+    if( (ssp = fetch_adc_ring_read(1, MS2ST(10))) != NULL )
     {
       chMtxLock(&mpipe_output_mutex);
-      ssp = (adc_sample_set_t*)msg;
-      streamPut(chp, 'A');
-      streamPut(chp, '2');
-      streamPut(chp, ':');
-      print_hex16(chp, ssp->sequence_number);
-      for( int i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
-      {
-        print_hex16(chp, ssp->sample[i]);
-      }
-      streamPut(chp, '\r');
-      streamPut(chp, '\n');
+      print_adc_sample_set(chp, ssp, '2', &next_seq, &since_timestamp);
       chMtxUnlock(&mpipe_output_mutex);
-      fetch_adc_free_sample_set(ssp);
+      fetch_adc_ring_release(1);
     }
   }
   chThdExit(MSG_OK);
@@ -228,26 +416,18 @@ static void mpipe_adc3_thread(void * p)
 	BaseSequentialStream * chp   = (BaseSequentialStream*)p;
 	chRegSetThreadName("mpipe_adc3");
   adc_sample_set_t *ssp;
-  msg_t msg;
+  uint16_t next_seq = 0;
+  uint32_t since_timestamp = MPIPE_TIMESTAMP_INTERVAL;
 
+  // ADC3 is fetch adc device 0
   while(!chThdShouldTerminateX())
   {
-    if( chMBFetch(&mpipe_adc3_mb, &msg, MS2ST(10)) == MSG_OK )
+    if( (ssp = fetch_adc_ring_read(0, MS2ST(10))) != NULL )
     {
       chMtxLock(&mpipe_output_mutex);
-      ssp = (adc_sample_set_t*)msg;
-      streamPut(chp, 'A');
-      streamPut(chp, '2');
-      streamPut(chp, ':');
-      print_hex16(chp, ssp->sequence_number);
-      for( int i = 0; i < ADC_SAMPLE_SET_SIZE; i++ )
-      {
-        print_hex16(chp, ssp->sample[i]);
-      }
-      streamPut(chp, '\r');
-      streamPut(chp, '\n');
+      print_adc_sample_set(chp, ssp, '3', &next_seq, &since_timestamp);
       chMtxUnlock(&mpipe_output_mutex);
-      fetch_adc_free_sample_set(ssp);
+      fetch_adc_ring_release(0);
     }
   }
   chThdExit(MSG_OK);
@@ -306,23 +486,31 @@ void mpipe_start(const mpipe_config_t * cfg)
   // start/restart io threads
   if( mpipe_adc2_tp == NULL || chThdTerminatedX(mpipe_adc2_tp))
   {
-    mpipe_adc2_tp = chThdCreateStatic(mpipe_adc2_wa, sizeof(mpipe_adc2_wa), NORMALPRIO, mpipe_adc2_thread, (void*)cfg->channel);
+    mpipe_adc2_tp = chThdCreateStatic(mpipe_adc2_wa, sizeof(mpipe_adc2_wa), MPIPE_PRIO, mpipe_adc2_thread, (void*)cfg->channel);
   }
   if( mpipe_adc3_tp == NULL || chThdTerminatedX(mpipe_adc3_tp))
   {
-    mpipe_adc3_tp = chThdCreateStatic(mpipe_adc3_wa, sizeof(mpipe_adc3_wa), NORMALPRIO, mpipe_adc3_thread, (void*)cfg->channel);
+    mpipe_adc3_tp = chThdCreateStatic(mpipe_adc3_wa, sizeof(mpipe_adc3_wa), MPIPE_PRIO, mpipe_adc3_thread, (void*)cfg->channel);
   }
   if( mpipe_serial_tp == NULL || chThdTerminatedX(mpipe_serial_tp))
   {
-    mpipe_serial_tp = chThdCreateStatic(mpipe_serial_wa, sizeof(mpipe_serial_wa), NORMALPRIO, mpipe_serial_thread, (void*)cfg->channel);
+    mpipe_serial_tp = chThdCreateStatic(mpipe_serial_wa, sizeof(mpipe_serial_wa), MPIPE_PRIO, mpipe_serial_thread, (void*)cfg->channel);
+  }
+  if( mpipe_snapshot_tp == NULL || chThdTerminatedX(mpipe_snapshot_tp))
+  {
+    mpipe_snapshot_tp = chThdCreateStatic(mpipe_snapshot_wa, sizeof(mpipe_snapshot_wa), MPIPE_PRIO, mpipe_snapshot_thread, (void*)cfg->channel);
+  }
+  if( mpipe_spi_tp == NULL || chThdTerminatedX(mpipe_spi_tp))
+  {
+    mpipe_spi_tp = chThdCreateStatic(mpipe_spi_wa, sizeof(mpipe_spi_wa), MPIPE_PRIO, mpipe_spi_thread, (void*)cfg->channel);
   }
   if( mpipe_can_tp == NULL || chThdTerminatedX(mpipe_can_tp))
   {
-    mpipe_can_tp = chThdCreateStatic(mpipe_can_wa, sizeof(mpipe_can_wa), NORMALPRIO, mpipe_can_thread, (void*)cfg->channel);
+    mpipe_can_tp = chThdCreateStatic(mpipe_can_wa, sizeof(mpipe_can_wa), MPIPE_PRIO, mpipe_can_thread, (void*)cfg->channel);
   }
   if( mpipe_input_tp == NULL || chThdTerminatedX(mpipe_input_tp))
   {
-    mpipe_input_tp = chThdCreateStatic(mpipe_input_wa, sizeof(mpipe_input_wa), NORMALPRIO, mpipe_input_thread, (void*)cfg->channel);
+    mpipe_input_tp = chThdCreateStatic(mpipe_input_wa, sizeof(mpipe_input_wa), MPIPE_INPUT_PRIO, mpipe_input_thread, (void*)cfg->channel);
   }
 }
 
@@ -357,6 +545,20 @@ void mpipe_stop(void)
     mpipe_serial_tp = NULL;
   }
 
+  if( mpipe_snapshot_tp )
+  {
+    chThdTerminate(mpipe_snapshot_tp);
+    chThdWait(mpipe_snapshot_tp);
+    mpipe_snapshot_tp = NULL;
+  }
+
+  if( mpipe_spi_tp )
+  {
+    chThdTerminate(mpipe_spi_tp);
+    chThdWait(mpipe_spi_tp);
+    mpipe_spi_tp = NULL;
+  }
+
   if( mpipe_can_tp )
   {
     chThdTerminate(mpipe_can_tp);
@@ -369,8 +571,6 @@ void mpipe_init(void)
 {
   chMtxObjectInit(&mpipe_output_mutex);
 
-  chMBObjectInit(&mpipe_adc2_mb, mpipe_adc2_mb_buffer, MPIPE_ADC_MB_SIZE);
-  chMBObjectInit(&mpipe_adc3_mb, mpipe_adc3_mb_buffer, MPIPE_ADC_MB_SIZE);
   chMBObjectInit(&mpipe_can_mb, mpipe_can_mb_buffer, MPIPE_CAN_MB_SIZE);
 }
 
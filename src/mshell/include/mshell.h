@@ -25,6 +25,7 @@
 #define _MSHELL_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief   Shell maximum input line length.
@@ -40,6 +41,10 @@
 #define MSHELL_MAX_ARGUMENTS         10
 #endif
 
+/**
+ * @brief   Number of concurrent shell sessions.
+ */
+#define MSHELL_SESSIONS              2
 
 #if !defined(MSHELL_WELCOME_STR) || defined(__DOXYGEN__)
 #define MSHELL_WELCOME_STR "Marionette Shell (\"help\" for fetch commands and  \"+help\" for shell commands)"
@@ -83,9 +88,11 @@ extern "C" {
 #endif
 
   void mshell_init(void);
-  void mshell_start(const mshell_config_t *cfg);
-  void mshell_stop(void);
+  void mshell_start(uint32_t session, const mshell_config_t *cfg);
+  void mshell_stop(uint32_t session);
   mshell_msg_t mshell_get_line(BaseAsynchronousChannel * channel, char * line, unsigned size, bool echo_chars );
+  void mshell_get_options(bool * show_prompt, bool * echo_chars);
+  void mshell_set_options(bool show_prompt, bool echo_chars);
 
 #ifdef __cplusplus
 }
@@ -38,6 +38,7 @@
 #include "util_version.h"
 
 #include "fetch.h"
+#include "fetch_irq.h"
 #include "mshell.h"
 #include "mshell_sync.h"
 
@@ -45,17 +46,89 @@
 #define MSHELL_WA_SIZE 16384
 #endif
 
+// the aux session runs the same fetch commands, keep enough stack for them
+#ifndef MSHELL_AUX_WA_SIZE
+#define MSHELL_AUX_WA_SIZE 8192
+#endif
+
+// below mpipe, so streaming output keeps up while a command runs
 #ifndef MSHELL_PRIO
-#define MSHELL_PRIO HIGHPRIO
+#define MSHELL_PRIO NORMALPRIO
+#endif
+
+#ifndef MSHELL_WATCH_WA_SIZE
+#define MSHELL_WATCH_WA_SIZE 256
+#endif
+
+#ifndef MSHELL_WATCH_PRIO
+#define MSHELL_WATCH_PRIO (MSHELL_PRIO + 1)
+#endif
+
+// how quickly the watcher hands the channel back after a command
+#ifndef MSHELL_WATCH_POLL_MS
+#define MSHELL_WATCH_POLL_MS 10
+#endif
+
+// input typed while a command runs, replayed to the next mshell_get_line
+#ifndef MSHELL_TYPEAHEAD_SIZE
+#define MSHELL_TYPEAHEAD_SIZE 128
 #endif
 
+#define ASCII_CTRL_C      ((char) 0x03)
+#define ASCII_CTRL_D      ((char) 0x04)
+#define ASCII_BACKSPACE   ((char) 0x08)
+#define ASCII_DELETE      ((char) 0x7F)
+#define ASCII_CTRL_U      ((char) 0x15)
+#define ASCII_SPACE       ((char) 0x20)
+
+typedef struct {
+  const char * name;
+  void * wa;
+  size_t wa_size;
+  void * watch_wa;
+  thread_t * tp;
+  thread_t * watch_tp;
+  binary_semaphore_t watch_start;
+  binary_semaphore_t watch_done;
+  volatile bool watching;
+  uint32_t typeahead_count;
+  uint32_t typeahead_read;
+  uint8_t typeahead[MSHELL_TYPEAHEAD_SIZE];
+  mshell_config_t config;
+  char input_line[MSHELL_MAX_LINE_LENGTH];
+} mshell_session_t;
+
 static THD_WORKING_AREA(mshell_wa, MSHELL_WA_SIZE);
+static THD_WORKING_AREA(mshell_aux_wa, MSHELL_AUX_WA_SIZE);
+static THD_WORKING_AREA(mshell_watch_wa, MSHELL_WATCH_WA_SIZE);
+static THD_WORKING_AREA(mshell_aux_watch_wa, MSHELL_WATCH_WA_SIZE);
 
-static thread_t * mshell_tp = NULL;
+static mshell_session_t mshell_sessions[MSHELL_SESSIONS] =
+{
+  { "mshell",     mshell_wa,     sizeof(mshell_wa),     mshell_watch_wa },
+  { "mshell_aux", mshell_aux_wa, sizeof(mshell_aux_wa), mshell_aux_watch_wa },
+};
 
-static mshell_config_t mshell_config;
+// prompt/echo set through mshell_set_options, kept across shell restarts
+static bool mshell_options_valid = false;
+static bool mshell_option_prompt;
+static bool mshell_option_echo;
 
 
+/*! \brief session a command was typed in, by its stream
+ */
+static mshell_session_t * mshell_session_of(BaseSequentialStream * chp)
+{
+  for( uint32_t i = 0; i < MSHELL_SESSIONS; i++ )
+  {
+    if( (BaseSequentialStream *)mshell_sessions[i].config.channel == chp )
+    {
+      return &mshell_sessions[i];
+    }
+  }
+  return &mshell_sessions[0];
+}
+
 static void list_commands(BaseSequentialStream * chp, const mshell_command_t * scp)
 {
 	while (scp->sc_name != NULL)
@@ -75,7 +148,7 @@ static bool cmd_prompt(BaseSequentialStream * chp, int argc, char * argv[] UNUSE
 		util_message_error(chp, "extra arguments for command 'prompt'");
 		return false;
 	}
-  mshell_config.show_prompt = true;
+  mshell_session_of(chp)->config.show_prompt = true;
   return true;
 }
 
@@ -88,7 +161,7 @@ static bool cmd_noprompt(BaseSequentialStream * chp, int argc, char * argv[] UNU
 		util_message_error(chp, "extra arguments for command 'noprompt'");
 		return false;
 	}
-	mshell_config.show_prompt = false;
+	mshell_session_of(chp)->config.show_prompt = false;
   return true;
 }
 
@@ -101,7 +174,7 @@ static bool cmd_echo(BaseSequentialStream * chp, int argc, char * argv[] UNUSED)
 		util_message_error(chp, "extra arguments for command 'echo'");
 		return false;
 	}
-	mshell_config.echo_chars = true;
+	mshell_session_of(chp)->config.echo_chars = true;
   return true;
 }
 
@@ -114,7 +187,7 @@ static bool cmd_noecho(BaseSequentialStream * chp, int argc, char * argv[] UNUSE
 		util_message_error(chp, "extra arguments for command 'noecho'");
 		return false;
 	}
-	mshell_config.echo_chars = false;
+	mshell_session_of(chp)->config.echo_chars = false;
   return true;
 }
 
@@ -176,11 +249,55 @@ static bool cmd_reset(BaseSequentialStream * chp, int argc, char * argv[] UNUSED
 		util_message_error(chp, "extra arguments for command 'reset'");
 		return false;
 	}
-  mshell_config.show_prompt = true;
-	mshell_config.echo_chars = true;
+  mshell_session_of(chp)->config.show_prompt = true;
+	mshell_session_of(chp)->config.echo_chars = true;
   return true;
 }
 
+/*! \brief number of the session this command was typed in
+ */
+static bool cmd_session(BaseSequentialStream * chp, int argc, char * argv[] UNUSED)
+{
+	if (argc > 0)
+	{
+		util_message_error(chp, "extra arguments for command 'session'");
+		return false;
+	}
+  util_message_uint32(chp, "session", mshell_session_of(chp) - mshell_sessions);
+  return true;
+}
+
+/*! \brief ask the fetch command running in any session to stop
+ *
+ * Only useful from the session that is not busy, a session running a
+ * command does not read its input.
+ */
+static bool cmd_abort(BaseSequentialStream * chp, int argc, char * argv[] UNUSED)
+{
+	if (argc > 0)
+	{
+		util_message_error(chp, "extra arguments for command 'abort'");
+		return false;
+	}
+  fetch_abort();
+  return true;
+}
+
+/*! \brief interrupt latency and jitter, see irq.help
+ *
+ * A local command, so it answers while the other session streams or
+ * runs the load.
+ */
+static bool cmd_irqstats(BaseSequentialStream * chp, int argc, char * argv[])
+{
+	if (argc > 0)
+	{
+		util_message_error(chp, "extra arguments for command 'irqstats'");
+		return false;
+	}
+  return fetch_irq_stats_cmd(chp, 0, argv);
+}
+
 /**
  * @brief   Array of the default commands.
  */
@@ -195,6 +312,9 @@ static mshell_command_t local_commands[] =
 	{cmd_noecho,    "noecho",     "Disable shell echo"},
 	{cmd_noecho,    "no_echo",    NULL},
   {cmd_reset,     "reset",      "Reset shell to defaults"},
+  {cmd_session,   "session",    "Query the number of this shell session"},
+  {cmd_abort,     "abort",      "Stop the fetch command running in another session"},
+  {cmd_irqstats,  "irqstats",   "Query interrupt latency and jitter statistics"},
 	{NULL, NULL, NULL}
 };
 
@@ -274,6 +394,87 @@ static bool mshell_parse(BaseSequentialStream* chp, const mshell_command_t * scp
 }
 
 
+/*! \brief Input watcher of a session
+ *
+ * While the session runs a fetch command it does not read its channel.
+ * The watcher reads it instead: ctrl-c aborts the command through
+ * fetch_abort(), anything else is kept for the next input line.
+ */
+static void mshell_watch_thread(void * p)
+{
+  mshell_session_t * sp = (mshell_session_t *)p;
+  char c;
+
+  chRegSetThreadName("mshell_watch");
+
+  while( !chThdShouldTerminateX() )
+  {
+    if( chBSemWaitTimeout(&sp->watch_start, MS2ST(100)) != MSG_OK )
+    {
+      continue;
+    }
+
+    while( sp->watching )
+    {
+      if( chnReadTimeout(sp->config.channel, (uint8_t *)&c, 1, MS2ST(MSHELL_WATCH_POLL_MS)) == 0 )
+      {
+        continue;
+      }
+
+      if( c == ASCII_CTRL_C )
+      {
+        fetch_abort();
+      }
+      else if( sp->typeahead_count < MSHELL_TYPEAHEAD_SIZE )
+      {
+        sp->typeahead[sp->typeahead_count++] = c;
+      }
+    }
+
+    chBSemSignal(&sp->watch_done);
+  }
+
+  chThdExit(MSG_OK);
+}
+
+static void mshell_watch_begin(mshell_session_t * sp)
+{
+  sp->watching = true;
+  chBSemSignal(&sp->watch_start);
+}
+
+/*
+ * Returns once the watcher stopped reading, the session owns the channel
+ * and the typeahead buffer again.
+ */
+static void mshell_watch_end(mshell_session_t * sp)
+{
+  sp->watching = false;
+  chBSemWait(&sp->watch_done);
+}
+
+/*! \brief next input character, typeahead first
+ */
+static size_t mshell_read_char(BaseAsynchronousChannel * channel, char * c)
+{
+  mshell_session_t * sp = mshell_session_of((BaseSequentialStream *)channel);
+
+  if( (BaseAsynchronousChannel *)sp->config.channel == channel &&
+      sp->typeahead_read < sp->typeahead_count )
+  {
+    *c = sp->typeahead[sp->typeahead_read++];
+    if( sp->typeahead_read == sp->typeahead_count )
+    {
+      sp->typeahead_read = 0;
+      sp->typeahead_count = 0;
+    }
+    return 1;
+  }
+
+  // timeout so we can check if the thread should terminate
+  return chnReadTimeout(channel, (uint8_t *)c, 1, MS2ST(100));
+}
+
 /*! \brief   MShell thread function.
  *
  * Marionette shell commands are escaped with a '+'
@@ -281,7 +482,7 @@ static bool mshell_parse(BaseSequentialStream* chp, const mshell_command_t * scp
  * Fetch commands are parsed here through the call to fetch_execute()
  * \sa fetch.c
  *
- * @param[in] p         pointer to a @p BaseSequentialStream object
+ * @param[in] p         pointer to the session
  * @return              Termination reason.
  * @retval MSG_OK       terminated by command.
  * @retval MSG_RESET    terminated by reset condition on the I/O channel.
@@ -289,11 +490,13 @@ static bool mshell_parse(BaseSequentialStream* chp, const mshell_command_t * scp
  */
 static void mshell_thread(void * p)
 {
-  BaseAsynchronousChannel * channel = mshell_config.channel;
-	BaseSequentialStream * stream = (BaseSequentialStream*)mshell_config.channel;
-  static char input_line[MSHELL_MAX_LINE_LENGTH];
+  mshell_session_t * session = (mshell_session_t *)p;
+  BaseAsynchronousChannel * channel = session->config.channel;
+	BaseSequentialStream * stream = (BaseSequentialStream*)session->config.channel;
+  char * input_line = session->input_line;
+  mshell_msg_t msg;
 
-	chRegSetThreadName("mshell");
+	chRegSetThreadName(session->name);
 	chThdSleepMilliseconds(500); // FIXME do we need this and does it need to be this long?
 
   chprintf(stream, "\r\n");
@@ -301,13 +504,21 @@ static void mshell_thread(void * p)
 
   while(!chThdShouldTerminateX())
 	{
-    if( mshell_config.show_prompt )
+    if( session->config.show_prompt )
     {
-      chprintf(stream, mshell_config.prompt);
+      chprintf(stream, session->config.prompt);
     }
 
-    // FIXME change this to handle each return code, eg. break, exit, etc.
-		if( mshell_get_line(channel, input_line, sizeof(input_line), mshell_config.echo_chars) != MSHELL_MSG_OK )
+    msg = mshell_get_line(channel, input_line, sizeof(session->input_line), session->config.echo_chars);
+
+    // ctrl-c drops the line
+    if( msg == MSHELL_MSG_BREAK )
+    {
+      chprintf(stream, "\r\n");
+      continue;
+    }
+
+		if( msg != MSHELL_MSG_OK )
     {
       chprintf(stream, "\r\n");
 			util_message_warning(stream, "exit mshell thread");
@@ -324,11 +535,14 @@ static void mshell_thread(void * p)
 
 		if(input_line[0] == '+' || input_line[0] == '.')    // use escape to process mshell commands
 		{
-      util_message_end(stream, mshell_parse(stream, mshell_config.commands, &input_line[1]) );
+      util_message_end(stream, mshell_parse(stream, session->config.commands, &input_line[1]) );
 		}
-		else // all other commands are passed to fetch
+		else // all other commands are passed to fetch, ctrl-c aborts them
 		{
-			util_message_end(stream, fetch_execute(stream, input_line) );
+      mshell_watch_begin(session);
+      bool ret = fetch_execute(stream, input_line);
+      mshell_watch_end(session);
+			util_message_end(stream, ret);
 		}
 	}
 
@@ -344,28 +558,100 @@ static void mshell_thread(void * p)
 void mshell_init()
 {
   mshell_sync_init();
+
+  for( uint32_t i = 0; i < MSHELL_SESSIONS; i++ )
+  {
+    chBSemObjectInit(&mshell_sessions[i].watch_start, true);
+    chBSemObjectInit(&mshell_sessions[i].watch_done, true);
+  }
 }
 
 
-void mshell_start( const mshell_config_t * cfg )
+/*! \brief start a shell session on a channel
+ *
+ * Sessions run independently, each with its own thread and input line.
+ * Fetch commands from different sessions still take turns on the fetch
+ * command lock. Session 0 is the USB shell, the prompt/echo options of
+ * mshell_set_options apply to it.
+ */
+void mshell_start( uint32_t session, const mshell_config_t * cfg )
 {
+  mshell_session_t * sp;
+
+  if( session >= MSHELL_SESSIONS )
+  {
+    return;
+  }
+  sp = &mshell_sessions[session];
+
   // start mshell thread if not already active
-  if( mshell_tp == NULL || chThdTerminatedX(mshell_tp) )
+  if( sp->tp == NULL || chThdTerminatedX(sp->tp) )
   {
-    mshell_config = *cfg;
+    sp->config = *cfg;
 
-	  mshell_tp = chThdCreateStatic(mshell_wa, sizeof(mshell_wa), MSHELL_PRIO, mshell_thread, NULL);
+    if( session == 0 && mshell_options_valid )
+    {
+      sp->config.show_prompt = mshell_option_prompt;
+      sp->config.echo_chars = mshell_option_echo;
+    }
+
+    sp->typeahead_count = 0;
+    sp->typeahead_read = 0;
+
+	  sp->tp = chThdCreateStatic(sp->wa, sp->wa_size, MSHELL_PRIO, mshell_thread, sp);
   }
+
+  if( sp->watch_tp == NULL || chThdTerminatedX(sp->watch_tp) )
+  {
+    sp->watch_tp = chThdCreateStatic(sp->watch_wa, THD_WORKING_AREA_SIZE(MSHELL_WATCH_WA_SIZE),
+                                     MSHELL_WATCH_PRIO, mshell_watch_thread, sp);
+  }
+}
+
+
+/*! \brief current prompt and echo flags of the USB shell
+ */
+void mshell_get_options(bool * show_prompt, bool * echo_chars)
+{
+  *show_prompt = mshell_sessions[0].config.show_prompt;
+  *echo_chars = mshell_sessions[0].config.echo_chars;
 }
 
+/*! \brief set prompt and echo flags of the USB shell, also for later starts
+ */
+void mshell_set_options(bool show_prompt, bool echo_chars)
+{
+  mshell_option_prompt = show_prompt;
+  mshell_option_echo = echo_chars;
+  mshell_options_valid = true;
+
+  mshell_sessions[0].config.show_prompt = show_prompt;
+  mshell_sessions[0].config.echo_chars = echo_chars;
+}
 
-void mshell_stop(void)
+void mshell_stop( uint32_t session )
 {
-  if( mshell_tp )
+  mshell_session_t * sp;
+
+  if( session >= MSHELL_SESSIONS )
+  {
+    return;
+  }
+  sp = &mshell_sessions[session];
+
+  if( sp->tp )
+  {
+    chThdTerminate(sp->tp);
+    chThdWait(sp->tp);
+    sp->tp = NULL;
+  }
+
+  // after the session, which may still be waiting for it in mshell_watch_end
+  if( sp->watch_tp )
   {
-    chThdTerminate(mshell_tp);
-    chThdWait(mshell_tp);
-    mshell_tp = NULL;
+    chThdTerminate(sp->watch_tp);
+    chThdWait(sp->watch_tp);
+    sp->watch_tp = NULL;
   }
 }
 
@@ -380,13 +666,6 @@ void mshell_stop(void)
  * \retval false        operation successful.
  *
  */
-#define ASCII_CTRL_C      ((char) 0x03)
-#define ASCII_CTRL_D      ((char) 0x04)
-#define ASCII_BACKSPACE   ((char) 0x08)
-#define ASCII_DELETE      ((char) 0x7F)
-#define ASCII_CTRL_U      ((char) 0x15)
-#define ASCII_SPACE       ((char) 0x20)
-
 mshell_msg_t mshell_get_line(BaseAsynchronousChannel * channel, char * line, unsigned size, bool echo_chars )
 {
 	char * p = line;
@@ -397,14 +676,11 @@ mshell_msg_t mshell_get_line(BaseAsynchronousChannel * channel, char * line, uns
 		char c;
 
     // Read a single character from the input stream, timeout so we can check if the thread should terminate
-		if( chnReadTimeout(channel, (uint8_t *)&c, 1, MS2ST(100)) == 0 ) 
+		if( mshell_read_char(channel, &c) == 0 )
 		{
 			continue;
 		}
 
-    // DEBUG lets spit stuff out to see what is received at initial connection
-    chprintf(DEBUG_CHP, "%c", c);
-
     // Ctrl+D: return true indicating we should exit mshell
 		if( c == ASCII_CTRL_D )
 		{
@@ -0,0 +1,56 @@
+/*! \file usb_msd.h
+ * @addtogroup usb_msd
+ * @{
+ */
+
+#ifndef _USB_MSD_H_
+#define _USB_MSD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Mass storage function exposing the SD card, see usb_msd.c. Off by
+ *  default, its double buffer alone takes 16 KB of RAM.
+ */
+#ifndef USB_USE_MSD
+#define USB_USE_MSD         FALSE
+#endif
+
+/*! Interface number of the mass storage function in the composite device */
+#define USB_MSD_INTERFACE   4
+
+/*! Bulk IN/OUT endpoint pair */
+#define USB_MSD_DATA_EP     5
+
+#define USB_MSD_PACKET_SIZE 512
+
+typedef struct usb_msd_status {
+  bool attached;
+  bool ejected;           //!< host sent START STOP UNIT with eject
+  uint32_t blocks;
+  uint32_t read_blocks;
+  uint32_t write_blocks;
+  uint32_t errors;
+} usb_msd_status_t;
+
+void usb_msd_init(void);
+
+bool usb_msd_attach(BaseBlockDevice * bbdp);
+void usb_msd_detach(void);
+bool usb_msd_is_attached(void);
+void usb_msd_get_status(usb_msd_status_t * status);
+
+/* usbcfg.c hooks */
+void usb_msd_configure_hook_i(USBDriver * usbp);
+void usb_msd_reset_hook_i(USBDriver * usbp);
+bool usb_msd_requests_hook(USBDriver * usbp);
+void usb_msd_data_transmitted(USBDriver * usbp, usbep_t ep);
+void usb_msd_data_received(USBDriver * usbp, usbep_t ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/*! @} */
@@ -20,10 +20,14 @@
 extern SerialUSBDriver SDU1;
 extern SerialUSBDriver SDU2;
 extern const USBConfig usbcfg;
-extern SerialUSBConfig serusbcfg;
-extern SerialUSBConfig serusbcfg2;
+extern const SerialUSBConfig serusbcfg;
+extern const SerialUSBConfig serusbcfg2;
 
 void usb_set_serial_strings(const uint32_t high, const uint32_t mid, const uint32_t low);
+void usb_get_sof_reference(uint32_t * count, uint64_t * timestamp);
+
+typedef void (*usb_sof_hook_t)(uint32_t count, uint64_t timestamp);
+void usb_set_sof_hook(usb_sof_hook_t hook);
 
 #endif  /* _USBCFG_H_ */
 
@@ -0,0 +1,763 @@
+/*! \file usb_msd.c
+ *
+ * USB mass storage (bulk only transport, SCSI transparent command set)
+ * function of the composite device.
+ *
+ * @defgroup usb_msd USB Mass Storage
+ * @{
+ */
+
+/*!
+ * <hr>
+ *
+ *  The function is always part of the configuration descriptor, but has
+ *  no medium until a block device is attached (sd.usb(ON)). While
+ *  detached every command fails with NOT READY / MEDIUM NOT PRESENT, the
+ *  same as an empty card reader. Attaching raises UNIT ATTENTION /
+ *  MEDIUM CHANGED once so the host rereads the card.
+ *
+ *  The block device must not be used by anything else (FatFs) while it
+ *  is attached. fetch_sd enforces this.
+ *
+ *  READ(10) and WRITE(10) are double buffered: the next chunk of
+ *  USB_MSD_BUFFER_BLOCKS blocks is read from (written to) the card while
+ *  the current one is on the bus.
+ *
+ *  Built with USB_USE_MSD only, 2 x USB_MSD_BUFFER_BLOCKS blocks of
+ *  static RAM. Otherwise the function is left out of the descriptors and
+ *  usb_msd_attach() fails.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "usb_msd.h"
+
+#if USB_USE_MSD
+
+#ifndef USB_MSD_BUFFER_BLOCKS
+#define USB_MSD_BUFFER_BLOCKS   16
+#endif
+
+#ifndef USB_MSD_WA_SIZE
+#define USB_MSD_WA_SIZE         1024
+#endif
+
+#ifndef USB_MSD_PRIO
+#define USB_MSD_PRIO            NORMALPRIO
+#endif
+
+#define MSD_BLOCK_SIZE          512
+#define MSD_BUFFER_SIZE         (USB_MSD_BUFFER_BLOCKS * MSD_BLOCK_SIZE)
+
+#define MSD_CBW_SIGNATURE       0x43425355
+#define MSD_CSW_SIGNATURE       0x53425355
+#define MSD_CBW_SIZE            31
+#define MSD_CSW_SIZE            13
+#define MSD_CBW_FLAG_IN         0x80
+
+#define MSD_CSW_PASSED          0
+#define MSD_CSW_FAILED          1
+#define MSD_CSW_PHASE_ERROR     2
+
+#define MSD_REQ_GET_MAX_LUN     0xFE
+#define MSD_REQ_RESET           0xFF
+
+#define SCSI_TEST_UNIT_READY    0x00
+#define SCSI_REQUEST_SENSE      0x03
+#define SCSI_INQUIRY            0x12
+#define SCSI_MODE_SENSE_6       0x1A
+#define SCSI_START_STOP_UNIT    0x1B
+#define SCSI_PREVENT_ALLOW      0x1E
+#define SCSI_READ_FORMAT_CAP    0x23
+#define SCSI_READ_CAPACITY_10   0x25
+#define SCSI_READ_10            0x28
+#define SCSI_WRITE_10           0x2A
+#define SCSI_VERIFY_10          0x2F
+#define SCSI_SYNC_CACHE_10      0x35
+#define SCSI_MODE_SENSE_10      0x5A
+
+#define SENSE_NO_SENSE          0x00
+#define SENSE_NOT_READY         0x02
+#define SENSE_MEDIUM_ERROR      0x03
+#define SENSE_ILLEGAL_REQUEST   0x05
+#define SENSE_UNIT_ATTENTION    0x06
+
+#define ASC_NONE                0x00
+#define ASC_WRITE_FAULT         0x03
+#define ASC_READ_ERROR          0x11
+#define ASC_INVALID_COMMAND     0x20
+#define ASC_LBA_OUT_OF_RANGE    0x21
+#define ASC_INVALID_FIELD       0x24
+#define ASC_MEDIUM_CHANGED      0x28
+#define ASC_MEDIUM_NOT_PRESENT  0x3A
+
+typedef struct {
+  uint32_t signature;
+  uint32_t tag;
+  uint32_t data_length;
+  uint8_t  flags;
+  uint8_t  lun;
+  uint8_t  cb_length;
+  uint8_t  cb[16];
+} __attribute__((packed)) msd_cbw_t;
+
+typedef struct {
+  uint32_t signature;
+  uint32_t tag;
+  uint32_t residue;
+  uint8_t  status;
+} __attribute__((packed)) msd_csw_t;
+
+static THD_WORKING_AREA(usb_msd_wa, USB_MSD_WA_SIZE);
+
+// word aligned for the SDIO DMA
+static uint32_t msd_buffer[2][MSD_BUFFER_SIZE / sizeof(uint32_t)];
+static uint32_t msd_cbw_buffer[(USB_MSD_PACKET_SIZE) / sizeof(uint32_t)];
+static msd_csw_t msd_csw;
+
+static USBDriver * msd_usbp = NULL;
+static bool msd_usb_ready = false;
+static binary_semaphore_t msd_ready_sem;
+static binary_semaphore_t msd_xfer_sem;
+static mutex_t msd_mutex;
+
+static BaseBlockDevice * msd_bbdp = NULL;
+static uint32_t msd_blocks = 0;
+static bool msd_unit_attention = false;
+static bool msd_ejected = false;
+
+static uint8_t msd_sense_key = SENSE_NO_SENSE;
+static uint8_t msd_asc = ASC_NONE;
+
+static uint32_t msd_read_blocks = 0;
+static uint32_t msd_write_blocks = 0;
+static uint32_t msd_errors = 0;
+
+static const uint8_t msd_inquiry[36] = {
+  0x00,                   // direct access block device
+  0x80,                   // removable
+  0x04,                   // SPC-2
+  0x02,                   // response data format
+  36 - 5,                 // additional length
+  0x00, 0x00, 0x00,
+  'A', 'P', 'D', 'M', ' ', ' ', ' ', ' ',
+  'M', 'a', 'r', 'i', 'o', 'n', 'e', 't', 't', 'e', ' ', 'S', 'D', ' ', ' ', ' ',
+  '1', '.', '0', ' '
+};
+
+static inline uint32_t get_be32(const uint8_t * p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint16_t get_be16(const uint8_t * p)
+{
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static inline void put_be32(uint8_t * p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void msd_set_sense(uint8_t key, uint8_t asc)
+{
+  msd_sense_key = key;
+  msd_asc = asc;
+}
+
+/*
+ * Endpoint transfers. Only one transfer is in flight at any time, its
+ * completion (or a bus reset) releases msd_xfer_sem.
+ */
+static bool msd_start_in(const uint8_t * buf, size_t n)
+{
+  usbPrepareTransmit(msd_usbp, USB_MSD_DATA_EP, buf, n);
+
+  chSysLock();
+  if( !msd_usb_ready || usbStartTransmitI(msd_usbp, USB_MSD_DATA_EP) )
+  {
+    chSysUnlock();
+    return false;
+  }
+  chSysUnlock();
+
+  return true;
+}
+
+static bool msd_start_out(uint8_t * buf, size_t n)
+{
+  usbPrepareReceive(msd_usbp, USB_MSD_DATA_EP, buf, n);
+
+  chSysLock();
+  if( !msd_usb_ready || usbStartReceiveI(msd_usbp, USB_MSD_DATA_EP) )
+  {
+    chSysUnlock();
+    return false;
+  }
+  chSysUnlock();
+
+  return true;
+}
+
+static bool msd_wait(void)
+{
+  return chBSemWait(&msd_xfer_sem) == MSG_OK;
+}
+
+static bool msd_in(const uint8_t * buf, size_t n)
+{
+  return msd_start_in(buf, n) && msd_wait();
+}
+
+/*
+ * Stall the data endpoint(s) and wait for the host to clear them, used
+ * when the data phase ends early and for invalid CBWs.
+ */
+static bool msd_stall(bool in, bool out)
+{
+  chSysLock();
+  if( in )
+  {
+    usbStallTransmitI(msd_usbp, USB_MSD_DATA_EP);
+  }
+  if( out )
+  {
+    usbStallReceiveI(msd_usbp, USB_MSD_DATA_EP);
+  }
+  chSysUnlock();
+
+  while( msd_usb_ready )
+  {
+    if( (!in || usb_lld_get_status_in(msd_usbp, USB_MSD_DATA_EP) != EP_STATUS_STALLED) &&
+        (!out || usb_lld_get_status_out(msd_usbp, USB_MSD_DATA_EP) != EP_STATUS_STALLED) )
+    {
+      return true;
+    }
+    chThdSleepMilliseconds(1);
+  }
+
+  return false;
+}
+
+/*! \brief READ(10), returns bytes sent */
+static uint32_t msd_read(uint32_t lba, uint32_t count, uint32_t max_bytes)
+{
+  uint32_t sent = 0;
+  uint32_t chunk;
+  uint32_t next_chunk;
+  int cur = 0;
+
+  if( lba >= msd_blocks || count > msd_blocks - lba )
+  {
+    msd_set_sense(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+    return 0;
+  }
+
+  if( count > max_bytes / MSD_BLOCK_SIZE )
+  {
+    count = max_bytes / MSD_BLOCK_SIZE;
+  }
+
+  if( count == 0 )
+  {
+    return 0;
+  }
+
+  chunk = count < USB_MSD_BUFFER_BLOCKS ? count : USB_MSD_BUFFER_BLOCKS;
+  if( blkRead(msd_bbdp, lba, (uint8_t *)msd_buffer[cur], chunk) != HAL_SUCCESS )
+  {
+    msd_set_sense(SENSE_MEDIUM_ERROR, ASC_READ_ERROR);
+    return 0;
+  }
+
+  while( count > 0 )
+  {
+    if( !msd_start_in((uint8_t *)msd_buffer[cur], chunk * MSD_BLOCK_SIZE) )
+    {
+      return sent;
+    }
+
+    lba += chunk;
+    count -= chunk;
+    msd_read_blocks += chunk;
+
+    // fetch the next chunk while this one goes out
+    next_chunk = count < USB_MSD_BUFFER_BLOCKS ? count : USB_MSD_BUFFER_BLOCKS;
+    bool ok = next_chunk == 0 ||
+              blkRead(msd_bbdp, lba, (uint8_t *)msd_buffer[cur ^ 1], next_chunk) == HAL_SUCCESS;
+
+    if( !msd_wait() )
+    {
+      return sent;
+    }
+    sent += chunk * MSD_BLOCK_SIZE;
+
+    if( !ok )
+    {
+      msd_set_sense(SENSE_MEDIUM_ERROR, ASC_READ_ERROR);
+      return sent;
+    }
+
+    chunk = next_chunk;
+    cur ^= 1;
+  }
+
+  return sent;
+}
+
+/*! \brief WRITE(10), returns bytes received */
+static uint32_t msd_write(uint32_t lba, uint32_t count, uint32_t max_bytes, bool * ok)
+{
+  uint32_t received = 0;
+  uint32_t chunk;
+  uint32_t next_chunk;
+  int cur = 0;
+
+  *ok = false;
+
+  if( lba >= msd_blocks || count > msd_blocks - lba )
+  {
+    msd_set_sense(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+    return 0;
+  }
+
+  if( count > max_bytes / MSD_BLOCK_SIZE )
+  {
+    count = max_bytes / MSD_BLOCK_SIZE;
+  }
+
+  if( count == 0 )
+  {
+    *ok = true;
+    return 0;
+  }
+
+  chunk = count < USB_MSD_BUFFER_BLOCKS ? count : USB_MSD_BUFFER_BLOCKS;
+  if( !msd_start_out((uint8_t *)msd_buffer[cur], chunk * MSD_BLOCK_SIZE) || !msd_wait() )
+  {
+    return 0;
+  }
+  received += chunk * MSD_BLOCK_SIZE;
+
+  while( count > 0 )
+  {
+    count -= chunk;
+
+    // receive the next chunk while this one is written
+    next_chunk = count < USB_MSD_BUFFER_BLOCKS ? count : USB_MSD_BUFFER_BLOCKS;
+    if( next_chunk > 0 && !msd_start_out((uint8_t *)msd_buffer[cur ^ 1], next_chunk * MSD_BLOCK_SIZE) )
+    {
+      return received;
+    }
+
+    bool written = blkWrite(msd_bbdp, lba, (uint8_t *)msd_buffer[cur], chunk) == HAL_SUCCESS;
+    lba += chunk;
+    msd_write_blocks += chunk;
+
+    if( next_chunk > 0 )
+    {
+      if( !msd_wait() )
+      {
+        return received;
+      }
+      received += next_chunk * MSD_BLOCK_SIZE;
+    }
+
+    if( !written )
+    {
+      msd_set_sense(SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+      return received;
+    }
+
+    chunk = next_chunk;
+    cur ^= 1;
+  }
+
+  *ok = true;
+  return received;
+}
+
+/*! \brief Respond to one command block. Returns the CSW status. */
+static uint8_t msd_command(const msd_cbw_t * cbw, uint32_t * residue)
+{
+  const uint8_t * cb = cbw->cb;
+  uint8_t * buf = (uint8_t *)msd_buffer[0];
+  uint32_t expected = cbw->data_length;
+  bool dir_in = (cbw->flags & MSD_CBW_FLAG_IN) != 0;
+  uint32_t length = 0;      // response bytes for simple IN commands
+  bool passed = true;
+  bool writes = cb[0] == SCSI_WRITE_10;
+
+  *residue = expected;
+
+  // direction must match the command, otherwise phase error
+  if( expected > 0 && dir_in == writes )
+  {
+    return MSD_CSW_PHASE_ERROR;
+  }
+
+  if( cb[0] != SCSI_REQUEST_SENSE && cb[0] != SCSI_INQUIRY )
+  {
+    if( msd_bbdp == NULL )
+    {
+      msd_set_sense(SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+      return MSD_CSW_FAILED;
+    }
+
+    if( msd_unit_attention )
+    {
+      msd_unit_attention = false;
+      msd_set_sense(SENSE_UNIT_ATTENTION, ASC_MEDIUM_CHANGED);
+      return MSD_CSW_FAILED;
+    }
+  }
+
+  switch( cb[0] )
+  {
+    case SCSI_TEST_UNIT_READY:
+    case SCSI_PREVENT_ALLOW:
+    case SCSI_VERIFY_10:
+      break;
+
+    case SCSI_START_STOP_UNIT:
+      // LoEj without Start: the host ejected the medium
+      if( (cb[4] & 0x03) == 0x02 )
+      {
+        msd_ejected = true;
+      }
+      break;
+
+    case SCSI_SYNC_CACHE_10:
+      passed = blkSync(msd_bbdp) == HAL_SUCCESS;
+      break;
+
+    case SCSI_REQUEST_SENSE:
+      memset(buf, 0, 18);
+      buf[0] = 0x70;
+      buf[2] = msd_sense_key;
+      buf[7] = 10;
+      buf[12] = msd_asc;
+      length = 18;
+      msd_set_sense(SENSE_NO_SENSE, ASC_NONE);
+      break;
+
+    case SCSI_INQUIRY:
+      if( cb[1] & 0x01 )
+      {
+        // no vital product data pages
+        msd_set_sense(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD);
+        passed = false;
+        break;
+      }
+      memcpy(buf, msd_inquiry, sizeof(msd_inquiry));
+      length = sizeof(msd_inquiry);
+      break;
+
+    case SCSI_MODE_SENSE_6:
+      memset(buf, 0, 4);
+      buf[0] = 3;
+      length = 4;
+      break;
+
+    case SCSI_MODE_SENSE_10:
+      memset(buf, 0, 8);
+      buf[1] = 6;
+      length = 8;
+      break;
+
+    case SCSI_READ_FORMAT_CAP:
+      memset(buf, 0, 12);
+      buf[3] = 8;
+      put_be32(&buf[4], msd_blocks);
+      buf[8] = 0x02;        // formatted media
+      buf[10] = MSD_BLOCK_SIZE >> 8;
+      buf[11] = MSD_BLOCK_SIZE & 0xff;
+      length = 12;
+      break;
+
+    case SCSI_READ_CAPACITY_10:
+      put_be32(&buf[0], msd_blocks - 1);
+      put_be32(&buf[4], MSD_BLOCK_SIZE);
+      length = 8;
+      break;
+
+    case SCSI_READ_10:
+    {
+      uint32_t want = get_be16(&cb[7]) * MSD_BLOCK_SIZE;
+      uint32_t sent = msd_read(get_be32(&cb[2]), get_be16(&cb[7]), expected);
+      *residue = expected - sent;
+      if( want > expected )
+      {
+        return MSD_CSW_PHASE_ERROR;
+      }
+      return sent == want ? MSD_CSW_PASSED : MSD_CSW_FAILED;
+    }
+
+    case SCSI_WRITE_10:
+    {
+      bool ok;
+      uint32_t want = get_be16(&cb[7]) * MSD_BLOCK_SIZE;
+      uint32_t received = msd_write(get_be32(&cb[2]), get_be16(&cb[7]), expected, &ok);
+      *residue = expected - received;
+      if( want > expected )
+      {
+        return MSD_CSW_PHASE_ERROR;
+      }
+      return ok && received == want ? MSD_CSW_PASSED : MSD_CSW_FAILED;
+    }
+
+    default:
+      msd_set_sense(SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+      passed = false;
+      break;
+  }
+
+  if( passed && length > 0 && expected > 0 )
+  {
+    if( length > expected )
+    {
+      length = expected;
+    }
+    if( msd_in(buf, length) )
+    {
+      *residue = expected - length;
+    }
+  }
+
+  return passed ? MSD_CSW_PASSED : MSD_CSW_FAILED;
+}
+
+static void usb_msd_thread(void * p)
+{
+  (void)p;
+  chRegSetThreadName("usb_msd");
+
+  msd_cbw_t * cbw = (msd_cbw_t *)msd_cbw_buffer;
+
+  while( true )
+  {
+    if( !msd_usb_ready )
+    {
+      chBSemWait(&msd_ready_sem);
+      continue;
+    }
+
+    if( !msd_start_out((uint8_t *)msd_cbw_buffer, sizeof(msd_cbw_buffer)) || !msd_wait() )
+    {
+      continue;
+    }
+
+    size_t size;
+    chSysLock();
+    size = usbGetReceiveTransactionSizeI(msd_usbp, USB_MSD_DATA_EP);
+    chSysUnlock();
+
+    if( size != MSD_CBW_SIZE || cbw->signature != MSD_CBW_SIGNATURE || cbw->lun != 0 )
+    {
+      // invalid CBW, stall until the host does a reset recovery
+      msd_errors++;
+      msd_stall(true, true);
+      continue;
+    }
+
+    uint32_t residue;
+    uint8_t status;
+
+    chMtxLock(&msd_mutex);
+    status = msd_command(cbw, &residue);
+    chMtxUnlock(&msd_mutex);
+
+    if( status != MSD_CSW_PASSED )
+    {
+      msd_errors++;
+    }
+
+    // data phase ended early, tell the host with a stall
+    if( residue > 0 && status != MSD_CSW_PHASE_ERROR )
+    {
+      bool in = (cbw->flags & MSD_CBW_FLAG_IN) != 0;
+      if( !msd_stall(in, !in) )
+      {
+        continue;
+      }
+    }
+
+    msd_csw.signature = MSD_CSW_SIGNATURE;
+    msd_csw.tag = cbw->tag;
+    msd_csw.residue = residue;
+    msd_csw.status = status;
+    msd_in((uint8_t *)&msd_csw, MSD_CSW_SIZE);
+  }
+}
+
+/*! \brief Export a block device to the host
+ *
+ * The device must be connected (BLK_READY) with 512 byte blocks.
+ */
+bool usb_msd_attach(BaseBlockDevice * bbdp)
+{
+  BlockDeviceInfo info;
+
+  if( blkGetDriverState(bbdp) != BLK_READY || blkGetInfo(bbdp, &info) != HAL_SUCCESS ||
+      info.blk_size != MSD_BLOCK_SIZE || info.blk_num == 0 )
+  {
+    return false;
+  }
+
+  chMtxLock(&msd_mutex);
+  msd_bbdp = bbdp;
+  msd_blocks = info.blk_num;
+  msd_unit_attention = true;
+  msd_ejected = false;
+  msd_read_blocks = 0;
+  msd_write_blocks = 0;
+  msd_errors = 0;
+  chMtxUnlock(&msd_mutex);
+
+  return true;
+}
+
+/*! \brief Stop exporting, waits for the command in progress */
+void usb_msd_detach(void)
+{
+  chMtxLock(&msd_mutex);
+  if( msd_bbdp != NULL )
+  {
+    blkSync(msd_bbdp);
+  }
+  msd_bbdp = NULL;
+  msd_blocks = 0;
+  chMtxUnlock(&msd_mutex);
+}
+
+bool usb_msd_is_attached(void)
+{
+  return msd_bbdp != NULL;
+}
+
+void usb_msd_get_status(usb_msd_status_t * status)
+{
+  chMtxLock(&msd_mutex);
+  status->attached = msd_bbdp != NULL;
+  status->ejected = msd_ejected;
+  status->blocks = msd_blocks;
+  status->read_blocks = msd_read_blocks;
+  status->write_blocks = msd_write_blocks;
+  status->errors = msd_errors;
+  chMtxUnlock(&msd_mutex);
+}
+
+/*! \brief USB_EVENT_CONFIGURED, called from the usb event ISR */
+void usb_msd_configure_hook_i(USBDriver * usbp)
+{
+  msd_usbp = usbp;
+  msd_usb_ready = true;
+  chBSemResetI(&msd_xfer_sem, true);
+  chBSemSignalI(&msd_ready_sem);
+}
+
+/*! \brief Bus reset, suspend or unconfigure, called from ISR */
+void usb_msd_reset_hook_i(USBDriver * usbp)
+{
+  (void)usbp;
+
+  msd_usb_ready = false;
+  chBSemResetI(&msd_xfer_sem, true);
+}
+
+/*! \brief Class specific interface requests */
+bool usb_msd_requests_hook(USBDriver * usbp)
+{
+  static uint8_t max_lun = 0;
+
+  if( (usbp->setup[0] & (USB_RTYPE_TYPE_MASK | USB_RTYPE_RECIPIENT_MASK)) !=
+      (USB_RTYPE_TYPE_CLASS | USB_RTYPE_RECIPIENT_INTERFACE) || usbp->setup[4] != USB_MSD_INTERFACE )
+  {
+    return false;
+  }
+
+  switch( usbp->setup[1] )
+  {
+    case MSD_REQ_GET_MAX_LUN:
+      usbSetupTransfer(usbp, &max_lun, 1, NULL);
+      return true;
+    case MSD_REQ_RESET:
+      // nothing is queued outside the endpoint transfer itself, the host
+      // finishes the recovery by clearing the halts
+      usbSetupTransfer(usbp, NULL, 0, NULL);
+      return true;
+    default:
+      return false;
+  }
+}
+
+void usb_msd_data_transmitted(USBDriver * usbp, usbep_t ep)
+{
+  (void)usbp;
+  (void)ep;
+
+  chSysLockFromISR();
+  chBSemSignalI(&msd_xfer_sem);
+  chSysUnlockFromISR();
+}
+
+void usb_msd_data_received(USBDriver * usbp, usbep_t ep)
+{
+  (void)usbp;
+  (void)ep;
+
+  chSysLockFromISR();
+  chBSemSignalI(&msd_xfer_sem);
+  chSysUnlockFromISR();
+}
+
+void usb_msd_init(void)
+{
+  chBSemObjectInit(&msd_ready_sem, true);
+  chBSemObjectInit(&msd_xfer_sem, true);
+  chMtxObjectInit(&msd_mutex);
+
+  chThdCreateStatic(usb_msd_wa, sizeof(usb_msd_wa), USB_MSD_PRIO, usb_msd_thread, NULL);
+}
+
+#else
+
+bool usb_msd_attach(BaseBlockDevice * bbdp)
+{
+  (void)bbdp;
+
+  return false;
+}
+
+void usb_msd_detach(void)
+{
+}
+
+bool usb_msd_is_attached(void)
+{
+  return false;
+}
+
+void usb_msd_get_status(usb_msd_status_t * status)
+{
+  memset(status, 0, sizeof(*status));
+}
+
+void usb_msd_init(void)
+{
+}
+
+#endif
+
+//! @}
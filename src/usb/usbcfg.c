@@ -24,6 +24,10 @@
 
 #include <string.h>
 
+#include "util_timestamp.h"
+#include "usbcfg.h"
+#include "usb_msd.h"
+
 #if STM32_USB_USE_OTG2
 # define USBD_PERIPHERIAL   USBD2
 #else
@@ -55,6 +59,23 @@
 #define USBD_DATA_AVAILABLE_SDU2_EP3         3
 #define USBD_INTERRUPT_REQUEST_SDU2_EP4      4
 
+/*
+ * EP5 (USB_MSD_DATA_EP) is the mass storage bulk pair. Its 512 byte IN
+ * FIFO still fits the OTG HS FIFO RAM next to the two CDC functions.
+ */
+
+#define USB_CDC_CONFIGURATION_SIZE        141
+
+#if USB_USE_MSD
+# define USB_MSD_CONFIGURATION_SIZE       (9 + 7 + 7)
+# define USB_NUM_INTERFACES               5
+#else
+# define USB_MSD_CONFIGURATION_SIZE       0
+# define USB_NUM_INTERFACES               4
+#endif
+
+#define USB_CONFIGURATION_SIZE            (USB_CDC_CONFIGURATION_SIZE + USB_MSD_CONFIGURATION_SIZE)
+
 SerialUSBDriver SDU1;
 SerialUSBDriver SDU2;
 
@@ -77,10 +98,10 @@ static const uint8_t vcom_device_descriptor_data[18] = {
 };
 
 /*! Configuration Descriptor tree for a CDC.*/
-static const uint8_t vcom_configuration_descriptor_data[141] = {
+static const uint8_t vcom_configuration_descriptor_data[USB_CONFIGURATION_SIZE] = {
   /* Configuration Descriptor.*/
-  USB_DESC_CONFIGURATION(141,            /* wTotalLength.                    */ // FIXME make sure this is correct
-                         0x04,          /* bNumInterfaces.                  */
+  USB_DESC_CONFIGURATION(USB_CONFIGURATION_SIZE, /* wTotalLength.           */
+                         USB_NUM_INTERFACES,    /* bNumInterfaces.          */
                          0x01,          /* bConfigurationValue.             */
                          0,             /* iConfiguration.                  */
                          0xC0,          /* bmAttributes (self powered).     */ // FIXME change to bus powered, 0x80
@@ -239,7 +260,29 @@ static const uint8_t vcom_configuration_descriptor_data[141] = {
   USB_DESC_ENDPOINT     (USBD_DATA_REQUEST_SDU2_EP3|0x80,    /* bEndpointAddress.*/
                          0x02,          /* bmAttributes (Bulk).             */
                          USB_CDC_DESCRIPTOR_MAX_PACKET_SIZE,        /* wMaxPacketSize.                  */
-                         0x00)          /* bInterval.                       */
+                         0x00),         /* bInterval.                       */
+#if USB_USE_MSD
+
+  /* Interface Descriptor MSD.*/
+  USB_DESC_INTERFACE    (USB_MSD_INTERFACE, /* bInterfaceNumber.            */
+                         0x00,          /* bAlternateSetting.               */
+                         0x02,          /* bNumEndpoints.                   */
+                         0x08,          /* bInterfaceClass (Mass Storage).  */
+                         0x06,          /* bInterfaceSubClass (SCSI
+                                           transparent command set).        */
+                         0x50,          /* bInterfaceProtocol (Bulk Only).  */
+                         6),            /* iInterface.                      */
+  /* Endpoint 5 OUT Descriptor.*/
+  USB_DESC_ENDPOINT     (USB_MSD_DATA_EP,                    /* bEndpointAddress.*/
+                         0x02,          /* bmAttributes (Bulk).             */
+                         USB_MSD_PACKET_SIZE,               /* wMaxPacketSize.                  */
+                         0x00),         /* bInterval.                       */
+  /* Endpoint 5 IN Descriptor.*/
+  USB_DESC_ENDPOINT     (USB_MSD_DATA_EP|0x80,               /* bEndpointAddress.*/
+                         0x02,          /* bmAttributes (Bulk).             */
+                         USB_MSD_PACKET_SIZE,               /* wMaxPacketSize.                  */
+                         0x00),         /* bInterval.                       */
+#endif
 };
 
 /*!
@@ -311,6 +354,13 @@ static const uint8_t vcom_string5[] = {
   'D', 0, 'a', 0, 't', 0, 'a', 0
 };
 
+/* Mass Storage Interface String. */
+static const uint8_t vcom_string6[] = {
+  USB_DESC_BYTE(18),                    /* bLength.                         */
+  USB_DESC_BYTE(USB_DESCRIPTOR_STRING), /* bDescriptorType.                 */
+  'S', 0, 'D', 0, ' ', 0, 'C', 0, 'a', 0, 'r', 0, 'd', 0, 's', 0
+};
+
 
 /*
  * Strings wrappers array.
@@ -321,7 +371,8 @@ static const USBDescriptor vcom_strings[] = {
   {sizeof vcom_string2, vcom_string2},
   {sizeof vcom_string3, vcom_string3},
   {sizeof vcom_string4, vcom_string4},
-  {sizeof vcom_string5, vcom_string5}
+  {sizeof vcom_string5, vcom_string5},
+  {sizeof vcom_string6, vcom_string6}
 };
 
 /*
@@ -341,7 +392,7 @@ static const USBDescriptor *get_descriptor(USBDriver *usbp,
   case USB_DESCRIPTOR_CONFIGURATION:
     return &vcom_configuration_descriptor;
   case USB_DESCRIPTOR_STRING:
-    if (dindex < 6)
+    if (dindex < (sizeof(vcom_strings) / sizeof(vcom_strings[0])))
       return &vcom_strings[dindex];
   }
   return NULL;
@@ -440,6 +491,34 @@ static const USBEndpointConfig ep4config = {
   1,
   NULL
 };
+
+#if USB_USE_MSD
+/**
+ * @brief   IN EP5 state.
+ */
+static USBInEndpointState ep5instate;
+
+/**
+ * @brief   OUT EP5 state.
+ */
+static USBOutEndpointState ep5outstate;
+
+/**
+ * @brief   EP5 initialization structure (both IN and OUT).
+ */
+static const USBEndpointConfig ep5config = {
+  USB_EP_MODE_TYPE_BULK,
+  NULL,
+  usb_msd_data_transmitted,
+  usb_msd_data_received,
+  USB_MSD_PACKET_SIZE,
+  USB_MSD_PACKET_SIZE,
+  &ep5instate,
+  &ep5outstate,
+  1,
+  NULL
+};
+#endif
 /*
  * Handles the USB driver global events.
  */
@@ -447,6 +526,11 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
 
   switch (event) {
   case USB_EVENT_RESET:
+#if USB_USE_MSD
+    chSysLockFromISR();
+    usb_msd_reset_hook_i(usbp);
+    chSysUnlockFromISR();
+#endif
     return;
   case USB_EVENT_ADDRESS:
     return;
@@ -464,12 +548,22 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
       usbInitEndpointI(usbp, USBD_DATA_REQUEST_SDU2_EP3, &ep3config);
       usbInitEndpointI(usbp, USBD_INTERRUPT_REQUEST_SDU2_EP4, &ep4config);
 
+#if USB_USE_MSD
+      usbInitEndpointI(usbp, USB_MSD_DATA_EP, &ep5config);
+#endif
+
       /* Resetting the state of the CDC subsystem.*/
       sduConfigureHookI(&SDU1);
       sduConfigureHookI(&SDU2);
+#if USB_USE_MSD
+      usb_msd_configure_hook_i(usbp);
+#endif
     }
     else if(usbp->state == USB_SELECTED)
     {
+#if USB_USE_MSD
+      usb_msd_reset_hook_i(usbp);
+#endif
       usbDisableEndpointsI(usbp);
     }
 
@@ -480,6 +574,9 @@ static void usb_event(USBDriver *usbp, usbevent_t event) {
     /* Disconnection event on suspend.*/
     sduDisconnectI(&SDU1);
     sduDisconnectI(&SDU2);
+#if USB_USE_MSD
+    usb_msd_reset_hook_i(usbp);
+#endif
     chSysUnlockFromISR();    
     return;
   case USB_EVENT_WAKEUP:
@@ -526,6 +623,12 @@ void usb_set_serial_strings(const uint32_t high, const uint32_t mid, const uint3
  */
 static bool requests_hook(USBDriver *usbp) {
 
+#if USB_USE_MSD
+  if (usb_msd_requests_hook(usbp)) {
+    return true;
+  }
+#endif
+
   if (((usbp->setup[0] & USB_RTYPE_RECIPIENT_MASK) == USB_RTYPE_RECIPIENT_INTERFACE) &&
       (usbp->setup[1] == USB_REQ_SET_INTERFACE)) {
     usbSetupTransfer(usbp, NULL, 0, NULL);
@@ -534,13 +637,48 @@ static bool requests_hook(USBDriver *usbp) {
   return sduRequestsHook(usbp);
 }
 
+/*
+ * SOF reference for host time correlation. The 14 bit hardware frame
+ * number is extended to 32 bits and paired with the device timestamp
+ * taken when the SOF was handled.
+ */
+#define USB_SOF_FRAME_MASK  0x3fff
+
+static uint16_t usb_sof_last_frame = 0;
+static uint32_t usb_sof_count = 0;
+static uint64_t usb_sof_timestamp = 0;
+static usb_sof_hook_t usb_sof_hook = NULL;
+
+void usb_get_sof_reference(uint32_t * count, uint64_t * timestamp) {
+  chSysLock();
+  *count = usb_sof_count;
+  *timestamp = usb_sof_timestamp;
+  chSysUnlock();
+}
+
+/*
+ * Called locked from the SOF interrupt with the extended frame count and
+ * the entry timestamp. NULL removes the hook.
+ */
+void usb_set_sof_hook(usb_sof_hook_t hook) {
+  chSysLock();
+  usb_sof_hook = hook;
+  chSysUnlock();
+}
+
 /*
  * Handles the USB driver global events.
  */
 static void sof_handler(USBDriver *usbp) {
-  (void)usbp;
+  uint64_t timestamp = util_timestamp_now();
+  uint16_t frame = usbGetFrameNumberX(usbp) & USB_SOF_FRAME_MASK;
 
   osalSysLockFromISR();
+  usb_sof_count += (frame - usb_sof_last_frame) & USB_SOF_FRAME_MASK;
+  usb_sof_last_frame = frame;
+  usb_sof_timestamp = timestamp;
+  if (usb_sof_hook != NULL)
+    usb_sof_hook(usb_sof_count, timestamp);
   sduSOFHookI(&SDU1);
   sduSOFHookI(&SDU2);
   osalSysUnlockFromISR();
@@ -0,0 +1,99 @@
+/*! \file util_dma.h
+ *
+ * @addtogroup util_dma
+ * @{
+ */
+
+#ifndef UTIL_DMA_H_
+#define UTIL_DMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UTIL_DMA_STREAMS      16
+#define UTIL_DMA_NO_STREAM    0xff
+
+/*! \brief DMA users, one per peripheral (all of its requests together) */
+typedef enum {
+  UTIL_DMA_ADC1,
+  UTIL_DMA_ADC2,
+  UTIL_DMA_ADC3,
+  UTIL_DMA_DAC1,
+  UTIL_DMA_DAC2,
+  UTIL_DMA_I2C1,
+  UTIL_DMA_I2C2,
+  UTIL_DMA_I2C3,
+  UTIL_DMA_SDIO,
+  UTIL_DMA_SPI1,
+  UTIL_DMA_SPI2,
+  UTIL_DMA_SPI3,
+  UTIL_DMA_SPI4,
+  UTIL_DMA_SPI5,
+  UTIL_DMA_SPI6,
+  UTIL_DMA_USART1,
+  UTIL_DMA_USART2,
+  UTIL_DMA_USART3,
+  UTIL_DMA_UART4,
+  UTIL_DMA_UART5,
+  UTIL_DMA_USART6,
+  UTIL_DMA_TIM1_UP,
+  UTIL_DMA_TIM8_UP,
+  UTIL_DMA_TIM8_TRIG,
+  UTIL_DMA_OWNER_COUNT
+} util_dma_owner_t;
+
+/*! \brief one DMA request line of a peripheral */
+typedef struct {
+  const char * name;
+  util_dma_owner_t owner;
+  uint8_t configured;     //!< stream from mcuconf.h, UTIL_DMA_NO_STREAM if none
+  uint8_t stream;         //!< stream in use, UTIL_DMA_NO_STREAM if idle
+  uint8_t planned;        //!< preferred stream from the boot time plan
+  uint8_t channel;        //!< channel of the stream in use
+} util_dma_request_info_t;
+
+typedef struct {
+  uint32_t count;                 //!< failed claims
+  util_dma_owner_t blocked_by;    //!< holder of the stream the last failure wanted
+  const char * request;           //!< request that found no free stream
+} util_dma_conflict_t;
+
+void util_dma_init(void);
+
+bool util_dma_claim(util_dma_owner_t owner);
+void util_dma_release(util_dma_owner_t owner);
+bool util_dma_is_claimed(util_dma_owner_t owner);
+
+const char * util_dma_owner_name(util_dma_owner_t owner);
+uint32_t util_dma_request_count(void);
+bool util_dma_request_info(uint32_t index, util_dma_request_info_t * info);
+bool util_dma_stream_owner(uint32_t stream, util_dma_owner_t * owner, const char ** request);
+void util_dma_get_conflict(util_dma_owner_t owner, util_dma_conflict_t * conflict);
+const stm32_dma_stream_t * util_dma_stream(util_dma_owner_t owner, uint32_t n, uint32_t * channel);
+
+/* drivers that allocate their streams in xxxStart() */
+bool util_dma_spi_start(SPIDriver * spip, const SPIConfig * config);
+void util_dma_spi_stop(SPIDriver * spip);
+bool util_dma_i2c_start(I2CDriver * i2cp, const I2CConfig * config);
+void util_dma_i2c_stop(I2CDriver * i2cp);
+bool util_dma_adc_start(ADCDriver * adcp, const ADCConfig * config);
+void util_dma_adc_stop(ADCDriver * adcp);
+bool util_dma_sdc_start(SDCDriver * sdcp, const SDCConfig * config);
+void util_dma_sdc_stop(SDCDriver * sdcp);
+bool util_dma_dac_start(DACDriver * dacp, const DACConfig * config);
+void util_dma_dac_stop(DACDriver * dacp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
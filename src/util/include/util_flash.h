@@ -0,0 +1,34 @@
+/*! \file util_flash.h
+ *
+ * @addtogroup util_flash
+ * @{
+ */
+
+#ifndef UTIL_FLASH_H_
+#define UTIL_FLASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UTIL_FLASH_ERASED_WORD    0xffffffff
+
+uint32_t util_flash_sector_address(uint32_t sector);
+uint32_t util_flash_sector_size(uint32_t sector);
+
+bool util_flash_erase_sector(uint32_t sector);
+bool util_flash_program(uint32_t address, const uint32_t * data, uint32_t words);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
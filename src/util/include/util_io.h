@@ -26,12 +26,8 @@ typedef struct port_pin
   uint32_t    pin;
 } port_pin_t;
 
-typedef struct alt_pin_mode
-{
-  const ioportid_t  port;
-  const uint32_t    pin;
-  const uint32_t    mode;
-} alt_pin_mode_t;
+// GPIOA..GPIOI are 0x400 apart, ports outside give a large index
+#define UTIL_PIN_PORT_INDEX(port) ((((uint32_t)(port)) - GPIOA_BASE) >> 10)
 
 
 void set_status_led(bool r, bool g, bool b);
@@ -42,6 +38,13 @@ bool set_alternate_mode_ext( ioportid_t port, uint32_t pin, uint32_t pupdr, uint
 
 bool reset_alternate_mode( ioportid_t port, uint32_t pin );
 
+uint32_t util_pin_index( ioportid_t port, uint32_t pin );
+uint32_t util_pin_lookup( uint32_t pin_class, uint32_t unit, uint32_t signal );
+bool util_pin_port_pin( uint32_t index, port_pin_t * pp );
+ioportid_t util_pin_port( uint32_t port_index );
+uint16_t util_pin_gpio_mask( ioportid_t port );
+bool util_pin_gpio_allowed( ioportid_t port, uint32_t pin );
+
 #ifdef __cplusplus
 }
 
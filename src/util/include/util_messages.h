@@ -20,7 +20,11 @@ extern "C" {
 #endif
 
 #define DEBUG_SERIAL  SD6
-#define DEBUG_CHP     ((BaseSequentialStream *) &DEBUG_SERIAL)
+
+/*! Debug output, the debug serial port until shell session 1 takes it
+ *  over, a null stream afterwards. \sa util_debug_stream_release
+ */
+#define DEBUG_CHP     util_debug_stream()
 
 #define DEBUG_MSG(chp, msg) \
        do { if (DEBUG_MSG_ENABLE) util_message_debug(chp,__FILE__, __LINE__, __func__, msg); } while (0)
@@ -28,6 +32,9 @@ extern "C" {
 #define DEBUG_VMSG(chp, fmt, ...) \
        do { if (DEBUG_MSG_ENABLE) util_message_debug(chp,__FILE__, __LINE__, __func__, fmt, __VA_ARGS__); } while (0)
 
+BaseSequentialStream * util_debug_stream(void);
+void util_debug_stream_release(void);
+
 void util_message_begin( BaseSequentialStream * chp);
 void util_message_end( BaseSequentialStream * chp, bool success);
 
@@ -52,6 +59,7 @@ void util_message_uint32( BaseSequentialStream * chp, char * name, uint32_t data
 void util_message_hex_uint8( BaseSequentialStream * chp, char * name, uint8_t data);
 void util_message_hex_uint16( BaseSequentialStream * chp, char * name, uint16_t data);
 void util_message_hex_uint32( BaseSequentialStream * chp, char * name, uint32_t data);
+void util_message_hex_uint64( BaseSequentialStream * chp, char * name, uint64_t data);
 
 void util_message_double_array( BaseSequentialStream * chp, char * name, double * data, uint32_t count);
 void util_message_int8_array( BaseSequentialStream * chp, char * name, int8_t * data, uint32_t count);
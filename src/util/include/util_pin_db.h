@@ -0,0 +1,79 @@
+/*! \file util_pin_db.h
+ *
+ * Board pin tables, generated by toolchain/pin_db_gen.py from
+ * src/boards/marionette_pins.txt. Do not edit, run 'make pin_db' instead.
+ *
+ * @addtogroup util_pin_db
+ * @{
+ */
+
+#ifndef UTIL_PIN_DB_H_
+#define UTIL_PIN_DB_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UTIL_PIN_DB_COUNT               70
+#define UTIL_PIN_DB_PORTS               9
+#define UTIL_PIN_DB_NONE                0xff
+
+#define UTIL_PIN_CAP_GPIO               (1 << 0)
+#define UTIL_PIN_CAP_TIMER              (1 << 1)
+#define UTIL_PIN_CAP_SPI                (1 << 2)
+#define UTIL_PIN_CAP_I2C                (1 << 3)
+#define UTIL_PIN_CAP_UART               (1 << 4)
+
+#define UTIL_PIN_CLASS_DIO              0
+#define UTIL_PIN_CLASS_TIMER            1
+#define UTIL_PIN_CLASS_SPI              2
+#define UTIL_PIN_CLASS_I2C              3
+#define UTIL_PIN_CLASS_UART             4
+
+#define UTIL_PIN_DB_TIMER_UNITS         5
+#define UTIL_PIN_DB_TIMER_SIGNALS       3
+
+#define UTIL_PIN_DB_SPI_UNITS           2
+#define UTIL_PIN_DB_SPI_SIGNALS         4
+#define UTIL_PIN_SPI_SCK                0
+#define UTIL_PIN_SPI_MOSI               1
+#define UTIL_PIN_SPI_MISO               2
+#define UTIL_PIN_SPI_NSS                3
+
+#define UTIL_PIN_DB_I2C_UNITS           1
+#define UTIL_PIN_DB_I2C_SIGNALS         2
+#define UTIL_PIN_I2C_SDA                0
+#define UTIL_PIN_I2C_SCL                1
+
+#define UTIL_PIN_DB_UART_UNITS          3
+#define UTIL_PIN_DB_UART_SIGNALS        4
+#define UTIL_PIN_UART_TX                0
+#define UTIL_PIN_UART_RX                1
+#define UTIL_PIN_UART_CTS               2
+#define UTIL_PIN_UART_RTS               3
+
+typedef struct {
+  uint8_t   port;       //!< 0 = GPIOA .. 8 = GPIOI
+  uint8_t   pin;
+  uint8_t   caps;       //!< UTIL_PIN_CAP_*
+  uint8_t   reserved;
+  uint32_t  alt_mode;   //!< PAL mode for the alternate function, 0 = none
+} util_pin_t;
+
+extern const util_pin_t util_pin_db[UTIL_PIN_DB_COUNT];
+extern const uint8_t util_pin_db_index[UTIL_PIN_DB_PORTS][16];
+extern const uint16_t util_pin_db_gpio_mask[UTIL_PIN_DB_PORTS];
+extern const uint8_t util_pin_db_timer[UTIL_PIN_DB_TIMER_UNITS][UTIL_PIN_DB_TIMER_SIGNALS];
+extern const uint8_t util_pin_db_spi[UTIL_PIN_DB_SPI_UNITS][UTIL_PIN_DB_SPI_SIGNALS];
+extern const uint8_t util_pin_db_i2c[UTIL_PIN_DB_I2C_UNITS][UTIL_PIN_DB_I2C_SIGNALS];
+extern const uint8_t util_pin_db_uart[UTIL_PIN_DB_UART_UNITS][UTIL_PIN_DB_UART_SIGNALS];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,130 @@
+/*! \file util_ring.h
+ *
+ * Single producer, single consumer ring of fixed size elements.
+ *
+ * The producer only writes head, the consumer only writes tail, so
+ * neither side needs a lock: an interrupt can fill the ring while a
+ * thread drains it. Elements are filled and read in place, there is no
+ * copy through the ring. Publishing uses release stores and the other
+ * side acquire loads; on the single core Cortex-M4 these are plain
+ * loads and stores with a barrier, no LDREX/STREX loop.
+ *
+ * Indices run over 0 .. 2 * count - 1, so all count elements are usable
+ * and full and empty differ without a spare slot. Does not depend on
+ * ChibiOS, ring_test/ builds it for the host.
+ *
+ *   producer                       consumer
+ *   e = util_ring_write_slot(r)    e = util_ring_read_slot(r)
+ *   fill *e                        use *e
+ *   util_ring_commit(r)            util_ring_release(r)
+ *
+ * @defgroup util_ring Lock-free Ring
+ * @{
+ */
+
+#ifndef UTIL_RING_H_
+#define UTIL_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint8_t * buffer;
+  uint32_t size;                  //!< element bytes
+  uint32_t count;                 //!< elements, 0 = no storage
+  uint32_t head;                  //!< next write, producer owned
+  uint32_t tail;                  //!< next read, consumer owned
+} util_ring_t;
+
+/*! \brief attach storage for count elements of size bytes
+ *
+ * Neither side may use the ring meanwhile.
+ */
+static inline void util_ring_init(util_ring_t * r, void * buffer, uint32_t size, uint32_t count)
+{
+  r->buffer = (uint8_t *)buffer;
+  r->size = size;
+  r->count = count;
+  r->head = 0;
+  r->tail = 0;
+}
+
+static inline uint32_t util_ring_next(const util_ring_t * r, uint32_t index)
+{
+  return (index + 1 < 2 * r->count) ? index + 1 : 0;
+}
+
+static inline void * util_ring_element(const util_ring_t * r, uint32_t index)
+{
+  return r->buffer + ((index < r->count) ? index : index - r->count) * r->size;
+}
+
+static inline uint32_t util_ring_distance(const util_ring_t * r, uint32_t head, uint32_t tail)
+{
+  return (head >= tail) ? head - tail : head + 2 * r->count - tail;
+}
+
+/*! \brief elements written and not yet released, either side
+ */
+static inline uint32_t util_ring_used(const util_ring_t * r)
+{
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+  return util_ring_distance(r, head, tail);
+}
+
+/*! \brief producer, element to fill or NULL when full
+ */
+static inline void * util_ring_write_slot(util_ring_t * r)
+{
+  uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+  if( r->count == 0 || util_ring_distance(r, r->head, tail) >= r->count )
+  {
+    return NULL;
+  }
+
+  return util_ring_element(r, r->head);
+}
+
+/*! \brief producer, publish the element of util_ring_write_slot
+ */
+static inline void util_ring_commit(util_ring_t * r)
+{
+  __atomic_store_n(&r->head, util_ring_next(r, r->head), __ATOMIC_RELEASE);
+}
+
+/*! \brief consumer, oldest element or NULL when empty
+ */
+static inline void * util_ring_read_slot(util_ring_t * r)
+{
+  uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+  if( head == r->tail )
+  {
+    return NULL;
+  }
+
+  return util_ring_element(r, r->tail);
+}
+
+/*! \brief consumer, hand the element of util_ring_read_slot back
+ */
+static inline void util_ring_release(util_ring_t * r)
+{
+  __atomic_store_n(&r->tail, util_ring_next(r, r->tail), __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,31 @@
+/*! \file util_timestamp.h
+ *
+ * @addtogroup util_timestamp
+ * @{
+ */
+
+#ifndef UTIL_TIMESTAMP_H_
+#define UTIL_TIMESTAMP_H_
+
+#include <stdint.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief device timestamp tick rate, the core clock */
+#define UTIL_TIMESTAMP_FREQ   STM32_HCLK
+
+void util_timestamp_init(void);
+uint64_t util_timestamp_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*! @} */
@@ -0,0 +1,735 @@
+/*! \file util_dma.c
+ *
+ * DMA stream allocation
+ *
+ * @defgroup util_dma DMA Stream Allocator
+ * @{
+ */
+
+/*!
+ * <hr>
+ *
+ *  Every DMA request of the STM32F4 can be served by one or two of the 16
+ *  streams (RM0090 tables 42/43). mcuconf.h fixes one stream per request at
+ *  build time and nothing stops two enabled peripherals from sharing one,
+ *  which only shows up as a driver halting when the second one starts.
+ *
+ *  At boot util_dma_init() assigns streams to all requests of the drivers
+ *  enabled in mcuconf.h with a bipartite matching (augmenting paths),
+ *  keeping the mcuconf.h stream where possible. At run time a peripheral
+ *  claims its streams before its driver is started: the planned stream
+ *  when free, otherwise a free legal alternative, preferring streams no
+ *  other driver is planned on. The chosen stream and
+ *  channel are written into the driver before xxxStart() allocates them.
+ *
+ *  A claim that finds no free stream takes nothing, leaves the driver
+ *  stopped and is counted against the peripheral together with the holder
+ *  of the stream it wanted (dma.conflicts).
+ *
+ *  The DAC requests have a single legal stream each, DAC and UART claims
+ *  are bookkeeping only.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "util_dma.h"
+
+#define DMA_ID(dma, stream)       STM32_DMA_STREAM_ID(dma, stream)
+#define DMA_NO_REQUEST            0xff
+#define DMA_MAX_OPTIONS           2
+
+#ifndef STM32_ADC_USE_ADC1
+#define STM32_ADC_USE_ADC1        FALSE
+#endif
+#ifndef STM32_ADC_USE_ADC2
+#define STM32_ADC_USE_ADC2        FALSE
+#endif
+#ifndef STM32_ADC_USE_ADC3
+#define STM32_ADC_USE_ADC3        FALSE
+#endif
+#ifndef STM32_DAC_USE_DAC1_CH1
+#define STM32_DAC_USE_DAC1_CH1    FALSE
+#endif
+#ifndef STM32_DAC_USE_DAC1_CH2
+#define STM32_DAC_USE_DAC1_CH2    FALSE
+#endif
+#ifndef STM32_I2C_USE_I2C1
+#define STM32_I2C_USE_I2C1        FALSE
+#endif
+#ifndef STM32_I2C_USE_I2C2
+#define STM32_I2C_USE_I2C2        FALSE
+#endif
+#ifndef STM32_I2C_USE_I2C3
+#define STM32_I2C_USE_I2C3        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI1
+#define STM32_SPI_USE_SPI1        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI2
+#define STM32_SPI_USE_SPI2        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI3
+#define STM32_SPI_USE_SPI3        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI4
+#define STM32_SPI_USE_SPI4        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI5
+#define STM32_SPI_USE_SPI5        FALSE
+#endif
+#ifndef STM32_SPI_USE_SPI6
+#define STM32_SPI_USE_SPI6        FALSE
+#endif
+#ifndef STM32_UART_USE_USART1
+#define STM32_UART_USE_USART1     FALSE
+#endif
+#ifndef STM32_UART_USE_USART2
+#define STM32_UART_USE_USART2     FALSE
+#endif
+#ifndef STM32_UART_USE_USART3
+#define STM32_UART_USE_USART3     FALSE
+#endif
+#ifndef STM32_UART_USE_UART4
+#define STM32_UART_USE_UART4      FALSE
+#endif
+#ifndef STM32_UART_USE_UART5
+#define STM32_UART_USE_UART5      FALSE
+#endif
+#ifndef STM32_UART_USE_USART6
+#define STM32_UART_USE_USART6     FALSE
+#endif
+
+// the sdc driver has no per instance switch
+#if HAL_USE_SDC
+#define DMA_USE_SDIO              TRUE
+#else
+#define DMA_USE_SDIO              FALSE
+#endif
+
+typedef struct {
+  uint8_t stream;
+  uint8_t channel;
+} dma_option_t;
+
+typedef struct {
+  const char * name;
+  util_dma_owner_t owner;
+  bool enabled;                 //!< driver enabled in mcuconf.h, part of the boot plan
+  uint8_t configured;
+  uint8_t option_count;
+  dma_option_t options[DMA_MAX_OPTIONS];
+} dma_request_t;
+
+/*
+ * Requests of one owner are consecutive.
+ */
+static const dma_request_t dma_requests[] = {
+  {"ADC1",      UTIL_DMA_ADC1,    STM32_ADC_USE_ADC1,     STM32_ADC_ADC1_DMA_STREAM,         2, {{DMA_ID(2,0),0}, {DMA_ID(2,4),0}}},
+  {"ADC2",      UTIL_DMA_ADC2,    STM32_ADC_USE_ADC2,     STM32_ADC_ADC2_DMA_STREAM,         2, {{DMA_ID(2,2),1}, {DMA_ID(2,3),1}}},
+  {"ADC3",      UTIL_DMA_ADC3,    STM32_ADC_USE_ADC3,     STM32_ADC_ADC3_DMA_STREAM,         2, {{DMA_ID(2,0),2}, {DMA_ID(2,1),2}}},
+  {"DAC1",      UTIL_DMA_DAC1,    STM32_DAC_USE_DAC1_CH1, STM32_DAC_DAC1_CH1_DMA_STREAM,     1, {{DMA_ID(1,5),7}}},
+  {"DAC2",      UTIL_DMA_DAC2,    STM32_DAC_USE_DAC1_CH2, STM32_DAC_DAC1_CH2_DMA_STREAM,     1, {{DMA_ID(1,6),7}}},
+  {"I2C1_RX",   UTIL_DMA_I2C1,    STM32_I2C_USE_I2C1,     STM32_I2C_I2C1_RX_DMA_STREAM,      2, {{DMA_ID(1,0),1}, {DMA_ID(1,5),1}}},
+  {"I2C1_TX",   UTIL_DMA_I2C1,    STM32_I2C_USE_I2C1,     STM32_I2C_I2C1_TX_DMA_STREAM,      2, {{DMA_ID(1,6),1}, {DMA_ID(1,7),1}}},
+  {"I2C2_RX",   UTIL_DMA_I2C2,    STM32_I2C_USE_I2C2,     STM32_I2C_I2C2_RX_DMA_STREAM,      2, {{DMA_ID(1,2),7}, {DMA_ID(1,3),7}}},
+  {"I2C2_TX",   UTIL_DMA_I2C2,    STM32_I2C_USE_I2C2,     STM32_I2C_I2C2_TX_DMA_STREAM,      1, {{DMA_ID(1,7),7}}},
+  {"I2C3_RX",   UTIL_DMA_I2C3,    STM32_I2C_USE_I2C3,     STM32_I2C_I2C3_RX_DMA_STREAM,      1, {{DMA_ID(1,2),3}}},
+  {"I2C3_TX",   UTIL_DMA_I2C3,    STM32_I2C_USE_I2C3,     STM32_I2C_I2C3_TX_DMA_STREAM,      1, {{DMA_ID(1,4),3}}},
+  {"SDIO",      UTIL_DMA_SDIO,    DMA_USE_SDIO,           STM32_SDC_SDIO_DMA_STREAM,         2, {{DMA_ID(2,3),4}, {DMA_ID(2,6),4}}},
+  {"SPI1_RX",   UTIL_DMA_SPI1,    STM32_SPI_USE_SPI1,     STM32_SPI_SPI1_RX_DMA_STREAM,      2, {{DMA_ID(2,0),3}, {DMA_ID(2,2),3}}},
+  {"SPI1_TX",   UTIL_DMA_SPI1,    STM32_SPI_USE_SPI1,     STM32_SPI_SPI1_TX_DMA_STREAM,      2, {{DMA_ID(2,3),3}, {DMA_ID(2,5),3}}},
+  {"SPI2_RX",   UTIL_DMA_SPI2,    STM32_SPI_USE_SPI2,     STM32_SPI_SPI2_RX_DMA_STREAM,      1, {{DMA_ID(1,3),0}}},
+  {"SPI2_TX",   UTIL_DMA_SPI2,    STM32_SPI_USE_SPI2,     STM32_SPI_SPI2_TX_DMA_STREAM,      1, {{DMA_ID(1,4),0}}},
+  {"SPI3_RX",   UTIL_DMA_SPI3,    STM32_SPI_USE_SPI3,     STM32_SPI_SPI3_RX_DMA_STREAM,      2, {{DMA_ID(1,0),0}, {DMA_ID(1,2),0}}},
+  {"SPI3_TX",   UTIL_DMA_SPI3,    STM32_SPI_USE_SPI3,     STM32_SPI_SPI3_TX_DMA_STREAM,      2, {{DMA_ID(1,5),0}, {DMA_ID(1,7),0}}},
+  {"SPI4_RX",   UTIL_DMA_SPI4,    STM32_SPI_USE_SPI4,     STM32_SPI_SPI4_RX_DMA_STREAM,      2, {{DMA_ID(2,0),4}, {DMA_ID(2,3),5}}},
+  {"SPI4_TX",   UTIL_DMA_SPI4,    STM32_SPI_USE_SPI4,     STM32_SPI_SPI4_TX_DMA_STREAM,      2, {{DMA_ID(2,1),4}, {DMA_ID(2,4),5}}},
+  {"SPI5_RX",   UTIL_DMA_SPI5,    STM32_SPI_USE_SPI5,     STM32_SPI_SPI5_RX_DMA_STREAM,      2, {{DMA_ID(2,3),2}, {DMA_ID(2,5),7}}},
+  {"SPI5_TX",   UTIL_DMA_SPI5,    STM32_SPI_USE_SPI5,     STM32_SPI_SPI5_TX_DMA_STREAM,      2, {{DMA_ID(2,4),2}, {DMA_ID(2,6),7}}},
+  {"SPI6_RX",   UTIL_DMA_SPI6,    STM32_SPI_USE_SPI6,     STM32_SPI_SPI6_RX_DMA_STREAM,      1, {{DMA_ID(2,6),1}}},
+  {"SPI6_TX",   UTIL_DMA_SPI6,    STM32_SPI_USE_SPI6,     STM32_SPI_SPI6_TX_DMA_STREAM,      1, {{DMA_ID(2,5),1}}},
+  {"USART1_RX", UTIL_DMA_USART1,  STM32_UART_USE_USART1,  STM32_UART_USART1_RX_DMA_STREAM,   2, {{DMA_ID(2,2),4}, {DMA_ID(2,5),4}}},
+  {"USART1_TX", UTIL_DMA_USART1,  STM32_UART_USE_USART1,  STM32_UART_USART1_TX_DMA_STREAM,   1, {{DMA_ID(2,7),4}}},
+  {"USART2_RX", UTIL_DMA_USART2,  STM32_UART_USE_USART2,  STM32_UART_USART2_RX_DMA_STREAM,   1, {{DMA_ID(1,5),4}}},
+  {"USART2_TX", UTIL_DMA_USART2,  STM32_UART_USE_USART2,  STM32_UART_USART2_TX_DMA_STREAM,   1, {{DMA_ID(1,6),4}}},
+  {"USART3_RX", UTIL_DMA_USART3,  STM32_UART_USE_USART3,  STM32_UART_USART3_RX_DMA_STREAM,   1, {{DMA_ID(1,1),4}}},
+  {"USART3_TX", UTIL_DMA_USART3,  STM32_UART_USE_USART3,  STM32_UART_USART3_TX_DMA_STREAM,   2, {{DMA_ID(1,3),4}, {DMA_ID(1,4),7}}},
+  {"UART4_RX",  UTIL_DMA_UART4,   STM32_UART_USE_UART4,   STM32_UART_UART4_RX_DMA_STREAM,    1, {{DMA_ID(1,2),4}}},
+  {"UART4_TX",  UTIL_DMA_UART4,   STM32_UART_USE_UART4,   STM32_UART_UART4_TX_DMA_STREAM,    1, {{DMA_ID(1,4),4}}},
+  {"UART5_RX",  UTIL_DMA_UART5,   STM32_UART_USE_UART5,   STM32_UART_UART5_RX_DMA_STREAM,    1, {{DMA_ID(1,0),4}}},
+  {"UART5_TX",  UTIL_DMA_UART5,   STM32_UART_USE_UART5,   STM32_UART_UART5_TX_DMA_STREAM,    1, {{DMA_ID(1,7),4}}},
+  {"USART6_RX", UTIL_DMA_USART6,  STM32_UART_USE_USART6,  STM32_UART_USART6_RX_DMA_STREAM,   2, {{DMA_ID(2,1),5}, {DMA_ID(2,2),5}}},
+  {"USART6_TX", UTIL_DMA_USART6,  STM32_UART_USE_USART6,  STM32_UART_USART6_TX_DMA_STREAM,   2, {{DMA_ID(2,6),5}, {DMA_ID(2,7),5}}},
+  {"TIM1_UP",   UTIL_DMA_TIM1_UP, false,                  UTIL_DMA_NO_STREAM,                1, {{DMA_ID(2,5),6}}},
+  {"TIM8_UP",   UTIL_DMA_TIM8_UP, false,                  UTIL_DMA_NO_STREAM,                1, {{DMA_ID(2,1),7}}},
+  {"TIM8_TRIG", UTIL_DMA_TIM8_TRIG, false,                UTIL_DMA_NO_STREAM,                1, {{DMA_ID(2,7),7}}},
+};
+
+#define DMA_REQUEST_COUNT   (sizeof(dma_requests) / sizeof(dma_requests[0]))
+
+static const char * const dma_owner_names[UTIL_DMA_OWNER_COUNT] = {
+  "ADC1", "ADC2", "ADC3", "DAC1", "DAC2", "I2C1", "I2C2", "I2C3", "SDIO",
+  "SPI1", "SPI2", "SPI3", "SPI4", "SPI5", "SPI6",
+  "USART1", "USART2", "USART3", "UART4", "UART5", "USART6",
+  "TIM1_UP", "TIM8_UP", "TIM8_TRIG"
+};
+
+static uint8_t request_planned[DMA_REQUEST_COUNT];
+static uint8_t request_stream[DMA_REQUEST_COUNT];
+static uint8_t request_channel[DMA_REQUEST_COUNT];
+
+// request index holding a stream, DMA_NO_REQUEST if free
+static uint8_t stream_holder[UTIL_DMA_STREAMS];
+
+static util_dma_conflict_t dma_conflicts[UTIL_DMA_OWNER_COUNT];
+
+/*
+ * Boot plan, Kuhn's augmenting paths. plan_holder is the matching from the
+ * stream side, plan_visited marks streams already tried in one search.
+ */
+static uint8_t plan_holder[UTIL_DMA_STREAMS];
+static bool plan_visited[UTIL_DMA_STREAMS];
+
+static bool dma_plan_augment(uint32_t request)
+{
+  const dma_request_t * req = &dma_requests[request];
+
+  // the mcuconf.h stream first so a conflict free build keeps its layout
+  for( uint32_t pass = 0; pass < 2; pass++ )
+  {
+    for( uint32_t i = 0; i < req->option_count; i++ )
+    {
+      uint8_t stream = req->options[i].stream;
+
+      if( (pass == 0) != (stream == req->configured) || plan_visited[stream] )
+      {
+        continue;
+      }
+
+      plan_visited[stream] = true;
+
+      if( plan_holder[stream] == DMA_NO_REQUEST || dma_plan_augment(plan_holder[stream]) )
+      {
+        plan_holder[stream] = request;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static void dma_plan(void)
+{
+  memset(plan_holder, DMA_NO_REQUEST, sizeof(plan_holder));
+
+  for( uint32_t i = 0; i < DMA_REQUEST_COUNT; i++ )
+  {
+    if( dma_requests[i].enabled )
+    {
+      memset(plan_visited, 0, sizeof(plan_visited));
+      dma_plan_augment(i);
+    }
+  }
+
+  for( uint32_t i = 0; i < DMA_REQUEST_COUNT; i++ )
+  {
+    request_planned[i] = UTIL_DMA_NO_STREAM;
+  }
+
+  for( uint32_t stream = 0; stream < UTIL_DMA_STREAMS; stream++ )
+  {
+    if( plan_holder[stream] != DMA_NO_REQUEST )
+    {
+      request_planned[plan_holder[stream]] = stream;
+    }
+  }
+}
+
+static int32_t dma_request_channel(uint32_t request, uint8_t stream)
+{
+  const dma_request_t * req = &dma_requests[request];
+
+  for( uint32_t i = 0; i < req->option_count; i++ )
+  {
+    if( req->options[i].stream == stream )
+    {
+      return req->options[i].channel;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * Pick a free stream for one request, the planned one first.
+ * Called with the system locked.
+ */
+static bool dma_request_take(uint32_t request)
+{
+  const dma_request_t * req = &dma_requests[request];
+  uint8_t stream = request_planned[request];
+
+  if( stream == UTIL_DMA_NO_STREAM || stream_holder[stream] != DMA_NO_REQUEST )
+  {
+    stream = UTIL_DMA_NO_STREAM;
+
+    // stay off streams planned for other drivers unless there is no choice
+    for( uint32_t pass = 0; pass < 2 && stream == UTIL_DMA_NO_STREAM; pass++ )
+    {
+      for( uint32_t i = 0; i < req->option_count; i++ )
+      {
+        uint8_t option = req->options[i].stream;
+
+        if( stream_holder[option] == DMA_NO_REQUEST && (pass == 1 || plan_holder[option] == DMA_NO_REQUEST) )
+        {
+          stream = option;
+          break;
+        }
+      }
+    }
+  }
+
+  if( stream == UTIL_DMA_NO_STREAM )
+  {
+    return false;
+  }
+
+  stream_holder[stream] = request;
+  request_stream[request] = stream;
+  request_channel[request] = dma_request_channel(request, stream);
+
+  return true;
+}
+
+static void dma_request_free(uint32_t request)
+{
+  if( request_stream[request] != UTIL_DMA_NO_STREAM )
+  {
+    stream_holder[request_stream[request]] = DMA_NO_REQUEST;
+    request_stream[request] = UTIL_DMA_NO_STREAM;
+  }
+}
+
+static void dma_record_conflict(util_dma_owner_t owner, uint32_t request)
+{
+  const dma_request_t * req = &dma_requests[request];
+  uint8_t stream = request_planned[request];
+
+  if( stream == UTIL_DMA_NO_STREAM )
+  {
+    stream = req->options[0].stream;
+  }
+
+  dma_conflicts[owner].count++;
+  dma_conflicts[owner].request = req->name;
+
+  if( stream_holder[stream] != DMA_NO_REQUEST )
+  {
+    dma_conflicts[owner].blocked_by = dma_requests[stream_holder[stream]].owner;
+  }
+}
+
+/*! \brief first request index of an owner and the number of its requests
+ */
+static uint32_t dma_owner_requests(util_dma_owner_t owner, uint32_t * first)
+{
+  uint32_t count = 0;
+
+  for( uint32_t i = 0; i < DMA_REQUEST_COUNT; i++ )
+  {
+    if( dma_requests[i].owner == owner )
+    {
+      if( count == 0 )
+      {
+        *first = i;
+      }
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*! \brief plan stream assignments for the enabled drivers
+ */
+void util_dma_init(void)
+{
+  memset(stream_holder, DMA_NO_REQUEST, sizeof(stream_holder));
+
+  for( uint32_t i = 0; i < DMA_REQUEST_COUNT; i++ )
+  {
+    request_stream[i] = UTIL_DMA_NO_STREAM;
+    request_channel[i] = 0;
+  }
+
+  for( uint32_t i = 0; i < UTIL_DMA_OWNER_COUNT; i++ )
+  {
+    dma_conflicts[i].count = 0;
+    dma_conflicts[i].blocked_by = UTIL_DMA_OWNER_COUNT;
+    dma_conflicts[i].request = NULL;
+  }
+
+  dma_plan();
+}
+
+/*! \brief claim streams for all requests of a peripheral
+ *
+ * All or nothing. Claiming an owner that already holds its streams
+ * succeeds without changes.
+ */
+bool util_dma_claim(util_dma_owner_t owner)
+{
+  uint32_t first = 0;
+  uint32_t count = dma_owner_requests(owner, &first);
+  bool ok = true;
+
+  chSysLock();
+
+  if( count > 0 && request_stream[first] != UTIL_DMA_NO_STREAM )
+  {
+    chSysUnlock();
+    return true;
+  }
+
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    if( !dma_request_take(first + i) )
+    {
+      dma_record_conflict(owner, first + i);
+
+      while( i-- > 0 )
+      {
+        dma_request_free(first + i);
+      }
+
+      ok = false;
+      break;
+    }
+  }
+
+  chSysUnlock();
+
+  return ok;
+}
+
+void util_dma_release(util_dma_owner_t owner)
+{
+  uint32_t first = 0;
+  uint32_t count = dma_owner_requests(owner, &first);
+
+  chSysLock();
+
+  for( uint32_t i = 0; i < count; i++ )
+  {
+    dma_request_free(first + i);
+  }
+
+  chSysUnlock();
+}
+
+bool util_dma_is_claimed(util_dma_owner_t owner)
+{
+  uint32_t first = 0;
+
+  if( dma_owner_requests(owner, &first) == 0 )
+  {
+    return false;
+  }
+
+  return request_stream[first] != UTIL_DMA_NO_STREAM;
+}
+
+const char * util_dma_owner_name(util_dma_owner_t owner)
+{
+  if( owner >= UTIL_DMA_OWNER_COUNT )
+  {
+    return "NONE";
+  }
+
+  return dma_owner_names[owner];
+}
+
+uint32_t util_dma_request_count(void)
+{
+  return DMA_REQUEST_COUNT;
+}
+
+bool util_dma_request_info(uint32_t index, util_dma_request_info_t * info)
+{
+  if( index >= DMA_REQUEST_COUNT )
+  {
+    return false;
+  }
+
+  info->name = dma_requests[index].name;
+  info->owner = dma_requests[index].owner;
+  info->configured = dma_requests[index].configured;
+  info->stream = request_stream[index];
+  info->planned = request_planned[index];
+  info->channel = request_channel[index];
+
+  return true;
+}
+
+bool util_dma_stream_owner(uint32_t stream, util_dma_owner_t * owner, const char ** request)
+{
+  if( stream >= UTIL_DMA_STREAMS || stream_holder[stream] == DMA_NO_REQUEST )
+  {
+    return false;
+  }
+
+  *owner = dma_requests[stream_holder[stream]].owner;
+  *request = dma_requests[stream_holder[stream]].name;
+
+  return true;
+}
+
+void util_dma_get_conflict(util_dma_owner_t owner, util_dma_conflict_t * conflict)
+{
+  chSysLock();
+  *conflict = dma_conflicts[owner];
+  chSysUnlock();
+}
+
+/*
+ * Claimed stream and channel of the n-th request of an owner.
+ */
+static const stm32_dma_stream_t * dma_owner_stream(util_dma_owner_t owner, uint32_t n, uint32_t * channel)
+{
+  uint32_t first = 0;
+
+  dma_owner_requests(owner, &first);
+  *channel = request_channel[first + n];
+
+  return STM32_DMA_STREAM(request_stream[first + n]);
+}
+
+/*! \brief claimed stream and channel of the n-th request of an owner
+ *
+ * For owners that program their stream directly, the timer update
+ * requests. NULL if the owner holds no stream.
+ */
+const stm32_dma_stream_t * util_dma_stream(util_dma_owner_t owner, uint32_t n, uint32_t * channel)
+{
+  uint32_t first = 0;
+  uint32_t count = dma_owner_requests(owner, &first);
+
+  if( n >= count || request_stream[first + n] == UTIL_DMA_NO_STREAM )
+  {
+    return NULL;
+  }
+
+  return dma_owner_stream(owner, n, channel);
+}
+
+static void dma_set_channel(uint32_t * mode, uint32_t channel)
+{
+  *mode = (*mode & ~STM32_DMA_CR_CHSEL_MASK) | STM32_DMA_CR_CHSEL(channel);
+}
+
+static util_dma_owner_t dma_spi_owner(SPIDriver * spip)
+{
+#if STM32_SPI_USE_SPI1
+  if( spip == &SPID1 ) return UTIL_DMA_SPI1;
+#endif
+#if STM32_SPI_USE_SPI2
+  if( spip == &SPID2 ) return UTIL_DMA_SPI2;
+#endif
+#if STM32_SPI_USE_SPI3
+  if( spip == &SPID3 ) return UTIL_DMA_SPI3;
+#endif
+#if STM32_SPI_USE_SPI4
+  if( spip == &SPID4 ) return UTIL_DMA_SPI4;
+#endif
+#if STM32_SPI_USE_SPI5
+  if( spip == &SPID5 ) return UTIL_DMA_SPI5;
+#endif
+#if STM32_SPI_USE_SPI6
+  if( spip == &SPID6 ) return UTIL_DMA_SPI6;
+#endif
+  (void) spip;
+  return UTIL_DMA_OWNER_COUNT;
+}
+
+static util_dma_owner_t dma_i2c_owner(I2CDriver * i2cp)
+{
+#if STM32_I2C_USE_I2C1
+  if( i2cp == &I2CD1 ) return UTIL_DMA_I2C1;
+#endif
+#if STM32_I2C_USE_I2C2
+  if( i2cp == &I2CD2 ) return UTIL_DMA_I2C2;
+#endif
+#if STM32_I2C_USE_I2C3
+  if( i2cp == &I2CD3 ) return UTIL_DMA_I2C3;
+#endif
+  (void) i2cp;
+  return UTIL_DMA_OWNER_COUNT;
+}
+
+static util_dma_owner_t dma_adc_owner(ADCDriver * adcp)
+{
+#if STM32_ADC_USE_ADC1
+  if( adcp == &ADCD1 ) return UTIL_DMA_ADC1;
+#endif
+#if STM32_ADC_USE_ADC2
+  if( adcp == &ADCD2 ) return UTIL_DMA_ADC2;
+#endif
+#if STM32_ADC_USE_ADC3
+  if( adcp == &ADCD3 ) return UTIL_DMA_ADC3;
+#endif
+  (void) adcp;
+  return UTIL_DMA_OWNER_COUNT;
+}
+
+/*! \brief spiStart() with stream allocation
+ *
+ * Returns false and leaves the driver stopped if the streams are taken.
+ */
+bool util_dma_spi_start(SPIDriver * spip, const SPIConfig * config)
+{
+  util_dma_owner_t owner = dma_spi_owner(spip);
+  uint32_t channel;
+
+  if( spip->state == SPI_STOP && owner != UTIL_DMA_OWNER_COUNT )
+  {
+    if( !util_dma_claim(owner) )
+    {
+      return false;
+    }
+
+    spip->dmarx = dma_owner_stream(owner, 0, &channel);
+    dma_set_channel(&spip->rxdmamode, channel);
+    spip->dmatx = dma_owner_stream(owner, 1, &channel);
+    dma_set_channel(&spip->txdmamode, channel);
+  }
+
+  spiStart(spip, config);
+
+  return true;
+}
+
+void util_dma_spi_stop(SPIDriver * spip)
+{
+  spiStop(spip);
+  util_dma_release(dma_spi_owner(spip));
+}
+
+/*! \brief i2cStart() with stream allocation
+ *
+ * The alternative streams of an i2c request share the channel, only the
+ * stream pointers change.
+ */
+bool util_dma_i2c_start(I2CDriver * i2cp, const I2CConfig * config)
+{
+  util_dma_owner_t owner = dma_i2c_owner(i2cp);
+  uint32_t channel;
+
+  if( i2cp->state == I2C_STOP && owner != UTIL_DMA_OWNER_COUNT )
+  {
+    if( !util_dma_claim(owner) )
+    {
+      return false;
+    }
+
+    i2cp->dmarx = dma_owner_stream(owner, 0, &channel);
+    i2cp->dmatx = dma_owner_stream(owner, 1, &channel);
+  }
+
+  i2cStart(i2cp, config);
+
+  return true;
+}
+
+void util_dma_i2c_stop(I2CDriver * i2cp)
+{
+  i2cStop(i2cp);
+  util_dma_release(dma_i2c_owner(i2cp));
+}
+
+bool util_dma_adc_start(ADCDriver * adcp, const ADCConfig * config)
+{
+  util_dma_owner_t owner = dma_adc_owner(adcp);
+  uint32_t channel;
+
+  if( adcp->state == ADC_STOP && owner != UTIL_DMA_OWNER_COUNT )
+  {
+    if( !util_dma_claim(owner) )
+    {
+      return false;
+    }
+
+    adcp->dmastp = dma_owner_stream(owner, 0, &channel);
+    dma_set_channel(&adcp->dmamode, channel);
+  }
+
+  adcStart(adcp, config);
+
+  return true;
+}
+
+void util_dma_adc_stop(ADCDriver * adcp)
+{
+  adcStop(adcp);
+  util_dma_release(dma_adc_owner(adcp));
+}
+
+/*! \brief sdcStart() with stream allocation
+ *
+ * Both sdio streams use channel 4, the driver derives it on its own.
+ */
+bool util_dma_sdc_start(SDCDriver * sdcp, const SDCConfig * config)
+{
+  uint32_t channel;
+
+  if( sdcp->state == BLK_STOP )
+  {
+    if( !util_dma_claim(UTIL_DMA_SDIO) )
+    {
+      return false;
+    }
+
+    sdcp->dma = dma_owner_stream(UTIL_DMA_SDIO, 0, &channel);
+  }
+
+  sdcStart(sdcp, config);
+
+  return true;
+}
+
+void util_dma_sdc_stop(SDCDriver * sdcp)
+{
+  sdcStop(sdcp);
+  util_dma_release(UTIL_DMA_SDIO);
+}
+
+/*! \brief dacStart() with stream bookkeeping
+ *
+ * Each dac channel has a single legal stream, nothing to patch.
+ */
+bool util_dma_dac_start(DACDriver * dacp, const DACConfig * config)
+{
+  if( dacp->state == DAC_STOP && !util_dma_claim(UTIL_DMA_DAC1) )
+  {
+    return false;
+  }
+
+  dacStart(dacp, config);
+
+  return true;
+}
+
+void util_dma_dac_stop(DACDriver * dacp)
+{
+  dacStop(dacp);
+  util_dma_release(UTIL_DMA_DAC1);
+}
+
+/*! @} */
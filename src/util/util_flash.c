@@ -0,0 +1,174 @@
+/*! \file util_flash.c
+ *
+ * Internal flash erase and program
+ *
+ * @defgroup util_flash Flash Utilities
+ * @{
+ */
+
+/*!
+ * <hr>
+ *
+ *  STM32F429xI, 2 MB in two banks of 12 sectors:
+ *
+ *    sector  0-3, 12-15   16 kB
+ *    sector  4,   16      64 kB
+ *    sector  5-11, 17-23 128 kB
+ *
+ *  The firmware runs from bank 1, so bank 2 can be erased and programmed
+ *  while code keeps executing (read while write). Programming uses 32 bit
+ *  parallelism, which needs a 2.7 V to 3.6 V supply.
+ *
+ *  Only one writer at a time, callers serialize.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "util_flash.h"
+
+#define FLASH_BASE_ADDRESS    0x08000000
+#define FLASH_BANK_SECTORS    12
+#define FLASH_BANK_SIZE       0x00100000
+#define FLASH_SECTORS         (2 * FLASH_BANK_SECTORS)
+
+#define FLASH_UNLOCK_KEY1     0x45670123
+#define FLASH_UNLOCK_KEY2     0xcdef89ab
+
+// SNB, bank 2 sectors are numbered from 0x10
+#define FLASH_CR_SNB_SHIFT    3
+
+#define FLASH_SR_ERRORS       (FLASH_SR_WRPERR | FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR)
+
+static uint32_t flash_bank_offset(uint32_t bank_sector)
+{
+  if( bank_sector < 4 )
+  {
+    return bank_sector * 0x4000;
+  }
+  if( bank_sector == 4 )
+  {
+    return 0x10000;
+  }
+  return (bank_sector - 4) * 0x20000;
+}
+
+uint32_t util_flash_sector_address(uint32_t sector)
+{
+  return FLASH_BASE_ADDRESS + (sector / FLASH_BANK_SECTORS) * FLASH_BANK_SIZE + flash_bank_offset(sector % FLASH_BANK_SECTORS);
+}
+
+uint32_t util_flash_sector_size(uint32_t sector)
+{
+  return flash_bank_offset(sector % FLASH_BANK_SECTORS + 1) - flash_bank_offset(sector % FLASH_BANK_SECTORS);
+}
+
+static void flash_unlock(void)
+{
+  if( FLASH->CR & FLASH_CR_LOCK )
+  {
+    FLASH->KEYR = FLASH_UNLOCK_KEY1;
+    FLASH->KEYR = FLASH_UNLOCK_KEY2;
+  }
+}
+
+static void flash_lock(void)
+{
+  FLASH->CR |= FLASH_CR_LOCK;
+}
+
+static bool flash_wait(bool sleep)
+{
+  while( FLASH->SR & FLASH_SR_BSY )
+  {
+    if( sleep )
+    {
+      chThdSleepMilliseconds(1);
+    }
+  }
+
+  return (FLASH->SR & FLASH_SR_ERRORS) == 0;
+}
+
+/*
+ * The ART data cache may hold words of an erased or reprogrammed sector.
+ */
+static void flash_flush_data_cache(void)
+{
+  uint32_t acr = FLASH->ACR;
+
+  FLASH->ACR = acr & ~FLASH_ACR_DCEN;
+  FLASH->ACR = (acr & ~FLASH_ACR_DCEN) | FLASH_ACR_DCRST;
+  FLASH->ACR = acr & ~FLASH_ACR_DCRST;
+}
+
+/*! \brief erase one sector
+ *
+ * Sleeps while the erase runs, a 128 kB sector takes 1-2 s.
+ */
+bool util_flash_erase_sector(uint32_t sector)
+{
+  bool ok;
+
+  if( sector >= FLASH_SECTORS )
+  {
+    return false;
+  }
+
+  uint32_t snb = (sector / FLASH_BANK_SECTORS) * 0x10 + (sector % FLASH_BANK_SECTORS);
+
+  flash_unlock();
+  flash_wait(false);
+  FLASH->SR = FLASH_SR_ERRORS | FLASH_SR_EOP;
+
+  FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_SER | (snb << FLASH_CR_SNB_SHIFT);
+  FLASH->CR |= FLASH_CR_STRT;
+
+  ok = flash_wait(true);
+
+  FLASH->CR = 0;
+  flash_lock();
+  flash_flush_data_cache();
+
+  return ok;
+}
+
+/*! \brief program words into erased flash
+ *
+ * address must be word aligned. Stops at the first failing word.
+ */
+bool util_flash_program(uint32_t address, const uint32_t * data, uint32_t words)
+{
+  volatile uint32_t * dest = (volatile uint32_t *) address;
+  bool ok = true;
+
+  if( address & 3 )
+  {
+    return false;
+  }
+
+  flash_unlock();
+  flash_wait(false);
+  FLASH->SR = FLASH_SR_ERRORS | FLASH_SR_EOP;
+
+  FLASH->CR = FLASH_CR_PSIZE_1 | FLASH_CR_PG;
+
+  for( uint32_t i = 0; i < words && ok; i++ )
+  {
+    dest[i] = data[i];
+    ok = flash_wait(false) && dest[i] == data[i];
+  }
+
+  FLASH->CR = 0;
+  flash_lock();
+  flash_flush_data_cache();
+
+  return ok;
+}
+
+/*! @} */
@@ -6,44 +6,12 @@
 
 #include "util_general.h"
 #include "util_io.h"
+#include "util_pin_db.h"
 
-// null terminated list of alternate modes for GPIO pins
-static const alt_pin_mode_t alternate_modes[] = {
-  {GPIOB, GPIOB_PB8_TIM4_CH3,       PAL_MODE_ALTERNATE(2) },
-  {GPIOB, GPIOB_PB9_TIM4_CH4,       PAL_MODE_ALTERNATE(2) },
-  {GPIOE, GPIOE_PE5_TIM9_CH1,       PAL_MODE_ALTERNATE(3) },
-  {GPIOE, GPIOE_PE6_TIM9_CH2,       PAL_MODE_ALTERNATE(3) },
-  {GPIOE, GPIOE_PE9_TIM1_CH1,       PAL_MODE_ALTERNATE(1) },
-  {GPIOE, GPIOE_PE13_TIM1_CH3,      PAL_MODE_ALTERNATE(1) },
-  {GPIOH, GPIOH_PH10_TIM5_CH1,      PAL_MODE_ALTERNATE(2) },
-  {GPIOH, GPIOH_PH11_TIM5_CH2,      PAL_MODE_ALTERNATE(2) },
-  {GPIOH, GPIOH_PH12_TIM5_CH3,      PAL_MODE_ALTERNATE(2) },
-  {GPIOA, GPIOA_PA15_TIM2_CH1_ETR,  PAL_MODE_ALTERNATE(1) },
-  {GPIOI, GPIOI_PI1_SPI2_SCK,       PAL_MODE_ALTERNATE(5) },
-  {GPIOI, GPIOI_PI0_SPI2_NSS,       PAL_MODE_ALTERNATE(5) },
-  {GPIOI, GPIOI_PI2_SPI2_MISO,      PAL_MODE_ALTERNATE(5) },
-  {GPIOI, GPIOI_PI3_SPI2_MOSI,      PAL_MODE_ALTERNATE(5) },
-  {GPIOG, GPIOG_PG13_SPI6_SCK,      PAL_MODE_ALTERNATE(5) },
-  {GPIOG, GPIOG_PG8_SPI6_NSS,       PAL_MODE_ALTERNATE(5) },
-  {GPIOG, GPIOG_PG12_SPI6_MISO,     PAL_MODE_ALTERNATE(5) },
-  {GPIOG, GPIOG_PG14_SPI6_MOSI,     PAL_MODE_ALTERNATE(5) },
-  {GPIOF, GPIOF_PF0_I2C2_SDA,       PAL_MODE_ALTERNATE(4) | PAL_STM32_OTYPE_OPENDRAIN },
-  {GPIOF, GPIOF_PF1_I2C2_SCL,       PAL_MODE_ALTERNATE(4) | PAL_STM32_OTYPE_OPENDRAIN },
-  {GPIOA, GPIOA_PA0_UART4_TX,       PAL_MODE_ALTERNATE(8) },
-  {GPIOA, GPIOA_PA1_UART4_RX,       PAL_MODE_ALTERNATE(8) },
-  {GPIOD, GPIOD_PD8_USART3_TX,      PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD9_USART3_RX,      PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD11_USART3_CTS,    PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD12_USART3_RTS,    PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD5_USART2_TX,      PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD6_USART2_RX,      PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD3_USART2_CTS,      PAL_MODE_ALTERNATE(7) },
-  {GPIOD, GPIOD_PD4_USART2_RTS,      PAL_MODE_ALTERNATE(7) },
-
-  {NULL,0,0},
+static ioportid_t const pin_ports[UTIL_PIN_DB_PORTS] = {
+  GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOF, GPIOG, GPIOH, GPIOI
 };
 
-
 void set_status_led(bool r, bool g, bool b)
 {
   if(r) {
@@ -71,63 +39,138 @@ bool set_alternate_mode( ioportid_t port, uint32_t pin )
 bool set_alternate_mode_ext( ioportid_t port, uint32_t pin, uint32_t pupdr, uint32_t otype, uint32_t ospeed)
 {
   // port override settings use UINT32_MAX as default designator, signed value -1 equates to UINT32_MAX for convenience.
+  uint32_t index = util_pin_index(port, pin);
 
-  // search for port/pin in alternate_modes, if found change pin mode
-  const alt_pin_mode_t * alt_mode = alternate_modes;
-  uint32_t mode = 0;
-
-  while( alt_mode->port != NULL )
+  if( index == UTIL_PIN_DB_NONE || util_pin_db[index].alt_mode == 0 )
   {
-    if( alt_mode->port == port && alt_mode->pin == pin )
-    {
-      mode = alt_mode->mode;
+    return false;
+  }
 
-      if( pupdr != UINT32_MAX )
-      {
-        mode &= ~PAL_STM32_PUPDR_MASK;
-        mode |= (pupdr & PAL_STM32_PUPDR_MASK);
-      }
+  uint32_t mode = util_pin_db[index].alt_mode;
 
-      if( otype != UINT32_MAX )
-      {
-        mode &= ~PAL_STM32_OTYPE_MASK;
-        mode |= (otype & PAL_STM32_OTYPE_MASK);
-      }
+  if( pupdr != UINT32_MAX )
+  {
+    mode &= ~PAL_STM32_PUPDR_MASK;
+    mode |= (pupdr & PAL_STM32_PUPDR_MASK);
+  }
 
-      if( ospeed != UINT32_MAX )
-      {
-        mode &= ~PAL_STM32_OSPEED_MASK;
-        mode |= (ospeed & PAL_STM32_OSPEED_MASK);
-      }
+  if( otype != UINT32_MAX )
+  {
+    mode &= ~PAL_STM32_OTYPE_MASK;
+    mode |= (otype & PAL_STM32_OTYPE_MASK);
+  }
 
-      palSetPadMode(port, pin, mode);
-      return true;
-      break;
-    }
-    alt_mode++;
+  if( ospeed != UINT32_MAX )
+  {
+    mode &= ~PAL_STM32_OSPEED_MASK;
+    mode |= (ospeed & PAL_STM32_OSPEED_MASK);
   }
-  return false;
+
+  palSetPadMode(port, pin, mode);
+  return true;
 }
 
 bool reset_alternate_mode( ioportid_t port, uint32_t pin )
 {
-  // search for port/pin in alternate_modes, if found change pin mode
-  const alt_pin_mode_t * alt_mode = alternate_modes;
+  uint32_t index = util_pin_index(port, pin);
 
-  while( alt_mode->port != NULL )
+  if( index == UTIL_PIN_DB_NONE || util_pin_db[index].alt_mode == 0 )
   {
-    if( alt_mode->port == port && alt_mode->pin == pin )
-    {
-      if( (port->MODER >> (pin*2)) & PAL_STM32_MODE_ALTERNATE )
+    return false;
+  }
+
+  if( (port->MODER >> (pin*2)) & PAL_STM32_MODE_ALTERNATE )
+  {
+    palSetPadMode(port, pin, PAL_STM32_MODE_INPUT | PAL_STM32_PUPDR_FLOATING );
+  }
+  return true;
+}
+
+/*! \brief pin index of a port/pin, UTIL_PIN_DB_NONE if the board does not expose it
+ */
+uint32_t util_pin_index( ioportid_t port, uint32_t pin )
+{
+  uint32_t port_index = UTIL_PIN_PORT_INDEX(port);
+
+  if( port_index >= UTIL_PIN_DB_PORTS || pin > 15 )
+  {
+    return UTIL_PIN_DB_NONE;
+  }
+  return util_pin_db_index[port_index][pin];
+}
+
+/*! \brief pin index of a named pin, UTIL_PIN_DB_NONE if there is no such pin
+ *
+ * DIO pins take the DIO number as unit, the other classes the peripheral
+ * unit and the UTIL_PIN_<class>_<signal> (timer: channel) number.
+ */
+uint32_t util_pin_lookup( uint32_t pin_class, uint32_t unit, uint32_t signal )
+{
+  switch( pin_class )
+  {
+    case UTIL_PIN_CLASS_DIO:
+      return (unit < UTIL_PIN_DB_COUNT) ? unit : UTIL_PIN_DB_NONE;
+    case UTIL_PIN_CLASS_TIMER:
+      if( unit < UTIL_PIN_DB_TIMER_UNITS && signal < UTIL_PIN_DB_TIMER_SIGNALS )
       {
-        palSetPadMode(port, pin, PAL_STM32_MODE_INPUT | PAL_STM32_PUPDR_FLOATING );
+        return util_pin_db_timer[unit][signal];
       }
-      return true;
       break;
-    }
-    alt_mode++;
+    case UTIL_PIN_CLASS_SPI:
+      if( unit < UTIL_PIN_DB_SPI_UNITS && signal < UTIL_PIN_DB_SPI_SIGNALS )
+      {
+        return util_pin_db_spi[unit][signal];
+      }
+      break;
+    case UTIL_PIN_CLASS_I2C:
+      if( unit < UTIL_PIN_DB_I2C_UNITS && signal < UTIL_PIN_DB_I2C_SIGNALS )
+      {
+        return util_pin_db_i2c[unit][signal];
+      }
+      break;
+    case UTIL_PIN_CLASS_UART:
+      if( unit < UTIL_PIN_DB_UART_UNITS && signal < UTIL_PIN_DB_UART_SIGNALS )
+      {
+        return util_pin_db_uart[unit][signal];
+      }
+      break;
+  }
+  return UTIL_PIN_DB_NONE;
+}
+
+/*! \brief port and pin of a pin index
+ */
+bool util_pin_port_pin( uint32_t index, port_pin_t * pp )
+{
+  if( index >= UTIL_PIN_DB_COUNT )
+  {
+    return false;
   }
-  return false;
+  pp->port = pin_ports[util_pin_db[index].port];
+  pp->pin = util_pin_db[index].pin;
+  return true;
+}
+
+/*! \brief port for a pin db port number, 0 = GPIOA
+ */
+ioportid_t util_pin_port( uint32_t port_index )
+{
+  return (port_index < UTIL_PIN_DB_PORTS) ? pin_ports[port_index] : NULL;
 }
 
+/*! \brief pins of a port the gpio module may touch
+ */
+uint16_t util_pin_gpio_mask( ioportid_t port )
+{
+  uint32_t port_index = UTIL_PIN_PORT_INDEX(port);
+
+  return (port_index < UTIL_PIN_DB_PORTS) ? util_pin_db_gpio_mask[port_index] : 0;
+}
+
+/*! \brief true if the gpio module may touch the pin
+ */
+bool util_pin_gpio_allowed( ioportid_t port, uint32_t pin )
+{
+  return pin < 16 && (util_pin_gpio_mask(port) & (1 << pin));
+}
 
@@ -12,6 +12,7 @@
 #include "hal.h"
 #include "chprintf.h"
 #include "chbsem.h"
+#include "nullstreams.h"
 
 #include "mshell_sync.h"
 
@@ -20,6 +21,27 @@
 
 #include "util_messages.h"
 
+static NullStream debug_null_stream;
+static BaseSequentialStream * debug_stream = (BaseSequentialStream *) &DEBUG_SERIAL;
+
+/*! \brief stream behind DEBUG_CHP
+ */
+BaseSequentialStream * util_debug_stream(void)
+{
+  return debug_stream;
+}
+
+/*! \brief drop debug output from now on
+ *
+ * The debug serial port becomes shell session 1, debug text written to
+ * it would land in the middle of that session's responses.
+ */
+void util_debug_stream_release(void)
+{
+  nullObjectInit(&debug_null_stream);
+  debug_stream = (BaseSequentialStream *) &debug_null_stream;
+}
+
 static bool needs_newline(char * str)
 {
 	if( str == NULL || str[0] == '\0' )
@@ -599,6 +621,21 @@ void util_message_hex_uint32( BaseSequentialStream * chp, char * name, uint32_t
 	chBSemSignal( &mshell_sync_sem );
 }
 
+void util_message_hex_uint64( BaseSequentialStream * chp, char * name, uint64_t data)
+{
+	if(chp == NULL)
+	{
+		return;
+	}
+
+	chBSemWait( &mshell_sync_sem );
+
+	// chprintf has no 64 bit conversions, print as two words
+	chprintf(chp, "H64:%s:%08X%08X\r\n", name, (uint32_t)(data >> 32), (uint32_t)data);
+
+	chBSemSignal( &mshell_sync_sem );
+}
+
 void util_message_hex_uint32_array( BaseSequentialStream * chp, char * name, uint32_t * data, uint32_t count)
 {
 	if(chp == NULL)
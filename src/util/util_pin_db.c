@@ -0,0 +1,129 @@
+/*! \file util_pin_db.c
+ *
+ * Board pin tables, generated by toolchain/pin_db_gen.py from
+ * src/boards/marionette_pins.txt. Do not edit, run 'make pin_db' instead.
+ *
+ * @addtogroup util_pin_db
+ * @{
+ */
+
+#include "hal.h"
+
+#include "util_pin_db.h"
+
+// indexed by pin index, which is the DIO number
+const util_pin_t util_pin_db[UTIL_PIN_DB_COUNT] = {
+  {6,  0, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO0 PG0
+  {6,  1, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO1 PG1
+  {6,  2, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO2 PG2
+  {6,  3, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO3 PG3
+  {6,  4, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO4 PG4
+  {6,  5, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO5 PG5
+  {6,  6, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO6 PG6
+  {6,  7, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO7 PG7
+  {4,  0, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO8 PE0
+  {4,  7, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO9 PE7
+  {4,  8, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO10 PE8
+  {5, 11, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO11 PF11
+  {5, 12, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO12 PF12
+  {5, 13, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO13 PF13
+  {5, 14, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO14 PF14
+  {5, 15, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO15 PF15
+  {7,  2, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO16 PH2
+  {7,  3, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO17 PH3
+  {7,  5, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO18 PH5
+  {7,  6, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO19 PH6
+  {7,  9, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO20 PH9
+  {7, 14, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO21 PH14
+  {1,  8, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(2)}, // DIO22 PB8
+  {1,  9, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(2)}, // DIO23 PB9
+  {4,  5, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(3)}, // DIO24 PE5
+  {4,  6, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(3)}, // DIO25 PE6
+  {4,  9, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(1)}, // DIO26 PE9
+  {4, 13, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(1)}, // DIO27 PE13
+  {7, 10, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(2)}, // DIO28 PH10
+  {7, 11, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(2)}, // DIO29 PH11
+  {7, 12, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(2)}, // DIO30 PH12
+  {0, 15, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_TIMER, 0, PAL_MODE_ALTERNATE(1)}, // DIO31 PA15
+  {8,  1, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO32 PI1
+  {8,  0, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO33 PI0
+  {8,  2, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO34 PI2
+  {8,  3, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO35 PI3
+  {7, 15, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO36 PH15
+  {3,  7, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO37 PD7
+  {6, 13, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO38 PG13
+  {6,  8, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO39 PG8
+  {6, 12, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO40 PG12
+  {6, 14, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_SPI, 0, PAL_MODE_ALTERNATE(5)}, // DIO41 PG14
+  {6,  9, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO42 PG9
+  {6, 11, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO43 PG11
+  {5,  0, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_I2C, 0, PAL_MODE_ALTERNATE(4) | PAL_STM32_OTYPE_OPENDRAIN}, // DIO44 PF0
+  {5,  1, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_I2C, 0, PAL_MODE_ALTERNATE(4) | PAL_STM32_OTYPE_OPENDRAIN}, // DIO45 PF1
+  {4,  1, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO46 PE1
+  {6, 15, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO47 PG15
+  {0,  0, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(8)}, // DIO48 PA0
+  {0,  1, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(8)}, // DIO49 PA1
+  {4,  2, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO50 PE2
+  {4,  3, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO51 PE3
+  {3,  8, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO52 PD8
+  {3,  9, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO53 PD9
+  {3, 11, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO54 PD11
+  {3, 12, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO55 PD12
+  {3,  5, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO56 PD5
+  {3,  6, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO57 PD6
+  {3,  3, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO58 PD3
+  {3,  4, UTIL_PIN_CAP_GPIO | UTIL_PIN_CAP_UART, 0, PAL_MODE_ALTERNATE(7)}, // DIO59 PD4
+  {8,  8, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO60 PI8
+  {8, 11, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO61 PI11
+  {3,  1, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO62 PD1
+  {6, 10, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO63 PG10
+  {1, 15, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO64 PB15
+  {8,  4, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO65 PI4
+  {3,  0, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO66 PD0
+  {2, 13, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO67 PC13
+  {8, 10, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO68 PI10
+  {1, 14, UTIL_PIN_CAP_GPIO, 0, 0}, // DIO69 PB14
+};
+
+// port, pin -> pin index
+const uint8_t util_pin_db_index[UTIL_PIN_DB_PORTS][16] = {
+  {0x30, 0x31, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1f}, // GPIOA
+  {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x16, 0x17, 0xff, 0xff, 0xff, 0xff, 0x45, 0x40}, // GPIOB
+  {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x43, 0xff, 0xff}, // GPIOC
+  {0x42, 0x3e, 0xff, 0x3a, 0x3b, 0x38, 0x39, 0x25, 0x34, 0x35, 0xff, 0x36, 0x37, 0xff, 0xff, 0xff}, // GPIOD
+  {0x08, 0x2e, 0x32, 0x33, 0xff, 0x18, 0x19, 0x09, 0x0a, 0x1a, 0xff, 0xff, 0xff, 0x1b, 0xff, 0xff}, // GPIOE
+  {0x2c, 0x2d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f}, // GPIOF
+  {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x27, 0x2a, 0x3f, 0x2b, 0x28, 0x26, 0x29, 0x2f}, // GPIOG
+  {0xff, 0xff, 0x10, 0x11, 0xff, 0x12, 0x13, 0xff, 0xff, 0x14, 0x1c, 0x1d, 0x1e, 0xff, 0x15, 0x24}, // GPIOH
+  {0x21, 0x20, 0x22, 0x23, 0x41, 0xff, 0xff, 0xff, 0x3c, 0xff, 0x44, 0x3d, 0xff, 0xff, 0xff, 0xff}, // GPIOI
+};
+
+// pins the gpio module may touch
+const uint16_t util_pin_db_gpio_mask[UTIL_PIN_DB_PORTS] = {
+  0x8003, 0xc300, 0x2000, 0x1bfb, 0x23ef, 0xf803, 0xffff, 0xde6c, 0x0d1f,
+};
+
+const uint8_t util_pin_db_timer[UTIL_PIN_DB_TIMER_UNITS][UTIL_PIN_DB_TIMER_SIGNALS] = {
+  {0x16, 0x17, 0xff},
+  {0x18, 0x19, 0xff},
+  {0x1a, 0x1b, 0xff},
+  {0x1c, 0x1d, 0x1e},
+  {0x1f, 0xff, 0xff},
+};
+
+const uint8_t util_pin_db_spi[UTIL_PIN_DB_SPI_UNITS][UTIL_PIN_DB_SPI_SIGNALS] = {
+  {0x20, 0x23, 0x22, 0x21},
+  {0x26, 0x29, 0x28, 0x27},
+};
+
+const uint8_t util_pin_db_i2c[UTIL_PIN_DB_I2C_UNITS][UTIL_PIN_DB_I2C_SIGNALS] = {
+  {0x2c, 0x2d},
+};
+
+const uint8_t util_pin_db_uart[UTIL_PIN_DB_UART_UNITS][UTIL_PIN_DB_UART_SIGNALS] = {
+  {0x30, 0x31, 0xff, 0xff},
+  {0x34, 0x35, 0x36, 0x37},
+  {0x38, 0x39, 0x3a, 0x3b},
+};
+
+/*! @} */
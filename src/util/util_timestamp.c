@@ -0,0 +1,66 @@
+/*! \file util_timestamp.c
+ *
+ * 64 bit device timestamps
+ *
+ * @defgroup util_timestamp Timestamp Utilities
+ * @{
+ */
+
+/*!
+ * <hr>
+ *
+ *  Timestamps count core clock cycles using the DWT cycle counter. The
+ *  32 bit counter wraps every 2^32 / STM32_HCLK, ~25-30 s depending on
+ *  HCLK (29.8 s at 144 MHz, 25.6 s at 168 MHz), so the upper word is kept
+ *  in software and extended whenever a timestamp is taken. The USB SOF
+ *  handler takes one every (micro)frame, which keeps the extension valid
+ *  while the device is connected.
+ *
+ * <hr>
+ */
+
+#include <stdint.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "util_timestamp.h"
+
+static uint32_t timestamp_high = 0;
+static uint32_t timestamp_last = 0;
+
+/*! \brief enable the cycle counter
+ */
+void util_timestamp_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  timestamp_high = 0;
+  timestamp_last = 0;
+}
+
+/*! \brief current 64 bit timestamp in UTIL_TIMESTAMP_FREQ ticks
+ *
+ * Safe to call from threads and ISRs.
+ */
+uint64_t util_timestamp_now(void)
+{
+  syssts_t sts = chSysGetStatusAndLockX();
+  uint32_t now = DWT->CYCCNT;
+
+  if( now < timestamp_last )
+  {
+    timestamp_high++;
+  }
+  timestamp_last = now;
+
+  uint64_t timestamp = ((uint64_t)timestamp_high << 32) | now;
+
+  chSysRestoreStatusX(sts);
+
+  return timestamp;
+}
+
+/*! @} */
@@ -0,0 +1,354 @@
+#!/usr/bin/env python
+# file: replay.py
+
+"""
+Replay a command transcript against a Marionette device without a human
+at the keyboard, check the responses against golden output and measure
+command round trip latency and stream throughput.
+
+Transcript format, one directive per line:
+
+    # comment
+    > gpio.set(porth, pin2)     send a fetch command (prefix '+' for mshell)
+    < #:gpio.set                expected response line, exact match
+    <~ ^H64:ticks:[0-9a-f]+$    expected response line, regular expression
+    <*                          ignore the rest of the response
+    @repeat 200                 run the next command 200 times (latency only)
+    @sleep 0.5                  pause, seconds
+    @stream 5 adc.start(1)      run a command, then read the stream port for
+                                5 s and report bytes/s and records/s
+
+Responses are the lines between BEGIN: and the END: line; the END: line
+itself is compared too, so a golden '< END:ERROR' checks a failure path.
+A command without any '<' lines is timed but not checked.
+
+Results are written as JSON to results/<build>.json, <build> being the
+firmware_version reported by the device (override with --build). Pass
+--compare with an earlier result to flag latency and throughput
+regressions between firmware builds.
+
+The device side can be a serial port or any program that speaks the
+shell protocol on stdin/stdout (--exec), e.g. a host build of the fetch
+parser.
+
+Example:
+
+    ./replay.py transcripts/smoke.txt
+    ./replay.py transcripts/smoke.txt --record > transcripts/new.txt
+    ./replay.py transcripts/smoke.txt --compare results/1a2b3c4.json
+
+"""
+
+# get division operator '/' vs. '//'
+from __future__ import division
+
+import sys
+import os
+import re
+import json
+import time
+import argparse
+import subprocess
+
+import utils as u
+
+Default_Port        = "/dev/ttyACM0"
+Default_Stream_Port = "/dev/ttyACM1"
+Default_Timeout     = 2
+Default_Results     = "results"
+Default_Threshold   = 0.20          # relative change flagged as regression
+Percentiles         = (50, 90, 99)
+
+try:
+    monotonic = time.monotonic
+except AttributeError:
+    monotonic = time.time
+
+
+def percentile(samples, p):
+    """nearest rank percentile of a sorted list"""
+    if not samples:
+        return None
+    k = int(round(p / 100.0 * (len(samples) - 1)))
+    return samples[k]
+
+
+class SerialLink():
+    """shell on a serial port"""
+
+    def __init__(self, port, timeout=Default_Timeout):
+        import serial
+        self.tty = serial.Serial(port=port, timeout=timeout)
+        self.tty.write(b"\r\n+noecho\r\n+noprompt\r\n\r\n")
+        time.sleep(0.2)
+        self.tty.flushInput()
+
+    def write(self, data):
+        self.tty.write(data)
+
+    def readline(self):
+        return self.tty.readline()
+
+    def close(self):
+        self.tty.close()
+
+
+class ExecLink():
+    """shell on the stdin/stdout of a host program"""
+
+    def __init__(self, cmdline):
+        self.proc = subprocess.Popen(cmdline, shell=True, stdin=subprocess.PIPE,
+                                     stdout=subprocess.PIPE, bufsize=0)
+        self.write(b"+noecho\r\n+noprompt\r\n")
+        self.skip = 2    # BEGIN/END of the two option commands
+
+    def write(self, data):
+        self.proc.stdin.write(data)
+        self.proc.stdin.flush()
+
+    def readline(self):
+        return self.proc.stdout.readline()
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+class Step():
+    def __init__(self, lineno, command):
+        self.lineno  = lineno
+        self.command = command
+        self.expect  = []       # (kind, text)
+        self.repeat  = 1
+        self.stream  = None     # seconds
+        self.sleep   = 0.0
+
+
+def load_transcript(path):
+    steps   = []
+    pending = Step(0, None)
+    with open(path) as f:
+        for lineno, raw in enumerate(f, 1):
+            line = raw.rstrip("\r\n")
+            if len(line.strip()) == 0 or line.lstrip().startswith("#"):
+                continue
+            if line.startswith("<~ "):
+                steps[-1].expect.append(("re", re.compile(line[3:])))
+            elif line.startswith("<*"):
+                steps[-1].expect.append(("rest", None))
+            elif line.startswith("< "):
+                steps[-1].expect.append(("eq", line[2:]))
+            elif line.startswith("> "):
+                pending.lineno  = lineno
+                pending.command = line[2:].strip()
+                steps.append(pending)
+                pending = Step(0, None)
+            elif line.startswith("@repeat "):
+                pending.repeat = int(line.split()[1])
+            elif line.startswith("@sleep "):
+                pending.sleep = float(line.split()[1])
+            elif line.startswith("@stream "):
+                fields = line.split(None, 2)
+                pending.lineno  = lineno
+                pending.stream  = float(fields[1])
+                pending.command = fields[2].strip()
+                steps.append(pending)
+                pending = Step(0, None)
+            else:
+                raise ValueError("%s:%d: unknown directive '%s'" % (path, lineno, line))
+    return steps
+
+
+def check_response(step, lines):
+    """list of mismatch descriptions, empty when the response matches"""
+    if not step.expect:
+        return []
+    errors = []
+    for i, (kind, text) in enumerate(step.expect):
+        if kind == "rest":
+            return errors
+        if i >= len(lines):
+            errors.append("missing line %d, expected '%s'" % (i + 1, getattr(text, "pattern", text)))
+            continue
+        if kind == "eq" and lines[i] != text:
+            errors.append("line %d: got '%s' expected '%s'" % (i + 1, lines[i], text))
+        elif kind == "re" and not text.search(lines[i]):
+            errors.append("line %d: got '%s' expected /%s/" % (i + 1, lines[i], text.pattern))
+    if len(lines) > len(step.expect):
+        errors.append("%d extra lines, first '%s'" % (len(lines) - len(step.expect), lines[len(step.expect)]))
+    return errors
+
+
+class Replay():
+    def __init__(self, link, stream_port=None, record=False):
+        self.link        = link
+        self.stream_port = stream_port
+        self.record      = record
+        self.latency     = {}   # command -> [seconds]
+        self.throughput  = {}   # command -> {bytes_per_s, records_per_s}
+        self.failures    = []
+        for i in range(getattr(link, "skip", 0)):
+            self.response()
+
+    def response(self):
+        """response lines up to and including END:"""
+        lines = []
+        while True:
+            raw = self.link.readline()
+            if len(raw) == 0:
+                raise IOError("timeout waiting for response")
+            line = raw.decode(errors="replace").strip()
+            if len(line) == 0 or line == "BEGIN:":
+                continue
+            lines.append(line)
+            if line.startswith("END:"):
+                return lines
+
+    def command(self, cmd):
+        t0 = monotonic()
+        self.link.write((cmd + "\r\n").encode())
+        lines = self.response()
+        return (monotonic() - t0, lines)
+
+    def stream(self, seconds):
+        import serial
+        tty = serial.Serial(port=self.stream_port, timeout=0.1)
+        tty.flushInput()
+        nbytes  = 0
+        records = 0
+        t0 = monotonic()
+        while monotonic() - t0 < seconds:
+            data = tty.read(4096)
+            nbytes  += len(data)
+            records += data.count(b"\n")
+        elapsed = monotonic() - t0
+        tty.close()
+        return {"bytes_per_s": nbytes / elapsed, "records_per_s": records / elapsed}
+
+    def run(self, steps):
+        for step in steps:
+            if step.sleep:
+                time.sleep(step.sleep)
+            for n in range(step.repeat):
+                dt, lines = self.command(step.command)
+                self.latency.setdefault(step.command, []).append(dt)
+            if self.record:
+                print("> " + step.command)
+                for line in lines:
+                    print("< " + line)
+            errors = check_response(step, lines)
+            for e in errors:
+                self.failures.append("line %d '%s': %s" % (step.lineno, step.command, e))
+                u.error("'%s' %s" % (step.command, e))
+            if step.stream is not None:
+                if self.stream_port is None:
+                    u.warning("no stream port, skipping throughput of '%s'" % step.command)
+                    continue
+                self.throughput[step.command] = self.stream(step.stream)
+
+    def summary(self):
+        latency = {}
+        for cmd, samples in self.latency.items():
+            s = sorted(samples)
+            latency[cmd] = dict(("p%d" % p, percentile(s, p)) for p in Percentiles)
+            latency[cmd]["count"] = len(s)
+            latency[cmd]["max"]   = s[-1]
+        return {"latency": latency, "throughput": self.throughput, "failures": self.failures}
+
+
+def compare(old, new, threshold=Default_Threshold):
+    """regression messages between two result dicts"""
+    found = []
+    for cmd, lat in new["latency"].items():
+        base = old["latency"].get(cmd)
+        if base is None:
+            continue
+        for key in ("p50", "p90", "p99"):
+            if base[key] > 0 and lat[key] > base[key] * (1 + threshold):
+                found.append("%s %s %.3f ms -> %.3f ms" % (cmd, key, base[key] * 1e3, lat[key] * 1e3))
+    for cmd, tp in new["throughput"].items():
+        base = old["throughput"].get(cmd)
+        if base is None:
+            continue
+        for key in ("bytes_per_s", "records_per_s"):
+            if tp[key] < base[key] * (1 - threshold):
+                found.append("%s %s %.0f -> %.0f" % (cmd, key, base[key], tp[key]))
+    return found
+
+
+def firmware_version(replay):
+    dt, lines = replay.command("version")
+    for line in lines:
+        fields = line.split(":", 2)
+        if len(fields) == 3 and fields[1] == "firmware_version":
+            return fields[2]
+    return "unknown"
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description="Replay a command transcript and benchmark it")
+    parser.add_argument("transcript")
+    parser.add_argument("--port", default=Default_Port)
+    parser.add_argument("--stream-port", default=Default_Stream_Port)
+    parser.add_argument("--exec", dest="exec_cmd", help="host program speaking the shell protocol on stdio")
+    parser.add_argument("--build", help="result name, default is the firmware version")
+    parser.add_argument("--results", default=Default_Results)
+    parser.add_argument("--compare", help="earlier result file to check for regressions")
+    parser.add_argument("--threshold", type=float, default=Default_Threshold)
+    parser.add_argument("--record", action="store_true", help="print the transcript with the device responses")
+    args = parser.parse_args()
+
+    steps = load_transcript(args.transcript)
+
+    # read before the run, the new result may overwrite the same file
+    old = None
+    if args.compare:
+        with open(args.compare) as f:
+            old = json.load(f)
+
+    if args.exec_cmd:
+        link        = ExecLink(args.exec_cmd)
+        stream_port = None
+    else:
+        link        = SerialLink(args.port)
+        stream_port = args.stream_port
+
+    replay = Replay(link, stream_port, args.record)
+    try:
+        build = args.build or firmware_version(replay)
+        replay.run(steps)
+    finally:
+        link.close()
+
+    result = replay.summary()
+    result["build"]      = build
+    result["transcript"] = os.path.basename(args.transcript)
+    result["date"]       = time.strftime("%Y-%m-%dT%H:%M:%S")
+
+    if not os.path.isdir(args.results):
+        os.makedirs(args.results)
+    out = os.path.join(args.results, "%s.json" % build)
+    with open(out, "w") as f:
+        json.dump(result, f, indent=2, sort_keys=True)
+
+    out_log = sys.stderr if args.record else sys.stdout
+    for cmd in sorted(result["latency"]):
+        lat = result["latency"][cmd]
+        out_log.write("%-40s n=%-5d p50 %8.3f ms  p90 %8.3f ms  p99 %8.3f ms\n" %
+                      (cmd, lat["count"], lat["p50"] * 1e3, lat["p90"] * 1e3, lat["p99"] * 1e3))
+    for cmd in sorted(result["throughput"]):
+        tp = result["throughput"][cmd]
+        out_log.write("%-40s %10.0f B/s  %8.0f records/s\n" % (cmd, tp["bytes_per_s"], tp["records_per_s"]))
+    out_log.write("results: %s\n" % out)
+
+    status = 0
+    if result["failures"]:
+        u.error("%d golden output mismatches" % len(result["failures"]))
+        status = 1
+    if old is not None:
+        regressions = compare(old, result, args.threshold)
+        for r in regressions:
+            u.warning("regression vs %s: %s" % (old.get("build", args.compare), r))
+        if regressions:
+            status = 1
+    sys.exit(status)
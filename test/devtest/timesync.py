@@ -0,0 +1,199 @@
+#!/usr/bin/env python
+# file: timesync.py
+
+"""
+Map Marionette device timestamps onto host monotonic time.
+
+The device answers 'time.sync' with
+
+    H64:ticks:<device timestamp while the command ran>
+    U32:sof_count:<extended USB frame counter>
+    H64:sof_ticks:<device timestamp of that SOF>
+
+Offset comes from the pings with the smallest round trip (the device
+timestamp lies between the host send and receive times). Drift comes from
+the SOF pairs: SOFs are generated by the host controller at a fixed
+period, so the device ticks per SOF measure the device clock against the
+host clock without the USB round trip jitter. Without SOF data the drift
+falls back to a fit over the ping midpoints.
+
+Stream 'T<dev>:<seq><ticks>' records carry the device timestamp of a
+sample set; StreamClock fills in the sets in between.
+
+Example:
+
+    ./timesync.py /dev/ttyACM0 30
+
+"""
+
+# get division operator '/' vs. '//'
+from __future__ import division
+
+import sys
+import time
+import serial
+
+import utils as u
+
+Default_Port        = "/dev/ttyACM0"
+Default_Timeout     = 2
+Default_Tick_Freq   = 144000000     # time.freq
+Default_SOF_Period  = 125e-6        # high speed microframe
+Ping_Window         = 64            # pings kept for the estimate
+Ping_Best_Fraction  = 0.25          # fraction of fastest pings used for offset
+
+try:
+    monotonic = time.monotonic
+except AttributeError:
+    monotonic = time.time
+
+
+def linear_fit(xs, ys):
+    """least squares y = a + b*x, returns (a, b)"""
+    n  = len(xs)
+    mx = sum(xs) / n
+    my = sum(ys) / n
+    sxx = sum((x - mx) ** 2 for x in xs)
+    sxy = sum((x - mx) * (y - my) for x, y in zip(xs, ys))
+    if sxx == 0:
+        return (my, 0.0)
+    b = sxy / sxx
+    return (my - b * mx, b)
+
+
+class TimeSyncEstimator():
+    """device ticks -> host seconds with drift compensation"""
+
+    def __init__(self, tick_freq=Default_Tick_Freq, sof_period=Default_SOF_Period):
+        self.tick_freq  = tick_freq
+        self.sof_period = sof_period
+        self.pings      = []    # (host_send, host_recv, ticks)
+        self.sofs       = []    # (sof_count, sof_ticks)
+        self.rate       = float(tick_freq)   # device ticks per host second
+        self.offset     = None  # host seconds at tick 0
+        self.ref_ticks  = 0
+
+    def add_ping(self, host_send, host_recv, ticks, sof_count=None, sof_ticks=None):
+        self.pings.append((host_send, host_recv, ticks))
+        self.pings = self.pings[-Ping_Window:]
+        if sof_count is not None and sof_ticks is not None:
+            if not self.sofs or self.sofs[-1][0] != sof_count:
+                self.sofs.append((sof_count, sof_ticks))
+                self.sofs = self.sofs[-Ping_Window:]
+        self.update()
+
+    def update(self):
+        if not self.pings:
+            return
+
+        self.ref_ticks = self.pings[0][2]
+
+        # drift: device ticks per host second
+        if len(self.sofs) >= 2 and self.sofs[-1][0] != self.sofs[0][0]:
+            _, ticks_per_sof = linear_fit([s[0] for s in self.sofs],
+                                          [s[1] - self.sofs[0][1] for s in self.sofs])
+            self.rate = ticks_per_sof / self.sof_period
+        elif len(self.pings) >= 2:
+            mids = [(p[0] + p[1]) / 2 for p in self.pings]
+            _, b = linear_fit([p[2] - self.ref_ticks for p in self.pings], mids)
+            if b > 0:
+                self.rate = 1.0 / b
+
+        # offset: fastest round trips bound the device time best
+        best = sorted(self.pings, key=lambda p: p[1] - p[0])
+        best = best[:max(1, int(len(best) * Ping_Best_Fraction))]
+        offsets = sorted((p[0] + p[1]) / 2 - (p[2] - self.ref_ticks) / self.rate for p in best)
+        self.offset = offsets[len(offsets) // 2]
+
+    def to_host(self, ticks):
+        """host monotonic seconds for a device timestamp"""
+        if self.offset is None:
+            raise ValueError("no time sync data")
+        return self.offset + (ticks - self.ref_ticks) / self.rate
+
+    def drift_ppm(self):
+        return (self.rate / self.tick_freq - 1.0) * 1e6
+
+    def uncertainty(self):
+        """half of the best round trip, seconds"""
+        return min(p[1] - p[0] for p in self.pings) / 2
+
+
+class StreamClock():
+    """device timestamps for stream sample sets from T records"""
+
+    def __init__(self):
+        self.last = {}      # dev -> (seq, ticks)
+        self.period = {}    # dev -> ticks per sample set
+
+    def timestamp_record(self, line):
+        """feed a 'T<dev>:<seq><ticks>' line"""
+        dev   = line[1]
+        seq   = int(line[3:7], 16)
+        ticks = int(line[7:23], 16)
+        if dev in self.last:
+            last_seq, last_ticks = self.last[dev]
+            count = (seq - last_seq) & 0xffff
+            if count:
+                self.period[dev] = (ticks - last_ticks) / count
+        self.last[dev] = (seq, ticks)
+
+    def ticks(self, dev, seq):
+        """device timestamp for a sample set sequence number"""
+        last_seq, last_ticks = self.last[dev]
+        delta = (seq - last_seq) & 0xffff
+        if delta >= 0x8000:
+            delta -= 0x10000
+        return last_ticks + delta * self.period.get(dev, 0)
+
+
+class TimeSyncSerial():
+    def __init__(self, port=Default_Port, timeout=Default_Timeout):
+        self.tty = serial.Serial(port=port, timeout=timeout)
+        self.tty.write(b"\r\n+noecho\r\n+noprompt\r\n\r\n")
+        time.sleep(0.2)
+        self.tty.flushInput()
+
+    def command(self, cmd):
+        self.tty.write((cmd + "\r\n").encode())
+        values = {}
+        while True:
+            line = self.tty.readline().decode(errors="replace").strip()
+            if len(line) == 0:
+                raise IOError("timeout waiting for '%s'" % cmd)
+            if line.startswith("END:"):
+                if line != "END:OK":
+                    raise IOError("'%s' failed" % cmd)
+                return values
+            fields = line.split(":", 2)
+            if len(fields) == 3:
+                values[fields[1]] = (fields[0], fields[2])
+
+    def ping(self):
+        host_send = monotonic()
+        values    = self.command("time.sync")
+        host_recv = monotonic()
+        ticks     = int(values["ticks"][1], 16)
+        sof_count = int(values["sof_count"][1])
+        sof_ticks = int(values["sof_ticks"][1], 16)
+        return (host_send, host_recv, ticks, sof_count, sof_ticks)
+
+    def close(self):
+        self.tty.close()
+
+
+if __name__ == '__main__':
+    port  = sys.argv[1] if len(sys.argv) > 1 else Default_Port
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+
+    dut = TimeSyncSerial(port)
+    try:
+        freq = int(dut.command("time.freq")["freq"][1])
+        est  = TimeSyncEstimator(tick_freq=freq)
+        for i in range(count):
+            est.add_ping(*dut.ping())
+            u.info("offset %.6f s  drift %+.3f ppm  +/- %.1f us" %
+                   (est.offset, est.drift_ppm(), est.uncertainty() * 1e6))
+            time.sleep(0.5)
+    finally:
+        dut.close()
@@ -0,0 +1,179 @@
+/*
+ * Host test of util_ring.h, make check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "util_ring.h"
+
+#define STRESS_COUNT 7
+#define STRESS_SETS  1000000
+
+typedef struct {
+  uint32_t sequence;
+  uint32_t check;
+} element_t;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if( !(cond) ) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+static void test_empty_full(void)
+{
+  element_t buffer[4];
+  util_ring_t r;
+  element_t * e;
+
+  util_ring_init(&r, buffer, sizeof(element_t), 4);
+  CHECK(util_ring_used(&r) == 0);
+  CHECK(util_ring_read_slot(&r) == NULL);
+
+  // all count elements are usable
+  for( uint32_t i = 0; i < 4; i++ )
+  {
+    e = util_ring_write_slot(&r);
+    CHECK(e == &buffer[i]);
+    e->sequence = i;
+    util_ring_commit(&r);
+    CHECK(util_ring_used(&r) == i + 1);
+  }
+  CHECK(util_ring_write_slot(&r) == NULL);
+  // full, head and tail point at the same element but differ by count
+  CHECK(r.head == 4 && r.tail == 0);
+
+  e = util_ring_read_slot(&r);
+  CHECK(e == &buffer[0] && e->sequence == 0);
+  util_ring_release(&r);
+  CHECK(util_ring_used(&r) == 3);
+  CHECK(util_ring_write_slot(&r) == &buffer[0]);
+}
+
+static void test_wraparound(void)
+{
+  element_t buffer[3];
+  util_ring_t r;
+  uint32_t next_write = 0;
+  uint32_t next_read = 0;
+
+  util_ring_init(&r, buffer, sizeof(element_t), 3);
+
+  // several laps over the 2 * count index range with every fill level
+  for( uint32_t round = 0; round < 50; round++ )
+  {
+    uint32_t fill = round % 4;
+
+    for( uint32_t i = 0; i < fill; i++ )
+    {
+      element_t * e = util_ring_write_slot(&r);
+
+      CHECK(e != NULL);
+      if( e == NULL )
+      {
+        return;
+      }
+      e->sequence = next_write++;
+      util_ring_commit(&r);
+    }
+    CHECK(util_ring_used(&r) == fill);
+    CHECK((util_ring_write_slot(&r) == NULL) == (fill == 3));
+    CHECK(r.head < 6 && r.tail < 6);
+
+    for( uint32_t i = 0; i < fill; i++ )
+    {
+      element_t * e = util_ring_read_slot(&r);
+
+      CHECK(e != NULL && e->sequence == next_read);
+      next_read++;
+      util_ring_release(&r);
+    }
+    CHECK(util_ring_used(&r) == 0);
+    CHECK(util_ring_read_slot(&r) == NULL);
+  }
+}
+
+static void test_no_storage(void)
+{
+  util_ring_t r;
+
+  util_ring_init(&r, NULL, sizeof(element_t), 0);
+  CHECK(util_ring_write_slot(&r) == NULL);
+  CHECK(util_ring_read_slot(&r) == NULL);
+  CHECK(util_ring_used(&r) == 0);
+}
+
+static element_t stress_buffer[STRESS_COUNT];
+static util_ring_t stress_ring;
+
+static void * stress_producer(void * arg)
+{
+  uint32_t sequence = 0;
+
+  (void)arg;
+
+  while( sequence < STRESS_SETS )
+  {
+    element_t * e = util_ring_write_slot(&stress_ring);
+
+    if( e == NULL )
+    {
+      sched_yield();
+      continue;
+    }
+    e->sequence = sequence;
+    e->check = ~sequence;
+    util_ring_commit(&stress_ring);
+    sequence++;
+  }
+
+  return NULL;
+}
+
+static void test_spsc_order(void)
+{
+  pthread_t producer;
+  uint32_t sequence = 0;
+  uint32_t errors = 0;
+
+  util_ring_init(&stress_ring, stress_buffer, sizeof(element_t), STRESS_COUNT);
+  pthread_create(&producer, NULL, stress_producer, NULL);
+
+  while( sequence < STRESS_SETS )
+  {
+    element_t * e = util_ring_read_slot(&stress_ring);
+
+    if( e == NULL )
+    {
+      sched_yield();
+      continue;
+    }
+    // a torn or reordered element shows as a gap or a bad check word
+    if( e->sequence != sequence || e->check != ~sequence )
+    {
+      errors++;
+    }
+    util_ring_release(&stress_ring);
+    sequence++;
+  }
+
+  pthread_join(producer, NULL);
+  CHECK(errors == 0);
+  CHECK(util_ring_used(&stress_ring) == 0);
+}
+
+int main(void)
+{
+  test_empty_full();
+  test_wraparound();
+  test_no_storage();
+  test_spsc_order();
+
+  printf("%s\n", failures ? "FAIL" : "PASS");
+
+  return failures ? 1 : 0;
+}
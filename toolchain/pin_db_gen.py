@@ -0,0 +1,269 @@
+#!/usr/bin/env python
+# file: pin_db_gen.py
+
+"""
+Generate the board pin tables used by the fetch parser and the pin
+validators from the board pin description.
+
+    ./pin_db_gen.py ../src/boards/marionette_pins.txt ../src/util
+
+writes util_pin_db.c and include/util_pin_db.h below the output directory.
+The pin index is the DIO number, so 'DIO<n>' needs no table at all; every
+other lookup (port/pin -> index, named pin -> index, index -> port, pin,
+alternate mode, capabilities) is a single const array access.
+"""
+
+import os
+import re
+import sys
+
+PORTS = "ABCDEFGHI"
+
+# named pin classes: (class, signal names or None for numbered signals)
+CLASSES = [
+    ("TIMER", None),
+    ("SPI",   ["SCK", "MOSI", "MISO", "NSS"]),
+    ("I2C",   ["SDA", "SCL"]),
+    ("UART",  ["TX", "RX", "CTS", "RTS"]),
+]
+
+CAPS = ["GPIO"] + [c[0] for c in CLASSES]
+
+NONE = 0xff
+
+
+def die(msg):
+    sys.stderr.write("pin_db_gen: %s\n" % msg)
+    sys.exit(1)
+
+
+def parse(path):
+    pins = {}       # index -> dict
+    named = dict((c[0], {}) for c in CLASSES)   # class -> {(unit, signal): index}
+    seen = {}
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split("#", 1)[0].split()
+            if not line:
+                continue
+            where = "%s:%d" % (path, lineno)
+            if len(line) < 3:
+                die("%s: expected <pin> <af> <names>" % where)
+
+            m = re.match(r"^P([A-I])(\d+)$", line[0].upper())
+            if not m or int(m.group(2)) > 15:
+                die("%s: bad pin '%s'" % (where, line[0]))
+            port = PORTS.index(m.group(1))
+            pin = int(m.group(2))
+            if (port, pin) in seen:
+                die("%s: %s listed twice" % (where, line[0]))
+
+            af = None
+            opendrain = False
+            if line[1] != "-":
+                m = re.match(r"^(\d+)(/od)?$", line[1].lower())
+                if not m or int(m.group(1)) > 15:
+                    die("%s: bad alternate function '%s'" % (where, line[1]))
+                af = int(m.group(1))
+                opendrain = m.group(2) is not None
+
+            index = None
+            caps = set()
+            entries = []    # (class, unit, signal)
+            for name in line[2:]:
+                name = name.upper()
+                m = re.match(r"^DIO(\d+)$", name)
+                if m:
+                    index = int(m.group(1))
+                    caps.add("GPIO")
+                    continue
+                m = re.match(r"^([A-Z0-9]+?)(\d+)\.(\w+)$", name)
+                if not m or m.group(1) not in named:
+                    die("%s: unknown pin name '%s'" % (where, name))
+                cls, unit, signal = m.group(1), int(m.group(2)), m.group(3)
+                signals = dict(CLASSES)[cls]
+                if signals is None:
+                    if not signal.isdigit():
+                        die("%s: '%s' needs a numbered channel" % (where, name))
+                    signal = int(signal)
+                elif signal not in signals:
+                    die("%s: '%s' signal not one of %s" % (where, name, ", ".join(signals)))
+                else:
+                    signal = signals.index(signal)
+                if (unit, signal) in named[cls]:
+                    die("%s: %s defined twice" % (where, name))
+                if af is None:
+                    die("%s: %s needs an alternate function" % (where, name))
+                entries.append((cls, unit, signal))
+                caps.add(cls)
+            if index is None:
+                die("%s: every pin needs a DIO<n> index" % where)
+            if index in pins:
+                die("%s: DIO%d listed twice" % (where, index))
+            for cls, unit, signal in entries:
+                named[cls][(unit, signal)] = index
+
+            seen[(port, pin)] = index
+            pins[index] = {"port": port, "pin": pin, "af": af, "od": opendrain, "caps": caps}
+
+    count = len(pins)
+    if sorted(pins) != list(range(count)):
+        die("DIO numbers must run 0..%d without gaps" % (count - 1))
+    if count >= NONE:
+        die("too many pins")
+    return pins, named
+
+
+def define(name, value):
+    return "#define %-32s%s" % (name, value)
+
+
+def c_array(values, per_line=8, fmt="0x%02x"):
+    out = []
+    for i in range(0, len(values), per_line):
+        out.append("  " + ", ".join(fmt % v for v in values[i:i + per_line]) + ",")
+    return "\n".join(out)
+
+
+def generate(src, outdir):
+    pins, named = parse(src)
+    count = len(pins)
+    rel_src = "src/boards/" + os.path.basename(src)
+
+    h = []
+    h.append("/*! \\file util_pin_db.h")
+    h.append(" *")
+    h.append(" * Board pin tables, generated by toolchain/pin_db_gen.py from")
+    h.append(" * %s. Do not edit, run 'make pin_db' instead." % rel_src)
+    h.append(" *")
+    h.append(" * @addtogroup util_pin_db")
+    h.append(" * @{")
+    h.append(" */")
+    h.append("")
+    h.append("#ifndef UTIL_PIN_DB_H_")
+    h.append("#define UTIL_PIN_DB_H_")
+    h.append("")
+    h.append("#include <stdint.h>")
+    h.append("")
+    h.append("#ifdef __cplusplus")
+    h.append('extern "C" {')
+    h.append("#endif")
+    h.append("")
+    h.append(define("UTIL_PIN_DB_COUNT", count))
+    h.append(define("UTIL_PIN_DB_PORTS", len(PORTS)))
+    h.append(define("UTIL_PIN_DB_NONE", "0x%02x" % NONE))
+    h.append("")
+    for i, cap in enumerate(CAPS):
+        h.append(define("UTIL_PIN_CAP_" + cap, "(1 << %d)" % i))
+    h.append("")
+    h.append(define("UTIL_PIN_CLASS_DIO", 0))
+    for i, (cls, signals) in enumerate(CLASSES, 1):
+        h.append(define("UTIL_PIN_CLASS_" + cls, i))
+    h.append("")
+    dims = {}
+    for cls, signals in CLASSES:
+        units = max([k[0] for k in named[cls]] + [-1]) + 1
+        nsig = len(signals) if signals else max([k[1] for k in named[cls]] + [-1]) + 1
+        dims[cls] = (max(units, 1), max(nsig, 1))
+        h.append(define("UTIL_PIN_DB_%s_UNITS" % cls, dims[cls][0]))
+        h.append(define("UTIL_PIN_DB_%s_SIGNALS" % cls, dims[cls][1]))
+        if signals:
+            for i, s in enumerate(signals):
+                h.append(define("UTIL_PIN_%s_%s" % (cls, s), i))
+        h.append("")
+    h.append("typedef struct {")
+    h.append("  uint8_t   port;       //!< 0 = GPIOA .. %d = GPIO%s" % (len(PORTS) - 1, PORTS[-1]))
+    h.append("  uint8_t   pin;")
+    h.append("  uint8_t   caps;       //!< UTIL_PIN_CAP_*")
+    h.append("  uint8_t   reserved;")
+    h.append("  uint32_t  alt_mode;   //!< PAL mode for the alternate function, 0 = none")
+    h.append("} util_pin_t;")
+    h.append("")
+    h.append("extern const util_pin_t util_pin_db[UTIL_PIN_DB_COUNT];")
+    h.append("extern const uint8_t util_pin_db_index[UTIL_PIN_DB_PORTS][16];")
+    h.append("extern const uint16_t util_pin_db_gpio_mask[UTIL_PIN_DB_PORTS];")
+    for cls, signals in CLASSES:
+        h.append("extern const uint8_t util_pin_db_%s[UTIL_PIN_DB_%s_UNITS][UTIL_PIN_DB_%s_SIGNALS];" %
+                 (cls.lower(), cls, cls))
+    h.append("")
+    h.append("#ifdef __cplusplus")
+    h.append("}")
+    h.append("#endif")
+    h.append("")
+    h.append("#endif")
+    h.append("")
+    h.append("/*! @} */")
+
+    c = []
+    c.append("/*! \\file util_pin_db.c")
+    c.append(" *")
+    c.append(" * Board pin tables, generated by toolchain/pin_db_gen.py from")
+    c.append(" * %s. Do not edit, run 'make pin_db' instead." % rel_src)
+    c.append(" *")
+    c.append(" * @addtogroup util_pin_db")
+    c.append(" * @{")
+    c.append(" */")
+    c.append("")
+    c.append('#include "hal.h"')
+    c.append("")
+    c.append('#include "util_pin_db.h"')
+    c.append("")
+    c.append("// indexed by pin index, which is the DIO number")
+    c.append("const util_pin_t util_pin_db[UTIL_PIN_DB_COUNT] = {")
+    for i in range(count):
+        p = pins[i]
+        caps = " | ".join("UTIL_PIN_CAP_%s" % cap for cap in CAPS if cap in p["caps"]) or "0"
+        if p["af"] is None:
+            mode = "0"
+        else:
+            mode = "PAL_MODE_ALTERNATE(%d)" % p["af"]
+            if p["od"]:
+                mode += " | PAL_STM32_OTYPE_OPENDRAIN"
+        c.append("  {%d, %2d, %s, 0, %s}, // DIO%d P%s%d" %
+                 (p["port"], p["pin"], caps, mode, i, PORTS[p["port"]], p["pin"]))
+    c.append("};")
+    c.append("")
+    c.append("// port, pin -> pin index")
+    c.append("const uint8_t util_pin_db_index[UTIL_PIN_DB_PORTS][16] = {")
+    for port in range(len(PORTS)):
+        row = [NONE] * 16
+        for i in range(count):
+            if pins[i]["port"] == port:
+                row[pins[i]["pin"]] = i
+        c.append("  {" + ", ".join("0x%02x" % v for v in row) + "}, // GPIO%s" % PORTS[port])
+    c.append("};")
+    c.append("")
+    c.append("// pins the gpio module may touch")
+    c.append("const uint16_t util_pin_db_gpio_mask[UTIL_PIN_DB_PORTS] = {")
+    masks = []
+    for port in range(len(PORTS)):
+        mask = 0
+        for i in range(count):
+            if pins[i]["port"] == port and "GPIO" in pins[i]["caps"]:
+                mask |= 1 << pins[i]["pin"]
+        masks.append(mask)
+    c.append(c_array(masks, 9, "0x%04x"))
+    c.append("};")
+    for cls, signals in CLASSES:
+        units, nsig = dims[cls]
+        c.append("")
+        c.append("const uint8_t util_pin_db_%s[UTIL_PIN_DB_%s_UNITS][UTIL_PIN_DB_%s_SIGNALS] = {" %
+                 (cls.lower(), cls, cls))
+        for unit in range(units):
+            row = [named[cls].get((unit, s), NONE) for s in range(nsig)]
+            c.append("  {" + ", ".join("0x%02x" % v for v in row) + "},")
+        c.append("};")
+    c.append("")
+    c.append("/*! @} */")
+
+    with open(os.path.join(outdir, "include", "util_pin_db.h"), "w") as f:
+        f.write("\n".join(h) + "\n")
+    with open(os.path.join(outdir, "util_pin_db.c"), "w") as f:
+        f.write("\n".join(c) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        print("Usage: %s <pin description> <util directory>" % sys.argv[0])
+        sys.exit(1)
+    generate(sys.argv[1], sys.argv[2])